@@ -34,7 +34,6 @@ EXPORT_MODULE_FACTORY(DBRegAgent);
 DEFINE_MODULE_INSTANCE(DBRegAgent, MOD_NAME);
 
 mysqlpp::Connection DBRegAgent::MainDBConnection(mysqlpp::use_exceptions);
-mysqlpp::Connection DBRegAgent::ProcessorDBConnection(mysqlpp::use_exceptions);
 
 string DBRegAgent::joined_query;
 string DBRegAgent::registrations_table = "registrations";
@@ -188,16 +187,6 @@ int DBRegAgent::onLoad()
       return -1;
     }
 
-    ProcessorDBConnection.set_option(new mysqlpp::ReconnectOption(true));
-    // matched instead of changed rows in result, so we know when to create DB entry
-    ProcessorDBConnection.set_option(new mysqlpp::FoundRowsOption(true));
-    ProcessorDBConnection.connect(mysql_db.c_str(), mysql_server.c_str(),
-                      mysql_user.c_str(), mysql_passwd.c_str());
-    if (!ProcessorDBConnection) {
-      ERROR("Database connection failed: %s\n", ProcessorDBConnection.error());
-      return -1;
-    }
-
   } catch (const mysqlpp::Exception& er) {
     // Catch-all for any MySQL++ exceptions
     ERROR("MySQL++ error: %s\n", er.what());
@@ -224,6 +213,23 @@ int DBRegAgent::onLoad()
   }
   DBG("using registrations table '%s'\n", registrations_table.c_str());
 
+  DBRegStatusWriter::registrations_table = registrations_table;
+  DBRegStatusWriter::batch_size =
+    cfg.getParameterInt("db_write_batch_size", DB_WRITE_BATCH_SIZE);
+  DBRegStatusWriter::interval =
+    cfg.getParameterInt("db_write_interval", DB_WRITE_INTERVAL);
+  if (!DBRegStatusWriter::batch_size || !DBRegStatusWriter::interval) {
+    ERROR("db_write_batch_size and db_write_interval must be > 0\n");
+    return -1;
+  }
+
+  if (!status_writer.start(cfg.getParameterInt("db_write_connections",
+					       DB_WRITE_CONNECTIONS),
+			   mysql_db, mysql_server, mysql_user, mysql_passwd)) {
+    ERROR("starting the DB status writer\n");
+    return -1;
+  }
+
   if (!loadRegistrations()) {
     ERROR("loading registrations from DB\n");
     return -1;
@@ -255,10 +261,11 @@ void DBRegAgent::onUnload() {
     }
   }
 
+  DBG("writing pending registration status to DB\n");
+  status_writer.stop();
+
   DBG("closing main DB connection\n");
   MainDBConnection.disconnect();
-  DBG("closing auxiliary DB connection\n");
-  ProcessorDBConnection.disconnect();
 }
 
 bool DBRegAgent::loadRegistrations() {
@@ -294,7 +301,7 @@ bool DBRegAgent::loadRegistrations() {
       else {
 	DBG("registration status entry for id %ld does not exist, creating...\n",
 	    subscriber_id);
-	createDBRegistration(subscriber_id, ProcessorDBConnection);
+	createDBRegistration(subscriber_id);
       }
 
       DBG("got subscriber '%s@%s' status %i\n",
@@ -583,7 +590,6 @@ void DBRegAgent::process(AmEvent* ev) {
   ERROR("unknown event received!\n");
 }
 
-// uses ProcessorDBConnection
 void DBRegAgent::onRegistrationActionEvent(RegistrationActionEvent* reg_action_ev) {
   switch (reg_action_ev->action) {
   case RegistrationActionEvent::Register:
@@ -597,8 +603,7 @@ void DBRegAgent::onRegistrationActionEvent(RegistrationActionEvent* reg_action_e
 	    reg_action_ev->subscriber_id);
       } else {
 	if (!it->second->doRegistration()) {
-	  updateDBRegistration(ProcessorDBConnection,
-			       reg_action_ev->subscriber_id,
+	  updateDBRegistration(reg_action_ev->subscriber_id,
 			       480, ERR_REASON_UNABLE_TO_SEND_REQUEST,
 			       true, REG_STATUS_FAILED);
 	  if (error_retry_interval) {
@@ -624,13 +629,12 @@ void DBRegAgent::onRegistrationActionEvent(RegistrationActionEvent* reg_action_e
 	  if (delete_removed_registrations && delete_failed_deregistrations) {
 	    DBG("sending de-Register failed - deleting registration %ld "
 		"(delete_failed_deregistrations=yes)\n", reg_action_ev->subscriber_id);
-	    deleteDBRegistration(reg_action_ev->subscriber_id, ProcessorDBConnection);
+	    deleteDBRegistration(reg_action_ev->subscriber_id);
 	  } else {
 	    DBG("failed sending de-register, updating DB with REG_STATUS_TO_BE_REMOVED "
 		ERR_REASON_UNABLE_TO_SEND_REQUEST "for subscriber %ld\n",
 		reg_action_ev->subscriber_id);
-	    updateDBRegistration(ProcessorDBConnection,
-				 reg_action_ev->subscriber_id,
+	    updateDBRegistration(reg_action_ev->subscriber_id,
 				 480, ERR_REASON_UNABLE_TO_SEND_REQUEST,
 				 true, REG_STATUS_TO_BE_REMOVED);
 	    // don't re-try de-registrations if sending failed
@@ -647,107 +651,24 @@ void DBRegAgent::onRegistrationActionEvent(RegistrationActionEvent* reg_action_e
   }
 }
 
-void DBRegAgent::createDBRegistration(long subscriber_id, mysqlpp::Connection& conn) {
-  string insert_query = "insert into "+registrations_table+
-    " (subscriber_id) values ("+
-    long2str(subscriber_id)+");";
-
-  try {
-    mysqlpp::Query query = conn.query();
-    query << insert_query;
-
-    mysqlpp::SimpleResult res = query.execute();
-    if (!res) {
-      WARN("creating registration in DB with query '%s' failed: '%s'\n",
-	   insert_query.c_str(), res.info());
-    }
-  }  catch (const mysqlpp::Exception& er) {
-    // Catch-all for any MySQL++ exceptions
-    ERROR("MySQL++ error: %s\n", er.what());
-    return;
-  }
+void DBRegAgent::createDBRegistration(long subscriber_id) {
+  status_writer.createRegistration(subscriber_id);
 }
 
-void DBRegAgent::deleteDBRegistration(long subscriber_id, mysqlpp::Connection& conn) {
-  string insert_query = "delete from "+registrations_table+
-    " where subscriber_id=" +  long2str(subscriber_id)+";";
-
-  try {
-    mysqlpp::Query query = conn.query();
-    query << insert_query;
-
-    mysqlpp::SimpleResult res = query.execute();
-    if (!res) {
-      WARN("removing registration in DB with query '%s' failed: '%s'\n",
-	   insert_query.c_str(), res.info());
-    }
-  }  catch (const mysqlpp::Exception& er) {
-    // Catch-all for any MySQL++ exceptions
-    ERROR("MySQL++ error: %s\n", er.what());
-    return;
-  }
+void DBRegAgent::deleteDBRegistration(long subscriber_id) {
+  status_writer.deleteRegistration(subscriber_id);
 }
 
-void DBRegAgent::updateDBRegistration(mysqlpp::Connection& db_connection,
-				      long subscriber_id, int last_code,
+void DBRegAgent::updateDBRegistration(long subscriber_id, int last_code,
 				      const string& last_reason,
 				      bool update_status, int status,
 				      bool update_ts, unsigned int expiry,
 				      bool update_contacts, const string& contacts) {
-  try {
-
-    mysqlpp::Query query = db_connection.query();
-
-    query << "update "+registrations_table+" set last_code="+ int2str(last_code) +", ";
-    query << "last_reason=";
-    query << mysqlpp::quote << last_reason;
-
-    if (update_status) {
-      query <<  ", registration_status="+int2str(status);
-    }
-
-    if (update_ts) {
-      query << ", last_registration=NOW(), "
-	"expiry=TIMESTAMPADD(SECOND,"+int2str(expiry)+", NOW())";
-    }
-
-    if (update_contacts) {
-      query << ", contacts=" << mysqlpp::quote << contacts;
-    }
-
-    query << " where " COLNAME_SUBSCRIBER_ID "="+long2str(subscriber_id) + ";";
-    string query_str = query.str();
-    DBG("updating registration in DB with query '%s'\n", query_str.c_str());
-
-    mysqlpp::SimpleResult res = query.execute();
-    if (!res) {
-      WARN("updating registration in DB with query '%s' failed: '%s'\n",
-	   query_str.c_str(), res.info());
-    } else {
-      if (!res.rows()) {
-	// should not happen - DB entry is created on load or on createRegistration
-	DBG("creating registration DB entry for subscriber %ld\n", subscriber_id);
-	createDBRegistration(subscriber_id, db_connection);
-	query.reset();
-	query << query_str;
-
-	mysqlpp::SimpleResult res = query.execute();
-	if (!res || !res.rows()) {
-	  WARN("updating registration in DB with query '%s' failed: '%s'\n",
-	       query_str.c_str(), res.info());
-	}
-      }
-    }
-
-  }  catch (const mysqlpp::Exception& er) {
-    // Catch-all for any MySQL++ exceptions
-    ERROR("MySQL++ error: %s\n", er.what());
-    return;
-  }
-
+  status_writer.updateRegistration(subscriber_id, last_code, last_reason,
+				   update_status, status, update_ts, expiry,
+				   update_contacts, contacts);
 }
 
-// uses MainDBConnection
 void DBRegAgent::onSipReplyEvent(AmSipReplyEvent* ev) {
   if (!ev) return;
 
@@ -862,14 +783,13 @@ void DBRegAgent::onSipReplyEvent(AmSipReplyEvent* ev) {
 	      ev->reply.code, ev->reply.reason.c_str());
 	} else {
 	  DBG("update DB with reply %u %s\n", ev->reply.code, ev->reply.reason.c_str());
-	  updateDBRegistration(MainDBConnection,
-			       subscriber_id, ev->reply.code, ev->reply.reason,
+	  updateDBRegistration(subscriber_id, ev->reply.code, ev->reply.reason,
 			       update_status, status, update_ts, expiry,
 			       save_contacts, ev->reply.contact);
 	}
       } else {
 	DBG("delete DB registration of subscriber %ld\n", subscriber_id);
-	deleteDBRegistration(subscriber_id, MainDBConnection);
+	deleteDBRegistration(subscriber_id);
       }
 
     } else {
@@ -1135,6 +1055,14 @@ void DBRegAgent::DIrefreshRegistration(int subscriber_id, AmArg& ret) {
   ret.push("OK");
 }
 
+void DBRegAgent::DIgetStats(AmArg& ret) {
+  AmArg stats;
+  status_writer.getStats(stats);
+  ret.push(200);
+  ret.push("OK");
+  ret.push(stats);
+}
+
 // ///////// DI API ///////////////////
 
 void DBRegAgent::invoke(const string& method,
@@ -1166,11 +1094,14 @@ void DBRegAgent::invoke(const string& method,
   } else if (method == "refreshRegistration"){
     args.assertArrayFmt("i"); // subscriber_id
     DIrefreshRegistration(args.get(0).asInt(), ret);
+  } else if (method == "getStats"){
+    DIgetStats(ret);
   }  else if(method == "_list"){
     ret.push(AmArg("createRegistration"));
     ret.push(AmArg("updateRegistration"));
     ret.push(AmArg("removeRegistration"));
     ret.push(AmArg("refreshRegistration"));
+    ret.push(AmArg("getStats"));
   }  else
     throw AmDynInvoke::NotImplemented(method);
 }
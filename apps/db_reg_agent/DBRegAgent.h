@@ -39,6 +39,7 @@ using std::queue;
 #include "AmSipRegistration.h"
 
 #include "RegistrationTimer.h"
+#include "DBRegStatusWriter.h"
 
 #define REG_STATUS_INACTIVE      0
 #define REG_STATUS_PENDING       1
@@ -149,11 +150,11 @@ class DBRegAgent
   map<long, RegTimer*>          registration_timers;
   AmMutex registrations_mut;
 
-  // connection used in main DBRegAgent thread
+  // connection used for loading the registrations
   static mysqlpp::Connection MainDBConnection;
 
-  // connection used in other thread (processor thread)
-  static mysqlpp::Connection ProcessorDBConnection;
+  // registration status changes are written behind by the status writer
+  DBRegStatusWriter status_writer;
 
   int onLoad();
 
@@ -169,10 +170,9 @@ class DBRegAgent
 
   bool loadRegistrations();
 
-  void createDBRegistration(long subscriber_id, mysqlpp::Connection& conn);
-  void deleteDBRegistration(long subscriber_id, mysqlpp::Connection& conn);
-  void updateDBRegistration(mysqlpp::Connection& db_connection,
-			    long subscriber_id, int last_code,
+  void createDBRegistration(long subscriber_id);
+  void deleteDBRegistration(long subscriber_id);
+  void updateDBRegistration(long subscriber_id, int last_code,
 			    const string& last_reason,
 			    bool update_status = false, int status = 0,
 			    bool update_ts=false, unsigned int expiry = 0,
@@ -251,6 +251,7 @@ class DBRegAgent
 			    const string& contact, AmArg& ret);
   void DIremoveRegistration(int subscriber_id, AmArg& ret);
   void DIrefreshRegistration(int subscriber_id, AmArg& ret);
+  void DIgetStats(AmArg& ret);
 
 
  public:
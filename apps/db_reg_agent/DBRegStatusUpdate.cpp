@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2026 SEMS contributors
+ *
+ * This file is part of SEMS, a free SIP media server.
+ *
+ * SEMS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * For a license to use the sems software under conditions
+ * other than those described here, or to purchase support for this
+ * software, please contact iptel.org by e-mail at the following addresses:
+ *    info@iptel.org
+ *
+ * SEMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "DBRegStatusUpdate.h"
+
+void DBRegStatusUpdate::merge(const DBRegStatusUpdate& u) {
+  if (u.op == Delete || u.recreate) {
+    // nothing written before is left
+    *this = u;
+    return;
+  }
+
+  switch (u.op) {
+  case Delete: break;
+
+  case Create:
+    // a pending update creates the entry as well
+    if (op == Delete) {
+      *this = u;
+      recreate = true;
+    }
+    break;
+
+  case Update:
+    if (op != Update) {
+      // updates create the entry if necessary; a deleted entry
+      // must not keep the columns this update does not set
+      bool del = (op == Delete) || recreate;
+      *this = u;
+      recreate = del;
+      break;
+    }
+    last_code = u.last_code;
+    last_reason = u.last_reason;
+    if (u.update_status) {
+      update_status = true;
+      status = u.status;
+    }
+    if (u.update_ts) {
+      update_ts = true;
+      expiry = u.expiry;
+      ts = u.ts;
+    }
+    if (u.update_contacts) {
+      update_contacts = true;
+      contacts = u.contacts;
+    }
+    break;
+  }
+}
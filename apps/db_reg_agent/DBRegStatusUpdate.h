@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2026 SEMS contributors
+ *
+ * This file is part of SEMS, a free SIP media server.
+ *
+ * SEMS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * For a license to use the sems software under conditions
+ * other than those described here, or to purchase support for this
+ * software, please contact iptel.org by e-mail at the following addresses:
+ *    info@iptel.org
+ *
+ * SEMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _DBRegStatusUpdate_h_
+#define _DBRegStatusUpdate_h_
+
+#include <time.h>
+
+#include <string>
+using std::string;
+
+/** pending change of the DB status of one registration */
+struct DBRegStatusUpdate
+{
+  enum Op { Create=0, Update, Delete };
+  Op op;
+
+  /** delete the entry before the create/update
+      (a delete followed by a create or update) */
+  bool recreate;
+
+  int last_code;
+  string last_reason;
+
+  bool update_status;
+  int status;
+
+  bool update_ts;
+  unsigned int expiry;
+  time_t ts; // of the registration (the change, not the write)
+
+  bool update_contacts;
+  string contacts;
+
+  DBRegStatusUpdate()
+    : op(Create), recreate(false), last_code(0), update_status(false), status(0),
+      update_ts(false), expiry(0), ts(0), update_contacts(false) { }
+
+  /** merge a later change into this one */
+  void merge(const DBRegStatusUpdate& u);
+};
+
+#endif
@@ -0,0 +1,431 @@
+/*
+ * Copyright (C) 2026 SEMS contributors
+ *
+ * This file is part of SEMS, a free SIP media server.
+ *
+ * SEMS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * For a license to use the sems software under conditions
+ * other than those described here, or to purchase support for this
+ * software, please contact iptel.org by e-mail at the following addresses:
+ *    info@iptel.org
+ *
+ * SEMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program; if not, write to the Free Software 
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "DBRegStatusWriter.h"
+#include "DBRegAgent.h"
+
+#include "log.h"
+#include "AmArg.h"
+#include "AmUtils.h"
+
+string DBRegStatusWriter::registrations_table = "registrations";
+unsigned int DBRegStatusWriter::batch_size = DB_WRITE_BATCH_SIZE;
+unsigned int DBRegStatusWriter::interval = DB_WRITE_INTERVAL;
+
+DBRegStatusWriter::DBRegStatusWriter()
+  : seq(0), work(false), stopping(false),
+    queued(0), coalesced(0), flushes(0), written(0), errors(0), requeued(0),
+    max_depth(0), last_flush_ms(0), max_flush_ms(0), total_flush_ms(0)
+{
+}
+
+DBRegStatusWriter::~DBRegStatusWriter() {
+  for (std::vector<DBRegStatusWriterThread*>::iterator it = threads.begin();
+       it != threads.end(); it++)
+    delete *it;
+}
+
+bool DBRegStatusWriter::start(unsigned int n, const string& db, const string& server,
+			      const string& user, const string& passwd) {
+  if (!n)
+    n = 1;
+
+  for (unsigned int i=0;i<n;i++) {
+    DBRegStatusWriterThread* t = new DBRegStatusWriterThread(this);
+    threads.push_back(t);
+    if (!t->connect(db, server, user, passwd))
+      return false;
+  }
+
+  DBG("starting %u DB status writer threads (batch size %u, interval %ums)\n",
+      n, batch_size, interval);
+  for (std::vector<DBRegStatusWriterThread*>::iterator it = threads.begin();
+       it != threads.end(); it++)
+    (*it)->start();
+
+  return true;
+}
+
+void DBRegStatusWriter::stop() {
+  pending_mut.lock();
+  stopping = true;
+  DBG("stopping DB status writer, %zd changes pending\n", pending.size());
+  pending_mut.unlock();
+  work.set(true);
+
+  for (std::vector<DBRegStatusWriterThread*>::iterator it = threads.begin();
+       it != threads.end(); it++) {
+    (*it)->join();
+    (*it)->disconnect();
+  }
+}
+
+void DBRegStatusWriter::enqueue(long subscriber_id, const DBRegStatusUpdate& u,
+				const struct timeval& now) {
+  PendingUpdate& p = pending[subscriber_id];
+  p.u = u;
+  p.since = now;
+  p.seq = ++seq;
+  order.push_back(std::make_pair(subscriber_id, p.seq));
+
+  if (pending.size() > max_depth)
+    max_depth = pending.size();
+}
+
+void DBRegStatusWriter::dropOutdated() {
+  while (!order.empty()) {
+    Pending::iterator it = pending.find(order.front().first);
+    if (it != pending.end() && it->second.seq == order.front().second)
+      break;
+    order.pop_front();
+  }
+}
+
+void DBRegStatusWriter::push(long subscriber_id, const DBRegStatusUpdate& u) {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+
+  pending_mut.lock();
+  queued++;
+
+  Pending::iterator it = pending.find(subscriber_id);
+  if (it != pending.end()) {
+    it->second.u.merge(u);
+    coalesced++;
+  } else {
+    enqueue(subscriber_id, u, now);
+  }
+
+  bool due = pending.size() >= batch_size;
+  pending_mut.unlock();
+
+  if (due)
+    work.set(true);
+}
+
+void DBRegStatusWriter::createRegistration(long subscriber_id) {
+  DBRegStatusUpdate u;
+  u.op = DBRegStatusUpdate::Create;
+  push(subscriber_id, u);
+}
+
+void DBRegStatusWriter::deleteRegistration(long subscriber_id) {
+  DBRegStatusUpdate u;
+  u.op = DBRegStatusUpdate::Delete;
+  push(subscriber_id, u);
+}
+
+void DBRegStatusWriter::updateRegistration(long subscriber_id, int last_code,
+					   const string& last_reason,
+					   bool update_status, int status,
+					   bool update_ts, unsigned int expiry,
+					   bool update_contacts, const string& contacts) {
+  DBRegStatusUpdate u;
+  u.op = DBRegStatusUpdate::Update;
+  u.last_code = last_code;
+  u.last_reason = last_reason;
+  u.update_status = update_status;
+  u.status = status;
+  u.update_ts = update_ts;
+  u.expiry = expiry;
+  if (update_ts)
+    u.ts = time(NULL);
+  u.update_contacts = update_contacts;
+  u.contacts = contacts;
+  push(subscriber_id, u);
+}
+
+bool DBRegStatusWriter::takeBatch(Batch& batch) {
+  struct timeval now, age;
+  gettimeofday(&now, NULL);
+
+  pending_mut.lock();
+  if (pending.empty()) {
+    bool run = !stopping;
+    pending_mut.unlock();
+    work.set(false);
+    return run;
+  }
+
+  dropOutdated();
+  timersub(&now, &pending[order.front().first].since, &age);
+  if (!stopping && pending.size() < batch_size &&
+      (unsigned int)(age.tv_sec * 1000 + age.tv_usec / 1000) < interval) {
+    pending_mut.unlock();
+    return true;
+  }
+
+  // oldest first; changes of subscribers being written by another
+  // thread are held back
+  for (std::deque<std::pair<long, unsigned long> >::iterator it = order.begin();
+       it != order.end() && batch.size() < batch_size; it++) {
+    Pending::iterator p = pending.find(it->first);
+    if (p == pending.end() || p->second.seq != it->second ||
+	in_flight.find(it->first) != in_flight.end())
+      continue;
+
+    batch[it->first] = p->second.u;
+    in_flight.insert(it->first);
+    pending.erase(p);
+  }
+  dropOutdated();
+
+  // (if all are held back, wait for the other writers)
+  bool more = !batch.empty() && (pending.size() >= batch_size);
+  pending_mut.unlock();
+
+  if (!more)
+    work.set(false);
+
+  return true;
+}
+
+void DBRegStatusWriter::batchDone(const Batch& batch, double ms, bool ok) {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+
+  pending_mut.lock();
+  for (Batch::const_iterator it = batch.begin(); it != batch.end(); it++)
+    in_flight.erase(it->first);
+
+  flushes++;
+  if (ok) {
+    written += batch.size();
+  } else {
+    errors++;
+    if (stopping) {
+      ERROR("DB errors on shutdown, %zd registration status changes lost\n",
+	    batch.size());
+    } else {
+      // all statements are idempotent, so the whole batch is written
+      // again, with the changes queued in the meantime on top
+      for (Batch::const_iterator it = batch.begin(); it != batch.end(); it++) {
+	Pending::iterator p = pending.find(it->first);
+	if (p != pending.end()) {
+	  DBRegStatusUpdate u = it->second;
+	  u.merge(p->second.u);
+	  p->second.u = u;
+	} else {
+	  enqueue(it->first, it->second, now);
+	}
+      }
+      requeued += batch.size();
+      WARN("writing %zd registration status changes failed, retrying in %ums\n",
+	   batch.size(), interval);
+    }
+  }
+
+  last_flush_ms = ms;
+  total_flush_ms += ms;
+  if (ms > max_flush_ms)
+    max_flush_ms = ms;
+  pending_mut.unlock();
+}
+
+void DBRegStatusWriter::getStats(AmArg& ret) {
+  pending_mut.lock();
+  ret["queue_depth"] = (int)pending.size();
+  ret["in_flight"] = (int)in_flight.size();
+  ret["max_queue_depth"] = (long)max_depth;
+  ret["queued"] = (long)queued;
+  ret["coalesced"] = (long)coalesced;
+  ret["flushes"] = (long)flushes;
+  ret["written"] = (long)written;
+  ret["errors"] = (long)errors;
+  ret["requeued"] = (long)requeued;
+  ret["last_flush_ms"] = last_flush_ms;
+  ret["max_flush_ms"] = max_flush_ms;
+  ret["avg_flush_ms"] = flushes ? total_flush_ms / flushes : 0.0;
+  ret["connections"] = (int)threads.size();
+  pending_mut.unlock();
+}
+
+// /////////////// writer thread /////////////////
+
+DBRegStatusWriterThread::DBRegStatusWriterThread(DBRegStatusWriter* writer)
+  : writer(writer), conn(mysqlpp::use_exceptions)
+{
+}
+
+bool DBRegStatusWriterThread::connect(const string& db, const string& server,
+				      const string& user, const string& passwd) {
+  try {
+    conn.set_option(new mysqlpp::ReconnectOption(true));
+    conn.connect(db.c_str(), server.c_str(), user.c_str(), passwd.c_str());
+    if (!conn) {
+      ERROR("Database connection failed: %s\n", conn.error());
+      return false;
+    }
+  } catch (const mysqlpp::Exception& er) {
+    ERROR("MySQL++ error: %s\n", er.what());
+    return false;
+  }
+  return true;
+}
+
+void DBRegStatusWriterThread::disconnect() {
+  conn.disconnect();
+}
+
+void DBRegStatusWriterThread::run() {
+  mysqlpp::Connection::thread_start();
+
+  DBRegStatusWriter::Batch batch;
+  while (writer->takeBatch(batch)) {
+    if (batch.empty()) {
+      writer->work.wait_for_to(DBRegStatusWriter::interval);
+      continue;
+    }
+
+    struct timeval start, end, diff;
+    gettimeofday(&start, NULL);
+    bool ok = write(batch);
+    gettimeofday(&end, NULL);
+    timersub(&end, &start, &diff);
+
+    writer->batchDone(batch, diff.tv_sec * 1000.0 + diff.tv_usec / 1000.0, ok);
+    batch.clear();
+  }
+
+  mysqlpp::Connection::thread_end();
+  DBG("DB status writer thread stopped\n");
+}
+
+bool DBRegStatusWriterThread::write(const std::map<long, DBRegStatusUpdate>& batch) {
+  std::vector<long> creates, deletes;
+  // by columns to update: status | ts << 1 | contacts << 2
+  std::vector<std::pair<long, DBRegStatusUpdate> > updates[8];
+
+  for (std::map<long, DBRegStatusUpdate>::const_iterator it = batch.begin();
+       it != batch.end(); it++) {
+    const DBRegStatusUpdate& u = it->second;
+    if (u.recreate)
+      deletes.push_back(it->first);
+
+    switch (u.op) {
+    case DBRegStatusUpdate::Create: creates.push_back(it->first); break;
+    case DBRegStatusUpdate::Delete: deletes.push_back(it->first); break;
+    case DBRegStatusUpdate::Update:
+      updates[(u.update_status ? 1 : 0) | (u.update_ts ? 2 : 0) |
+	      (u.update_contacts ? 4 : 0)].push_back(*it);
+      break;
+    }
+  }
+
+  bool ok = true;
+  try {
+    // deletes first: recreated entries are created or updated afterwards
+    if (!deletes.empty())
+      ok = writeDeletes(deletes) && ok;
+    if (!creates.empty())
+      ok = writeCreates(creates) && ok;
+    for (int i=0;i<8;i++) {
+      if (!updates[i].empty())
+	ok = writeUpdates(updates[i]) && ok;
+    }
+  } catch (const mysqlpp::Exception& er) {
+    // Catch-all for any MySQL++ exceptions
+    ERROR("MySQL++ error: %s\n", er.what());
+    return false;
+  }
+
+  return ok;
+}
+
+bool DBRegStatusWriterThread::execute(mysqlpp::Query& query) {
+  DBG("writing registration status to DB with query '%s'\n", query.str().c_str());
+  mysqlpp::SimpleResult res = query.execute();
+  if (!res) {
+    WARN("writing registration status to DB failed: '%s'\n", res.info());
+    return false;
+  }
+  return true;
+}
+
+bool DBRegStatusWriterThread::writeCreates(const std::vector<long>& ids) {
+  mysqlpp::Query query = conn.query();
+  query << "insert ignore into " << DBRegStatusWriter::registrations_table
+	<< " (" COLNAME_SUBSCRIBER_ID ") values ";
+  for (size_t i=0;i<ids.size();i++)
+    query << (i ? ",(" : "(") << ids[i] << ")";
+  query << ";";
+  return execute(query);
+}
+
+bool DBRegStatusWriterThread::writeDeletes(const std::vector<long>& ids) {
+  mysqlpp::Query query = conn.query();
+  query << "delete from " << DBRegStatusWriter::registrations_table
+	<< " where " COLNAME_SUBSCRIBER_ID " in (";
+  for (size_t i=0;i<ids.size();i++)
+    query << (i ? "," : "") << ids[i];
+  query << ");";
+  return execute(query);
+}
+
+bool DBRegStatusWriterThread::
+writeUpdates(const std::vector<std::pair<long, DBRegStatusUpdate> >& updates) {
+  // all with the same columns to update
+  const DBRegStatusUpdate& f = updates[0].second;
+
+  mysqlpp::Query query = conn.query();
+  query << "insert into " << DBRegStatusWriter::registrations_table
+	<< " (" COLNAME_SUBSCRIBER_ID ", " COLNAME_LAST_CODE ", " COLNAME_LAST_REASON;
+  if (f.update_status)
+    query << ", " COLNAME_STATUS;
+  if (f.update_ts)
+    query << ", " COLNAME_REGISTRATION_TS ", " COLNAME_EXPIRY;
+  if (f.update_contacts)
+    query << ", contacts";
+  query << ") values ";
+
+  for (size_t i=0;i<updates.size();i++) {
+    const DBRegStatusUpdate& u = updates[i].second;
+    query << (i ? ",(" : "(") << updates[i].first << "," << u.last_code << ","
+	  << mysqlpp::quote << u.last_reason;
+    if (u.update_status)
+      query << "," << u.status;
+    if (u.update_ts)
+      query << ",FROM_UNIXTIME(" << (long)u.ts << "),FROM_UNIXTIME("
+	    << (long)u.ts + (long)u.expiry << ")";
+    if (u.update_contacts)
+      query << "," << mysqlpp::quote << u.contacts;
+    query << ")";
+  }
+
+  // entries which do not exist yet are created
+  query << " on duplicate key update "
+    COLNAME_LAST_CODE "=values(" COLNAME_LAST_CODE "), "
+    COLNAME_LAST_REASON "=values(" COLNAME_LAST_REASON ")";
+  if (f.update_status)
+    query << ", " COLNAME_STATUS "=values(" COLNAME_STATUS ")";
+  if (f.update_ts)
+    query << ", " COLNAME_REGISTRATION_TS "=values(" COLNAME_REGISTRATION_TS "), "
+      COLNAME_EXPIRY "=values(" COLNAME_EXPIRY ")";
+  if (f.update_contacts)
+    query << ", contacts=values(contacts)";
+  query << ";";
+
+  return execute(query);
+}
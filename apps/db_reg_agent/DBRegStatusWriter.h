@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2026 SEMS contributors
+ *
+ * This file is part of SEMS, a free SIP media server.
+ *
+ * SEMS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * For a license to use the sems software under conditions
+ * other than those described here, or to purchase support for this
+ * software, please contact iptel.org by e-mail at the following addresses:
+ *    info@iptel.org
+ *
+ * SEMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program; if not, write to the Free Software 
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _DBRegStatusWriter_h_
+#define _DBRegStatusWriter_h_
+
+#include <sys/time.h>
+
+#include <mysql++/mysql++.h>
+
+#include <map>
+#include <set>
+#include <deque>
+#include <vector>
+#include <string>
+using std::string;
+
+#include "AmThread.h"
+#include "DBRegStatusUpdate.h"
+
+class AmArg;
+
+// defaults of the write-behind queue
+#define DB_WRITE_CONNECTIONS 2
+#define DB_WRITE_BATCH_SIZE  100
+#define DB_WRITE_INTERVAL    200  // ms
+
+class DBRegStatusWriter;
+
+/** writer thread with its own DB connection */
+class DBRegStatusWriterThread
+: public AmThread
+{
+  DBRegStatusWriter* writer;
+  mysqlpp::Connection conn;
+
+  bool writeCreates(const std::vector<long>& ids);
+  bool writeDeletes(const std::vector<long>& ids);
+  bool writeUpdates(const std::vector<std::pair<long, DBRegStatusUpdate> >& updates);
+  bool execute(mysqlpp::Query& query);
+
+ protected:
+  void run();
+  void on_stop() { }
+
+ public:
+  DBRegStatusWriterThread(DBRegStatusWriter* writer);
+
+  bool connect(const string& db, const string& server,
+	       const string& user, const string& passwd);
+  void disconnect();
+
+  /** write a batch of changes, @return false on DB errors */
+  bool write(const std::map<long, DBRegStatusUpdate>& batch);
+};
+
+/**
+  Write-behind queue for the registration status in the DB.
+
+  Changes are queued per subscriber; a later change of the same
+  subscriber is merged into the pending one. Writer threads (each with
+  its own DB connection) take batches once batch_size changes are
+  pending or the oldest one waits for interval ms, oldest first, and
+  write them with one multi-row statement per kind of change (insert
+  ... on duplicate key update, delete ... in). Changes of a subscriber
+  which is being written are kept back until that write is done, so
+  that changes are written in order. Batches which failed are queued
+  again (below newer changes) and retried after interval ms.
+ */
+class DBRegStatusWriter
+{
+  struct PendingUpdate
+  {
+    DBRegStatusUpdate u;
+    struct timeval since; // first change not written yet
+    unsigned long seq;
+  };
+
+  typedef std::map<long, PendingUpdate> Pending;
+  typedef std::map<long, DBRegStatusUpdate> Batch;
+
+  std::vector<DBRegStatusWriterThread*> threads;
+
+  AmMutex pending_mut;
+  Pending pending;
+  /** subscriber and seq of the pending changes, oldest first
+      (entries with another seq than in pending are outdated) */
+  std::deque<std::pair<long, unsigned long> > order;
+  unsigned long seq;
+  std::set<long> in_flight;
+
+  AmCondition<bool> work;
+  bool stopping;
+
+  // statistics (under pending_mut)
+  unsigned long queued;
+  unsigned long coalesced;
+  unsigned long flushes;
+  unsigned long written;
+  unsigned long errors;
+  unsigned long requeued;
+  unsigned long max_depth;
+  double last_flush_ms;
+  double max_flush_ms;
+  double total_flush_ms;
+
+  void push(long subscriber_id, const DBRegStatusUpdate& u);
+  /** queue a new change of a subscriber without pending change */
+  void enqueue(long subscriber_id, const DBRegStatusUpdate& u,
+	       const struct timeval& now);
+  /** drop outdated entries from the front of order */
+  void dropOutdated();
+
+  /** take a batch if one is due, @return false if stopped and all written */
+  bool takeBatch(Batch& batch);
+  void batchDone(const Batch& batch, double ms, bool ok);
+
+  friend class DBRegStatusWriterThread;
+
+ public:
+  static string registrations_table;
+
+  static unsigned int batch_size;
+  static unsigned int interval;
+
+  DBRegStatusWriter();
+  ~DBRegStatusWriter();
+
+  /** connect n writer connections and start the threads */
+  bool start(unsigned int n, const string& db, const string& server,
+	     const string& user, const string& passwd);
+  /** write everything pending and stop the threads */
+  void stop();
+
+  /** create the status entry (if it does not exist) */
+  void createRegistration(long subscriber_id);
+  void deleteRegistration(long subscriber_id);
+  void updateRegistration(long subscriber_id, int last_code,
+			  const string& last_reason,
+			  bool update_status = false, int status = 0,
+			  bool update_ts=false, unsigned int expiry = 0,
+			  bool update_contacts=false, const string& contacts = "");
+
+  /** queue depth, coalesced changes and flush latency */
+  void getStats(AmArg& ret);
+};
+
+#endif
@@ -964,6 +964,29 @@ void DSMFactory::listDSMs(const AmArg& args, AmArg& ret) {
   }
 }
 
+void DSMFactory::getDSMStats(const AmArg& args, AmArg& ret) {
+  ret.assertStruct();
+  ScriptConfigs_mut.lock();
+
+  try {
+    if (isArgUndef(args) || !args.size())
+      MainScriptConfig.diags->getStats(ret);
+    else {
+      if (isArgCStr(args.get(0))) {
+	map<string, DSMScriptConfig>::iterator i=
+	  ScriptConfigs.find(args.get(0).asCStr());
+	if (i!= ScriptConfigs.end()) 
+	  i->second.diags->getStats(ret);
+      }
+    }
+  } catch (...) {
+    ScriptConfigs_mut.unlock();
+    throw;
+  }
+
+  ScriptConfigs_mut.unlock();
+}
+
 bool DSMFactory::hasDSM(const string& dsm_name, const string& conf_name) {
   bool res = false; 
   if (conf_name.empty())
@@ -1156,6 +1179,8 @@ void DSMFactory::invoke(const string& method, const AmArg& args,
     hasDSM(args,ret);      
   } else if (method == "listDSMs"){
     listDSMs(args,ret);
+  } else if (method == "getDSMStats"){
+    getDSMStats(args,ret);
   } else if (method == "registerApplication"){
     args.assertArrayFmt("s");
     registerApplication(args,ret);
@@ -1182,6 +1207,7 @@ void DSMFactory::invoke(const string& method, const AmArg& args,
     ret.push(AmArg("loadConfig"));
     ret.push(AmArg("hasDSM"));
     ret.push(AmArg("listDSMs"));
+    ret.push(AmArg("getDSMStats"));
     ret.push(AmArg("registerApplication"));
     ret.push(AmArg("createSystemDSM"));
   }  else
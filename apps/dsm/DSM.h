@@ -114,6 +114,7 @@ class DSMFactory
   DSMChartReader preload_reader;
 
   void listDSMs(const AmArg& args, AmArg& ret);
+  void getDSMStats(const AmArg& args, AmArg& ret);
   void hasDSM(const AmArg& args, AmArg& ret);
   void reloadDSMs(const AmArg& args, AmArg& ret);
   void preloadModules(const AmArg& args, AmArg& ret);
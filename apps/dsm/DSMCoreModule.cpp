@@ -263,25 +263,25 @@ DSMCondition* DSMCoreModule::getCondition(const string& from_str) {
 }
 
 EXEC_ACTION_START(SCPlayPromptAction) {
-  sc_sess->playPrompt(resolveVars(arg, sess, sc_sess, event_params));
+  sc_sess->playPrompt(arg_ref.resolve(sess, sc_sess, event_params));
 } EXEC_ACTION_END;
 
 EXEC_ACTION_START(SCPlayPromptFrontAction) {
-  sc_sess->playPrompt(resolveVars(arg, sess, sc_sess, event_params), false, true);
+  sc_sess->playPrompt(arg_ref.resolve(sess, sc_sess, event_params), false, true);
 } EXEC_ACTION_END;
 
 EXEC_ACTION_START(SCSetPromptsAction) {
-  sc_sess->setPromptSet(resolveVars(arg, sess, sc_sess, event_params));
+  sc_sess->setPromptSet(arg_ref.resolve(sess, sc_sess, event_params));
 } EXEC_ACTION_END;
 
 CONST_ACTION_2P(SCAddSeparatorAction, ',', true);
 EXEC_ACTION_START(SCAddSeparatorAction){
-  bool front = resolveVars(par2, sess, sc_sess, event_params) == "true";
-  sc_sess->addSeparator(resolveVars(par1, sess, sc_sess, event_params), front);
+  bool front = par2_ref.resolve(sess, sc_sess, event_params) == "true";
+  sc_sess->addSeparator(par1_ref.resolve(sess, sc_sess, event_params), front);
 } EXEC_ACTION_END;
 
 EXEC_ACTION_START(SCPlayPromptLoopedAction){
-  sc_sess->playPrompt(resolveVars(arg, sess, sc_sess, event_params), true);
+  sc_sess->playPrompt(arg_ref.resolve(sess, sc_sess, event_params), true);
 } EXEC_ACTION_END;
 
 void setEventParameters(const DSMSession* sc_sess, const string& var, VarMapT& params) {
@@ -289,7 +289,7 @@ void setEventParameters(const DSMSession* sc_sess, const string& var, VarMapT& p
     return;
 
   if (var == "var") {
-    params = sc_sess->var;
+    params = sc_sess->var.getMap();
   } else {
     vector<string> vars = explode(var, ";");
     for (vector<string>::iterator it = vars.begin(); it != vars.end(); it++) {
@@ -320,8 +320,8 @@ void setEventParameters(const DSMSession* sc_sess, const string& var, VarMapT& p
 
 CONST_ACTION_2P(SCPostEventAction, ',', true);
 EXEC_ACTION_START(SCPostEventAction){
-  string sess_id = resolveVars(par1, sess, sc_sess, event_params);
-  string var = resolveVars(par2, sess, sc_sess, event_params);
+  string sess_id = par1_ref.resolve(sess, sc_sess, event_params);
+  string var = par2_ref.resolve(sess, sc_sess, event_params);
   DSMEvent* ev = new DSMEvent();
   setEventParameters(sc_sess, var, ev->params);
 
@@ -340,7 +340,7 @@ EXEC_ACTION_START(SCRelayB2BEventAction) {
     throw DSMException("script", "cause", "relayEvent used without B2B call");
   }
 
-  string var = resolveVars(arg, sess, sc_sess, event_params);
+  string var = arg_ref.resolve(sess, sc_sess, event_params);
   B2BEvent* ev = new B2BEvent(E_B2B_APP, B2BEvent::B2BApplication);
   setEventParameters(sc_sess, var, ev->params);
 
@@ -351,24 +351,24 @@ EXEC_ACTION_START(SCRelayB2BEventAction) {
 CONST_ACTION_2P(SCPlayFileAction, ',', true);
 EXEC_ACTION_START(SCPlayFileAction) {
   bool loop = 
-    resolveVars(par2, sess, sc_sess, event_params) == "true";
+    par2_ref.resolve(sess, sc_sess, event_params) == "true";
   DBG("par1 = '%s', par2 = %s\n", par1.c_str(), par2.c_str());
-  sc_sess->playFile(resolveVars(par1, sess, sc_sess, event_params), 
+  sc_sess->playFile(par1_ref.resolve(sess, sc_sess, event_params), 
 		    loop);
 } EXEC_ACTION_END;
 
 CONST_ACTION_2P(SCPlayFileFrontAction, ',', true);
 EXEC_ACTION_START(SCPlayFileFrontAction) {
   bool loop = 
-    resolveVars(par2, sess, sc_sess, event_params) == "true";
+    par2_ref.resolve(sess, sc_sess, event_params) == "true";
   DBG("par1 = '%s', par2 = %s\n", par1.c_str(), par2.c_str());
-  sc_sess->playFile(resolveVars(par1, sess, sc_sess, event_params), 
+  sc_sess->playFile(par1_ref.resolve(sess, sc_sess, event_params), 
 		    loop, true);
 } EXEC_ACTION_END;
 
 EXEC_ACTION_START(SCPlaySilenceAction) {
   int length;
-  string length_str = resolveVars(arg, sess, sc_sess, event_params);
+  string length_str = arg_ref.resolve(sess, sc_sess, event_params);
   if (!str2int(length_str, length)) {
     throw DSMException("core", "cause", "cannot parse number");
   }
@@ -384,7 +384,7 @@ EXEC_ACTION_START(SCPlayRingtoneAction) {
   if (varname.length() && varname[0]=='$')
     varname = varname.substr(1);
 
-  string front = resolveVars(par2, sess, sc_sess, event_params);
+  string front = par2_ref.resolve(sess, sc_sess, event_params);
 
 #define GET_VAR_INT(var_str, var_name)					\
   it = sc_sess->var.find(varname+"." var_str);				\
@@ -410,7 +410,7 @@ EXEC_ACTION_START(SCPlayRingtoneAction) {
 
 EXEC_ACTION_START(SCPlaySilenceFrontAction) {
   int length;
-  string length_str = resolveVars(arg, sess, sc_sess, event_params);
+  string length_str = arg_ref.resolve(sess, sc_sess, event_params);
   if (!str2int(length_str, length)) {
     throw DSMException("core", "cause", "cannot parse number");
   }
@@ -418,7 +418,7 @@ EXEC_ACTION_START(SCPlaySilenceFrontAction) {
 } EXEC_ACTION_END;
 
 EXEC_ACTION_START(SCRecordFileAction) {
-  sc_sess->recordFile(resolveVars(arg, sess, sc_sess, event_params));
+  sc_sess->recordFile(arg_ref.resolve(sess, sc_sess, event_params));
 } EXEC_ACTION_END;
 
 EXEC_ACTION_START(SCStopRecordAction) {
@@ -426,14 +426,14 @@ EXEC_ACTION_START(SCStopRecordAction) {
 } EXEC_ACTION_END;
 
 EXEC_ACTION_START(SCGetRecordLengthAction) {
-  string varname = resolveVars(arg, sess, sc_sess, event_params);
+  string varname = arg_ref.resolve(sess, sc_sess, event_params);
   if (varname.empty())
     varname = "record_length";
   sc_sess->var[varname]=int2str(sc_sess->getRecordLength());
 } EXEC_ACTION_END;
 
 EXEC_ACTION_START(SCGetRecordDataSizeAction) {
-  string varname = resolveVars(arg, sess, sc_sess, event_params);
+  string varname = arg_ref.resolve(sess, sc_sess, event_params);
   if (varname.empty())
     varname = "record_data_size";
   sc_sess->var[varname]=int2str(sc_sess->getRecordDataSize());
@@ -490,7 +490,7 @@ EXEC_ACTION_START(SCDisableForceDTMFReceiving) {
 } EXEC_ACTION_END;
 
 EXEC_ACTION_START(SCMonitorRTPTimeoutAction) {
-  string e = resolveVars(arg, sess, sc_sess, event_params);
+  string e = arg_ref.resolve(sess, sc_sess, event_params);
   DBG("setting RTP stream to %smonitor RTP timeout\n", e=="true"?"":"not");
   sess->RTPStream()->setMonitorRTPTimeout(e=="true");
 } EXEC_ACTION_END;
@@ -515,10 +515,10 @@ EXEC_ACTION_START(SCDisableDTMFDetection) {
 CONST_ACTION_2P(SCThrowAction, ',', true);
 EXEC_ACTION_START(SCThrowAction) {
   map<string, string> e_args;
-  e_args["type"] = resolveVars(par1, sess, sc_sess, event_params); 
+  e_args["type"] = par1_ref.resolve(sess, sc_sess, event_params); 
   DBG("throwing DSMException type '%s'\n", e_args["type"].c_str());
 
-  string e_params = resolveVars(par2, sess, sc_sess, event_params);
+  string e_params = par2_ref.resolve(sess, sc_sess, event_params);
   
   // inefficient param-split
   vector<string> params = explode(e_params, ";");
@@ -550,7 +550,7 @@ EXEC_ACTION_START(SCThrowOnErrorAction) {
 
 
 EXEC_ACTION_START(SCStopAction) {
-  if (resolveVars(arg, sess, sc_sess, event_params) == "true") {
+  if (arg_ref.resolve(sess, sc_sess, event_params) == "true") {
     DBG("sending bye\n");
     sess->dlg->bye();
   }
@@ -578,7 +578,7 @@ DSMAction::SEAction SCJumpFSMAction::getSEAction(string& param,
 						 AmSession* sess, DSMSession* sc_sess,
 						 DSMCondition::EventType event,
 						 map<string,string>* event_params) {
-  param = resolveVars(arg, sess, sc_sess, event_params);
+  param = arg_ref.resolve(sess, sc_sess, event_params);
   return Jump; 
 }
 
@@ -587,7 +587,7 @@ DSMAction::SEAction SCCallFSMAction::getSEAction(string& param,
 						 AmSession* sess, DSMSession* sc_sess,
 						 DSMCondition::EventType event,
 						 map<string,string>* event_params) {
-  param = resolveVars(arg, sess, sc_sess, event_params);
+  param = arg_ref.resolve(sess, sc_sess, event_params);
   return Call; 
 }
 
@@ -604,11 +604,11 @@ DSMAction::SEAction SCReturnFSMAction::getSEAction(string& param,
 CONST_ACTION_2P(SCLogAction, ',', false);
 EXEC_ACTION_START(SCLogAction) {
   unsigned int lvl;
-  if (str2i(resolveVars(par1, sess, sc_sess, event_params), lvl)) {
+  if (str2i(par1_ref.resolve(sess, sc_sess, event_params), lvl)) {
     ERROR("unknown log level '%s'\n", par1.c_str());
     EXEC_ACTION_STOP;
   }
-  string l_line = resolveVars(par2, sess, sc_sess, event_params).c_str();
+  string l_line = par2_ref.resolve(sess, sc_sess, event_params).c_str();
   _LOG((int)lvl, "FSM: %s '%s'\n", (par2 != l_line)?par2.c_str():"",
        l_line.c_str());
 } EXEC_ACTION_END;
@@ -616,7 +616,7 @@ EXEC_ACTION_START(SCLogAction) {
 CONST_ACTION_2P(SCLogsAction, ',', false);
 EXEC_ACTION_START(SCLogsAction) {
   unsigned int lvl;
-  if (str2i(resolveVars(par1, sess, sc_sess, event_params), lvl)) {
+  if (str2i(par1_ref.resolve(sess, sc_sess, event_params), lvl)) {
     ERROR("unknown log level '%s'\n", par1.c_str());
     EXEC_ACTION_STOP;
   }
@@ -727,12 +727,17 @@ EXEC_ACTION_START(SCLogAllAction) {
   log_selects(arg, sess, sc_sess, event_params);
 } EXEC_ACTION_END;
 
-CONST_ACTION_2P(SCSetAction,'=', false);
+SCSetAction::SCSetAction(const string& arg) {
+  SPLIT_ARGS('=', false);
+  par1_ref.compileVarName(par1);
+  par2_ref.compile(par2);
+}
+
 EXEC_ACTION_START(SCSetAction) {
   if (par1.length() && par1[0] == '#') {
     // set param
     if (NULL != event_params) {
-      string res = resolveVars(par2, sess, sc_sess, event_params);
+      string res = par2_ref.resolve(sess, sc_sess, event_params);
       (*event_params)[par1.substr(1)] = res;
       DBG("set #%s='%s'\n", par1.substr(1).c_str(), res.c_str());
     } else {
@@ -740,13 +745,12 @@ EXEC_ACTION_START(SCSetAction) {
     }
   } else {
     // set variable
-    string var_name = (par1.length() && par1[0] == '$')?
-      par1.substr(1) : par1;
-
-    sc_sess->var[var_name] = resolveVars(par2, sess, sc_sess, event_params);
+    string& val = sc_sess->var.slotValue(par1_ref.getSlot(),
+					 par1_ref.getValue());
+    val = par2_ref.resolve(sess, sc_sess, event_params);
     
     DBG("set $%s='%s'\n", 
-	var_name.c_str(), sc_sess->var[var_name].c_str());
+	par1_ref.getValue().c_str(), val.c_str());
   }
 } EXEC_ACTION_END;
 
@@ -849,20 +853,24 @@ EXEC_ACTION_START(SCSetSAction) {
   }
 } EXEC_ACTION_END;
 
-CONST_ACTION_2P(SCEvalAction,'=', false);
-EXEC_ACTION_START(SCEvalAction) {
-  string var_name = (par1.length() && par1[0] == '$')?
-    par1.substr(1) : par1;
+SCEvalAction::SCEvalAction(const string& arg) {
+  SPLIT_ARGS('=', false);
+  par1_ref.compileVarName(par1);
+  par2_ref.compile(par2, true);
+}
 
-  sc_sess->var[var_name] = resolveVars(par2, sess, sc_sess, event_params, true);
+EXEC_ACTION_START(SCEvalAction) {
+  string& val = sc_sess->var.slotValue(par1_ref.getSlot(),
+				       par1_ref.getValue());
+  val = par2_ref.resolve(sess, sc_sess, event_params);
   DBG("eval $%s='%s'\n", 
-      var_name.c_str(), sc_sess->var[var_name].c_str());
+      par1_ref.getValue().c_str(), val.c_str());
 } EXEC_ACTION_END;
 
 CONST_ACTION_2P(SCSetVarAction,'=', false);
 EXEC_ACTION_START(SCSetVarAction) {
-  string var_name = resolveVars(par1, sess, sc_sess, event_params);
-  sc_sess->var[var_name] = resolveVars(par2, sess, sc_sess, event_params);
+  string var_name = par1_ref.resolve(sess, sc_sess, event_params);
+  sc_sess->var[var_name] = par2_ref.resolve(sess, sc_sess, event_params);
   DBG("set $%s='%s'\n", 
       var_name.c_str(), sc_sess->var[var_name].c_str());
 } EXEC_ACTION_END;
@@ -872,7 +880,7 @@ EXEC_ACTION_START(SCGetParamAction){
 
   string dst_var_name = (par1.length() && par1[0] == '$')?
     par1.substr(1) : par1;
-  string param_name = resolveVars(par2, sess, sc_sess, event_params);
+  string param_name = par2_ref.resolve(sess, sc_sess, event_params);
   
   DBG("param_name = %s, dst = %s\n", param_name.c_str(), dst_var_name.c_str());
 
@@ -896,7 +904,7 @@ CONST_ACTION_2P(SCGetVarAction,'=', false);
 EXEC_ACTION_START(SCGetVarAction){
   string dst_var_name = (par1.length() && par1[0] == '$')?
     par1.substr(1) : par1;
-  string var_name = resolveVars(par2, sess, sc_sess, event_params);
+  string var_name = par2_ref.resolve(sess, sc_sess, event_params);
   
   DBG("var_name = %s, dst = %s\n", var_name.c_str(), dst_var_name.c_str());
   sc_sess->var[dst_var_name] = sc_sess->var[var_name];
@@ -982,7 +990,7 @@ EXEC_ACTION_START(SCArrayIndexAction) {
   if (array_name.length() && array_name[0]=='$')
     array_name.erase(0,1);
 
-  string val = resolveVars(par2, sess, sc_sess, event_params);
+  string val = par2_ref.resolve(sess, sc_sess, event_params);
   unsigned int i = 0;
   bool found = false;
   while (true) {
@@ -1006,15 +1014,19 @@ EXEC_ACTION_START(SCArrayIndexAction) {
   }
 } EXEC_ACTION_END;
 
-CONST_ACTION_2P(SCAppendAction,',', false);
-EXEC_ACTION_START(SCAppendAction) {
-  string var_name = (par1.length() && par1[0] == '$')?
-    par1.substr(1) : par1;
+SCAppendAction::SCAppendAction(const string& arg) {
+  SPLIT_ARGS(',', false);
+  par1_ref.compileVarName(par1);
+  par2_ref.compile(par2);
+}
 
-  sc_sess->var[var_name] += resolveVars(par2, sess, sc_sess, event_params);
+EXEC_ACTION_START(SCAppendAction) {
+  string& val = sc_sess->var.slotValue(par1_ref.getSlot(),
+				       par1_ref.getValue());
+  val += par2_ref.resolve(sess, sc_sess, event_params);
 
   DBG("$%s now '%s'\n", 
-      var_name.c_str(), sc_sess->var[var_name].c_str());
+      par1_ref.getValue().c_str(), val.c_str());
 } EXEC_ACTION_END;
 
 CONST_ACTION_2P(SCSubStrAction,',', false);
@@ -1025,9 +1037,9 @@ EXEC_ACTION_START(SCSubStrAction) {
   unsigned int pos2 = 0;
   size_t c_pos = par2.find(",");
   if (c_pos == string::npos) {
-    if (str2i(resolveVars(par2, sess, sc_sess, event_params), pos)) {
+    if (str2i(par2_ref.resolve(sess, sc_sess, event_params), pos)) {
       ERROR("substr length '%s' unparseable\n",
-	    resolveVars(par2, sess, sc_sess, event_params).c_str());
+	    par2_ref.resolve(sess, sc_sess, event_params).c_str());
       return false;
     }
   } else {
@@ -1074,23 +1086,23 @@ CONST_ACTION_2P(SCSetTimerAction,',', false);
 EXEC_ACTION_START(SCSetTimerAction) {
 
   unsigned int timerid;
-  if (str2i(resolveVars(par1, sess, sc_sess, event_params), timerid)) {
+  if (str2i(par1_ref.resolve(sess, sc_sess, event_params), timerid)) {
     ERROR("timer id '%s' not decipherable\n", 
-	  resolveVars(par1, sess, sc_sess, event_params).c_str());
+	  par1_ref.resolve(sess, sc_sess, event_params).c_str());
     sc_sess->SET_ERRNO(DSM_ERRNO_UNKNOWN_ARG);
     sc_sess->SET_STRERROR("timer id '"+
-			  resolveVars(par1, sess, sc_sess, event_params)+
+			  par1_ref.resolve(sess, sc_sess, event_params)+
 			  "' not decipherable\n");
     EXEC_ACTION_STOP;
   }
 
   unsigned int timeout;
-  if (str2i(resolveVars(par2, sess, sc_sess, event_params), timeout)) {
+  if (str2i(par2_ref.resolve(sess, sc_sess, event_params), timeout)) {
     ERROR("timeout value '%s' not decipherable\n", 
-	  resolveVars(par2, sess, sc_sess, event_params).c_str());
+	  par2_ref.resolve(sess, sc_sess, event_params).c_str());
     sc_sess->SET_ERRNO(DSM_ERRNO_UNKNOWN_ARG);
     sc_sess->SET_STRERROR("timeout value '"+
-			  resolveVars(par2, sess, sc_sess, event_params)+
+			  par2_ref.resolve(sess, sc_sess, event_params)+
 			  "' not decipherable\n");
     EXEC_ACTION_STOP;
   }
@@ -1109,7 +1121,7 @@ EXEC_ACTION_START(SCSetTimerAction) {
 EXEC_ACTION_START(SCRemoveTimerAction) {
 
   unsigned int timerid;
-  string timerid_s = resolveVars(arg, sess, sc_sess, event_params);
+  string timerid_s = arg_ref.resolve(sess, sc_sess, event_params);
   if (str2i(timerid_s, timerid)) {
     ERROR("timer id '%s' not decipherable\n", timerid_s.c_str());
     sc_sess->SET_ERRNO(DSM_ERRNO_UNKNOWN_ARG);
@@ -1143,7 +1155,8 @@ EXEC_ACTION_START(SCRemoveTimersAction) {
 
 
 // TODO: replace with real expression matching 
-TestDSMCondition::TestDSMCondition(const string& expr, DSMCondition::EventType evt) {
+TestDSMCondition::TestDSMCondition(const string& expr, DSMCondition::EventType evt)
+  : lhs_len(false), rhs_len(false) {
 
   type = evt;
 
@@ -1182,6 +1195,14 @@ TestDSMCondition::TestDSMCondition(const string& expr, DSMCondition::EventType e
   lhs = trim(expr.substr(0, p), " ");
   rhs = trim(expr.substr(p2,expr.length()-p2+1), " ");
 
+  lhs_len = lhs.length() > 5 &&
+    (lhs.substr(0, 4) == "len(") && lhs[lhs.length()-1] == ')';
+  lhs_ref.compile(lhs_len ? lhs.substr(4, lhs.length()-5) : lhs);
+
+  rhs_len = rhs.length() > 5 &&
+    rhs.substr(0, 4) == "len(" && rhs[rhs.length()-1] == ')';
+  rhs_ref.compile(rhs_len ? rhs.substr(4, rhs.length()-5) : rhs);
+
   name = expr;
 }
 
@@ -1198,22 +1219,13 @@ bool TestDSMCondition::match(AmSession* sess, DSMSession* sc_sess, DSMCondition:
     return false;
   }
   
-  string l;
-  string r;
-  if (lhs.length() > 5 && 
-      (lhs.substr(0, 4) == "len(") && lhs[lhs.length()-1] == ')') {
-    l = int2str((unsigned int)resolveVars(lhs.substr(4, lhs.length()-5), sess, sc_sess, event_params).length());
-  } else {    
-    l   = resolveVars(lhs, sess, sc_sess, event_params);
-  }
-  if (rhs.length() > 5 && 
-      rhs.substr(0, 4) == "len(" && rhs[rhs.length()-1] == ')') {
-    r = resolveVars(rhs.substr(4, rhs.length()-5), sess, sc_sess, event_params).length();
-  } else {    
-    r   = resolveVars(rhs, sess, sc_sess, event_params);
-  }
+  string l = lhs_ref.resolve(sess, sc_sess, event_params);
+  if (lhs_len)
+    l = int2str((unsigned int)l.length());
 
-//   string r = resolveVars(rhs, sess, sc_sess, event_params);
+  string r = rhs_ref.resolve(sess, sc_sess, event_params);
+  if (rhs_len)
+    r = int2str((unsigned int)r.length());
 
   DBG("test '%s' vs '%s'\n", l.c_str(), r.c_str());
 
@@ -1469,8 +1481,8 @@ EXEC_ACTION_START(SCDIAction) {
 
 CONST_ACTION_2P(SCB2BConnectCalleeAction,',', false);
 EXEC_ACTION_START(SCB2BConnectCalleeAction) {  
-  string remote_party = resolveVars(par1, sess, sc_sess, event_params);
-  string remote_uri = resolveVars(par2, sess, sc_sess, event_params);
+  string remote_party = par1_ref.resolve(sess, sc_sess, event_params);
+  string remote_uri = par2_ref.resolve(sess, sc_sess, event_params);
   bool relayed_invite = false;
   VarMapT::iterator it = sc_sess->var.find(DSM_B2B_RELAYED_INVITE);
   if (it != sc_sess->var.end() && it->second == "true")
@@ -1491,27 +1503,27 @@ EXEC_ACTION_START(SCB2BReinviteAction) {
 } EXEC_ACTION_END;
 
 EXEC_ACTION_START(SCB2BEnableEarlyMediaRelayAction) {
-  string val = resolveVars(arg, sess, sc_sess, event_params);
+  string val = arg_ref.resolve(sess, sc_sess, event_params);
   DBG("B2B: %sabling early media SDP relay as re-Invite\n", (val=="true")?"En":"Dis");
   sc_sess->B2BsetRelayEarlyMediaSDP(val=="true");
 } EXEC_ACTION_END;
 
 EXEC_ACTION_START(SCB2BAddHeaderAction) {
-  string val = resolveVars(arg, sess, sc_sess, event_params);
+  string val = arg_ref.resolve(sess, sc_sess, event_params);
   DBG("adding B2B header '%s'\n", val.c_str());
   sc_sess->B2BaddHeader(val);
 } EXEC_ACTION_END;
 
 EXEC_ACTION_START(SCB2BRemoveHeaderAction) {
-  string val = resolveVars(arg, sess, sc_sess, event_params);
+  string val = arg_ref.resolve(sess, sc_sess, event_params);
   DBG("removing B2B header '%s'\n", val.c_str());
   sc_sess->B2BremoveHeader(val);
 } EXEC_ACTION_END;
 
 CONST_ACTION_2P(SCB2BSetHeadersAction,',', true);
 EXEC_ACTION_START(SCB2BSetHeadersAction) {
-  string val = resolveVars(par1, sess, sc_sess, event_params);
-  string repl = resolveVars(par2, sess, sc_sess, event_params);
+  string val = par1_ref.resolve(sess, sc_sess, event_params);
+  string repl = par2_ref.resolve(sess, sc_sess, event_params);
   bool replace_crlf = false;
   if (repl == "true")
     replace_crlf = true;
@@ -1527,8 +1539,8 @@ EXEC_ACTION_START(SCB2BClearHeadersAction) {
 
 CONST_ACTION_2P(SCSendDTMFAction,',', true);
 EXEC_ACTION_START(SCSendDTMFAction) {
-  string event = resolveVars(par1, sess, sc_sess, event_params);
-  string duration = resolveVars(par2, sess, sc_sess, event_params);  
+  string event = par1_ref.resolve(sess, sc_sess, event_params);
+  string duration = par2_ref.resolve(sess, sc_sess, event_params);  
   
   unsigned int event_i;
   if (str2i(event, event_i)) {
@@ -1551,8 +1563,8 @@ EXEC_ACTION_START(SCSendDTMFAction) {
 
 CONST_ACTION_2P(SCSendDTMFSequenceAction,',', true);
 EXEC_ACTION_START(SCSendDTMFSequenceAction) {
-  string events = resolveVars(par1, sess, sc_sess, event_params);
-  string duration = resolveVars(par2, sess, sc_sess, event_params);
+  string events = par1_ref.resolve(sess, sc_sess, event_params);
+  string duration = par2_ref.resolve(sess, sc_sess, event_params);
 
   unsigned int duration_i;
   if (duration.empty()) {
@@ -1584,7 +1596,7 @@ EXEC_ACTION_START(SCSendDTMFSequenceAction) {
 } EXEC_ACTION_END;
 
 EXEC_ACTION_START(SCRegisterEventQueueAction) {
-  string q_name = resolveVars(arg, sess, sc_sess, event_params);
+  string q_name = arg_ref.resolve(sess, sc_sess, event_params);
   DBG("Registering event queue '%s'\n", q_name.c_str());
   if (q_name.empty()) {
     WARN("Registering empty event queue name!\n");
@@ -1593,7 +1605,7 @@ EXEC_ACTION_START(SCRegisterEventQueueAction) {
 } EXEC_ACTION_END;
 
 EXEC_ACTION_START(SCUnregisterEventQueueAction) {
-  string q_name = resolveVars(arg, sess, sc_sess, event_params);
+  string q_name = arg_ref.resolve(sess, sc_sess, event_params);
   DBG("Unregistering event queue '%s'\n", q_name.c_str());
   if (q_name.empty()) {
     WARN("Unregistering empty event queue name!\n");
@@ -1603,8 +1615,8 @@ EXEC_ACTION_START(SCUnregisterEventQueueAction) {
 
 CONST_ACTION_2P(SCCreateSystemDSMAction,',', false);
 EXEC_ACTION_START(SCCreateSystemDSMAction) {
-  string conf_name = resolveVars(par1, sess, sc_sess, event_params);
-  string script_name = resolveVars(par2, sess, sc_sess, event_params);
+  string conf_name = par1_ref.resolve(sess, sc_sess, event_params);
+  string script_name = par2_ref.resolve(sess, sc_sess, event_params);
 
   if (conf_name.empty() || script_name.empty()) {
     throw DSMException("core", "cause", "parameters missing - "
@@ -1641,7 +1653,7 @@ DSMDisposable* getObjectFromVariable(DSMSession* sc_sess, const string& var_name
 }
 
 EXEC_ACTION_START(SCTrackObjectAction) {
-  string var_name = resolveVars(arg, sess, sc_sess, event_params);
+  string var_name = arg_ref.resolve(sess, sc_sess, event_params);
   DSMDisposable* disp = getObjectFromVariable(sc_sess, var_name);
   if (NULL == disp) {
     EXEC_ACTION_STOP;
@@ -1650,7 +1662,7 @@ EXEC_ACTION_START(SCTrackObjectAction) {
 } EXEC_ACTION_END;
 
 EXEC_ACTION_START(SCReleaseObjectAction) {
-  string var_name = resolveVars(arg, sess, sc_sess, event_params);
+  string var_name = arg_ref.resolve(sess, sc_sess, event_params);
   DSMDisposable* disp = getObjectFromVariable(sc_sess, var_name);
   if (NULL == disp) {
     EXEC_ACTION_STOP;
@@ -1659,7 +1671,7 @@ EXEC_ACTION_START(SCReleaseObjectAction) {
 } EXEC_ACTION_END;
 
 EXEC_ACTION_START(SCFreeObjectAction) {
-  string var_name = resolveVars(arg, sess, sc_sess, event_params);
+  string var_name = arg_ref.resolve(sess, sc_sess, event_params);
   DSMDisposable* disp = getObjectFromVariable(sc_sess, var_name);
   if (NULL == disp) {
     EXEC_ACTION_STOP;
@@ -165,6 +165,12 @@ class TestDSMCondition
   string rhs;
   CondType ttype;
 
+  /* compiled lhs/rhs, without len() */
+  DSMArgRef lhs_ref;
+  DSMArgRef rhs_ref;
+  bool lhs_len;
+  bool rhs_len;
+
  public:
   TestDSMCondition(const string& expr, DSMCondition::EventType e);
   bool match(AmSession* sess, DSMSession* sc_sess, DSMCondition::EventType event,
@@ -42,6 +42,7 @@ SCStrArgAction::SCStrArgAction(const string& m_arg) {
     arg = trim(arg, "\"");
   else if (arg.length() && arg[0] == '\'')
     arg = trim(arg, "'");
+  arg_ref.compile(arg);
 }
 
 bool isNumber(const std::string& s) {
@@ -55,91 +56,214 @@ bool isNumber(const std::string& s) {
   return true;
 }
 
-string resolveVars(const string ts, AmSession* sess,
-		   DSMSession* sc_sess, map<string,string>* event_params,
-		   bool eval_ops) {
+DSMArgRef::DSMArgRef()
+  : type(Const), select(SelectNone), slot(DSMVarSlots::NoSlot), op(0),
+    lhs(NULL), rhs(NULL), whole(NULL)
+{
+}
+
+DSMArgRef::DSMArgRef(const DSMArgRef& r)
+  : type(Const), select(SelectNone), slot(DSMVarSlots::NoSlot), op(0),
+    lhs(NULL), rhs(NULL), whole(NULL)
+{
+  copy(r);
+}
+
+DSMArgRef::~DSMArgRef() {
+  clear();
+}
+
+DSMArgRef& DSMArgRef::operator=(const DSMArgRef& r) {
+  if (this != &r) {
+    clear();
+    copy(r);
+  }
+  return *this;
+}
+
+void DSMArgRef::copy(const DSMArgRef& r) {
+  type = r.type;
+  value = r.value;
+  select = r.select;
+  slot = r.slot;
+  op = r.op;
+  if (r.type == Expr) {
+    lhs = new DSMArgRef(*r.lhs);
+    rhs = new DSMArgRef(*r.rhs);
+    whole = new DSMArgRef(*r.whole);
+  }
+}
+
+void DSMArgRef::clear() {
+  delete lhs;
+  delete rhs;
+  delete whole;
+  lhs = rhs = whole = NULL;
+  type = Const;
+  value.clear();
+  select = SelectNone;
+  slot = DSMVarSlots::NoSlot;
+  op = 0;
+}
+
+void DSMArgRef::compile(const string& ts, bool eval_ops, bool intern) {
+  clear();
+  if (ts.empty())
+    return;
+
+  if (!eval_ops) {
+    compileRef(ts, intern);
+    return;
+  }
+
+  // remove all spaces
   string s = ts;
-  if (s.length()) {
-
-    if(eval_ops) {
-      // remove all spaces
-      string::size_type p;
-      for (p = s.find (" ", 0 ); 
-  	p != string::npos; p = s.find(" ", p)) {
-        s.erase (p, 1);
-      }
-
-      // evaluate operators
-      string a,b;
-      if((p = s.find("-")) != string::npos) {
-        a = resolveVars(s.substr(0, p), sess, sc_sess, event_params, true);
-        b = resolveVars(s.substr(p+1, string::npos), sess, sc_sess, event_params, true);
-        if(isNumber(a) && isNumber(b)) {
-          std::stringstream res; res << atoi(a.c_str()) - atoi(b.c_str());
-          return res.str();
-        }
-      }
-      else if((p = s.find("+")) != string::npos) {
-        a = resolveVars(s.substr(0, p), sess, sc_sess, event_params, true);
-        b = resolveVars(s.substr(p+1, string::npos), sess, sc_sess, event_params, true);
-        if(isNumber(a) && isNumber(b)) {
-          std::stringstream res; res << atoi(a.c_str()) + atoi(b.c_str());
-          return res.str();
-        }
-      }
+  string::size_type p;
+  for (p = s.find (" ", 0 );
+       p != string::npos; p = s.find(" ", p)) {
+    s.erase (p, 1);
+  }
+
+  if ((p = s.find("-")) == string::npos)
+    p = s.find("+");
+
+  if (p == string::npos) {
+    compileRef(s, intern);
+    return;
+  }
+
+  type = Expr;
+  op = s[p];
+  lhs = new DSMArgRef();
+  lhs->compile(s.substr(0, p), true, intern);
+  rhs = new DSMArgRef();
+  rhs->compile(s.substr(p+1, string::npos), true, intern);
+  whole = new DSMArgRef();
+  whole->compileRef(s, intern);
+}
+
+void DSMArgRef::compileVarName(const string& s) {
+  clear();
+  type = Var;
+  value = (s.length() && s[0] == '$') ? s.substr(1) : s;
+  slot = DSMVarSlots::get(value);
+}
+
+void DSMArgRef::compileRef(const string& s, bool intern) {
+  if (s.empty())
+    return;
+
+  switch(s[0]) {
+  case '$':
+  case '#': {
+    if (s.length() > 1 && s[1] == s[0]) {
+      value = s.substr(0, 1);
+      return;
     }
+    type = s[0] == '$' ? Var : Param;
+    value = s.substr(1);
+    if (type == Var && intern)
+      slot = DSMVarSlots::get(value);
+  } break;
+
+  case '@': {
+    if (s.length() < 2 || s[1] == '@') {
+      value = "@";
+      return;
+    }
+
+    string s1 = s.substr(1);
+    if (s1 == "local_tag")
+      select = SelectLocalTag;
+    else if (s1 == "user")
+      select = SelectUser;
+    else if (s1 == "domain")
+      select = SelectDomain;
+    else if (s1 == "remote_tag")
+      select = SelectRemoteTag;
+    else if (s1 == "callid")
+      select = SelectCallId;
+    else if (s1 == "local_uri")
+      select = SelectLocalUri;
+    else if (s1 == "local_party")
+      select = SelectLocalParty;
+    else if (s1 == "remote_uri")
+      select = SelectRemoteUri;
+    else if (s1 == "remote_party")
+      select = SelectRemoteParty;
+    else
+      return; // unknown select: empty
 
-    switch(s[0]) {
-    case '$': {
-      if (s.substr(1, 1)=="$")
-	return "$";
-      map<string, string>::iterator it = sc_sess->var.find(s.substr(1));
-      if (it != sc_sess->var.end())
+    type = Select;
+    value = s1;
+  } break;
+
+  default:
+    value = trim(s, "\"");
+    break;
+  }
+}
+
+string DSMArgRef::resolve(AmSession* sess, DSMSession* sc_sess,
+			  map<string,string>* event_params) const {
+  switch (type) {
+  case Const:
+    return value;
+
+  case Var: {
+    const string* v = sc_sess->var.findSlot(slot, value);
+    return v ? *v : "";
+  }
+
+  case Param: {
+    if (event_params) {
+      map<string, string>::const_iterator it = event_params->find(value);
+      if (it != event_params->end())
 	return it->second;
-      return "";
     }
-    case '#': 
-      if (s.substr(1, 1)=="#")
-	return "#";
-      if (event_params) {
-	map<string, string>::iterator it = event_params->find(s.substr(1));
-	if (it != event_params->end())
-	  return it->second;
-	return  "";
-      }else 
-	return string();
-    case '@': {
-      if (s.substr(1, 1)=="@")
-	return "@";
-      if (s.length() < 2)
-	return "@";
-
-      string s1 = s.substr(1); 
-      if (s1 == "local_tag")
-	return sess->getLocalTag();	
-      else if (s1 == "user")
-	return sess->dlg->getUser();
-      else if (s1 == "domain")
-	return sess->dlg->getDomain();
-      else if (s1 == "remote_tag")
-	return sess->getRemoteTag();
-      else if (s1 == "callid")
-	return sess->getCallID();
-      else if (s1 == "local_uri")
-	return sess->dlg->getLocalUri();
-      else if (s1 == "local_party")
-	return sess->dlg->getLocalParty();
-      else if (s1 == "remote_uri")
-	return sess->dlg->getRemoteUri();
-      else if (s1 == "remote_party")
-	return sess->dlg->getRemoteParty();
+    return "";
+  }
+
+  case Select: {
+    switch (select) {
+    case SelectLocalTag:    return sess->getLocalTag();
+    case SelectUser:        return sess->dlg->getUser();
+    case SelectDomain:      return sess->dlg->getDomain();
+    case SelectRemoteTag:   return sess->getRemoteTag();
+    case SelectCallId:      return sess->getCallID();
+    case SelectLocalUri:    return sess->dlg->getLocalUri();
+    case SelectLocalParty:  return sess->dlg->getLocalParty();
+    case SelectRemoteUri:   return sess->dlg->getRemoteUri();
+    case SelectRemoteParty: return sess->dlg->getRemoteParty();
+    default:                return "";
+    }
+  }
+
+  case Expr: {
+    string a = lhs->resolve(sess, sc_sess, event_params);
+    string b = rhs->resolve(sess, sc_sess, event_params);
+    if(isNumber(a) && isNumber(b)) {
+      std::stringstream res;
+      if (op == '-')
+	res << atoi(a.c_str()) - atoi(b.c_str());
       else
-	return string();
-    } 
-    default: return trim(s, "\"");
+	res << atoi(a.c_str()) + atoi(b.c_str());
+      return res.str();
     }
+    return whole->resolve(sess, sc_sess, event_params);
   }
-  return s;
+  }
+
+  return "";
+}
+
+string resolveVars(const string& s, AmSession* sess,
+		   DSMSession* sc_sess, map<string,string>* event_params,
+		   bool eval_ops) {
+  // not from a chart: do not add the names to the slots
+  DSMArgRef ref;
+  ref.compile(s, eval_ops, false);
+  return ref.resolve(sess, sc_sess, event_params);
 }
 
 void splitCmd(const string& from_str, 
@@ -83,10 +83,84 @@ typedef void* (*SCFactoryCreate)();
 #define SC_EXPORT(class_name)			\
   EXPORT_SC_FACTORY(SC_FACTORY_EXPORT,class_name)
 
-class SCStrArgAction   
+/**
+ * Action/condition argument compiled when the script is read: $var,
+ * #param and @select references are split off and constants unquoted
+ * once, so that resolving it on an event is at most one lookup instead
+ * of re-parsing the argument string. resolve() returns the same as
+ * resolveVars() on the source string.
+ */
+class DSMArgRef {
+ public:
+  enum RefType {
+    Const,  // constant (also escaped $$, ## and @@)
+    Var,    // $varname
+    Param,  // #paramname
+    Select, // @selectname
+    Expr    // a-b or a+b (eval)
+  };
+
+  enum SelectType {
+    SelectNone,
+    SelectLocalTag,
+    SelectUser,
+    SelectDomain,
+    SelectRemoteTag,
+    SelectCallId,
+    SelectLocalUri,
+    SelectLocalParty,
+    SelectRemoteUri,
+    SelectRemoteParty
+  };
+
+ private:
+  RefType    type;
+  string     value;  // constant, or variable/parameter name
+  SelectType select;
+  unsigned int slot; // Var: slot of the variable (DSMVarSlots), or NoSlot
+
+  /* Expr: operands, and the whole expression as reference
+     in case one of the operands is not a number */
+  char       op;
+  DSMArgRef* lhs;
+  DSMArgRef* rhs;
+  DSMArgRef* whole;
+
+  void compileRef(const string& s, bool intern);
+  void copy(const DSMArgRef& r);
+  void clear();
+
+ public:
+  DSMArgRef();
+  DSMArgRef(const DSMArgRef& r);
+  ~DSMArgRef();
+  DSMArgRef& operator=(const DSMArgRef& r);
+
+  /** @param eval_ops evaluate + and - operators (see resolveVars)
+      @param intern   give $var references a slot (charts only, the
+                      slots are never freed) */
+  void compile(const string& s, bool eval_ops = false, bool intern = true);
+
+  /** variable to be set: $name or name */
+  void compileVarName(const string& s);
+
+  RefType getType() const { return type; }
+
+  /** constant value, or name of the variable/parameter */
+  const string& getValue() const { return value; }
+
+  /** Var: slot of the variable */
+  unsigned int getSlot() const { return slot; }
+
+  string resolve(AmSession* sess, DSMSession* sc_sess,
+		 map<string,string>* event_params) const;
+};
+
+class SCStrArgAction
 : public DSMAction {
  protected:
   string arg;
+  DSMArgRef arg_ref;
  public:
   SCStrArgAction(const string& m_arg); 
 };
@@ -123,6 +197,8 @@ class SCStrArgAction
   : public DSMAction {							\
     string par1;							\
     string par2;							\
+    DSMArgRef par1_ref;							\
+    DSMArgRef par2_ref;							\
   public:								\
     CL_Name(const string& arg);						\
     bool execute(AmSession* sess, DSMSession* sc_sess,			\
@@ -201,6 +277,8 @@ class SCStrArgAction
 #define CONST_ACTION_2P(CL_name, _sep, _optional)			\
   CL_name::CL_name(const string& arg) {					\
     SPLIT_ARGS(_sep, _optional);					\
+    par1_ref.compile(par1);						\
+    par2_ref.compile(par2);						\
   }
 
 
@@ -217,7 +295,7 @@ class SCStrArgAction
 #define EXEC_ACTION_STOP			\
   return false;
 
-string resolveVars(const string s, AmSession* sess,
+string resolveVars(const string& s, AmSession* sess,
 		   DSMSession* sc_sess, map<string,string>* event_params,
 		   bool eval_ops = false);
 
@@ -238,12 +316,13 @@ void splitCmd(const string& from_str,
   class cond_name				\
   : public DSMCondition {			\
     string arg;					\
+    DSMArgRef arg_ref;				\
     bool inv;					\
     						\
   public:					\
     						\
   cond_name(const string& arg, bool inv)				\
-    : arg(arg), inv(inv) { }						\
+    : arg(arg), inv(inv) { arg_ref.compile(arg); }			\
     bool match(AmSession* sess, DSMSession* sc_sess, DSMCondition::EventType event, \
 	       map<string,string>* event_params);			\
   };
@@ -253,6 +332,8 @@ void splitCmd(const string& from_str,
   : public DSMCondition {						\
     string par1;							\
     string par2;							\
+    DSMArgRef par1_ref;							\
+    DSMArgRef par2_ref;							\
     bool inv;								\
   public:								\
     cond_name(const string& arg, bool inv);				\
@@ -264,6 +345,8 @@ void splitCmd(const string& from_str,
   cond_name::cond_name(const string& arg, bool inv)			\
   : inv(inv) {								\
     SPLIT_ARGS(_sep, _optional);					\
+    par1_ref.compile(par1);						\
+    par2_ref.compile(par2);						\
   }
 
 #define MATCH_CONDITION_START(cond_clsname)				\
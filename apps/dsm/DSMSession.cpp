@@ -26,6 +26,58 @@
  */
 
 #include "DSMSession.h"
+#include "AmThread.h"
+
+static map<string, unsigned int> var_slots;
+static AmMutex var_slots_mut;
+
+unsigned int DSMVarSlots::get(const string& name)
+{
+  AmLock l(var_slots_mut);
+  map<string, unsigned int>::iterator it = var_slots.find(name);
+  if (it != var_slots.end())
+    return it->second;
+
+  unsigned int slot = var_slots.size();
+  var_slots[name] = slot;
+  return slot;
+}
+
+string* DSMVarMap::cacheSlot(unsigned int slot, string* v)
+{
+  if (slot >= slots.size()) {
+    size_t n = slots.size() ? 2 * slots.size() : 16;
+    slots.resize(slot < n ? n : slot + 1, NULL);
+  }
+  slots[slot] = v;
+  return v;
+}
+
+const string* DSMVarMap::findSlot(unsigned int slot, const string& name)
+{
+  if (slot < slots.size() && slots[slot])
+    return slots[slot];
+
+  iterator it = vars.find(name);
+  if (it == vars.end())
+    return NULL;
+
+  if (slot == DSMVarSlots::NoSlot)
+    return &it->second;
+
+  return cacheSlot(slot, &it->second);
+}
+
+string& DSMVarMap::slotValue(unsigned int slot, const string& name)
+{
+  if (slot < slots.size() && slots[slot])
+    return *slots[slot];
+
+  if (slot == DSMVarSlots::NoSlot)
+    return vars[name];
+
+  return *cacheSlot(slot, &vars[name]);
+}
 
 DSMSession::DSMSession() 
   : last_req(0) {
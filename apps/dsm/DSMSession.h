@@ -114,6 +114,101 @@ using std::map;
 typedef map<string, string> VarMapT;
 typedef map<string, AmArg>  AVarMapT;
 
+/**
+ * Interned variable names: the $var references of the charts are
+ * numbered (slots) when the charts are read.
+ */
+class DSMVarSlots {
+ public:
+  /** no slot: the variable is only looked up by name */
+  static const unsigned int NoSlot = (unsigned int)-1;
+
+  /** slot of the variable name (new slot if not seen yet) */
+  static unsigned int get(const string& name);
+};
+
+/**
+ * Session variables ($varname). Besides by name, variables can be
+ * accessed by slot, which caches the map entry of the variable after
+ * the first lookup. The map is only modified through the members
+ * below, and every member that removes entries drops the cache.
+ */
+class DSMVarMap {
+  VarMapT vars;
+  vector<string*> slots;
+
+  string* cacheSlot(unsigned int slot, string* v);
+
+ public:
+  typedef VarMapT::key_type       key_type;
+  typedef VarMapT::mapped_type    mapped_type;
+  typedef VarMapT::value_type     value_type;
+  typedef VarMapT::size_type      size_type;
+  typedef VarMapT::iterator       iterator;
+  typedef VarMapT::const_iterator const_iterator;
+
+  DSMVarMap() {}
+  DSMVarMap(const DSMVarMap& m) : vars(m.vars) {}
+
+  DSMVarMap& operator=(const VarMapT& m) {
+    slots.clear();
+    vars = m;
+    return *this;
+  }
+
+  DSMVarMap& operator=(const DSMVarMap& m) {
+    if (this != &m)
+      operator=(m.vars);
+    return *this;
+  }
+
+  /** the variables as plain map (read only) */
+  const VarMapT& getMap() const { return vars; }
+
+  iterator begin() { return vars.begin(); }
+  iterator end() { return vars.end(); }
+  const_iterator begin() const { return vars.begin(); }
+  const_iterator end() const { return vars.end(); }
+
+  size_type size() const { return vars.size(); }
+  bool empty() const { return vars.empty(); }
+  size_type count(const string& name) const { return vars.count(name); }
+
+  iterator find(const string& name) { return vars.find(name); }
+  const_iterator find(const string& name) const { return vars.find(name); }
+  iterator lower_bound(const string& name) { return vars.lower_bound(name); }
+  const_iterator lower_bound(const string& name) const {
+    return vars.lower_bound(name);
+  }
+  iterator upper_bound(const string& name) { return vars.upper_bound(name); }
+  const_iterator upper_bound(const string& name) const {
+    return vars.upper_bound(name);
+  }
+
+  string& operator[](const string& name) { return vars[name]; }
+  std::pair<iterator, bool> insert(const value_type& v) {
+    return vars.insert(v);
+  }
+
+  void erase(iterator it) { slots.clear(); vars.erase(it); }
+  void erase(iterator first, iterator last) {
+    slots.clear();
+    vars.erase(first, last);
+  }
+  size_type erase(const string& name) {
+    slots.clear();
+    return vars.erase(name);
+  }
+  void clear() { slots.clear(); vars.clear(); }
+
+  /** value of the variable, NULL if not set
+      (slot may be DSMVarSlots::NoSlot) */
+  const string* findSlot(unsigned int slot, const string& name);
+
+  /** the variable (set to "" if not set) */
+  string& slotValue(unsigned int slot, const string& name);
+};
+
 class DSMDisposable;
 struct AmPlaylistItem;
 
@@ -176,7 +271,7 @@ class DSMSession {
   virtual void releaseOwnership(DSMDisposable* d) = 0;
 
   /* holds variables which are accessed by $varname */
-  VarMapT var;
+  DSMVarMap var;
 
   /* holds AmArg variables. todo(?): merge var with these */
   AVarMapT avar;
@@ -139,6 +139,12 @@ vector<string> DSMStateDiagramCollection::getDiagramNames() {
   return res;
 }
 
+void DSMStateDiagramCollection::getStats(AmArg& ret) {
+  for (vector<DSMStateDiagram>::iterator it=
+	 diags.begin(); it != diags.end(); it++)
+    it->getStats(ret[it->getName()]);
+}
+
 void DSMStateDiagramCollection::addToEngine(DSMStateEngine* e) {
   DBG("adding %zd diags to engine\n", diags.size());
   for (vector <DSMStateDiagram>::iterator it = 
@@ -51,6 +51,9 @@ class DSMStateDiagramCollection
   void addToEngine(DSMStateEngine* e);
   bool hasDiagram(const string& name);
   vector<string> getDiagramNames();
+
+  /** transition/condition counters of the diagrams, by name */
+  void getStats(AmArg& ret);
 };
 
 #endif
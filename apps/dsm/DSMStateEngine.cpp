@@ -185,7 +185,7 @@ bool DSMStateDiagram::addTransition(const DSMTransition& trans) {
       return false;
     }
     
-    source_st->transitions.push_back(trans);
+    source_st->addTransition(trans);
   }
 
   return true;
@@ -212,6 +212,25 @@ State* DSMStateDiagram::getInitialState() {
 }
 
 
+void DSMStateDiagram::countEvent(unsigned int transitions,
+				 unsigned int conditions) {
+  cnt_events.inc();
+  if (transitions)
+    cnt_transitions.inc(transitions);
+  if (conditions)
+    cnt_conditions.inc(conditions);
+}
+
+void DSMStateDiagram::getStats(AmArg& ret) {
+  unsigned long long events = cnt_events.get();
+  unsigned long long conditions = cnt_conditions.get();
+  ret["events"] = (long)events;
+  ret["transitions"] = (long)cnt_transitions.get();
+  ret["conditions"] = (long)conditions;
+  ret["conditions_per_event"] =
+    events ? (double)conditions / events : 0.0;
+}
+
 bool DSMStateDiagram::checkConsistency(string& report) {
   bool res = true;
   DBG("checking consistency of '%s'\n", name.c_str());
@@ -609,21 +628,32 @@ void DSMStateEngine::runEvent(AmSession* sess, DSMSession* sc_sess,
 
 
       DBG(" > state '%s'\n", current->name.c_str());
-      for (vector<DSMTransition>::iterator tr = current->transitions.begin();
-	   tr != current->transitions.end();tr++) {
+      DSMStateDiagram* diag = current_diag;
+      unsigned int n_transitions = 0, n_conditions = 0;
+      bool counted = false;
+
+      const vector<unsigned int>& candidates =
+	current->getTransitions(active_event);
+      for (vector<unsigned int>::const_iterator t_it = candidates.begin();
+	   t_it != candidates.end(); t_it++) {
+	DSMTransition* tr = &current->transitions[*t_it];
 	if (tr->is_exception != is_exception)
 	  continue;
 	
 	DBG(" ...checking transition '%s'\n", tr->name.c_str());
+	n_transitions++;
 	
 	vector<DSMCondition*>::iterator con=tr->precond.begin();
 	while (con!=tr->precond.end()) {
+	  n_conditions++;
 	  if (!(*con)->_match(sess, sc_sess, active_event, active_params))
 	    break;
 	  con++;
 	}
 	if (con == tr->precond.end()) {
 	  DBG(" .>>transition '%s' matched.\n", tr->name.c_str());
+	  diag->countEvent(n_transitions, n_conditions);
+	  counted = true;
 	  
 	  //  matched all preconditions
 	  // find target state
@@ -697,6 +727,10 @@ void DSMStateEngine::runEvent(AmSession* sess, DSMSession* sc_sess,
 	  break;
 	}
       }
+
+      if (!counted)
+	diag->countEvent(n_transitions, n_conditions);
+
     } catch (DSMException& e) {
       DBG("DSMException occured, type = %s\n", e.params["type"].c_str());
       is_consumed = false;
@@ -812,6 +846,46 @@ State::State() {
 State::~State() {
 }
 
+void State::addTransition(const DSMTransition& trans) {
+  unsigned int idx = transitions.size();
+  transitions.push_back(trans);
+
+  // the only event type the transition can match, if any
+  DSMCondition::EventType ev = DSMCondition::Any;
+  for (vector<DSMCondition*>::const_iterator it=
+	 trans.precond.begin(); it != trans.precond.end(); it++) {
+    if ((*it)->invert || (*it)->type == DSMCondition::Any)
+      continue;
+
+    if (ev != DSMCondition::Any && ev != (*it)->type) {
+      WARN("transition '%s' from state '%s' can never match "
+	   "(conditions on %s and %s events)\n", trans.name.c_str(),
+	   name.c_str(), DSMCondition::type2str(ev),
+	   DSMCondition::type2str((*it)->type));
+      return;
+    }
+    ev = (*it)->type;
+  }
+
+  if (ev == DSMCondition::Any) {
+    any_transitions.push_back(idx);
+    for (vector<vector<unsigned int> >::iterator it=
+	   event_transitions.begin(); it != event_transitions.end(); it++)
+      it->push_back(idx);
+    return;
+  }
+
+  if ((unsigned int)ev >= event_transitions.size())
+    event_transitions.resize(ev + 1, any_transitions);
+  event_transitions[ev].push_back(idx);
+}
+
+const vector<unsigned int>& State::getTransitions(DSMCondition::EventType event) const {
+  if ((unsigned int)event < event_transitions.size())
+    return event_transitions[event];
+  return any_transitions;
+}
+
 DSMTransition::DSMTransition()
   : is_exception(false)
 {
@@ -45,6 +45,7 @@ using std::string;
 using std::pair;
 
 #include "log.h"
+#include "atomic_types.h"
 
 class DSMElement {
  public: 
@@ -133,9 +134,13 @@ class DSMCondition
 
   bool invert; 
   
-  DSMCondition() : invert(false) { }
+  DSMCondition() : invert(false), type(Any) { }
   virtual ~DSMCondition() { }
 
+  /**
+   * Event type the condition applies to. If not Any, match() must
+   * fail for all other events: transitions are indexed by it.
+   */
   EventType type;
   map<string, string> params;
 
@@ -177,6 +182,11 @@ class DSMTransition;
 
 class State
 : public DSMElement {
+  /* indexes of the transitions which may match an event, per event
+     type, in the order of the chart; any_transitions for other types */
+  vector<vector<unsigned int> > event_transitions;
+  vector<unsigned int> any_transitions;
+
  public:
   State();
   ~State();
@@ -184,6 +194,11 @@ class State
   vector<DSMElement*> post_actions;
   
   vector<DSMTransition> transitions;
+
+  void addTransition(const DSMTransition& trans);
+
+  /** @return indexes into transitions which may match event */
+  const vector<unsigned int>& getTransitions(DSMCondition::EventType event) const;
 };
 
 class DSMTransition
@@ -245,6 +260,11 @@ class DSMStateDiagram  {
   bool checkDestinationStates(string& report);
   bool checkHangupHandled(string& report);
 
+  /* profiling: events run, transitions and conditions checked */
+  atomic_int64 cnt_events;
+  atomic_int64 cnt_transitions;
+  atomic_int64 cnt_conditions;
+
  public:
   DSMStateDiagram(const string& name);
   ~DSMStateDiagram();
@@ -256,6 +276,9 @@ class DSMStateDiagram  {
   bool addTransition(const DSMTransition& trans);
   const string& getName() { return name; }
   bool checkConsistency(string& report);
+
+  void countEvent(unsigned int transitions, unsigned int conditions);
+  void getStats(AmArg& ret);
 };
 
 class DSMException {
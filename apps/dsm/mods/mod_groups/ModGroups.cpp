@@ -171,7 +171,7 @@ EXEC_ACTION_START(GroupsPostEventAction) {
 
   if (!var.empty()) {
     if (var == "var")
-      ev_params = sc_sess->var;
+      ev_params = sc_sess->var.getMap();
     else {
       vector<string> vars = explode(var, ";");
       for (vector<string>::iterator it =
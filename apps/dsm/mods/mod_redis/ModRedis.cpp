@@ -285,7 +285,7 @@ EXEC_ACTION_START(DSMRedisDisconnectAction) {
   sc_sess->CLR_ERRNO;
 } EXEC_ACTION_END;
 
-void decodeRedisResult(VarMapT& dst, const string& varname, redisReply* reply) {
+void decodeRedisResult(DSMVarMap& dst, const string& varname, redisReply* reply) {
   if (!reply)
     return;
   switch (reply->type) {
@@ -78,56 +78,119 @@ void SIPRegistrarClient::run() {
   }
 
   while (!stop_requested.get()) {
-    if (registrations.size()) {
-      unsigned int cnt = 250;
-      while (cnt > 0) {
-	usleep(2000); // every 2 ms
-	processEvents();
-	cnt--;
-      }
-      checkTimeouts();
-    } else {
-      waitForEvent();
-      processEvents();
-    }
+    waitForEvent();
+    processEvents();
   }
 }
 
-void SIPRegistrarClient::checkTimeouts() {
-  //	DBG("checking timeouts...\n");
-  struct timeval now;
-  gettimeofday(&now, NULL);
-  reg_mut.lock();
-  vector<string> remove_regs;
-
-  for (map<string, AmSIPRegistration*>::iterator it = registrations.begin();
-       it != registrations.end(); it++) {
-    if (it->second->active) {
-      if (it->second->registerExpired(now.tv_sec)) {
-	AmSIPRegistration* reg = it->second;
-	reg->onRegisterExpired();
-      } else if (!it->second->waiting_result && 
-		 it->second->timeToReregister(now.tv_sec)) {
-	it->second->doRegistration();
-      } 
-    } else if (it->second->remove) {
-      remove_regs.push_back(it->first);
-    } else if (it->second->waiting_result && 
-	       it->second->registerSendTimeout(now.tv_sec)) {
-      AmSIPRegistration* reg = it->second;
-      reg->onRegisterSendTimeout();
+void SIPRegistrationTimer::fire()
+{
+  SIPRegistrarClient::instance()->
+    postEvent(new SIPRegistrationTimerEvent(handle));
+}
+
+void SIPRegistrarClient::checkRegistration(const string& reg_id,
+					   AmSIPRegistration* reg)
+{
+  time_t now = time(NULL);
+
+  SIPRegistrationTimer* t = NULL;
+  std::map<std::string, SIPRegistrationTimer*>::iterator t_it =
+    reg_timers.find(reg_id);
+  if (t_it != reg_timers.end())
+    t = t_it->second;
+
+  if (reg->active) {
+    if (reg->registerExpired(now)) {
+      reg->onRegisterExpired();
+    } else if (!reg->waiting_result && t && t->refresh_ts &&
+	       (t->expires_ts == reg->getExpiresTS()) &&
+	       (now >= t->refresh_ts)) {
+      reg->doRegistration();
     }
+  } else if (!reg->remove && reg->waiting_result &&
+	     reg->registerSendTimeout(now)) {
+    reg->onRegisterSendTimeout();
   }
-  for (vector<string>::iterator it = remove_regs.begin(); 
-       it != remove_regs.end(); it++) {
+
+  if (!reg->active && reg->remove) {
     DBG("removing registration\n");
-    AmSIPRegistration* reg = registrations[*it];
-    registrations.erase(*it);
-    if (reg)
+    removeRegistrationTimer(reg_id);
+    if (remove_reg(reg_id) == reg)
       delete reg;
+    return;
   }
 
-  reg_mut.unlock();
+  if (!t) {
+    t = new SIPRegistrationTimer(reg_id);
+    reg_timers[reg_id] = t;
+  }
+  setRegistrationTimer(reg, t, now);
+}
+
+void SIPRegistrarClient::setRegistrationTimer(AmSIPRegistration* reg,
+					      SIPRegistrationTimer* t,
+					      time_t now)
+{
+  time_t next = 0;
+
+  if (reg->active) {
+    time_t expires_ts = reg->getExpiresTS();
+    if (t->expires_ts != expires_ts) {
+      // new registration period: refresh somewhat before half of it,
+      // so that the refreshes of many registrations do not line up
+      unsigned int half = reg->getExpiresLeft() / 2;
+      t->expires_ts = expires_ts;
+      t->refresh_ts = now + half -
+	half * (get_random() % (REGISTRATION_REFRESH_JITTER + 1)) / 100;
+    }
+
+    next = expires_ts;
+    if (!reg->waiting_result && (t->refresh_ts < next))
+      next = t->refresh_ts;
+  } else if (reg->waiting_result) {
+    next = reg->getSendTimeoutTS();
+  }
+
+  if (!next) {
+    if (t->due) {
+      AmAppTimer::instance()->removeTimer(t);
+      t->due = 0;
+    }
+    return;
+  }
+
+  if (next == t->due)
+    return;
+
+  // registerExpired() and registerSendTimeout() are true after the second
+  t->due = next;
+  AmAppTimer::instance()->setTimer(t, next < now ? 0.0 : (double)(next - now + 1));
+}
+
+void SIPRegistrarClient::removeRegistrationTimer(const string& reg_id)
+{
+  std::map<std::string, SIPRegistrationTimer*>::iterator it =
+    reg_timers.find(reg_id);
+  if (it == reg_timers.end())
+    return;
+
+  // not firing anymore once removed
+  AmAppTimer::instance()->removeTimer(it->second);
+  delete it->second;
+  reg_timers.erase(it);
+}
+
+void SIPRegistrarClient::onRegistrationTimer(const string& reg_id)
+{
+  std::map<std::string, SIPRegistrationTimer*>::iterator it =
+    reg_timers.find(reg_id);
+  if (it != reg_timers.end())
+    it->second->due = 0;
+
+  AmSIPRegistration* reg = get_reg(reg_id);
+  if (reg != NULL)
+    checkRegistration(reg_id, reg);
 }
 
 int SIPRegistrarClient::onLoad() {
@@ -144,6 +207,9 @@ void SIPRegistrarClient::onServerShutdown() {
     AmEventDispatcher::instance()->delEventQueue(it->first);
   }
 
+  while (!reg_timers.empty())
+    removeRegistrationTimer(reg_timers.begin()->first);
+
   stop_requested.set(true);
 //   
 //   setStopped();
@@ -181,6 +247,12 @@ void SIPRegistrarClient::process(AmEvent* ev)
     return;
   }
 
+  SIPRegistrationTimerEvent* reg_timer = dynamic_cast<SIPRegistrationTimerEvent*>(ev);
+  if (reg_timer) {
+    onRegistrationTimer(reg_timer->handle);
+    return;
+  }
+
 
 }
 
@@ -188,6 +260,7 @@ void SIPRegistrarClient::onSipReplyEvent(AmSipReplyEvent* ev) {
   AmSIPRegistration* reg = get_reg(ev->reply.from_tag);
   if (reg != NULL) {
     reg->getDlg()->onRxReply(ev->reply);
+    checkRegistration(ev->reply.from_tag, reg);
   }
 }
 
@@ -222,12 +295,15 @@ void SIPRegistrarClient::onNewRegistration(SIPNewRegistrationEvent* new_reg) {
   
   add_reg(new_reg->handle, reg);
   reg->doRegistration();
+  checkRegistration(new_reg->handle, reg);
 }
 
 void SIPRegistrarClient::onRemoveRegistration(SIPRemoveRegistrationEvent* new_reg) {
   AmSIPRegistration* reg = get_reg(new_reg->handle);
-  if (reg)
+  if (reg) {
     reg->doUnregister();
+    checkRegistration(new_reg->handle, reg);
+  }
 }
 
 
@@ -30,6 +30,7 @@
 
 #include "AmSipRegistration.h"
 #include "AmApi.h"
+#include "AmAppTimer.h"
 
 #include <sys/time.h>
 
@@ -41,6 +42,33 @@ using std::string;
 struct SIPNewRegistrationEvent;
 class SIPRemoveRegistrationEvent;
 
+/** refreshes are spread over the last x% before half of the expires time */
+#define REGISTRATION_REFRESH_JITTER 20
+
+/**
+ * Timer of one registration, set to its next refresh, expiry or
+ * request timeout. Fires in the timer thread and only posts an
+ * event to the registrar client.
+ */
+class SIPRegistrationTimer
+  : public DirectAppTimer
+{
+ public:
+  string handle;
+
+  /** expiry the refresh time has been computed for */
+  time_t expires_ts;
+  /** (jittered) time of the next refresh */
+  time_t refresh_ts;
+  /** time the timer is set to, 0 if not set */
+  time_t due;
+
+  SIPRegistrationTimer(const string& handle)
+    : handle(handle), expires_ts(0), refresh_ts(0), due(0) { }
+
+  void fire();
+};
+
 class SIPRegistrarClient  : public AmThread,
 			    public AmEventQueue,
 			    public AmEventHandler,
@@ -58,9 +86,20 @@ class SIPRegistrarClient  : public AmThread,
   AmSIPRegistration* get_reg(const string& reg_id);
   AmSIPRegistration* get_reg_unsafe(const string& reg_id);
 
+  // timers of the registrations (used by the client thread only)
+  std::map<std::string, SIPRegistrationTimer*> reg_timers;
+
+  /** handles timeouts of the registration, removes it if finished
+      and sets its timer to the next check */
+  void checkRegistration(const string& reg_id, AmSIPRegistration* reg);
+  void setRegistrationTimer(AmSIPRegistration* reg, SIPRegistrationTimer* t,
+			    time_t now);
+  void removeRegistrationTimer(const string& reg_id);
+
   void onSipReplyEvent(AmSipReplyEvent* ev);	
   void onNewRegistration(SIPNewRegistrationEvent* new_reg);
   void onRemoveRegistration(SIPRemoveRegistrationEvent* new_reg);
+  void onRegistrationTimer(const string& reg_id);
   void listRegistrations(AmArg& res);
 
   static SIPRegistrarClient* _instance;
@@ -68,7 +107,6 @@ class SIPRegistrarClient  : public AmThread,
   AmDynInvoke* uac_auth_i;
 
   AmSharedVar<bool> stop_requested;
-  void checkTimeouts();
   void onServerShutdown();
  public:
   SIPRegistrarClient(const string& name);
@@ -106,7 +144,8 @@ class SIPRegistrarClient  : public AmThread,
 
   enum {
     AddRegistration,
-    RemoveRegistration
+    RemoveRegistration,
+    RegistrationTimer
   } RegEvents;
 
 };
@@ -133,4 +172,12 @@ class SIPRemoveRegistrationEvent : public AmEvent {
     AmEvent(SIPRegistrarClient::RemoveRegistration) { }
 };
 
+class SIPRegistrationTimerEvent : public AmEvent {
+ public:
+  string handle;
+  SIPRegistrationTimerEvent(const string& handle)
+    : handle(handle),
+    AmEvent(SIPRegistrarClient::RegistrationTimer) { }
+};
+
 #endif
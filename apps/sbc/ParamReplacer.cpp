@@ -35,9 +35,8 @@
 #include <algorithm>
 #include <stdlib.h>
 
-int replaceParsedParam(const string& s, size_t p,
-			const AmUriParser& parsed, string& res) {
-  int skip_chars=1;
+static void replaceParsedParam(const string& s, size_t p,
+			       const AmUriParser& parsed, string& res) {
   switch (s[p+1]) {
   case 'u': { // URI
     res+=parsed.uri_user+"@"+parsed.uri_host;
@@ -64,7 +63,6 @@ int replaceParsedParam(const string& s, size_t p,
       string param_name = s.substr(p+3,skip_p-p-3);
       if(param_name.empty()) {
 	res+=parsed.uri_param;
-	skip_chars = skip_p-p;
 	break;
       }
       
@@ -89,7 +87,6 @@ int replaceParsedParam(const string& s, size_t p,
       }
       free_gen_params(&params);
       res+=param;
-      skip_chars = skip_p-p;
     }
     else {
       res+=parsed.uri_param; 
@@ -105,673 +102,947 @@ int replaceParsedParam(const string& s, size_t p,
   default: WARN("unknown replace pattern $%c%c\n",
 		s[p], s[p+1]); break;
   };
-
-  return skip_chars;
 }
 
 /* Returns a url-decoded version of str */
 /* IMPORTANT: be sure to free() the returned string after use */
 char *url_encode(const char *str);
 
-string replaceParameters(const string& s,
-			 const char* r_type,
-			 const AmSipRequest& req,
-			 const SBCCallProfile* call_profile,
-			 const string& app_param,
-			 AmUriParser& ruri_parser, 
-			 AmUriParser& from_parser,
-			 AmUriParser& to_parser,
-			 bool rebuild_ruri,
-			 bool rebuild_from,
-			 bool rebuild_to) {
-  string res;
-  bool is_replaced = false;
-  size_t p = 0;
-  bool is_escaped = false;
-  const string& used_hdrs = req.hdrs; //(hdrs == NULL) ? req.hdrs : *hdrs;
+static inline char char_at(const string& s, size_t p) {
+  return p < s.length() ? s[p] : '\0';
+}
 
-  // char last_char=' ';
-  
-  while (p<s.length()) {
-    size_t skip_chars = 1;
+/** position of the ')' closing a parameter started at p, or npos */
+static size_t closing_bracket(const string& s, size_t p) {
+  for (;p<s.length() && s[p] != ')';p++) { }
+  return p < s.length() ? p : string::npos;
+}
 
-    if (is_escaped) {
-      switch (s[p]) {
-      case 'r': res += '\r'; break;
-      case 'n': res += '\n'; break;
-      case 't': res += '\t'; break;
-      default: res += s[p]; break;
+/** $xP(name) in replaceParsedParam() (p: position of x) */
+static size_t parsedParamEnd(const string& s, size_t p) {
+  if((char_at(s,p+1) == 'P') && (s.length() > p+3) && (s[p+2] == '(')) {
+    size_t skip_p = closing_bracket(s, p+3);
+    if (skip_p != string::npos)
+      return skip_p;
+  }
+  return p+1;
+}
+
+/** $x(...) which may contain nested brackets (p: position of '(') */
+static size_t nestedBracketsEnd(const string& s, size_t p) {
+  size_t skip_p = skip_to_end_of_brackets(s, p);
+  // unclosed brackets consume the rest of the string
+  return skip_p < s.length() ? skip_p : s.length()-1;
+}
+
+/**
+ * End (last character) of the replacement pattern
+ * starting with the pattern character at p.
+ */
+static size_t expressionEnd(const string& s, size_t p) {
+  switch (char_at(s,p)) {
+  case 'f':
+  case 't':
+  case 'r':
+    if ((char_at(s,p+1) == '.') || (char_at(s,p+1) == 't'))
+      return p+1;
+    return parsedParamEnd(s, p);
+
+  case 'a':
+  case 'p':
+    if ((char_at(s,p+1) == '.') || (char_at(s,p+1) == 'i'))
+      return p+1;
+    return parsedParamEnd(s, p);
+
+  case 'P':
+  case 'V': {
+    if ((char_at(s,p+1) != '(') || (s.length()<p+3))
+      return p+1;
+    size_t skip_p = closing_bracket(s, p+2);
+    return skip_p != string::npos ? skip_p : p+1;
+  }
+
+  case 'H': {
+    size_t name_offset = 2;
+    if (char_at(s,p+1) != '(') {
+      if ((char_at(s,p+2) != '(') || (s[p+1] == '.'))
+	return p+1;
+      name_offset = 3;
+    }
+    size_t skip_p = closing_bracket(s, p+name_offset);
+    return skip_p != string::npos ? skip_p : p+1;
+  }
+
+  case 'M':
+  case '#':
+    if ((char_at(s,p+1) != '(') || (s.length()<p+3))
+      return p+1;
+    return nestedBracketsEnd(s, p+2);
+
+  case '_':
+    if ((s.length()<p+4) || (s[p+2] != '('))
+      return p+1;
+    return nestedBracketsEnd(s, p+3);
+
+  default:
+    return p+1;
+  }
+}
+
+/** $V(name): call variable */
+static void replaceVariable(ParamReplacerCtx& ctx, string var_name,
+			    const AmSipRequest& req, string& res) {
+  const SBCCallProfile* call_profile = ctx.call_profile;
+  if (!call_profile) {
+    WARN("no call_profile object when replacing variable '%s'\n", var_name.c_str());
+    return;
+  }
+
+  const AmArg* val = NULL;
+  size_t dotpos = var_name.find('.');
+  string vn;
+  if (dotpos != string::npos) {
+    vn = var_name.substr(dotpos+1);
+    var_name = var_name.substr(0, dotpos);
+  }
+  SBCVarMapConstIteratorT it = call_profile->cc_vars.find(var_name);
+  if (it != call_profile->cc_vars.end()) {
+    if (vn.empty()) {
+      val = &it->second;
+    } else {
+      if (isArgStruct(it->second)) {
+	// recursive replacement for call variable name (defined via GUI)
+	if (vn.find('$') != string::npos)
+	  vn = ctx.replaceParameters(vn, "CallVar Subname", req);
+	val = &it->second[vn];
+      } else {
+	DBG("CC variable '%s' has wrong type: '%s'\n",
+	    vn.c_str(), AmArg::print(it->second).c_str());
       }
-      is_escaped = false;
-    } else { // not escaped
-      if (s[p]=='\\') {
-	if (p==s.length()-1) {
-	  res += '\\'; // add single \ at the end
-	} else {
-	  is_escaped = true;
-	  is_replaced = true;
-	}
-      } else if ((s[p]=='$') && (s.length() >= p+1)) {
-	is_replaced = true;
-	p++;
-	switch (s[p]) {
-	case 'f': { // from
-	  if ((s.length() == p+1) || (s[p+1] == '.')) {
-	    if (rebuild_from) {
-	      res += from_parser.nameaddr_str();
-	    } else {
-	      res += req.from;
-	    }
+    }
+    if (val != NULL) {
+      if (val->getType() == AmArg::CStr)
+	res += val->asCStr();
+      else
+	res += AmArg::print(*val);
+    }
+  } else {
+    DBG("CC variable '%s' does not exist\n", var_name.c_str());
+  }
+}
 
-	    break;
-	  }
+/** $Hx(name): component x of the header's URI (p: position of H) */
+static void replaceHeaderUri(const string& s, size_t p, const string& hdr_name,
+			     const string& hdrs, string& res) {
+  // parse URI and use component
+  AmUriParser uri_parser;
+  uri_parser.uri = getHeader(hdrs, hdr_name);
+  if ((s[p+1] == '.')) {
+    res += uri_parser.uri;
+    return;
+  }
 
-	  if (s[p+1]=='t') { // $ft - from tag
-	    res += req.from_tag;
-	    break;
-	  }
+  if (!uri_parser.parse_uri()) {
+    WARN("Error parsing header %s URI '%s'\n",
+	 hdr_name.c_str(), uri_parser.uri.c_str());
+    return;
+  }
+  replaceParsedParam(s, p, uri_parser, res);
+}
 
-	  if (from_parser.uri.empty()) {
-	    from_parser.uri = req.from;
-	    if (!from_parser.parse_uri()) {
-	      WARN("Error parsing From URI '%s'\n", req.from.c_str());
-	      break;
-	    }
-	  }
+/** $M(value=>mapping) */
+static void replaceRegexMap(const string& map_val, const string& map_val_replaced,
+			    const string& mapping_name, string& res) {
+  string map_res; 
+  if (SBCFactory::instance()->regex_mappings.
+      mapRegex(mapping_name, map_val_replaced.c_str(), map_res)) {
+    DBG("matched regex mapping '%s' (orig '%s) in '%s'\n",
+	map_val_replaced.c_str(), map_val.c_str(), mapping_name.c_str());
+    res+=map_res;
+  } else {
+    DBG("no match in regex mapping '%s' (orig '%s') in '%s'\n",
+	map_val_replaced.c_str(), map_val.c_str(), mapping_name.c_str());
+  }
+}
 
-	  skip_chars=replaceParsedParam(s, p, from_parser, res);
+/** $_x(br_str) string modifier, br_str already replaced */
+static void applyModifier(char operation, const string& br_str, string& res) {
+  string br_str_replaced = br_str;
+  switch(operation) {
+  case 'u': // uppercase
+    transform(br_str_replaced.begin(), br_str_replaced.end(),
+	      br_str_replaced.begin(), ::toupper); break;
+  case 'l': // lowercase
+    transform(br_str_replaced.begin(), br_str_replaced.end(),
+	      br_str_replaced.begin(), ::tolower); break;
+
+  case 's': // size (string length)
+    br_str_replaced = int2str((unsigned int)br_str.length());
+    break;
+
+  case '5': // md5
+    br_str_replaced = calculateMD5(br_str);
+    break;
+
+  case 't': // extract 'transport' (last 3 characters)
+    if (br_str.length() >= 4) {
+      br_str_replaced = br_str.substr(br_str.length()-3);
+    }
+    break;
+
+  case 'r': // random
+    {
+      int r_max;
+      if (!str2int(br_str, r_max)){
+	WARN("Error parsing $_r(%s) for random value, returning 0\n", br_str.c_str());
+	br_str_replaced = "0";
+      } else {
+	br_str_replaced = int2str(rand()%r_max);
+      }
+    }
+    break;
 
-	}; break;
+  default:
+    WARN("Error parsing $_%c string modifier: unknown operator '%c'\n",
+	 operation, operation);
+    break;
+  }
+  DBG("applied operator '%c': '%s' => '%s'\n", operation,
+      br_str.c_str(), br_str_replaced.c_str());
+  res+=br_str_replaced;
+}
 
-	case 't': { // to
-	  if ((s.length() == p+1) || (s[p+1] == '.')) {
-	    if (rebuild_to) {
-	      res += to_parser.nameaddr_str();
-	    } else {
-	      res += req.to;
-	    }
-	    break;
-	  }
+/** $#(s): URL encoding */
+static void appendUrlEncoded(const string& s, string& res) {
+  char* val_escaped = url_encode(s.c_str());
+  res += string(val_escaped);
+  free(val_escaped);
+}
 
-	  if (s[p+1]=='t') { // $tt - to tag
-	    res += req.to_tag;
-	    break;
-	  }
+/**
+ * Replaces the pattern starting with the pattern
+ * character at p (the character after '$').
+ */
+static void replaceExpression(const string& s, size_t p,
+			      const char* r_type,
+			      const AmSipRequest& req,
+			      ParamReplacerCtx& ctx,
+			      string& res) {
+
+  const SBCCallProfile* call_profile = ctx.call_profile;
+  const string& app_param = ctx.app_param;
+  AmUriParser& ruri_parser = ctx.ruri_parser;
+  AmUriParser& from_parser = ctx.from_parser;
+  AmUriParser& to_parser = ctx.to_parser;
+  bool rebuild_ruri = ctx.ruri_modified;
+  bool rebuild_from = ctx.from_modified;
+  bool rebuild_to = ctx.to_modified;
+  const string& used_hdrs = req.hdrs;
+
+  switch (s[p]) {
+  case 'f': { // from
+    if ((s.length() == p+1) || (s[p+1] == '.')) {
+      if (rebuild_from) {
+	res += from_parser.nameaddr_str();
+      } else {
+	res += req.from;
+      }
 
-	  if (to_parser.uri.empty()) {
-	    to_parser.uri = req.to;
-	    if (!to_parser.parse_uri()) {
-	      WARN("Error parsing To URI '%s'\n", req.to.c_str());
-	      break;
-	    }
-	  }
+      break;
+    }
 
-	  skip_chars=replaceParsedParam(s, p, to_parser, res);
+    if (s[p+1]=='t') { // $ft - from tag
+      res += req.from_tag;
+      break;
+    }
 
-	}; break;
+    if (from_parser.uri.empty()) {
+      from_parser.uri = req.from;
+      if (!from_parser.parse_uri()) {
+	WARN("Error parsing From URI '%s'\n", req.from.c_str());
+	break;
+      }
+    }
 
-	case 'r': { // r-uri
-	  if ((s.length() == p+1) || (s[p+1] == '.')) {
-	    if (rebuild_ruri) {
-	      res += ruri_parser.uri_str();
-	    } else {
-	      res += req.r_uri;
-	    }
-	    break;
-	  }
+    replaceParsedParam(s, p, from_parser, res);
 
-	  if (ruri_parser.uri.empty()) {
-	    ruri_parser.uri = req.r_uri;
-	    if (!ruri_parser.parse_uri()) {
-	      WARN("Error parsing R-URI '%s'\n", req.r_uri.c_str());
-	      break;
-	    }
-	  }
-	  skip_chars=replaceParsedParam(s, p, ruri_parser, res);
-	}; break;
+  }; break;
 
-	case 'c': { // call-id
-	  if ((s.length() == p+1) || (s[p+1] == 'i')) {
-	    res += req.callid;
-	    break;
-	  }
-	  WARN("unknown replacement $c%c\n", s[p+1]);
-	}; break;
+  case 't': { // to
+    if ((s.length() == p+1) || (s[p+1] == '.')) {
+      if (rebuild_to) {
+	res += to_parser.nameaddr_str();
+      } else {
+	res += req.to;
+      }
+      break;
+    }
 
-	case 's': { // source (remote)
-	  if (s.length() < p+1) {
-	    WARN("unknown replacement $s\n");
-	    break;
-	  }
+    if (s[p+1]=='t') { // $tt - to tag
+      res += req.to_tag;
+      break;
+    }
 
-	  if (s[p+1] == 'i') { // $si source IP address
-	    res += req.remote_ip;
-	    break;
-	  } else if (s[p+1] == 'p') { // $sp source port
-	    res += int2str(req.remote_port);
-	    break;
-	  }
+    if (to_parser.uri.empty()) {
+      to_parser.uri = req.to;
+      if (!to_parser.parse_uri()) {
+	WARN("Error parsing To URI '%s'\n", req.to.c_str());
+	break;
+      }
+    }
 
-	  WARN("unknown replacement $s%c\n", s[p+1]);
-	}; break;
+    replaceParsedParam(s, p, to_parser, res);
 
-	case 'd': { // destination (remote UAS)
-	  if (s.length() < p+1) {
-	    WARN("unknown replacement $s\n");
-	    break;
-	  }
+  }; break;
 
-	  if(!call_profile->next_hop.empty()) {
-	    cstring _next_hop = stl2cstr(call_profile->next_hop);
-	    list<sip_destination> dest_list;
-	    if(parse_next_hop(_next_hop,dest_list)) {
-	      WARN("parse_next_hop %.*s failed\n",
-		   _next_hop.len, _next_hop.s);
-	      break;
-	    }
+  case 'r': { // r-uri
+    if ((s.length() == p+1) || (s[p+1] == '.')) {
+      if (rebuild_ruri) {
+	res += ruri_parser.uri_str();
+      } else {
+	res += req.r_uri;
+      }
+      break;
+    }
 
-	    if(dest_list.size() == 0) {
-	      WARN("next-hop is not empty, but the resulting destination list is\n");
-	      break;
-	    }
+    if (ruri_parser.uri.empty()) {
+      ruri_parser.uri = req.r_uri;
+      if (!ruri_parser.parse_uri()) {
+	WARN("Error parsing R-URI '%s'\n", req.r_uri.c_str());
+	break;
+      }
+    }
+    replaceParsedParam(s, p, ruri_parser, res);
+  }; break;
 
-	    const sip_destination& dest = dest_list.front();
-	    if (s[p+1] == 'i') { // $di remote UAS IP address
-	      res += c2stlstr(dest.host);
-	      break;
-	    } else if (s[p+1] == 'p') { // $dp remote UAS port
-	      res += int2str(dest.port);
-	      break;
-	    }
-	    WARN("unknown replacement $d%c\n", s[p+1]);
-	    break;
-	  }
+  case 'c': { // call-id
+    if ((s.length() == p+1) || (s[p+1] == 'i')) {
+      res += req.callid;
+      break;
+    }
+    WARN("unknown replacement $c%c\n", s[p+1]);
+  }; break;
 
-	  if (ruri_parser.uri.empty()) {
-	    ruri_parser.uri = req.r_uri;
-	    if (!ruri_parser.parse_uri()) {
-	      WARN("Error parsing R-URI '%s'\n", req.r_uri.c_str());
-	      break;
-	    }
-	  }
+  case 's': { // source (remote)
+    if (s.length() < p+1) {
+      WARN("unknown replacement $s\n");
+      break;
+    }
 
-	  if (s[p+1] == 'i') { // $di remote UAS IP address
-	    res += ruri_parser.uri_host;
-	    break;
-	  } else if (s[p+1] == 'p') { // $dp remote UAS port
-	    res += ruri_parser.uri_port;
-	    break;
-	  }
+    if (s[p+1] == 'i') { // $si source IP address
+      res += req.remote_ip;
+      break;
+    } else if (s[p+1] == 'p') { // $sp source port
+      res += int2str(req.remote_port);
+      break;
+    }
 
-	  WARN("unknown replacement $d%c\n", s[p+1]);
-	}; break;
+    WARN("unknown replacement $s%c\n", s[p+1]);
+  }; break;
 
-	case 'R': { // received (local)
-	  if (s.length() < p+1) {
-	    WARN("unknown replacement $R\n");
-	    break;
-	  }
+  case 'd': { // destination (remote UAS)
+    if (s.length() < p+1) {
+      WARN("unknown replacement $s\n");
+      break;
+    }
 
-	  if (s[p+1] == 'i') { // $Ri received IP address
-	    res += req.local_ip.c_str();
-	    break;
-	  } else if (s[p+1] == 'p') { // $Rp received port
-	    res += int2str(req.local_port);
-	    break;
-	  } else if (s[p+1] == 'f') { // $Rf received interface id
-	    res += int2str(req.local_if);
-	    break;
-	  } else if (s[p+1] == 'n') { // $Rn received interface name
-	    if (req.local_if < AmConfig::SIP_Ifs.size()) {
-	      res += AmConfig::SIP_Ifs[req.local_if].name;
-	    }
-	    break;
-	  } else if (s[p+1] == 'I') { // $RI received interface public IP
-	    if (req.local_if < AmConfig::SIP_Ifs.size()) {
-	      res += AmConfig::SIP_Ifs[req.local_if].PublicIP;
-	    }
-	    break;
-	  }
-	  WARN("unknown replacement $R%c\n", s[p+1]);
-	}; break;
+    if(!call_profile->next_hop.empty()) {
+      cstring _next_hop = stl2cstr(call_profile->next_hop);
+      list<sip_destination> dest_list;
+      if(parse_next_hop(_next_hop,dest_list)) {
+	WARN("parse_next_hop %.*s failed\n",
+	     _next_hop.len, _next_hop.s);
+	break;
+      }
 
-	case 'u': {// Reg-cached destination user
-	  if (s.length() < p+1) {
-	    WARN("unknown replacement $u\n");
-	    break;
-	  }
+      if(dest_list.size() == 0) {
+	WARN("next-hop is not empty, but the resulting destination list is\n");
+	break;
+      }
 
-	  // REG-Cache lookup
-	  AliasEntry alias_entry;
-	  const string& alias = req.user;
+      const sip_destination& dest = dest_list.front();
+      if (s[p+1] == 'i') { // $di remote UAS IP address
+	res += c2stlstr(dest.host);
+	break;
+      } else if (s[p+1] == 'p') { // $dp remote UAS port
+	res += int2str(dest.port);
+	break;
+      }
+      WARN("unknown replacement $d%c\n", s[p+1]);
+      break;
+    }
 
-	  if(!RegisterCache::instance()->findAliasEntry(alias, alias_entry)) {
-	    WARN("reg-cache: User '%s' not found",alias.c_str());
-	    break;
-	  }
-	  
-	  if(s[p+1] == 'c') {
-	    res += alias_entry.contact_uri;
-	    break;
-	  }
-	  else if(s[p+1] == 's') {
-	    res += alias_entry.source_ip;
-	    if(alias_entry.source_port != 5060)
-	      res += ":" + int2str(alias_entry.source_port);
-	    break;
-	  }
-	  else if(s[p+1] == 'i') {
-	    res += AmConfig::SIP_Ifs[alias_entry.local_if].name;
-	    break;
-	  }
-	  
-	  WARN("unknown replacement $u%c\n", s[p+1]);
-	} break;
-
-	case 'U': { // Reg-cached originating user
-	  if (s.length() < p+1) {
-	    WARN("unknown replacement $U\n");
-	    break;
-	  }
-	  if (s[p+1] == 'a') { // $Ua originating AoR
-	    AliasEntry ae;
-	    RegisterCache* reg_cache = RegisterCache::instance();
-	    if(reg_cache->findAEByContact(req.from_uri,req.remote_ip,
-					   req.remote_port,ae)) {
-	      res += ae.aor;
-	    }
-	    break;
-	  }
-	  else if(s[p+1] == 'A') { // $UA originating alias
-	    AliasEntry ae;
-	    RegisterCache* reg_cache = RegisterCache::instance();
-
-	    string aor;
-	    if (from_parser.uri.empty())
-	      aor = req.from;
-	    else if(!rebuild_from)
-	      aor = from_parser.uri;
-	    else
-	      aor = from_parser.uri_str();
-
-	    aor = RegisterCache::canonicalize_aor(from_parser.uri_str());
-
-	    map<string,string> alias_map;
-	    if(reg_cache->getAorAliasMap(aor, alias_map) && !alias_map.empty()) {
-
-	      bool is_registered = false;  
-	      for(map<string,string>::iterator it = alias_map.begin();
-		  it != alias_map.end(); it++) {
-
-		AliasEntry alias_entry;
-		if(reg_cache->findAliasEntry(it->first,alias_entry)) {
-		  if((alias_entry.source_ip == req.remote_ip) &&
-		     (alias_entry.source_port == req.remote_port)) {
-		    DBG("matching entry for alias '%s' found (src=%s:%i)",
-			it->first.c_str(), 
-			alias_entry.source_ip.c_str(),
-			alias_entry.source_port);
-		    is_registered = true;
-		    res += it->first;
-		    break;
-		  }
-		  // else {
-		  //   DBG("alias '%s': source IP/port mismatch: %s:%i != %s:%i",
-		  // 	it->first.c_str(),
-		  // 	alias_entry.source_ip.c_str(),
-		  // 	alias_entry.source_port,
-		  // 	context.invite_req->remote_ip.c_str(),
-		  // 	context.invite_req->remote_port);
-		  // }
-		}
-	      }
-	      if(is_registered)
-		break;
-	    }
-	    DBG("AoR '%s' is not registered",aor.c_str());
-	    break;
-	  }
-	  WARN("unknown replacement $U%c\n", s[p+1]);
-	} break;
-
-#define case_HDR(pv_char, pv_name, hdr_name)				\
-	  case pv_char: {						\
-	    AmUriParser uri_parser;					\
-	    uri_parser.uri = getHeader(used_hdrs, hdr_name);		\
-	    if ((s.length() == p+1) || (s[p+1] == '.')) {		\
-	      res += uri_parser.uri;					\
-	      break;							\
-	    }								\
-									\
-	    if (!uri_parser.parse_uri()) {				\
-	      WARN("Error parsing " pv_name " URI '%s'\n", uri_parser.uri.c_str()); \
-	      break;							\
-	    }								\
-	    if (s[p+1] == 'i') {					\
-	      res+=uri_parser.uri_user+"@"+uri_parser.uri_host;		\
-	      if (!uri_parser.uri_port.empty())				\
-		res+=":"+uri_parser.uri_port;				\
-	    } else {							\
-	      skip_chars=replaceParsedParam(s, p, uri_parser, res);	\
-	    }								\
-	  }; break;
-
-	  case_HDR('a', "PAI", SIP_HDR_P_ASSERTED_IDENTITY);  // P-Asserted-Identity
-	  case_HDR('p', "PPI", SIP_HDR_P_PREFERRED_IDENTITY); // P-Preferred-Identity
-
-	case 'P': { // app-params
-	  if (s[p+1] != '(') {
-	    WARN("Error parsing P param replacement (missing '(')\n");
-	    break;
-	  }
-	  if (s.length()<p+3) {
-	    WARN("Error parsing P param replacement (short string)\n");
-	    break;
-	  }
+    if (ruri_parser.uri.empty()) {
+      ruri_parser.uri = req.r_uri;
+      if (!ruri_parser.parse_uri()) {
+	WARN("Error parsing R-URI '%s'\n", req.r_uri.c_str());
+	break;
+      }
+    }
 
-	  size_t skip_p = p+2;
-	  for (;skip_p<s.length() && s[skip_p] != ')';skip_p++) { }
-	  if (skip_p==s.length()) {
-	    WARN("Error parsing P param replacement (unclosed brackets)\n");
-	    break;
-	  }
-	  string param_name = s.substr(p+2, skip_p-p-2);
-	  // DBG("param_name = '%s' (skip-p - p = %d)\n", param_name.c_str(), skip_p-p);
-	  res += get_header_keyvalue(app_param, param_name);
-	  skip_chars = skip_p-p;
-	} break;
-
-	case 'V': { // variable
-	  if (s[p+1] != '(') {
-	    WARN("Error parsing V variable replacement (missing '(')\n");
-	    break;
-	  }
-	  if (s.length()<p+3) {
-	    WARN("Error parsing V param replacement (short string)\n");
-	    break;
-	  }
+    if (s[p+1] == 'i') { // $di remote UAS IP address
+      res += ruri_parser.uri_host;
+      break;
+    } else if (s[p+1] == 'p') { // $dp remote UAS port
+      res += ruri_parser.uri_port;
+      break;
+    }
 
-	  size_t skip_p = p+2;
-	  for (;skip_p<s.length() && s[skip_p] != ')';skip_p++) { }
-	  if (skip_p==s.length()) {
-	    WARN("Error parsing V param replacement (unclosed brackets)\n");
-	    break;
-	  }
-	  string var_name = s.substr(p+2, skip_p-p-2);
-	  // DBG("param_name = '%s' (skip-p - p = %d)\n", param_name.c_str(), skip_p-p);
-	  if (!call_profile) {
-	    WARN("no call_profile object when replacing variable '%s'\n", var_name.c_str());
-	  } else {
-	    const AmArg* val = NULL;
-	    size_t dotpos = var_name.find('.');
-	    string vn;
-	    if (dotpos != string::npos) {
-	      vn = var_name.substr(dotpos+1);
-	      var_name = var_name.substr(0, dotpos);
-	    }
-	    SBCVarMapConstIteratorT it = call_profile->cc_vars.find(var_name);
-	    if (it != call_profile->cc_vars.end()) {
-	      if (vn.empty()) {
-		val = &it->second;
-	      } else {
-		if (isArgStruct(it->second)) {
-		  // recursive replacement for call variable name (defined via GUI)
-		  if (vn.find('$') != string::npos)
-		    vn = replaceParameters(vn, "CallVar Subname", req, 
-					   call_profile, app_param, 
-					   ruri_parser, from_parser, to_parser,
-					   rebuild_ruri, rebuild_from, rebuild_to);
-		  val = &it->second[vn];
-		} else {
-		  DBG("CC variable '%s' has wrong type: '%s'\n",
-		      vn.c_str(), AmArg::print(it->second).c_str());
-		}
-	      }
-	      if (val != NULL) {
-		if (val->getType() == AmArg::CStr)
-		  res += val->asCStr();
-		else
-		  res += AmArg::print(*val);
-	      }
-	    } else {
-	      DBG("CC variable '%s' does not exist\n", var_name.c_str());
-	    }
-	  }
+    WARN("unknown replacement $d%c\n", s[p+1]);
+  }; break;
 
-	  skip_chars = skip_p-p;
-	} break;
+  case 'R': { // received (local)
+    if (s.length() < p+1) {
+      WARN("unknown replacement $R\n");
+      break;
+    }
 
-	case 'H': { // header
-	  size_t name_offset = 2;
-	  if (s[p+1] != '(') {
-	    if (s[p+2] != '(') {
-	      WARN("Error parsing H header replacement (missing '(')\n");
-	      break;
-	    }
-	    name_offset = 3;
-	  }
-	  if (s.length()<name_offset+1) {
-	    WARN("Error parsing H header replacement (short string)\n");
-	    break;
-	  }
+    if (s[p+1] == 'i') { // $Ri received IP address
+      res += req.local_ip.c_str();
+      break;
+    } else if (s[p+1] == 'p') { // $Rp received port
+      res += int2str(req.local_port);
+      break;
+    } else if (s[p+1] == 'f') { // $Rf received interface id
+      res += int2str(req.local_if);
+      break;
+    } else if (s[p+1] == 'n') { // $Rn received interface name
+      if (req.local_if < AmConfig::SIP_Ifs.size()) {
+	res += AmConfig::SIP_Ifs[req.local_if].name;
+      }
+      break;
+    } else if (s[p+1] == 'I') { // $RI received interface public IP
+      if (req.local_if < AmConfig::SIP_Ifs.size()) {
+	res += AmConfig::SIP_Ifs[req.local_if].PublicIP;
+      }
+      break;
+    }
+    WARN("unknown replacement $R%c\n", s[p+1]);
+  }; break;
 
-	  size_t skip_p = p+name_offset;
-	  for (;skip_p<s.length() && s[skip_p] != ')';skip_p++) { }
-	  if (skip_p==s.length()) {
-	    WARN("Error parsing H header replacement (unclosed brackets)\n");
-	    break;
-	  }
-	  string hdr_name = s.substr(p+name_offset, skip_p-p-name_offset);
-	  // DBG("param_name = '%s' (skip-p - p = %d)\n", param_name.c_str(), skip_p-p);
-	  if (name_offset == 2) {
-	    // full header
-	    res += getHeader(used_hdrs, hdr_name);
-	  } else {
-	    // parse URI and use component
-	    AmUriParser uri_parser;
-	    uri_parser.uri = getHeader(used_hdrs, hdr_name);
-	    if ((s[p+1] == '.')) {
-	      res += uri_parser.uri;
-	      break;
-	    }
+  case 'u': {// Reg-cached destination user
+    if (s.length() < p+1) {
+      WARN("unknown replacement $u\n");
+      break;
+    }
+
+    // REG-Cache lookup
+    AliasEntry alias_entry;
+    const string& alias = req.user;
+
+    if(!RegisterCache::instance()->findAliasEntry(alias, alias_entry)) {
+      WARN("reg-cache: User '%s' not found",alias.c_str());
+      break;
+    }
+
+    if(s[p+1] == 'c') {
+      res += alias_entry.contact_uri;
+      break;
+    }
+    else if(s[p+1] == 's') {
+      res += alias_entry.source_ip;
+      if(alias_entry.source_port != 5060)
+	res += ":" + int2str(alias_entry.source_port);
+      break;
+    }
+    else if(s[p+1] == 'i') {
+      res += AmConfig::SIP_Ifs[alias_entry.local_if].name;
+      break;
+    }
+
+    WARN("unknown replacement $u%c\n", s[p+1]);
+  } break;
+
+  case 'U': { // Reg-cached originating user
+    if (s.length() < p+1) {
+      WARN("unknown replacement $U\n");
+      break;
+    }
+    if (s[p+1] == 'a') { // $Ua originating AoR
+      AliasEntry ae;
+      RegisterCache* reg_cache = RegisterCache::instance();
+      if(reg_cache->findAEByContact(req.from_uri,req.remote_ip,
+				     req.remote_port,ae)) {
+	res += ae.aor;
+      }
+      break;
+    }
+    else if(s[p+1] == 'A') { // $UA originating alias
+      AliasEntry ae;
+      RegisterCache* reg_cache = RegisterCache::instance();
+
+      string aor;
+      if (from_parser.uri.empty())
+	aor = req.from;
+      else if(!rebuild_from)
+	aor = from_parser.uri;
+      else
+	aor = from_parser.uri_str();
+
+      aor = RegisterCache::canonicalize_aor(from_parser.uri_str());
+
+      map<string,string> alias_map;
+      if(reg_cache->getAorAliasMap(aor, alias_map) && !alias_map.empty()) {
 
-	    if (!uri_parser.parse_uri()) {
-	      WARN("Error parsing header %s URI '%s'\n",
-		   hdr_name.c_str(), uri_parser.uri.c_str());
+	bool is_registered = false;  
+	for(map<string,string>::iterator it = alias_map.begin();
+	    it != alias_map.end(); it++) {
+
+	  AliasEntry alias_entry;
+	  if(reg_cache->findAliasEntry(it->first,alias_entry)) {
+	    if((alias_entry.source_ip == req.remote_ip) &&
+	       (alias_entry.source_port == req.remote_port)) {
+	      DBG("matching entry for alias '%s' found (src=%s:%i)",
+		  it->first.c_str(), 
+		  alias_entry.source_ip.c_str(),
+		  alias_entry.source_port);
+	      is_registered = true;
+	      res += it->first;
 	      break;
 	    }
-	    //TODO: find out how to correct skip_chars correctly
-	    replaceParsedParam(s, p, uri_parser, res);
+	    // else {
+	    //   DBG("alias '%s': source IP/port mismatch: %s:%i != %s:%i",
+	    //    it->first.c_str(),
+	    //    alias_entry.source_ip.c_str(),
+	    //    alias_entry.source_port,
+	    //    context.invite_req->remote_ip.c_str(),
+	    //    context.invite_req->remote_port);
+	    // }
 	  }
-	  skip_chars = skip_p-p;
-	} break;
+	}
+	if(is_registered)
+	  break;
+      }
+      DBG("AoR '%s' is not registered",aor.c_str());
+      break;
+    }
+    WARN("unknown replacement $U%c\n", s[p+1]);
+  } break;
 
-	case 'M': { // regex map
-	  if (s[p+1] != '(') {
-	    WARN("Error parsing $M regex map replacement (missing '(')\n");
-	    break;
-	  }
-	  if (s.length()<p+3) {
-	    WARN("Error parsing $M regex map replacement (short string)\n");
-	    break;
-	  }
+#define case_HDR(pv_char, pv_name, hdr_name)                            \
+    case pv_char: {                                               \
+      AmUriParser uri_parser;                                     \
+      uri_parser.uri = getHeader(used_hdrs, hdr_name);            \
+      if ((s.length() == p+1) || (s[p+1] == '.')) {               \
+	res += uri_parser.uri;                                    \
+	break;                                                    \
+      }                                                           \
+								  \
+      if (!uri_parser.parse_uri()) {                              \
+	WARN("Error parsing " pv_name " URI '%s'\n", uri_parser.uri.c_str()); \
+	break;                                                    \
+      }                                                           \
+      if (s[p+1] == 'i') {                                        \
+	res+=uri_parser.uri_user+"@"+uri_parser.uri_host;         \
+	if (!uri_parser.uri_port.empty())                         \
+	  res+=":"+uri_parser.uri_port;                           \
+      } else {                                                    \
+	replaceParsedParam(s, p, uri_parser, res);                \
+      }                                                           \
+    }; break;
+
+    case_HDR('a', "PAI", SIP_HDR_P_ASSERTED_IDENTITY);  // P-Asserted-Identity
+    case_HDR('p', "PPI", SIP_HDR_P_PREFERRED_IDENTITY); // P-Preferred-Identity
+
+  case 'P': { // app-params
+    if (s[p+1] != '(') {
+      WARN("Error parsing P param replacement (missing '(')\n");
+      break;
+    }
+    if (s.length()<p+3) {
+      WARN("Error parsing P param replacement (short string)\n");
+      break;
+    }
 
-	  size_t skip_p = p+2;
-	  skip_p = skip_to_end_of_brackets(s, skip_p);
+    size_t skip_p = p+2;
+    for (;skip_p<s.length() && s[skip_p] != ')';skip_p++) { }
+    if (skip_p==s.length()) {
+      WARN("Error parsing P param replacement (unclosed brackets)\n");
+      break;
+    }
+    string param_name = s.substr(p+2, skip_p-p-2);
+    // DBG("param_name = '%s' (skip-p - p = %d)\n", param_name.c_str(), skip_p-p);
+    res += get_header_keyvalue(app_param, param_name);
+  } break;
 
-	  if (skip_p==s.length()) {
-	    WARN("Error parsing $M regex map replacement (unclosed brackets)\n");
-	    skip_chars = skip_p-p;
-	    break;
-	  }
+  case 'V': { // variable
+    if (s[p+1] != '(') {
+      WARN("Error parsing V variable replacement (missing '(')\n");
+      break;
+    }
+    if (s.length()<p+3) {
+      WARN("Error parsing V param replacement (short string)\n");
+      break;
+    }
 
-	  string map_str = s.substr(p+2, skip_p-p-2);
-	  size_t spos = map_str.rfind("=>");
-	  if (spos == string::npos) {
-	    skip_chars = skip_p-p;
-	    WARN("Error parsing $M regex map replacement: no => found in '%s'\n",
-		 map_str.c_str());
-	    break;
-	  }
+    size_t skip_p = p+2;
+    for (;skip_p<s.length() && s[skip_p] != ')';skip_p++) { }
+    if (skip_p==s.length()) {
+      WARN("Error parsing V param replacement (unclosed brackets)\n");
+      break;
+    }
+    string var_name = s.substr(p+2, skip_p-p-2);
+    // DBG("param_name = '%s' (skip-p - p = %d)\n", param_name.c_str(), skip_p-p);
+    replaceVariable(ctx, var_name, req, res);
+  } break;
 
-	  string map_val = map_str.substr(0, spos);
-	  string map_val_replaced = 
-	    replaceParameters(map_val, r_type, req, 
-			      call_profile, app_param,
-			      ruri_parser, from_parser, to_parser,
-			      rebuild_ruri, rebuild_from, rebuild_to);
-
-	  string mapping_name = map_str.substr(spos+2);
-
-	  string map_res; 
-	  if (SBCFactory::instance()->regex_mappings.
-	      mapRegex(mapping_name, map_val_replaced.c_str(), map_res)) {
-	    DBG("matched regex mapping '%s' (orig '%s) in '%s'\n",
-		map_val_replaced.c_str(), map_val.c_str(), mapping_name.c_str());
-	    res+=map_res;
-	  } else {
-	    DBG("no match in regex mapping '%s' (orig '%s') in '%s'\n",
-		map_val_replaced.c_str(), map_val.c_str(), mapping_name.c_str());
-	  }
- 
-	  skip_chars = skip_p-p;
-	} break;
-
-	case '_': { // modify
-	  if (s.length()<p+4) { // $_O()
-	    WARN("Error parsing $_ modifier replacement (short string)\n");
-	    break;
-	  }
+  case 'H': { // header
+    size_t name_offset = 2;
+    if (s[p+1] != '(') {
+      if (s[p+2] != '(') {
+	WARN("Error parsing H header replacement (missing '(')\n");
+	break;
+      }
+      name_offset = 3;
+    }
+    if (s.length()<name_offset+1) {
+      WARN("Error parsing H header replacement (short string)\n");
+      break;
+    }
 
-	  char operation = s[p+1];
-	  if (operation != 'U' && operation != 'l'
-	      && operation != 's' && operation != '5') {
-	    WARN("Error parsing $_%c string modifier: unknown operator '%c'\n",
-		 operation, operation);
-	  }
+    size_t skip_p = p+name_offset;
+    for (;skip_p<s.length() && s[skip_p] != ')';skip_p++) { }
+    if (skip_p==s.length()) {
+      WARN("Error parsing H header replacement (unclosed brackets)\n");
+      break;
+    }
+    string hdr_name = s.substr(p+name_offset, skip_p-p-name_offset);
+    // DBG("param_name = '%s' (skip-p - p = %d)\n", param_name.c_str(), skip_p-p);
+    if (name_offset == 2) {
+      // full header
+      res += getHeader(used_hdrs, hdr_name);
+    } else {
+      replaceHeaderUri(s, p, hdr_name, used_hdrs, res);
+    }
+  } break;
 
-	  if (s[p+2] != '(') {
-	    WARN("Error parsing $U upcase replacement (missing '(')\n");
-	    break;
-	  }
+  case 'M': { // regex map
+    if (s[p+1] != '(') {
+      WARN("Error parsing $M regex map replacement (missing '(')\n");
+      break;
+    }
+    if (s.length()<p+3) {
+      WARN("Error parsing $M regex map replacement (short string)\n");
+      break;
+    }
 
-	  size_t skip_p = p+3;
-	  skip_p = skip_to_end_of_brackets(s, skip_p);
+    size_t skip_p = p+2;
+    skip_p = skip_to_end_of_brackets(s, skip_p);
 
-	  if (skip_p==s.length()) {
-	    WARN("Error parsing $_ modifier (unclosed brackets)\n");
-	    skip_chars = skip_p-p;
-	    break;
-	  }
+    if (skip_p==s.length()) {
+      WARN("Error parsing $M regex map replacement (unclosed brackets)\n");
+      break;
+    }
 
-	  string br_str = s.substr(p+3, skip_p-p-3);
-	  string br_str_replaced = 
-	    replaceParameters(br_str, "$_*(...)",
-			      req, call_profile, app_param,
-			      ruri_parser, from_parser, to_parser,
-			      rebuild_ruri, rebuild_from, rebuild_to);
-
-	  br_str = br_str_replaced;
-	  switch(operation) {
-	  case 'u': // uppercase
-	    transform(br_str_replaced.begin(), br_str_replaced.end(),
-		      br_str_replaced.begin(), ::toupper); break;
-	  case 'l': // lowercase
-	    transform(br_str_replaced.begin(), br_str_replaced.end(),
-		      br_str_replaced.begin(), ::tolower); break;
-
-	  case 's': // size (string length)
-	    br_str_replaced = int2str((unsigned int)br_str.length());
-	    break;
-
-	  case '5': // md5
-	    br_str_replaced = calculateMD5(br_str);
-	    break;
-
-	  case 't': // extract 'transport' (last 3 characters)
-	    if (br_str.length() >= 4) {
-	      br_str_replaced = br_str.substr(br_str.length()-3);
-	    }
-	    break;
-
-	  case 'r': // random
-	    {
-	      int r_max;
-	      if (!str2int(br_str, r_max)){
-		WARN("Error parsing $_r(%s) for random value, returning 0\n", br_str.c_str());
-		br_str_replaced = "0";
-	      } else {
-		br_str_replaced = int2str(rand()%r_max);
-	      }
-	    }
-	    break;
+    string map_str = s.substr(p+2, skip_p-p-2);
+    size_t spos = map_str.rfind("=>");
+    if (spos == string::npos) {
+      WARN("Error parsing $M regex map replacement: no => found in '%s'\n",
+	   map_str.c_str());
+      break;
+    }
 
-	  default:
-	    WARN("Error parsing $_%c string modifier: unknown operator '%c'\n",
-		 operation, operation);
-	    break;
-	  }
-	  DBG("applied operator '%c': '%s' => '%s'\n", operation,
-	      br_str.c_str(), br_str_replaced.c_str());
-	  res+=br_str_replaced;
+    string map_val = map_str.substr(0, spos);
+    string map_val_replaced = 
+      ctx.replaceParameters(map_val, r_type, req);
 
-	  skip_chars = skip_p-p;
-	} break;
+    string mapping_name = map_str.substr(spos+2);
+    replaceRegexMap(map_val, map_val_replaced, mapping_name, res);
+  } break;
 
-	case 'm': // Request method
-	  res += req.method;
-	  break;
+  case '_': { // modify
+    if (s.length()<p+4) { // $_O()
+      WARN("Error parsing $_ modifier replacement (short string)\n");
+      break;
+    }
 
-	case '#': { // URL encoding
-	  if (s[p+1] != '(') {
-	    WARN("Error parsing $# URL encoding (missing '(')\n");
-	    break;
-	  }
-	  if (s.length()<p+3) {
-	    WARN("Error parsing $# URL encoding (short string)\n");
-	    break;
-	  }
+    char operation = s[p+1];
+    if (operation != 'U' && operation != 'l'
+	&& operation != 's' && operation != '5') {
+      WARN("Error parsing $_%c string modifier: unknown operator '%c'\n",
+	   operation, operation);
+    }
 
-	  size_t skip_p = p+2;
-	  skip_p = skip_to_end_of_brackets(s, skip_p);
+    if (s[p+2] != '(') {
+      WARN("Error parsing $U upcase replacement (missing '(')\n");
+      break;
+    }
 
-	  if (skip_p==s.length()) {
-	    WARN("Error parsing $# URL encoding (unclosed brackets)\n");
-	    skip_chars = skip_p-p;
-	    break;
-	  }
+    size_t skip_p = p+3;
+    skip_p = skip_to_end_of_brackets(s, skip_p);
+
+    if (skip_p==s.length()) {
+      WARN("Error parsing $_ modifier (unclosed brackets)\n");
+      break;
+    }
+
+    string br_str = s.substr(p+3, skip_p-p-3);
+    string br_str_replaced = 
+      ctx.replaceParameters(br_str, "$_*(...)", req);
+
+    applyModifier(operation, br_str_replaced, res);
+  } break;
+
+  case 'm': // Request method
+    res += req.method;
+    break;
+
+  case '#': { // URL encoding
+    if (s[p+1] != '(') {
+      WARN("Error parsing $# URL encoding (missing '(')\n");
+      break;
+    }
+    if (s.length()<p+3) {
+      WARN("Error parsing $# URL encoding (short string)\n");
+      break;
+    }
+
+    size_t skip_p = p+2;
+    skip_p = skip_to_end_of_brackets(s, skip_p);
+
+    if (skip_p==s.length()) {
+      WARN("Error parsing $# URL encoding (unclosed brackets)\n");
+      break;
+    }
 
-	  string expr_str = s.substr(p+2, skip_p-p-2);
-	  string expr_replaced = 
-	    replaceParameters(expr_str, r_type, req,
-			      call_profile, app_param, 
-			      ruri_parser, from_parser, to_parser,
-			      rebuild_ruri, rebuild_from, rebuild_to);
+    string expr_str = s.substr(p+2, skip_p-p-2);
+    string expr_replaced = 
+      ctx.replaceParameters(expr_str, r_type, req);
 
-	  char* val_escaped = url_encode(expr_replaced.c_str());
-	  res += string(val_escaped);
-	  free(val_escaped);
+    appendUrlEncoded(expr_replaced, res);
+  } break;
 
-	  skip_chars = skip_p-p;
-	} break;
+  default: {
+    WARN("unknown replace pattern $%c%c\n",
+	 s[p], s[p+1]);
+  }; break;
+  };
+}
 
-	default: {
-	  WARN("unknown replace pattern $%c%c\n",
-	       s[p], s[p+1]);
-	}; break;
-	};
+ParamTemplate::ParamTemplate(const string& s)
+  : src(s), replaced(false)
+{
+  string literal;
+  size_t p = 0;
+  bool is_escaped = false;
 
-	p+=skip_chars; // skip $.X
+  while (p<s.length()) {
+    if (is_escaped) {
+      switch (s[p]) {
+      case 'r': literal += '\r'; break;
+      case 'n': literal += '\n'; break;
+      case 't': literal += '\t'; break;
+      default: literal += s[p]; break;
+      }
+      is_escaped = false;
+    } else { // not escaped
+      if (s[p]=='\\') {
+	if (p==s.length()-1) {
+	  literal += '\\'; // add single \ at the end
+	} else {
+	  is_escaped = true;
+	  replaced = true;
+	}
+      } else if (s[p]=='$') {
+	replaced = true;
+	if (!literal.empty()) {
+	  tokens.push_back(Token(literal));
+	  literal.clear();
+	}
+	tokens.push_back(Token(p+1));
+	p = expressionEnd(s, p+1); // skip $.X
+	compileExpr(tokens.back(), p);
       } else {
-	res += s[p];
+	literal += s[p];
       }
-    } // end not escaped
+    }
 
     p++;
   }
 
-  if (is_replaced) {
-    DBG("%s pattern replace: '%s' -> '%s'\n", r_type, s.c_str(), res.c_str());
+  if (!literal.empty())
+    tokens.push_back(Token(literal));
+}
+
+ParamTemplate::~ParamTemplate()
+{
+  for (vector<ParamTemplate*>::iterator it = args.begin();
+       it != args.end(); it++)
+    delete *it;
+}
+
+const ParamTemplate* ParamTemplate::compileArg(const string& s)
+{
+  ParamTemplate* t = new ParamTemplate(s);
+  args.push_back(t);
+  return t;
+}
+
+void ParamTemplate::compileExpr(Token& t, size_t end)
+{
+  const string& s = src;
+  size_t p = t.pos;
+
+  // patterns without (properly closed) brackets are evaluated from src
+  if ((end <= p+1) || (s[end] != ')'))
+    return;
+
+  switch (s[p]) {
+  case 'H':
+    if (s[p+1] == '(') {
+      t.type = Token::Header;
+      t.literal = s.substr(p+2, end-p-2);
+    } else {
+      t.type = Token::HeaderUri;
+      t.literal = s.substr(p+3, end-p-3);
+    }
+    break;
+
+  case 'P':
+    t.type = Token::AppParam;
+    t.literal = s.substr(p+2, end-p-2);
+    break;
+
+  case 'V':
+    t.type = Token::Variable;
+    t.literal = s.substr(p+2, end-p-2);
+    break;
+
+  case 'M': {
+    if (skip_to_end_of_brackets(s, p+2) != end)
+      break;
+    string map_str = s.substr(p+2, end-p-2);
+    size_t spos = map_str.rfind("=>");
+    if (spos == string::npos)
+      break;
+    t.type = Token::RegexMap;
+    t.arg = compileArg(map_str.substr(0, spos));
+    t.literal = map_str.substr(spos+2);
+  } break;
+
+  case '_':
+    if ((s[p+2] != '(') || (skip_to_end_of_brackets(s, p+3) != end))
+      break;
+    t.type = Token::Modifier;
+    t.arg = compileArg(s.substr(p+3, end-p-3));
+    break;
+
+  case '#':
+    if (skip_to_end_of_brackets(s, p+2) != end)
+      break;
+    t.type = Token::UrlEncode;
+    t.arg = compileArg(s.substr(p+2, end-p-2));
+    break;
+
+  default:
+    break;
+  }
+}
+
+void ParamTemplate::eval(ParamReplacerCtx& ctx, const char* r_type,
+			 const AmSipRequest& req, string& res) const
+{
+  for (vector<Token>::const_iterator it = tokens.begin();
+       it != tokens.end(); it++) {
+    switch (it->type) {
+    case Token::Literal:
+      res += it->literal;
+      break;
+
+    case Token::Expr:
+      replaceExpression(src, it->pos, r_type, req, ctx, res);
+      break;
+
+    case Token::Header:
+      res += getHeader(req.hdrs, it->literal);
+      break;
+
+    case Token::HeaderUri:
+      replaceHeaderUri(src, it->pos, it->literal, req.hdrs, res);
+      break;
+
+    case Token::AppParam:
+      res += get_header_keyvalue(ctx.app_param, it->literal);
+      break;
+
+    case Token::Variable:
+      replaceVariable(ctx, it->literal, req, res);
+      break;
+
+    case Token::RegexMap:
+      replaceRegexMap(it->arg->source(),
+		      ctx.replaceParameters(*it->arg, r_type, req),
+		      it->literal, res);
+      break;
+
+    case Token::Modifier:
+      applyModifier(src[it->pos+1],
+		    ctx.replaceParameters(*it->arg, "$_*(...)", req), res);
+      break;
+
+    case Token::UrlEncode:
+      appendUrlEncoded(ctx.replaceParameters(*it->arg, r_type, req), res);
+      break;
+    }
+  }
+}
+
+bool ParamTemplate::needsReplace(const string& s)
+{
+  return (s.find_first_of("$\\") != string::npos);
+}
+
+ParamTemplates::~ParamTemplates()
+{
+  for (map<string, ParamTemplate*>::iterator it = templates.begin();
+       it != templates.end(); it++)
+    delete it->second;
+}
+
+void ParamTemplates::add(const string& s)
+{
+  if (!ParamTemplate::needsReplace(s) || templates.count(s))
+    return;
+
+  templates[s] = new ParamTemplate(s);
+}
+
+const ParamTemplate* ParamTemplates::find(const string& s) const
+{
+  map<string, ParamTemplate*>::const_iterator it = templates.find(s);
+  return (it != templates.end()) ? it->second : NULL;
+}
+
+string ParamReplacerCtx::replaceParameters(const string& s,
+					   const char* r_type,
+					   const AmSipRequest& req)
+{
+  if (!ParamTemplate::needsReplace(s))
+    return s;
+
+  const ParamTemplate* t = NULL;
+  if (call_profile && call_profile->param_templates.get())
+    t = call_profile->param_templates.get()->find(s);
+
+  if (!t) {
+    // not from the profile configuration
+    ParamTemplate tmp(s);
+    return replaceParameters(tmp, r_type, req);
+  }
+
+  return replaceParameters(*t, r_type, req);
+}
+
+string ParamReplacerCtx::replaceParameters(const ParamTemplate& t,
+					   const char* r_type,
+					   const AmSipRequest& req)
+{
+  string res;
+  t.eval(*this, r_type, req, res);
+
+  if (t.isReplaced()) {
+    DBG("%s pattern replace: '%s' -> '%s'\n",
+	r_type, t.source().c_str(), res.c_str());
   }
   return res;
 }
@@ -28,25 +28,105 @@
 
 #include <string>
 using std::string;
+#include <vector>
+using std::vector;
+#include <map>
+using std::map;
 
 #include "AmSipMsg.h"
 #include "AmUriParser.h"
+#include "atomic_types.h"
 
 struct SBCCallProfile;
+struct ParamReplacerCtx;
 
-// $xy parameters replacement
-string replaceParameters(const string& s,
-			 const char* r_type,
-			 const AmSipRequest& req,
-			 const SBCCallProfile* call_profile,
-			 const string& app_param,
-			 AmUriParser& ruri_parser,
-			 AmUriParser& from_parser,
-			 AmUriParser& to_parser,
-			 bool rebuild_ruri,
-			 bool rebuild_from,
-			 bool rebuild_to);
+/**
+ * Profile string with $xy parameters, compiled into literal
+ * text and replacement patterns, so that the string does not
+ * need to be scanned again on every call. The names and
+ * arguments in brackets ($H(name), $M(arg=>map), $_x(arg),
+ * $#(arg), ...) are compiled as well.
+ */
+class ParamTemplate
+{
+  struct Token
+  {
+    enum Type {
+      Literal,   // literal text, escapes resolved
+      Expr,      // evaluated from src
+      Header,    // $H(name)
+      HeaderUri, // $Hx(name)
+      AppParam,  // $P(name)
+      Variable,  // $V(name)
+      RegexMap,  // $M(arg=>name)
+      Modifier,  // $_x(arg)
+      UrlEncode  // $#(arg)
+    };
+
+    Type   type;
+    size_t pos;     /**< pattern character in src (after '$') */
+    string literal; /**< literal text, or the name in brackets */
+    const ParamTemplate* arg; /**< compiled argument in brackets */
+
+    Token(size_t pos) : type(Expr), pos(pos), arg(NULL) {}
+    Token(const string& literal)
+      : type(Literal), pos(0), literal(literal), arg(NULL) {}
+  };
+
+  string        src;
+  vector<Token> tokens;
+  bool          replaced; /**< contains patterns or escapes */
+
+  /** compiled arguments, owned */
+  vector<ParamTemplate*> args;
+
+  /** compiles the brackets of the pattern ending at end */
+  void compileExpr(Token& t, size_t end);
+  const ParamTemplate* compileArg(const string& s);
+
+  ParamTemplate(const ParamTemplate&);
+  ParamTemplate& operator=(const ParamTemplate&);
+
+public:
+  ParamTemplate(const string& s);
+  ~ParamTemplate();
+
+  const string& source() const { return src; }
+  bool isReplaced() const { return replaced; }
+
+  /** Appends the replaced template to res */
+  void eval(ParamReplacerCtx& ctx, const char* r_type,
+	    const AmSipRequest& req, string& res) const;
+
+  /** Whether s contains anything to replace */
+  static bool needsReplace(const string& s);
+};
+
+/**
+ * Compiled templates of the parameters of a call profile,
+ * shared read-only by the copies of the profile.
+ */
+class ParamTemplates
+  : public atomic_ref_cnt
+{
+  map<string, ParamTemplate*> templates;
+
+public:
+  ~ParamTemplates();
+
+  /** Compiles s, if it contains anything to replace */
+  void add(const string& s);
 
+  /** @return NULL if s has not been compiled */
+  const ParamTemplate* find(const string& s) const;
+
+  size_t size() const { return templates.size(); }
+};
+
+/**
+ * Per-request replacement context: the R-URI, From and To
+ * are parsed at most once, on first use.
+ */
 struct ParamReplacerCtx
 {
   string app_param;
@@ -67,20 +147,15 @@ struct ParamReplacerCtx
       call_profile(call_profile)
   {}
 
+  // $xy parameters replacement
+  // (with the call profile's template of s, if compiled)
   string replaceParameters(const string& s,
 			   const char* r_type,
-			   const AmSipRequest& req) {
-    
-    return ::replaceParameters(s,r_type,req,
-			       call_profile,
-			       app_param,
-			       ruri_parser,
-			       from_parser,
-			       to_parser,
-			       ruri_modified,
-			       from_modified,
-			       to_modified);
-  }
+			   const AmSipRequest& req);
+
+  string replaceParameters(const ParamTemplate& t,
+			   const char* r_type,
+			   const AmSipRequest& req);
 };
 
 #endif
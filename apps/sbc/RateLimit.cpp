@@ -6,8 +6,8 @@
 DynRateLimit::DynRateLimit(unsigned int time_base_ms)
   : last_update(0), counter(0)
 {
-  // wall_clock has a resolution of 20ms
-  time_base = time_base_ms / 20;
+  // wall_clock ticks every TIMER_RESOLUTION us
+  time_base = time_base_ms / (TIMER_RESOLUTION/1000);
 }
 
 bool DynRateLimit::limit(unsigned int rate, unsigned int peak, 
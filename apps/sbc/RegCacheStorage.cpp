@@ -0,0 +1,473 @@
+#include "RegCacheStorage.h"
+#include "log.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+
+#define SNAPSHOT_EXT ".snapshot"
+#define JOURNAL_EXT  ".journal"
+#define TMP_EXT      ".tmp"
+
+/*
+ * Record format:
+ *  - type (1 byte)
+ *  - payload length (4 bytes)
+ *  - payload
+ *
+ * Strings are stored as length (2 bytes) + characters.
+ */
+enum RecordType {
+  REC_UPDATE     = 'U', // binding + alias entry
+  REC_UA_EXPIRES = 'E', // alias, ua_expire
+  REC_DELETE     = 'D'  // aor, contact-uri, alias
+};
+
+#define REC_HDR_LEN (1 + sizeof(uint32_t))
+
+struct SnapshotHdr
+{
+  uint32_t magic;
+  uint32_t version;
+  int64_t  timestamp;
+};
+
+static void put_raw(string& rec, const void* p, size_t len)
+{
+  rec.append((const char*)p,len);
+}
+
+static void put_u16(string& rec, uint16_t v) { put_raw(rec,&v,sizeof(v)); }
+static void put_i64(string& rec, int64_t v)  { put_raw(rec,&v,sizeof(v)); }
+
+static bool put_str(string& rec, const string& s)
+{
+  if(s.length() > 0xFFFF)
+    return false;
+
+  put_u16(rec,(uint16_t)s.length());
+  rec.append(s);
+  return true;
+}
+
+/** Starts a record; the length is set by end_record() */
+static void begin_record(string& rec, char type)
+{
+  rec.clear();
+  rec.push_back(type);
+  rec.append(sizeof(uint32_t),'\0');
+}
+
+static void end_record(string& rec)
+{
+  uint32_t len = rec.length() - REC_HDR_LEN;
+  memcpy(&rec[1],&len,sizeof(len));
+}
+
+static bool encode_update(string& rec, long int reg_expire,
+			  const AliasEntry& ae)
+{
+  begin_record(rec,REC_UPDATE);
+  put_i64(rec,reg_expire);
+  if(!put_str(rec,ae.aor) || !put_str(rec,ae.alias) ||
+     !put_str(rec,ae.contact_uri) || !put_str(rec,ae.source_ip))
+    return false;
+  put_u16(rec,ae.source_port);
+  if(!put_str(rec,ae.trsp))
+    return false;
+  put_u16(rec,ae.local_if);
+  if(!put_str(rec,ae.remote_ua))
+    return false;
+  put_i64(rec,ae.ua_expire);
+  end_record(rec);
+  return true;
+}
+
+class RecordReader
+{
+  const char* p;
+  const char* end;
+
+  bool get_raw(void* v, size_t len) {
+    if((size_t)(end - p) < len) return false;
+    memcpy(v,p,len);
+    p += len;
+    return true;
+  }
+
+public:
+  RecordReader(const char* p, size_t len)
+    : p(p), end(p+len)
+  {}
+
+  bool get_u16(uint16_t& v) { return get_raw(&v,sizeof(v)); }
+
+  bool get_i64(long int& v) {
+    int64_t i;
+    if(!get_raw(&i,sizeof(i))) return false;
+    v = (long int)i;
+    return true;
+  }
+
+  bool get_str(string& s) {
+    uint16_t len;
+    if(!get_u16(len) || ((size_t)(end - p) < len))
+      return false;
+    s.assign(p,len);
+    p += len;
+    return true;
+  }
+
+  bool get_update(long int& reg_expire, AliasEntry& ae) {
+    uint16_t port, local_if;
+    if(!get_i64(reg_expire) || !get_str(ae.aor) || !get_str(ae.alias) ||
+       !get_str(ae.contact_uri) || !get_str(ae.source_ip) ||
+       !get_u16(port) || !get_str(ae.trsp) || !get_u16(local_if) ||
+       !get_str(ae.remote_ua) || !get_i64(ae.ua_expire))
+      return false;
+
+    ae.source_port = port;
+    ae.local_if = local_if;
+    return true;
+  }
+};
+
+/**
+ * Reads a whole file into 'buf'.
+ * A missing file is treated as an empty one.
+ */
+static int read_file(const string& path, string& buf)
+{
+  buf.clear();
+  FILE* f = fopen(path.c_str(),"r");
+  if(!f) {
+    if(errno == ENOENT)
+      return 0;
+    ERROR("could not open '%s': %s\n",path.c_str(),strerror(errno));
+    return -1;
+  }
+
+  char chunk[64*1024];
+  size_t n;
+  while((n = fread(chunk,1,sizeof(chunk),f)) > 0)
+    buf.append(chunk,n);
+
+  int res = ferror(f) ? -1 : 0;
+  if(res)
+    ERROR("could not read '%s'\n",path.c_str());
+
+  fclose(f);
+  return res;
+}
+
+/** Writes, syncs and closes 'f', then renames 'tmp' to 'path' */
+static bool commit_file(FILE* f, const string& tmp, const string& path)
+{
+  bool ok = (fflush(f) == 0) && (fsync(fileno(f)) == 0);
+  ok = (fclose(f) == 0) && ok;
+
+  if(ok && rename(tmp.c_str(),path.c_str())) {
+    ERROR("could not rename '%s' to '%s': %s\n",
+	  tmp.c_str(),path.c_str(),strerror(errno));
+    ok = false;
+  }
+
+  if(!ok)
+    unlink(tmp.c_str());
+
+  return ok;
+}
+
+RegCacheFileStorage::RegCacheFileStorage(const string& path)
+  : snapshot_path(path + SNAPSHOT_EXT),
+    journal_path(path + JOURNAL_EXT),
+    journal(NULL)
+{
+  openJournal();
+}
+
+RegCacheFileStorage::~RegCacheFileStorage()
+{
+  if(journal)
+    fclose(journal);
+}
+
+void RegCacheFileStorage::openJournal()
+{
+  journal = fopen(journal_path.c_str(),"a");
+  if(!journal) {
+    ERROR("could not open register cache journal '%s': %s\n",
+	  journal_path.c_str(),strerror(errno));
+  }
+}
+
+void RegCacheFileStorage::writeJournal(const string& rec)
+{
+  AmLock l(journal_mut);
+  if(!journal)
+    return;
+
+  if(fwrite(rec.data(),1,rec.length(),journal) != rec.length()) {
+    ERROR("could not write to register cache journal '%s'\n",
+	  journal_path.c_str());
+  }
+}
+
+void RegCacheFileStorage::flush()
+{
+  AmLock l(journal_mut);
+  if(journal)
+    fflush(journal);
+}
+
+void RegCacheFileStorage::onDelete(const string& aor, const string& uri,
+				   const string& alias)
+{
+  if(next.get())
+    next->onDelete(aor,uri,alias);
+
+  string rec;
+  begin_record(rec,REC_DELETE);
+  if(!put_str(rec,aor) || !put_str(rec,uri) || !put_str(rec,alias)) {
+    WARN("register cache entry too big for the journal (alias='%s')\n",
+	 alias.c_str());
+    return;
+  }
+  end_record(rec);
+  writeJournal(rec);
+}
+
+void RegCacheFileStorage::onUpdate(const string& canon_aor, const string& alias,
+				   long int expires,
+				   const AliasEntry& alias_update)
+{
+  if(next.get())
+    next->onUpdate(canon_aor,alias,expires,alias_update);
+
+  string rec;
+  if(!encode_update(rec,expires,alias_update)) {
+    WARN("register cache entry too big for the journal (alias='%s')\n",
+	 alias.c_str());
+    return;
+  }
+  writeJournal(rec);
+}
+
+void RegCacheFileStorage::onUpdate(const string& alias, long int ua_expires)
+{
+  if(next.get())
+    next->onUpdate(alias,ua_expires);
+
+  string rec;
+  begin_record(rec,REC_UA_EXPIRES);
+  if(!put_str(rec,alias))
+    return;
+  put_i64(rec,ua_expires);
+  end_record(rec);
+  writeJournal(rec);
+}
+
+int RegCacheFileStorage::replay(_RegisterCache* cache, const string& path,
+				bool snapshot, long int now,
+				unsigned int& expired)
+{
+  string buf;
+  if(read_file(path,buf))
+    return -1;
+
+  size_t pos = 0;
+  if(snapshot && !buf.empty()) {
+    SnapshotHdr hdr;
+    if(buf.length() < sizeof(hdr)) {
+      ERROR("register cache snapshot '%s' is truncated\n",path.c_str());
+      return -1;
+    }
+    memcpy(&hdr,buf.data(),sizeof(hdr));
+    if((hdr.magic != REG_CACHE_SNAPSHOT_MAGIC) ||
+       (hdr.version != REG_CACHE_SNAPSHOT_VERSION)) {
+      ERROR("'%s' is not a register cache snapshot (version %u)\n",
+	    path.c_str(),REG_CACHE_SNAPSHOT_VERSION);
+      return -1;
+    }
+    pos = sizeof(hdr);
+  }
+
+  int records = 0;
+  while(buf.length() - pos >= REC_HDR_LEN) {
+
+    char type = buf[pos];
+    uint32_t len;
+    memcpy(&len,buf.data() + pos + 1,sizeof(len));
+    if(buf.length() - pos - REC_HDR_LEN < len)
+      break;
+
+    RecordReader r(buf.data() + pos + REC_HDR_LEN, len);
+    pos += REC_HDR_LEN + len;
+
+    bool ok = false;
+    switch(type) {
+    case REC_UPDATE: {
+      long int reg_expire;
+      AliasEntry ae;
+      if(!(ok = r.get_update(reg_expire,ae)))
+	break;
+      if(reg_expire > now) {
+	cache->update(ae.alias,reg_expire,ae);
+      }
+      else {
+	// might have been inserted by a previous record
+	cache->remove(ae.aor,ae.contact_uri,ae.alias);
+	expired++;
+      }
+    } break;
+
+    case REC_UA_EXPIRES: {
+      string alias;
+      long int ua_expire;
+      if((ok = r.get_str(alias) && r.get_i64(ua_expire)))
+	cache->updateAliasExpires(alias,ua_expire);
+    } break;
+
+    case REC_DELETE: {
+      string aor, uri, alias;
+      if((ok = r.get_str(aor) && r.get_str(uri) && r.get_str(alias)))
+	cache->remove(aor,uri,alias);
+    } break;
+    }
+
+    if(!ok) {
+      ERROR("corrupted record in '%s' (offset %lu): stopping replay\n",
+	    path.c_str(),(unsigned long)(pos - REC_HDR_LEN - len));
+      return records;
+    }
+    records++;
+  }
+
+  if(pos != buf.length()) {
+    WARN("'%s': ignoring truncated record at the end of the file\n",
+	 path.c_str());
+  }
+
+  return records;
+}
+
+int RegCacheFileStorage::load(_RegisterCache* cache, long int now,
+			      unsigned int& expired)
+{
+  int s_records = replay(cache,snapshot_path,true,now,expired);
+  if(s_records < 0)
+    return -1;
+
+  int j_records = replay(cache,journal_path,false,now,expired);
+  if(j_records < 0)
+    return -1;
+
+  DBG("register cache: %i records from '%s', %i records from '%s'\n",
+      s_records,snapshot_path.c_str(),j_records,journal_path.c_str());
+
+  return s_records + j_records;
+}
+
+struct SnapshotWriter
+  : public _RegisterCache::BindingVisitor
+{
+  FILE* f;
+  bool  ok;
+  unsigned int bindings;
+  string rec;
+
+  SnapshotWriter(FILE* f)
+    : f(f), ok(true), bindings(0)
+  {}
+
+  void binding(long int reg_expire, const AliasEntry& ae) {
+    if(!ok || !encode_update(rec,reg_expire,ae))
+      return;
+    if(fwrite(rec.data(),1,rec.length(),f) != rec.length()) {
+      ok = false;
+      return;
+    }
+    bindings++;
+  }
+};
+
+bool RegCacheFileStorage::snapshot(_RegisterCache* cache)
+{
+  AmLock l(snapshot_mut);
+
+  // journal records after this offset are
+  // not necessarily part of the snapshot
+  long int journal_off = 0;
+  journal_mut.lock();
+  if(journal) {
+    fflush(journal);
+    fseek(journal,0,SEEK_END);
+    journal_off = ftell(journal);
+  }
+  journal_mut.unlock();
+
+  string tmp = snapshot_path + TMP_EXT;
+  FILE* f = fopen(tmp.c_str(),"w");
+  if(!f) {
+    ERROR("could not create '%s': %s\n",tmp.c_str(),strerror(errno));
+    return false;
+  }
+
+  SnapshotHdr hdr;
+  hdr.magic = REG_CACHE_SNAPSHOT_MAGIC;
+  hdr.version = REG_CACHE_SNAPSHOT_VERSION;
+  hdr.timestamp = time(NULL);
+
+  SnapshotWriter w(f);
+  w.ok = fwrite(&hdr,sizeof(hdr),1,f) == 1;
+  cache->forEachBinding(w);
+
+  if(!w.ok) {
+    ERROR("could not write register cache snapshot '%s'\n",tmp.c_str());
+    fclose(f);
+    unlink(tmp.c_str());
+    return false;
+  }
+
+  if(!commit_file(f,tmp,snapshot_path))
+    return false;
+
+  DBG("register cache snapshot: %u bindings written to '%s'\n",
+      w.bindings,snapshot_path.c_str());
+
+  // keep only the journal records written meanwhile
+  AmLock jl(journal_mut);
+  if(!journal)
+    return true;
+
+  fflush(journal);
+
+  string buf;
+  if(read_file(journal_path,buf))
+    return true;
+
+  tmp = journal_path + TMP_EXT;
+  f = fopen(tmp.c_str(),"w");
+  if(!f) {
+    ERROR("could not create '%s': %s\n",tmp.c_str(),strerror(errno));
+    return true;
+  }
+
+  if((size_t)journal_off < buf.length()) {
+    if(fwrite(buf.data() + journal_off,1,buf.length() - journal_off,f)
+       != buf.length() - journal_off) {
+      ERROR("could not write '%s'\n",tmp.c_str());
+      fclose(f);
+      unlink(tmp.c_str());
+      return true;
+    }
+  }
+
+  if(commit_file(f,tmp,journal_path)) {
+    fclose(journal);
+    openJournal();
+  }
+
+  return true;
+}
@@ -0,0 +1,87 @@
+#ifndef _RegCacheStorage_h_
+#define _RegCacheStorage_h_
+
+#include "RegisterCache.h"
+#include "AmThread.h"
+
+#include <stdio.h>
+#include <string>
+using std::string;
+
+/*
+ * Persistent register cache:
+ * --------------------------
+ *  - <path>.snapshot: all bindings, written periodically
+ *                     and on shutdown (via a temporary file).
+ *  - <path>.journal:  append-only log of the changes
+ *                     since the last snapshot.
+ *
+ * Both files are binary (host byte order). On startup, the snapshot
+ * is loaded and the journal replayed on top of it. As every record
+ * is an upsert or a delete, replaying records older than the snapshot
+ * is harmless, so that the journal does not need to be cut exactly
+ * at the snapshot.
+ */
+
+#define REG_CACHE_SNAPSHOT_MAGIC   0x53424352 /* "RCBS" */
+#define REG_CACHE_SNAPSHOT_VERSION 1
+
+class RegCacheFileStorage
+  : public RegCacheStorageHandler
+{
+  string snapshot_path;
+  string journal_path;
+
+  FILE*   journal;
+  AmMutex journal_mut;
+
+  // serializes snapshots (periodic / shutdown)
+  AmMutex snapshot_mut;
+
+  // previous storage handler of the cache (e.g. the debug log),
+  // called before writing the journal
+  auto_ptr<RegCacheStorageHandler> next;
+
+  void openJournal();
+  void writeJournal(const string& rec);
+
+  /** replays the records of a snapshot or journal file */
+  int replay(_RegisterCache* cache, const string& path, bool snapshot,
+	     long int now, unsigned int& expired);
+
+public:
+  RegCacheFileStorage(const string& path);
+  ~RegCacheFileStorage();
+
+  /* RegCacheStorageHandler interface */
+  void onDelete(const string& aor, const string& uri,
+		const string& alias);
+
+  void onUpdate(const string& canon_aor, const string& alias,
+		long int expires, const AliasEntry& alias_update);
+
+  void onUpdate(const string& alias, long int ua_expires);
+
+  /**
+   * Loads snapshot and journal into the cache;
+   * bindings expired in the meantime are dropped.
+   *
+   * Note: must be called before the storage
+   *       is set as the storage handler of the cache.
+   *
+   * @param expired number of expired bindings dropped
+   * @return number of records replayed, -1 on error
+   */
+  int load(_RegisterCache* cache, long int now, unsigned int& expired);
+
+  /** Writes a new snapshot and drops the journal records it contains */
+  bool snapshot(_RegisterCache* cache);
+
+  /** Flushes the journal to the file */
+  void flush();
+
+  /** Chains h (owned) to be called on every change as well */
+  void chain(RegCacheStorageHandler* h) { next.reset(h); }
+};
+
+#endif
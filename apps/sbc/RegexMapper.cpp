@@ -24,42 +24,283 @@
  */
 #include "RegexMapper.h"
 #include "log.h"
+#include "sip/hash.h"
+
+#include <string.h>
+#include <algorithm>
+
+static bool is_regex_special(char c)
+{
+  return strchr(".[]()*+?{}|^$\\", c) != NULL;
+}
+
+static bool is_quantifier(char c)
+{
+  return strchr("*+?{", c) != NULL;
+}
+
+/**
+ * Splits an extended regex into its literal prefix and the rest:
+ *   '^abc$'   -> 'abc', '$'
+ *   '^a\.b.*' -> 'a.b', '.*'
+ *   '^abc+d'  -> 'ab',  'c+d'
+ * Regexes which are not anchored or contain alternatives
+ * have no literal prefix.
+ */
+static void split_literal_prefix(const string& re, string& prefix,
+				 string& rest)
+{
+  prefix.clear();
+  rest = re;
+
+  if (re.empty() || (re[0] != '^'))
+    return;
+
+  for (size_t i = 0; i < re.length(); i++) {
+    if (re[i] == '\\') { i++; continue; }
+    if (re[i] == '|') return;
+  }
+
+  size_t i = 1;
+  while (i < re.length()) {
+    size_t next;
+    char c = re[i];
+    if (c == '\\') {
+      if ((i + 1 >= re.length()) || !is_regex_special(re[i+1]))
+	break;
+      c = re[i+1];
+      next = i + 2;
+    } else if (is_regex_special(c)) {
+      break;
+    } else {
+      next = i + 1;
+    }
+
+    // quantified character: not part of the prefix
+    if ((next < re.length()) && is_quantifier(re[next]))
+      break;
+
+    prefix += c;
+    i = next;
+  }
+
+  rest = re.substr(i);
+}
+
+/** result of a rule without groups, as run_regex_mapping_entry() does */
+static string static_result(const string& repl)
+{
+  string result;
+  for (size_t i = 0; i < repl.length(); i++) {
+    if ((repl[i] == '\\') && (i + 1 < repl.length()) && (repl[i+1] == '\\')) {
+      result += '\\';
+      i++;
+    } else if (repl[i] == char(1)) {
+      result += '\\';
+    } else {
+      result += repl[i];
+    }
+  }
+  return result;
+}
+
+static size_t ht_size(size_t elmts)
+{
+  size_t size = 16;
+  while (size < 2 * elmts)
+    size <<= 1;
+  return size;
+}
+
+RegexMap::RegexMap(const RegexMappingVector& mapping,
+		   const std::vector<string>& patterns)
+  : mapping(mapping)
+{
+  exact_ht.resize(ht_size(mapping.size()));
+  prefix_ht.resize(ht_size(mapping.size()));
+
+  for (unsigned int i = 0; i < mapping.size(); i++) {
+    Rule r;
+    r.type = Regex;
+
+    if (patterns.size() == mapping.size()) {
+      string rest;
+      split_literal_prefix(patterns[i], r.literal, rest);
+
+      if (rest.empty() || (rest == ".*")) {
+	r.type = Prefix;
+	r.result = static_result(mapping[i].second);
+      } else if (rest == "$") {
+	r.type = Exact;
+	r.result = static_result(mapping[i].second);
+      }
+    }
+    rules.push_back(r);
+
+    if (r.type == Exact) {
+      index(exact_ht, r.literal, i);
+    } else if (r.literal.empty() && (r.type == Regex)) {
+      unindexed.push_back(i);
+    } else {
+      index(prefix_ht, r.literal, i);
+      if (std::find(prefix_lens.begin(), prefix_lens.end(),
+		    r.literal.length()) == prefix_lens.end())
+	prefix_lens.push_back(r.literal.length());
+    }
+  }
+
+  std::sort(prefix_lens.begin(), prefix_lens.end());
+}
+
+RegexMap::~RegexMap()
+{
+  for (RegexMappingVector::iterator it = mapping.begin();
+       it != mapping.end(); it++) {
+    regfree(&it->first);
+  }
+}
+
+void RegexMap::index(std::vector<std::vector<Entry> >& ht,
+		     const string& literal, unsigned int rule)
+{
+  std::vector<Entry>& bucket =
+    ht[hashlittle(literal.data(), literal.length(), 0) & (ht.size() - 1)];
+
+  for (std::vector<Entry>::iterator it = bucket.begin();
+       it != bucket.end(); it++) {
+    if (it->literal == literal) {
+      it->rules.push_back(rule);
+      return;
+    }
+  }
+
+  bucket.push_back(Entry());
+  bucket.back().literal = literal;
+  bucket.back().rules.push_back(rule);
+}
+
+const RegexMap::Entry*
+RegexMap::lookup(const std::vector<std::vector<Entry> >& ht,
+		 const char* s, size_t len) const
+{
+  const std::vector<Entry>& bucket =
+    ht[hashlittle(s, len, 0) & (ht.size() - 1)];
+
+  for (std::vector<Entry>::const_iterator it = bucket.begin();
+       it != bucket.end(); it++) {
+    if ((it->literal.length() == len) &&
+	!memcmp(it->literal.data(), s, len))
+      return &*it;
+  }
+
+  return NULL;
+}
+
+bool RegexMap::match(const char* test_s, string& result) const
+{
+  size_t len = strlen(test_s);
+
+  // first matching rule
+  unsigned int best = rules.size();
+
+  const Entry* e = lookup(exact_ht, test_s, len);
+  if (e)
+    best = e->rules.front();
+
+  // candidates: rules with a matching prefix, ascending
+  std::vector<unsigned int> cand;
+  for (std::vector<size_t>::const_iterator l_it = prefix_lens.begin();
+       l_it != prefix_lens.end() && (*l_it <= len); l_it++) {
+    e = lookup(prefix_ht, test_s, *l_it);
+    if (e)
+      cand.insert(cand.end(), e->rules.begin(), e->rules.end());
+  }
+  if (!cand.empty()) {
+    cand.insert(cand.end(), unindexed.begin(), unindexed.end());
+    std::sort(cand.begin(), cand.end());
+  }
+  const std::vector<unsigned int>& c = cand.empty() ? unindexed : cand;
+
+  for (std::vector<unsigned int>::const_iterator it = c.begin();
+       it != c.end() && (*it < best); it++) {
+    if (rules[*it].type == Prefix) {
+      best = *it;
+      break;
+    }
+
+    if (run_regex_mapping_entry(mapping[*it].first, mapping[*it].second,
+				test_s, result))
+      return true;
+  }
+
+  if (best == rules.size())
+    return false;
+
+  result = rules[best].result;
+  return true;
+}
+
+size_t RegexMap::literalRules() const
+{
+  size_t n = 0;
+  for (std::vector<Rule>::const_iterator it = rules.begin();
+       it != rules.end(); it++) {
+    if (it->type != Regex) n++;
+  }
+  return n;
+}
+
+RegexMapper::~RegexMapper()
+{
+  for (std::map<string, RegexMap*>::iterator it = regex_mappings.begin();
+       it != regex_mappings.end(); it++) {
+    delete it->second;
+  }
+}
 
 bool RegexMapper::mapRegex(const string& mapping_name, const char* test_s,
 			   string& result) {
-  lock();
-  std::map<string, RegexMappingVector>::iterator it=regex_mappings.find(mapping_name);
+  regex_mappings_lock.lock_read();
+  std::map<string, RegexMap*>::iterator it=regex_mappings.find(mapping_name);
   if (it == regex_mappings.end()) {
-    unlock();
+    regex_mappings_lock.unlock();
     ERROR("regex mapping '%s' is not loaded!\n", mapping_name.c_str());
     return false;
   }
 
-  bool res = run_regex_mapping(it->second, test_s, result);
-  unlock();
+  bool res = it->second->match(test_s, result);
+  regex_mappings_lock.unlock();
   return res;
 }
 
-void RegexMapper::setRegexMap(const string& mapping_name, const RegexMappingVector& r) {
-  lock();
-  std::map<string, RegexMappingVector>::iterator it=regex_mappings.find(mapping_name);
+void RegexMapper::setRegexMap(const string& mapping_name,
+			      const RegexMappingVector& r,
+			      const std::vector<string>& patterns) {
+  RegexMap* m = new RegexMap(r, patterns);
+  DBG("regex mapping '%s': %u rules, %u without regex\n",
+      mapping_name.c_str(), (unsigned int)m->size(),
+      (unsigned int)m->literalRules());
+
+  RegexMap* old = NULL;
+  regex_mappings_lock.lock_write();
+  std::map<string, RegexMap*>::iterator it=regex_mappings.find(mapping_name);
   if (it != regex_mappings.end()) {
-    for (RegexMappingVector::iterator r_it =
-	   it->second.begin(); r_it != it->second.end(); r_it++) {
-      regfree(&r_it->first);
-    }
+    old = it->second;
+    it->second = m;
+  } else {
+    regex_mappings[mapping_name] = m;
   }
-  regex_mappings[mapping_name] = r;
-  unlock();
+  regex_mappings_lock.unlock();
+
+  delete old;
 }
 
 std::vector<std::string> RegexMapper::getNames() {
   std::vector<std::string> res;
-  lock();
-  for (std::map<string, RegexMappingVector>::iterator it=
+  regex_mappings_lock.lock_read();
+  for (std::map<string, RegexMap*>::iterator it=
 	 regex_mappings.begin(); it != regex_mappings.end(); it++)
     res.push_back(it->first);
-  unlock();
+  regex_mappings_lock.unlock();
   return res;
 }
-
@@ -33,21 +33,90 @@
 #include <string>
 #include "AmThread.h"
 
-struct RegexMapper {
+/**
+ * Compiled regex mapping.
+ *
+ * Rules which only match a literal string ('^abc$') or a literal
+ * prefix ('^abc', '^abc.*') are looked up in hash tables; the other
+ * rules are indexed by their literal prefix (if any), so that regexec
+ * is only run on the rules which may match. The result is the same as
+ * with run_regex_mapping(): the first matching rule wins.
+ */
+class RegexMap
+{
+  enum RuleType {
+    Exact,   // whole string
+    Prefix,  // literal prefix
+    Regex    // regexec(), if the literal prefix matches
+  };
 
-  RegexMapper() { }
-  ~RegexMapper() { }
+  struct Rule {
+    RuleType type;
+    string   literal; // string or prefix
+    string   result;  // for Exact/Prefix: without group references
+  };
+
+  // hash table entry: literal -> rule indexes (ascending)
+  struct Entry {
+    string literal;
+    std::vector<unsigned int> rules;
+  };
+
+  RegexMappingVector mapping;
+  std::vector<Rule>  rules;
+
+  std::vector<std::vector<Entry> > exact_ht;
+  std::vector<std::vector<Entry> > prefix_ht;
+
+  // distinct prefix lengths (ascending)
+  std::vector<size_t> prefix_lens;
+
+  // rules without literal prefix
+  std::vector<unsigned int> unindexed;
+
+  void index(std::vector<std::vector<Entry> >& ht, const string& literal,
+	     unsigned int rule);
+
+  const Entry* lookup(const std::vector<std::vector<Entry> >& ht,
+		      const char* s, size_t len) const;
 
-  std::map<string, RegexMappingVector> regex_mappings;
-  AmMutex regex_mappings_mut;
+  RegexMap(const RegexMap&);
+  RegexMap& operator=(const RegexMap&);
 
-  void lock() { regex_mappings_mut.lock(); }
-  void unlock() { regex_mappings_mut.unlock(); }
+public:
+  /**
+   * Takes over the regexes of 'mapping'.
+   * patterns: source of the regexes (if empty, no indexing)
+   */
+  RegexMap(const RegexMappingVector& mapping,
+	   const std::vector<string>& patterns);
+  ~RegexMap();
+
+  bool match(const char* test_s, string& result) const;
+
+  size_t size() const { return rules.size(); }
+
+  /** number of rules matched without regexec */
+  size_t literalRules() const;
+};
+
+class RegexMapper {
+
+  std::map<string, RegexMap*> regex_mappings;
+
+  // mappings are only written on (re)load:
+  // lookups run concurrently
+  AmRWLock regex_mappings_lock;
+
+public:
+  RegexMapper() { }
+  ~RegexMapper();
 
   bool mapRegex(const string& mapping_name, const char* test_s,
 		string& result);
 
-  void setRegexMap(const string& mapping_name, const RegexMappingVector& r);
+  void setRegexMap(const string& mapping_name, const RegexMappingVector& r,
+		   const std::vector<string>& patterns = std::vector<string>());
 
   std::vector<std::string> getNames();
 };
@@ -9,6 +9,7 @@
 #include "AmSession.h" //getNewId
 #include "AmUtils.h"
 #include "SBCEventLog.h"
+#include "RegCacheStorage.h"
 
 #include <utility>
 using std::pair;
@@ -16,6 +17,8 @@ using std::make_pair;
 
 #define REG_CACHE_CYCLE 10L /* 10 seconds to expire all buckets */
 
+#define REG_CACHE_JOURNAL_FLUSH 1 /* seconds */
+
  /* in us */
 #define REG_CACHE_SINGLE_CYCLE \
   ((REG_CACHE_CYCLE*1000000L)/REG_CACHE_TABLE_ENTRIES)
@@ -107,6 +110,20 @@ void AorBucket::gbc(RegCacheStorageHandler* h, long int now,
   }
 }
 
+void AorBucket::getBindings(list<RegBinding>& bindings)
+{
+  for(value_map::iterator it = elmts.begin(); it != elmts.end(); it++) {
+    AorEntry* aor_e = it->second;
+    if(!aor_e) continue;
+
+    for(AorEntry::iterator reg_it = aor_e->begin();
+	reg_it != aor_e->end(); reg_it++) {
+      if(reg_it->second)
+	bindings.push_back(*reg_it->second);
+    }
+  }
+}
+
 AliasEntry* AliasBucket::getContact(const string& alias)
 {
   value_map::iterator it = find(alias);
@@ -188,7 +205,10 @@ struct RegCacheLogHandler
 _RegisterCache::_RegisterCache()
   : reg_cache_ht(REG_CACHE_TABLE_ENTRIES),
     id_idx(REG_CACHE_TABLE_ENTRIES),
-    contact_idx(REG_CACHE_TABLE_ENTRIES)
+    contact_idx(REG_CACHE_TABLE_ENTRIES),
+    file_storage(NULL),
+    snapshot_interval(0),
+    last_snapshot(0)
 {
   // debug register cache WRITE operations
   setStorageHandler(new RegCacheLogHandler());
@@ -225,11 +245,86 @@ void _RegisterCache::gbc(unsigned int bucket_id)
   bucket->unlock();
 }
 
+void _RegisterCache::dispose()
+{
+  stop();
+
+  // last chance to keep the bindings across the restart
+  snapshot();
+}
+
 void _RegisterCache::on_stop()
 {
   running.set(false);
 }
 
+int _RegisterCache::enablePersistence(const string& path,
+				      unsigned int snapshot_interval)
+{
+  struct timeval start,end;
+  gettimeofday(&start,NULL);
+
+  RegCacheFileStorage* storage = new RegCacheFileStorage(path);
+
+  unsigned int expired = 0;
+  int records = storage->load(this,start.tv_sec,expired);
+  if(records < 0) {
+    delete storage;
+    return -1;
+  }
+
+  gettimeofday(&end,NULL);
+  INFO("register cache restored from '%s': %u bindings "
+       "(%u expired, %i records) in %li ms\n",
+       path.c_str(),getActiveRegs(),expired,records,
+       (end.tv_sec - start.tv_sec)*1000L
+       + (end.tv_usec - start.tv_usec)/1000L);
+
+  // keep the current handler (debug log) in the chain
+  storage->chain(storage_handler.release());
+  setStorageHandler(storage);
+  file_storage = storage;
+  this->snapshot_interval = snapshot_interval;
+
+  // compact the journal replayed above
+  snapshot();
+  return 0;
+}
+
+bool _RegisterCache::snapshot()
+{
+  if(!file_storage)
+    return false;
+
+  last_snapshot = time(NULL);
+  return file_storage->snapshot(this);
+}
+
+void _RegisterCache::forEachBinding(BindingVisitor& v)
+{
+  list<RegBinding> bindings;
+  for(unsigned long i=0; i < reg_cache_ht.get_size(); i++) {
+
+    AorBucket* bucket = reg_cache_ht.get_bucket(i);
+    bucket->lock();
+
+    bindings.clear();
+    bucket->getBindings(bindings);
+
+    for(list<RegBinding>::iterator it = bindings.begin();
+	it != bindings.end(); it++) {
+
+      AliasBucket* alias_bucket = getAliasBucket(it->alias);
+      alias_bucket->lock();
+      AliasEntry* ae = alias_bucket->getContact(it->alias);
+      if(ae) v.binding(it->reg_expire,*ae);
+      alias_bucket->unlock();
+    }
+
+    bucket->unlock();
+  }
+}
+
 void _RegisterCache::run()
 {
   struct timespec tick,rem;
@@ -238,11 +333,26 @@ void _RegisterCache::run()
 
   running.set(true);
 
+  time_t last_flush = time(NULL);
+  last_snapshot = last_flush;
+
   gbc_bucket_id = 0;
   while(running.get()) {
     gbc(gbc_bucket_id);
     gbc_bucket_id = (gbc_bucket_id+1);
     gbc_bucket_id &= (REG_CACHE_TABLE_ENTRIES-1);
+
+    if(file_storage) {
+      time_t now = time(NULL);
+      if(snapshot_interval && (now - last_snapshot >= snapshot_interval)) {
+	snapshot();
+      }
+      else if(now - last_flush >= REG_CACHE_JOURNAL_FLUSH) {
+	file_storage->flush();
+	last_flush = now;
+      }
+    }
+
     nanosleep(&tick,&rem);
   }  
 }
@@ -80,6 +80,8 @@ struct AliasEntry
 
 struct RegCacheStorageHandler 
 {
+  virtual ~RegCacheStorageHandler() {}
+
   virtual void onDelete(const string& aor, const string& uri, 
 			const string& alias) {}
 
@@ -110,6 +112,10 @@ public:
   /* Maintenance stuff */
 
   void gbc(RegCacheStorageHandler* h, long int now, list<string>& alias_list);
+
+  /** Retrieves alias and expiration of all bindings */
+  void getBindings(list<RegBinding>& bindings);
+
   void dump_elmt(const string& aor, const AorEntry* p_aor_entry) const;
 };
 
@@ -164,6 +170,8 @@ public:
  * Registrar/Reg-Caching 
  * parsing/processing context 
  */
+class RegCacheFileStorage;
+
 struct RegisterCacheCtx
   : public AmObject
 {
@@ -198,6 +206,11 @@ class _RegisterCache
 
   auto_ptr<RegCacheStorageHandler> storage_handler;
 
+  // persistence (owned by storage_handler)
+  RegCacheFileStorage* file_storage;
+  unsigned int     snapshot_interval;
+  time_t               last_snapshot;
+
   unsigned int gbc_bucket_id;
 
   AmSharedVar<bool> running;
@@ -212,7 +225,7 @@ protected:
   _RegisterCache();
   ~_RegisterCache();
 
-  void dispose() { stop(); }
+  void dispose();
 
   /* AmThread interface */
   void run();
@@ -251,6 +264,36 @@ public:
 
   void setStorageHandler(RegCacheStorageHandler* h) { storage_handler.reset(h); }
 
+  /**
+   * Restores the cache from the snapshot and journal found
+   * at 'path' (if any) and keeps them up-to-date from now on.
+   * The storage handler set before is still called (chained).
+   *
+   * snapshot_interval: seconds between two snapshots (0 = on shutdown only)
+   *
+   * Returns -1 if the files could not be read.
+   */
+  int enablePersistence(const string& path, unsigned int snapshot_interval);
+
+  /**
+   * Writes a snapshot of the cache (if persistence is enabled).
+   */
+  bool snapshot();
+
+  struct BindingVisitor
+  {
+    virtual ~BindingVisitor() {}
+    virtual void binding(long int reg_expire, const AliasEntry& ae)=0;
+  };
+
+  /**
+   * Calls the visitor for each binding.
+   *
+   * Note: the buckets are locked one after the other
+   *       while visiting their bindings.
+   */
+  void forEachBinding(BindingVisitor& v);
+
   /**
    * Match, retrieve the contact cache entry associated with the URI passed,
    * and return the alias found in the cache entry.
@@ -60,6 +60,7 @@ SBC - feature-wishlist
 #include "SubscriptionDialog.h"
 #include "RegisterDialog.h"
 #include "RegisterCache.h"
+#include "SBCCallRegistry.h"
 
 #include <algorithm>
 
@@ -156,6 +157,7 @@ SBCFactory::SBCFactory(const string& _app_name)
 }
 
 SBCFactory::~SBCFactory() {
+  clearActiveProfileRules();
   RegisterCache::dispose();
 }
 
@@ -216,18 +218,21 @@ int SBCFactory::onLoad()
   }
 
   INFO("SBC: active profile: '%s'\n", active_profile_s.c_str());
+  compileActiveProfile();
 
   vector<string> regex_maps = explode(cfg.getParameter("regex_maps"), ",");
   for (vector<string>::iterator it =
 	 regex_maps.begin(); it != regex_maps.end(); it++) {
     string regex_map_file_name = AmConfig::ModConfigPath + *it + ".conf";
     RegexMappingVector v;
+    vector<string> patterns;
     if (!read_regex_mapping(regex_map_file_name, "=>",
-			    ("SBC regex mapping " + *it+":").c_str(), v)) {
+			    ("SBC regex mapping " + *it+":").c_str(), v,
+			    &patterns)) {
       ERROR("reading regex mapping from '%s'\n", regex_map_file_name.c_str());
       return -1;
     }
-    regex_mappings.setRegexMap(*it, v);
+    regex_mappings.setRegexMap(*it, v, patterns);
     INFO("loaded regex mapping '%s'\n", it->c_str());
   }
 
@@ -246,31 +251,87 @@ int SBCFactory::onLoad()
 
   subnot_processor.addThreads(cfg.getParameterInt("out_of_dialog_threads",
                                                   DEFAULT_OOD_THREADS));
+
+  string reg_cache_storage = cfg.getParameter("reg_cache_storage");
+  if (!reg_cache_storage.empty()) {
+    unsigned int interval =
+      cfg.getParameterInt("reg_cache_snapshot_interval",
+			  DEFAULT_REG_CACHE_SNAPSHOT_INTERVAL);
+    if (RegisterCache::instance()->enablePersistence(reg_cache_storage,
+						     interval) < 0) {
+      ERROR("could not restore the register cache from '%s'\n",
+	    reg_cache_storage.c_str());
+      return -1;
+    }
+  }
   RegisterCache::instance()->start();
 
   return 0;
 }
 
-/** get the first matching profile name from active profiles */
-SBCCallProfile* SBCFactory::getActiveProfileMatch(const AmSipRequest& req,
-						  ParamReplacerCtx& ctx) 
+void SBCFactory::clearActiveProfileRules()
+{
+  for (vector<ActiveProfileRule>::iterator it = active_profile_rules.begin();
+       it != active_profile_rules.end(); it++)
+    delete it->tmpl;
+  active_profile_rules.clear();
+}
+
+void SBCFactory::compileActiveProfile()
 {
-  string profile, profile_rule;
-  vector<string>::const_iterator it = active_profile.begin();
-  for (; it != active_profile.end(); it++) {
+  clearActiveProfileRules();
+  for (vector<string>::const_iterator it = active_profile.begin();
+       it != active_profile.end(); it++) {
 
     if (it->empty())
       continue;
 
+    ActiveProfileRule r;
+    r.rule = *it;
+    r.tmpl = NULL;
     if (*it == "$(paramhdr)")
-      profile = get_header_keyvalue(ctx.app_param,"profile");
+      r.type = ActiveProfileRule::ParamHdr;
     else if (*it == "$(ruri.user)")
+      r.type = ActiveProfileRule::RUriUser;
+    else if (!ParamTemplate::needsReplace(*it))
+      r.type = ActiveProfileRule::Name;
+    else {
+      r.type = ActiveProfileRule::Template;
+      r.tmpl = new ParamTemplate(*it);
+    }
+
+    active_profile_rules.push_back(r);
+  }
+}
+
+/** get the first matching profile name from active profiles */
+SBCCallProfile* SBCFactory::getActiveProfileMatch(const AmSipRequest& req,
+						  ParamReplacerCtx& ctx) 
+{
+  static const string no_rule;
+
+  string profile;
+  const string* profile_rule = &no_rule;
+  vector<ActiveProfileRule>::const_iterator it = active_profile_rules.begin();
+  for (; it != active_profile_rules.end(); it++) {
+
+    switch (it->type) {
+    case ActiveProfileRule::Name:
+      profile = it->rule;
+      break;
+    case ActiveProfileRule::ParamHdr:
+      profile = get_header_keyvalue(ctx.app_param,"profile");
+      break;
+    case ActiveProfileRule::RUriUser:
       profile = req.user;
-    else
-      profile = ctx.replaceParameters(*it, "active_profile", req);
+      break;
+    case ActiveProfileRule::Template:
+      profile = ctx.replaceParameters(*it->tmpl, "active_profile", req);
+      break;
+    }
 
     if (!profile.empty()) {
-      profile_rule = *it;
+      profile_rule = &it->rule;
       break;
     }
   }
@@ -281,13 +342,13 @@ SBCCallProfile* SBCFactory::getActiveProfileMatch(const AmSipRequest& req,
   if (prof_it==call_profiles.end()) {
     ERROR("could not find call profile '%s'"
 	  " (matching active_profile rule: '%s')\n",
-	  profile.c_str(), profile_rule.c_str());
+	  profile.c_str(), profile_rule->c_str());
 
     return NULL;
   }
 
   DBG("using call profile '%s' (from matching active_profile rule '%s')\n",
-      profile.c_str(), profile_rule.c_str());
+      profile.c_str(), profile_rule->c_str());
 
   return &prof_it->second;
 }
@@ -480,8 +541,15 @@ void SBCFactory::invoke(const string& method, const AmArg& args,
     ret.push(AmArg("loadCallcontrolModules"));
     ret.push(AmArg("postControlCmd"));
     ret.push(AmArg("printCallStats"));
+    ret.push(AmArg("getCallRegistryStats"));
   } else if(method == "printCallStats"){ 
     B2BMediaStatistics::instance()->getReport(args, ret);
+  } else if(method == "getCallRegistryStats"){
+    AmArg p;
+    SBCCallRegistry::getStats(p);
+    ret.push(200);
+    ret.push("OK");
+    ret.push(p);
   }  else
     throw AmDynInvoke::NotImplemented(method);
 }
@@ -623,6 +691,7 @@ void SBCFactory::setActiveProfile(const AmArg& args, AmArg& ret) {
   }
   profiles_mut.lock();
   active_profile = explode(args[0]["active_profile"].asCStr(), ",");
+  compileActiveProfile();
   profiles_mut.unlock();
   ret.push(200);
   ret.push("OK");
@@ -654,13 +723,14 @@ void SBCFactory::setRegexMap(const AmArg& args, AmArg& ret) {
   string m_name = args[0]["name"].asCStr();
   string m_file = args[0]["file"].asCStr();
   RegexMappingVector v;
-  if (!read_regex_mapping(m_file, "=>", "SBC regex mapping", v)) {
+  vector<string> patterns;
+  if (!read_regex_mapping(m_file, "=>", "SBC regex mapping", v, &patterns)) {
     ERROR("reading regex mapping from '%s'\n", m_file.c_str());
     ret.push(401);
     ret.push("Error reading regex mapping from file");
     return;
   }
-  regex_mappings.setRegexMap(m_name, v);
+  regex_mappings.setRegexMap(m_name, v, patterns);
   ret.push(200);
   ret.push("OK");
 }
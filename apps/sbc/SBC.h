@@ -43,6 +43,7 @@ class SBCCallLeg;
 using std::string;
 
 #define DEFAULT_OOD_THREADS 1
+#define DEFAULT_REG_CACHE_SNAPSHOT_INTERVAL 300 /* seconds */
 
 #define SBC_TIMER_ID_CALL_TIMERS_START   10
 #define SBC_TIMER_ID_CALL_TIMERS_END     99
@@ -74,6 +75,23 @@ class SBCFactory: public AmSessionFactory,
   vector<string> active_profile;
   AmMutex profiles_mut;
 
+  /** active_profile entry, compiled on (re)configuration */
+  struct ActiveProfileRule
+  {
+    enum Type {
+      Name,      // call profile name
+      ParamHdr,  // $(paramhdr)
+      RUriUser,  // $(ruri.user)
+      Template   // replaced parameters
+    };
+
+    Type           type;
+    string         rule;
+    ParamTemplate* tmpl; // owned by SBCFactory
+  };
+
+  vector<ActiveProfileRule> active_profile_rules;
+
   bool core_options_handling;
 
   auto_ptr<CallLegCreator> callLegCreator;
@@ -90,6 +108,10 @@ class SBCFactory: public AmSessionFactory,
   void loadCallcontrolModules(const AmArg& args, AmArg& ret);
   void postControlCmd(const AmArg& args, AmArg& ret);
 
+  /** compiles active_profile into active_profile_rules */
+  void compileActiveProfile();
+  void clearActiveProfileRules();
+
   SBCCallProfile* getActiveProfileMatch(const AmSipRequest& req, 
 					ParamReplacerCtx& ctx);
   
@@ -403,12 +403,22 @@ bool SBCCallProfile::readFromConfiguration(const string& name,
 
   max_491_retry_time = cfg.getParameterInt("max_491_retry_time", 2000);
 
+  // compile the $xy parameter templates now instead of on every call
+  ParamTemplates* templates = new ParamTemplates();
+  for (std::map<string,string>::const_iterator it = cfg.begin();
+       it != cfg.end(); it++) {
+    templates->add(it->second);
+  }
+  param_templates.reset(templates);
+
   md5hash = "<unknown>";
   if (!cfg.getMD5(profile_file_name, md5hash)){
     ERROR("calculating MD5 of file %s\n", profile_file_name.c_str());
   }
 
   INFO("SBC: loaded SBC profile '%s' - MD5: %s\n", name.c_str(), md5hash.c_str());
+  INFO("SBC:      %u parameter templates compiled\n",
+       (unsigned int)templates->size());
 
   if (!refuse_with.empty()) {
     INFO("SBC:      refusing calls with '%s'\n", refuse_with.c_str());
@@ -326,6 +326,10 @@ struct SBCCallProfile
   // milliseconds), according to RFC 3261 should be 2000 ms
   int max_491_retry_time;
 
+  // compiled $xy templates of the profile parameters
+  // (shared with the copies of the profile)
+  ref_counted_ptr<ParamTemplates> param_templates;
+
  private:
   // message logging feature
   string msg_logger_path;
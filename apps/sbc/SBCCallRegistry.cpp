@@ -25,27 +25,58 @@
 
 #include "SBCCallRegistry.h"
 #include "log.h"
+#include "sip/hash.h"
 
-AmMutex SBCCallRegistry::registry_mutex;
-std::map<string, SBCCallRegistryEntry> SBCCallRegistry::registry;
+hash_table<SBCCallRegistryBucket>
+SBCCallRegistry::registry(SBC_CALL_REGISTRY_BUCKETS);
+
+atomic_int SBCCallRegistry::calls;
+atomic_int SBCCallRegistry::contended;
+
+bool SBCCallRegistryBucket::put(const string& ltag,
+				const SBCCallRegistryEntry& other_dlg)
+{
+  value_map::iterator it = find(ltag);
+  if (it != elmts.end()) {
+    *it->second = other_dlg;
+    return false;
+  }
+
+  insert(ltag, new SBCCallRegistryEntry(other_dlg));
+  return true;
+}
+
+SBCCallRegistryBucket* SBCCallRegistry::lockBucket(const string& ltag)
+{
+  unsigned int h = hashlittle(ltag.c_str(), ltag.length(), 0);
+  SBCCallRegistryBucket* bucket =
+    registry.get_bucket(h & (SBC_CALL_REGISTRY_BUCKETS-1));
+
+  if (!bucket->try_lock()) {
+    contended.inc();
+    bucket->lock();
+  }
+  return bucket;
+}
 
 void SBCCallRegistry::addCall(const string& ltag, const SBCCallRegistryEntry& other_dlg) {
-  registry_mutex.lock();
-  registry[ltag] = other_dlg;
-  registry_mutex.unlock();
+  SBCCallRegistryBucket* bucket = lockBucket(ltag);
+  if (bucket->put(ltag, other_dlg))
+    calls.inc();
+  bucket->unlock();
 
   DBG("SBCCallRegistry: Added call '%s' - mapped to: '%s'/'%s'/'%s'\n", ltag.c_str(), other_dlg.ltag.c_str(), other_dlg.rtag.c_str(), other_dlg.callid.c_str());
 }
 
 void SBCCallRegistry::updateCall(const string& ltag, const string& other_rtag) {
-  registry_mutex.lock();
+  SBCCallRegistryBucket* bucket = lockBucket(ltag);
 
-  std::map<string, SBCCallRegistryEntry>::iterator it = registry.find(ltag);
-  if (it != registry.end()) {
-    it->second.rtag = other_rtag;
+  SBCCallRegistryEntry* e = bucket->get(ltag);
+  if (e) {
+    e->rtag = other_rtag;
   }
 
-  registry_mutex.unlock();
+  bucket->unlock();
 
   DBG("SBCCallRegistry: Updated call '%s' - rtag to: '%s'\n", ltag.c_str(), other_rtag.c_str());
 }
@@ -53,13 +84,13 @@ void SBCCallRegistry::updateCall(const string& ltag, const string& other_rtag) {
 bool SBCCallRegistry::lookupCall(const string& ltag, SBCCallRegistryEntry& other_dlg) {
   bool res = false;
 
-  registry_mutex.lock();
-  std::map<string, SBCCallRegistryEntry>::iterator it = registry.find(ltag);
-  if (it != registry.end()) {
+  SBCCallRegistryBucket* bucket = lockBucket(ltag);
+  SBCCallRegistryEntry* e = bucket->get(ltag);
+  if (e) {
     res = true;
-    other_dlg = it->second;
+    other_dlg = *e;
   }
-  registry_mutex.unlock();
+  bucket->unlock();
 
   if (res) {
     DBG("SBCCallRegistry: found call mapping '%s' -> '%s'/'%s'/'%s'\n",
@@ -71,9 +102,16 @@ bool SBCCallRegistry::lookupCall(const string& ltag, SBCCallRegistryEntry& other
 }
 
 void SBCCallRegistry::removeCall(const string& ltag) {
-  registry_mutex.lock();
-  registry.erase(ltag);
-  registry_mutex.unlock();  
+  SBCCallRegistryBucket* bucket = lockBucket(ltag);
+  if (bucket->remove(ltag))
+    calls.dec();
+  bucket->unlock();  
 
   DBG("SBCCallRegistry: removed entry for call '%s'\n", ltag.c_str());
 }
+
+void SBCCallRegistry::getStats(AmArg& ret) {
+  ret["calls"] = (int)calls.get();
+  ret["buckets"] = SBC_CALL_REGISTRY_BUCKETS;
+  ret["contended"] = (int)contended.get();
+}
@@ -27,11 +27,17 @@
 #define _SBCCallRegistry_H
 
 #include "AmThread.h"
+#include "AmArg.h"
+#include "hash_table.h"
+#include "atomic_types.h"
 
 #include <string>
 using std::string;
 #include <map>
 
+#define SBC_CALL_REGISTRY_POWER   10
+#define SBC_CALL_REGISTRY_BUCKETS (1<<SBC_CALL_REGISTRY_POWER)
+
 struct SBCCallRegistryEntry
 {
   string ltag;
@@ -43,10 +49,38 @@ SBCCallRegistryEntry(const string& callid, const string& ltag, const string& rta
   : ltag(ltag), rtag(rtag), callid(callid) { }
 };
 
+/**
+ * Hash-table bucket:
+ *   local tag -> other call leg
+ */
+class SBCCallRegistryBucket
+  : public ht_map_bucket<string,SBCCallRegistryEntry>
+{
+public:
+  SBCCallRegistryBucket(unsigned long id)
+    : ht_map_bucket<string,SBCCallRegistryEntry>(id)
+  {}
+
+  /** @return true if a new entry has been inserted */
+  bool put(const string& ltag, const SBCCallRegistryEntry& other_dlg);
+};
+
+/**
+ * Call legs by local tag, for Replaces/REFER handling.
+ *
+ * Calls are spread over SBC_CALL_REGISTRY_BUCKETS independently
+ * locked buckets, so that call legs starting and stopping in
+ * parallel do not wait for each other.
+ */
 class SBCCallRegistry 
 {
-  static AmMutex registry_mutex;
-  static std::map<string, SBCCallRegistryEntry> registry;
+  static hash_table<SBCCallRegistryBucket> registry;
+
+  // stats
+  static atomic_int calls;
+  static atomic_int contended; // bucket was locked by another thread
+
+  static SBCCallRegistryBucket* lockBucket(const string& ltag);
 
  public:
   SBCCallRegistry() { }
@@ -56,6 +90,14 @@ class SBCCallRegistry
   static void updateCall(const string& ltag, const string& other_rtag);
   static bool lookupCall(const string& ltag, SBCCallRegistryEntry& other_dlg);
   static void removeCall(const string& ltag);
+
+  /** Number of entries */
+  static unsigned int getSize() { return calls.get(); }
+
+  /** Number of lock operations which had to wait */
+  static unsigned int getContended() { return contended.get(); }
+
+  static void getStats(AmArg& ret);
 };
 
 #endif                           
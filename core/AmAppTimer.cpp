@@ -28,23 +28,22 @@
 #include "AmSessionContainer.h"
 
 #include "AmAppTimer.h"
+#include "sip/hash.h"
 #include "log.h"
 
 using std::map;
 
 class app_timer : public timer 
 {
-  string q_id;
-  int    timer_id;
-
  public:
-  app_timer(const string& q_id, int timer_id, unsigned int expires)
-    : timer(expires), timer_id(timer_id), q_id(q_id) {}
+  AmAppTimerQueue* q;    // NULL once removed from the queue
+  AmMutex*         lock; // lock of the queue
+  int              timer_id;
 
-  ~app_timer() {}
+  app_timer(AmAppTimerQueue* q, AmMutex* lock, int timer_id, unsigned int expires)
+    : timer(expires), q(q), lock(lock), timer_id(timer_id) {}
 
-  int get_id() { return timer_id; }
-  string get_q_id() { return q_id; }
+  ~app_timer() {}
 
   // timer interface
   void fire() {
@@ -68,6 +67,11 @@ public:
   }
 };
 
+AmAppTimerQueue::~AmAppTimerQueue()
+{
+  AmAppTimer::instance()->removeTimers(this);
+}
+
 _AmAppTimer::_AmAppTimer()
   : direct_timers_mut(true)
 {
@@ -76,32 +80,39 @@ _AmAppTimer::_AmAppTimer()
 _AmAppTimer::~_AmAppTimer() {
 }
 
+AmMutex& _AmAppTimer::getLock(const AmAppTimerQueue* q)
+{
+  unsigned int h = hashlittle(&q, sizeof(q), 0);
+  return queue_mut[h & (APP_TIMER_LOCKS-1)];
+}
+
+void _AmAppTimer::detach_timer(app_timer* t)
+{
+  t->q = NULL;
+  remove_timer(t);
+}
+
 void _AmAppTimer::app_timer_cb(app_timer* at)
 {
-  user_timers_mut.lock();
-  app_timer* at_local = erase_timer(at->get_q_id(), at->get_id());
-
-  if (NULL != at_local) {
-
-    if (at_local != at) {
-      DBG("timer was reset while expiring - not firing timer\n");
-      // we'd better re-insert at_local into user_timers
-      // what happens else, when at_local get fired ???
-      user_timers[at->get_q_id()][at->get_id()] = at_local;
-    } else {
-      DBG("timer fired: %d for '%s'\n", at->get_id(), at->get_q_id().c_str());
-      AmSessionContainer::instance()->postEvent(at->get_q_id(),
-						new AmTimeoutEvent(at->get_id()));
-      delete at;
-    }
+  AmMutex* lock = at->lock;
+  lock->lock();
 
-  } else {
-    DBG("timer %d for '%s' already removed\n",
-	at->get_id(), at->get_q_id().c_str());
+  AmAppTimerQueue* q = at->q;
+  if (NULL == q) {
+    DBG("timer %d already removed or reset\n", at->timer_id);
     // will be deleted by wheeltimer
+    lock->unlock();
+    return;
   }
 
-  user_timers_mut.unlock();
+  q->timers.erase(at->timer_id);
+
+  DBG("timer fired: %d for '%s'\n", at->timer_id, q->q_id.c_str());
+  AmSessionContainer::instance()->postEvent(q->q_id,
+					    new AmTimeoutEvent(at->timer_id));
+  lock->unlock();
+
+  delete at;
 }
 
 void _AmAppTimer::direct_app_timer_cb(direct_app_timer* t)
@@ -130,40 +141,11 @@ void _AmAppTimer::direct_app_timer_cb(direct_app_timer* t)
   direct_timers_mut.unlock();
 }
 
-app_timer* _AmAppTimer::erase_timer(const string& q_id, int id) 
-{
-  app_timer* res = NULL;
-
-  map<string, map<int, app_timer*> >::iterator it=user_timers.find(q_id);
-  if (it != user_timers.end()) {
-    map<int, app_timer*>::iterator t_it = it->second.find(id);
-    if (t_it != it->second.end()) {
-      res = t_it->second;
-      it->second.erase(t_it);
-      if (it->second.empty())
-	user_timers.erase(it);
-    }
-  }
-
-  return res;
-}
-
-app_timer* _AmAppTimer::create_timer(const string& q_id, int id, 
-				     unsigned int expires) 
-{
-  app_timer* timer = new app_timer(q_id, id, expires);
-  if (!timer)
-    return NULL;
-
-  user_timers[q_id][id] = timer;
-
-  return timer;
-}
-
 #define MAX_TIMER_SECONDS 365*24*3600 // one year, well below 1<<31
 
-void _AmAppTimer::setTimer(const string& eventqueue_name, int timer_id, double timeout) {
-
+void _AmAppTimer::setTimer(AmAppTimerQueue* q, const string& eventqueue_name,
+			   int timer_id, double timeout)
+{
   // microseconds
   unsigned int expires;
   if (timeout < 0) { // in the past
@@ -178,41 +160,44 @@ void _AmAppTimer::setTimer(const string& eventqueue_name, int timer_id, double t
 
   expires += wall_clock;
 
-  user_timers_mut.lock();
-  app_timer* t = erase_timer(eventqueue_name, timer_id);
-  if (NULL != t) {
-    remove_timer(t);
-  }
-  t = create_timer(eventqueue_name, timer_id, expires);
-  if (NULL != t) {
-    insert_timer(t);
+  AmMutex& lock = getLock(q);
+  app_timer* t = new app_timer(q, &lock, timer_id, expires);
+
+  lock.lock();
+  if (q->q_id != eventqueue_name)
+    q->q_id = eventqueue_name;
+
+  app_timer*& slot = q->timers[timer_id];
+  if (NULL != slot) {
+    detach_timer(slot);
   }
-  user_timers_mut.unlock();
+  slot = t;
+  insert_timer(t);
+  lock.unlock();
 }
 
-void _AmAppTimer::removeTimer(const string& eventqueue_name, int timer_id) 
+void _AmAppTimer::removeTimer(AmAppTimerQueue* q, int timer_id) 
 {
-  user_timers_mut.lock();
-  app_timer* t = erase_timer(eventqueue_name, timer_id);
-  if (NULL != t) {
-    remove_timer(t);
+  AmMutex& lock = getLock(q);
+  lock.lock();
+  AmAppTimerQueue::AppTimers::iterator it = q->timers.find(timer_id);
+  if (it != q->timers.end()) {
+    detach_timer(it->second);
+    q->timers.erase(it);
   }
-  user_timers_mut.unlock();
+  lock.unlock();
 }
 
-void _AmAppTimer::removeTimers(const string& eventqueue_name) 
+void _AmAppTimer::removeTimers(AmAppTimerQueue* q) 
 {
-  user_timers_mut.lock();
-  TimerQueues::iterator it=user_timers.find(eventqueue_name);
-  if (it != user_timers.end()) {
-    for (AppTimers::iterator t_it =
-	   it->second.begin(); t_it != it->second.end(); t_it++) {
-      if (NULL != t_it->second)
-	remove_timer(t_it->second);
-    }
-    user_timers.erase(it);
+  AmMutex& lock = getLock(q);
+  lock.lock();
+  for (AmAppTimerQueue::AppTimers::iterator it = q->timers.begin();
+       it != q->timers.end(); it++) {
+    detach_timer(it->second);
   }
-  user_timers_mut.unlock();
+  q->timers.clear();
+  lock.unlock();
 }
 
 void _AmAppTimer::setTimer_unsafe(DirectAppTimer* t, double timeout)
@@ -33,10 +33,13 @@
 using std::string;
 
 #include <map>
-#include <set>
 
 #define TICKS_PER_SEC (1000000 / TIMER_RESOLUTION)
 
+// number of locks the timer queues are spread over
+#define APP_TIMER_LOCKS_POWER 8
+#define APP_TIMER_LOCKS       (1<<APP_TIMER_LOCKS_POWER)
+
 class app_timer;
 class direct_app_timer;
 
@@ -47,23 +50,49 @@ public:
   virtual void fire()=0;
 };
 
+/**
+ * \brief Application timers of one event queue.
+ *
+ * Owned by the object which receives the timeout events (the session),
+ * so that setting and removing a timer does not look up the queue by
+ * name. The timers link directly into the wheel timer; the queue is
+ * protected by one of APP_TIMER_LOCKS locks, chosen by its address.
+ *
+ * The destructor removes all pending timers.
+ */
+class AmAppTimerQueue
+{
+  typedef std::map<int, app_timer*> AppTimers;
+
+  /** name of the event queue the timeout events are posted to */
+  string    q_id;
+  AppTimers timers;
+
+  friend class _AmAppTimer;
+
+  // not copyable
+  AmAppTimerQueue(const AmAppTimerQueue&);
+  AmAppTimerQueue& operator=(const AmAppTimerQueue&);
+
+ public:
+  AmAppTimerQueue() {}
+  ~AmAppTimerQueue();
+};
+
 class _AmAppTimer 
   : public _wheeltimer 
 {
-  typedef std::map<int, app_timer*>   AppTimers;
-  typedef std::map<string, AppTimers> TimerQueues;
   typedef std::map<DirectAppTimer*,direct_app_timer*> DirectTimers;
 
-  AmMutex user_timers_mut;
-  TimerQueues user_timers;
+  AmMutex queue_mut[APP_TIMER_LOCKS];
 
   AmMutex direct_timers_mut;
   DirectTimers direct_timers;
 
-  /** creates timer object and inserts it into our container */
-  app_timer* create_timer(const string& q_id, int id, unsigned int expires);
-  /** erases timer - does not delete timer object @return timer object pointer, if found */
-  app_timer* erase_timer(const string& q_id, int id);
+  AmMutex& getLock(const AmAppTimerQueue* q);
+
+  /** unlinks the timer from its queue - the lock must be held */
+  void detach_timer(app_timer* t);
 
   /* callback used by app_timer */
   void app_timer_cb(app_timer* at);
@@ -77,12 +106,16 @@ class _AmAppTimer
   _AmAppTimer();
   ~_AmAppTimer();
 
-  /** set a timer for event queue eventqueue_name with id timer_id and timeout (s) */
-  void setTimer(const string& eventqueue_name, int timer_id, double timeout);
-  /** remove timer for event queue eventqueue_name with id timer_id */
-  void removeTimer(const string& eventqueue_name, int timer_id);
-  /** remove all timers for event queue eventqueue_name */
-  void removeTimers(const string& eventqueue_name);
+  /**
+   * set a timer with id timer_id and timeout (s) in the timer queue q;
+   * the timeout event is posted to the event queue eventqueue_name
+   */
+  void setTimer(AmAppTimerQueue* q, const string& eventqueue_name,
+		int timer_id, double timeout);
+  /** remove timer with id timer_id from the timer queue q */
+  void removeTimer(AmAppTimerQueue* q, int timer_id);
+  /** remove all timers of the timer queue q */
+  void removeTimers(AmAppTimerQueue* q);
 
   /* set a timer which directly calls your handler */
   void setTimer(DirectAppTimer* t, double timeout);
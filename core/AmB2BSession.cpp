@@ -67,7 +67,7 @@ static void errCode2RelayedReply(AmSipReply &reply, int err_code, unsigned defau
 AmB2BSession::AmB2BSession(const string& other_local_tag, AmSipDialog* p_dlg,
 			   AmSipSubscription* p_subs)
   : AmSession(p_dlg),
-    other_id(other_local_tag),
+    other_id(other_local_tag), other_queue(0),
     sip_relay_only(true),
     subs(p_subs),
     rtp_relay_mode(RTP_Direct),
@@ -587,8 +587,17 @@ int AmB2BSession::relayEvent(AmEvent* ev)
       other_id.c_str());
 
   if(!other_id.empty()) {
-    if (!AmSessionContainer::instance()->postEvent(other_id,ev))
-      return -1;
+    // the other leg's queue handle saves the local tag lookup
+    AmEventDispatcher* ed = AmEventDispatcher::instance();
+    if(!other_queue)
+      other_queue = ed->getQueueHandle(other_id);
+
+    if(!other_queue || !ed->post(other_queue,ev)) {
+      // not registered (yet) or gone
+      other_queue = 0;
+      if (!AmSessionContainer::instance()->postEvent(other_id,ev))
+	return -1;
+    }
   } else {
     delete ev;
   }
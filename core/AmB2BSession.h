@@ -33,6 +33,7 @@
 #include "sip/hash.h"
 #include "AmB2BMedia.h"
 #include "AmSipSubscription.h"
+#include "AmEventDispatcher.h"
 
 #define MAX_RELAY_STREAMS 3 // voice, video, rtt
 
@@ -155,6 +156,9 @@ private:
   /** local tag of the other leg */
   string other_id;
 
+  /** event queue of the other leg (0 = not looked up yet) */
+  AmEventDispatcher::QueueHandle other_queue;
+
   /** CSeq map for REFER subscriptions */
   map<unsigned int, unsigned int> refer_id_map;
 
@@ -310,6 +314,7 @@ private:
 
   virtual void setOtherId(const string& n_other_id) {
     other_id = n_other_id;
+    other_queue = 0;
   }
   virtual const string& getOtherId() const { return other_id; }
 
@@ -42,10 +42,14 @@
 #include "AmUtils.h"
 #include "AmSessionContainer.h"
 #include "Am100rel.h"
+#include "AmRtcp.h"
 #include "sip/transport.h"
 #include "sip/resolver.h"
+#include "sip/dns_client.h"
 #include "sip/ip_util.h"
 #include "sip/sip_timers.h"
+#include "sip/wheeltimer.h"
+#include "sip/trans_table.h"
 #include "sip/raw_sender.h"
 
 #include <cctype>
@@ -61,6 +65,8 @@ string       AmConfig::ExcludePlugins          = "";
 string       AmConfig::ExcludePayloads         = "";
 int          AmConfig::LogLevel                = L_INFO;
 bool         AmConfig::LogStderr               = false;
+bool         AmConfig::LogAsync                = false;
+unsigned int AmConfig::LogRingSize             = 16;
 
 vector<AmConfig::SIP_interface> AmConfig::SIP_Ifs;
 vector<AmConfig::RTP_interface> AmConfig::RTP_Ifs;
@@ -80,7 +86,13 @@ unsigned int AmConfig::MaxShutdownTime         = DEFAULT_MAX_SHUTDOWN_TIME;
 
 int          AmConfig::SessionProcessorThreads = NUM_SESSION_PROCESSORS;
 int          AmConfig::MediaProcessorThreads   = NUM_MEDIA_PROCESSORS;
+vector<int>  AmConfig::MediaProcessorCPUs;
+int          AmConfig::MediaProcessorRTPriority = 0;
+unsigned int AmConfig::MediaRebalanceInterval   = 0;
+unsigned int AmConfig::MediaRebalanceThreshold  = 1000;
 int          AmConfig::RTPReceiverThreads      = NUM_RTP_RECEIVERS;
+bool         AmConfig::RtpJumboBuffers         = false;
+unsigned int AmConfig::RtpRelayBatchSize       = 1;
 int          AmConfig::SIPServerThreads        = NUM_SIP_SERVERS;
 string       AmConfig::OutboundProxy           = "";
 bool         AmConfig::ForceOutboundProxy      = false;
@@ -96,6 +108,7 @@ string       AmConfig::Signature               = "";
 unsigned int AmConfig::MaxForwards             = MAX_FORWARDS;
 bool	     AmConfig::SingleCodecInOK	       = false;
 unsigned int AmConfig::DeadRtpTime             = DEAD_RTP_TIME;
+unsigned int AmConfig::RtcpInterval            = RTCP_REPORT_INTERVAL;
 bool         AmConfig::IgnoreRTPXHdrs          = false;
 string       AmConfig::Application             = "";
 AmConfig::ApplicationSelector AmConfig::AppSelect        = AmConfig::App_SPECIFIED;
@@ -305,6 +318,14 @@ int AmConfig::setDeadRtpTime(const string& drt)
   return 1;
 }
 
+int AmConfig::setRtcpInterval(const string& ri)
+{
+  if(sscanf(ri.c_str(),"%u",&RtcpInterval) != 1) {
+    return 0;
+  }
+  return 1;
+}
+
 int AmConfig::readConfiguration()
 {
   DBG("Reading configuration...\n");
@@ -337,6 +358,28 @@ int AmConfig::readConfiguration()
     }
   }
 
+  if(cfg.hasParameter("log_async")){
+    if(cfg.getParameter("log_async") == "yes")
+      LogAsync = true;
+    else if(cfg.getParameter("log_async") == "no")
+      LogAsync = false;
+    else {
+      ERROR("invalid log_async value specified,"
+	    " valid are only yes or no\n");
+      ret = -1;
+    }
+  }
+
+  if(cfg.hasParameter("log_ring_size")){
+    int size = cfg.getParameterInt("log_ring_size",LogRingSize);
+    if(size <= 0) {
+      ERROR("invalid log_ring_size specified\n");
+      ret = -1;
+    }
+    else
+      LogRingSize = size;
+  }
+
 #ifndef DISABLE_SYSLOG_LOG
   if (cfg.hasParameter("syslog_facility")) {
     set_syslog_facility(cfg.getParameter("syslog_facility").c_str());
@@ -399,6 +442,16 @@ int AmConfig::readConfiguration()
   if(cfg.hasParameter("disable_dns_srv")) {
     _resolver::disable_srv = (cfg.getParameter("disable_dns_srv") == "yes");
   }
+
+  if(cfg.hasParameter("dns_timeout")) {
+    _dns_client::timeout =
+      cfg.getParameterInt("dns_timeout", _dns_client::timeout);
+  }
+
+  if(cfg.hasParameter("dns_retries")) {
+    _dns_client::retries =
+      cfg.getParameterInt("dns_retries", _dns_client::retries);
+  }
   
 
   for (int t = STIMER_A; t < __STIMER_MAX; t++) {
@@ -416,6 +469,30 @@ int AmConfig::readConfiguration()
     INFO("Set SIP Timer T2 to %u ms\n", sip_timer_t2);
   }
 
+  if (cfg.hasParameter("timer_resolution")) {
+    unsigned int res = cfg.getParameterInt("timer_resolution", 0);
+    if (!res || res > 1000) {
+      ERROR("invalid timer_resolution value specified\n");
+      ret = -1;
+    }
+    else {
+      _wheeltimer::resolution = res * 1000;
+      INFO("Set timer resolution to %u ms\n", res);
+    }
+  }
+
+  if (cfg.hasParameter("sip_trans_table_size")) {
+    unsigned int size = cfg.getParameterInt("sip_trans_table_size", 0);
+    if (!size) {
+      ERROR("invalid sip_trans_table_size value specified\n");
+      ret = -1;
+    }
+    else {
+      trans_table_size = size;
+      INFO("Set SIP transaction table size to %u buckets\n", size);
+    }
+  }
+
   // plugin_path
   if (cfg.hasParameter("plugin_path"))
     PlugInPath = cfg.getParameter("plugin_path");
@@ -555,6 +632,42 @@ int AmConfig::readConfiguration()
     }
   }
 
+  if(cfg.hasParameter("media_processor_cpus")){
+    vector<string> cpus = explode(cfg.getParameter("media_processor_cpus"),",");
+    for(vector<string>::iterator it = cpus.begin(); it != cpus.end(); it++) {
+      int cpu;
+      if(!str2int(trim(*it," "),cpu) || cpu < 0) {
+	ERROR("invalid media_processor_cpus value specified");
+	ret = -1;
+	break;
+      }
+      MediaProcessorCPUs.push_back(cpu);
+    }
+  }
+
+  if(cfg.hasParameter("media_processor_rt_priority")){
+    MediaProcessorRTPriority =
+      cfg.getParameterInt("media_processor_rt_priority",0);
+    if(MediaProcessorRTPriority < 0 || MediaProcessorRTPriority > 99) {
+      ERROR("invalid media_processor_rt_priority value specified");
+      ret = -1;
+    }
+  }
+
+  if(cfg.hasParameter("media_rebalance_interval")){
+    MediaRebalanceInterval =
+      cfg.getParameterInt("media_rebalance_interval",0);
+  }
+
+  if(cfg.hasParameter("media_rebalance_threshold")){
+    MediaRebalanceThreshold =
+      cfg.getParameterInt("media_rebalance_threshold",0);
+    if(!MediaRebalanceThreshold) {
+      ERROR("invalid media_rebalance_threshold value specified");
+      ret = -1;
+    }
+  }
+
   if(cfg.hasParameter("rtp_receiver_threads")){
     if(!setRTPReceiverThreads(cfg.getParameter("rtp_receiver_threads"))){
       ERROR("invalid rtp_receiver_threads value specified");
@@ -562,6 +675,18 @@ int AmConfig::readConfiguration()
     }
   }
 
+  if(cfg.hasParameter("rtp_jumbo_buffers")) {
+    RtpJumboBuffers = (cfg.getParameter("rtp_jumbo_buffers") == "yes");
+  }
+
+  RtpRelayBatchSize =
+    cfg.getParameterInt("rtp_relay_batch_size", RtpRelayBatchSize);
+  if(RtpJumboBuffers && (RtpRelayBatchSize > 1)) {
+    WARN("rtp_relay_batch_size ignored: batch buffers can not hold "
+	 "jumbo packets (rtp_jumbo_buffers=yes)\n");
+    RtpRelayBatchSize = 1;
+  }
+
   if(cfg.hasParameter("sip_server_threads")){
     if(!setSIPServerThreads(cfg.getParameter("sip_server_threads"))){
       ERROR("invalid sip_server_threads value specified");
@@ -590,6 +715,14 @@ int AmConfig::readConfiguration()
     }
   }
 
+  // rtcp_interval
+  if(cfg.hasParameter("rtcp_interval")){
+    if(!setRtcpInterval(cfg.getParameter("rtcp_interval"))){
+      ERROR("invalid rtcp_interval value specified");
+      ret = -1;
+    }
+  }
+
   if(cfg.hasParameter("dtmf_detector")){
     if (cfg.getParameter("dtmf_detector") == "spandsp") {
 #ifndef USE_SPANDSP
@@ -65,6 +65,10 @@ struct AmConfig
   static int LogLevel;
   /** log to stderr */
   static bool LogStderr;
+  /** run the log hooks in a dedicated thread */
+  static bool LogAsync;
+  /** size of the per-thread log ring buffers in KB */
+  static unsigned int LogRingSize;
 
 #ifndef DISABLE_DAEMON_MODE
   /** run the program in daemon mode? */
@@ -173,8 +177,20 @@ struct AmConfig
   static int SessionProcessorThreads;
   /** number of media processor threads */
   static int MediaProcessorThreads;
+  /** CPUs the media processor threads are pinned to (round robin) */
+  static vector<int> MediaProcessorCPUs;
+  /** SCHED_FIFO priority of the media processor threads (0: off) */
+  static int MediaProcessorRTPriority;
+  /** interval of the media thread load rebalancing (ms, 0: off) */
+  static unsigned int MediaRebalanceInterval;
+  /** min. load difference between media threads to rebalance (us per tick) */
+  static unsigned int MediaRebalanceThreshold;
   /** number of RTP receiver threads */
   static int RTPReceiverThreads;
+  /** use jumbo buffers for received RTP packets bigger than the MTU */
+  static bool RtpJumboBuffers;
+  /** max. number of packets received/sent at once by RTP relay streams */
+  static unsigned int RtpRelayBatchSize;
   /** number of SIP server threads */
   static int SIPServerThreads;
   /** Outbound Proxy (optional, outgoing calls only) */
@@ -264,6 +280,9 @@ struct AmConfig
   /** Time of no RTP after which Session is regarded as dead, 0 for no Timeout */
   static unsigned int DeadRtpTime;
 
+  /** Interval of the RTCP reports (seconds), 0 for no reports */
+  static unsigned int RtcpInterval;
+
   /** Ignore RTP Extension headers? */
   static bool IgnoreRTPXHdrs;
 
@@ -315,6 +334,8 @@ struct AmConfig
   static int setSIPServerThreads(const string& th);
   /** Setter for parameter DeadRtpTime, returns 0 on invalid value */
   static int setDeadRtpTime(const string& drt);
+  /** Setter for parameter RtcpInterval, returns 0 on invalid value */
+  static int setRtcpInterval(const string& ri);
 
 };
 
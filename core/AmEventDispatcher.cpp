@@ -30,20 +30,50 @@
 #include "AmConfig.h"
 #include "sip/hash.h"
 
+#include <string.h>
+
 unsigned int AmEventDispatcher::hash(const string& s1)
 {
-  return hashlittle(s1.c_str(),s1.length(),0) 
-    & (EVENT_DISPATCHER_BUCKETS-1);
+  return hashlittle(s1.c_str(),s1.length(),0);
 }
 
-unsigned int AmEventDispatcher::hash(const string& s1, const string s2)
+unsigned int AmEventDispatcher::hash(const string& callid,
+				     const string& remote_tag,
+				     const string& via_branch)
 {
     unsigned int h=0;
 
-    h = hashlittle(s1.c_str(),s1.length(),h);
-    h = hashlittle(s2.c_str(),s2.length(),h);
+    h = hashlittle(callid.c_str(),callid.length(),h);
+    h = hashlittle(remote_tag.c_str(),remote_tag.length(),h);
+    if(AmConfig::AcceptForkedDialogs){
+      h = hashlittle(via_branch.c_str(),via_branch.length(),h);
+    }
+
+    return h;
+}
+
+#define BUCKET(h) ((h) & (EVENT_DISPATCHER_BUCKETS-1))
+#define SLOT_LOCK(s) slot_locks[(s) & (EVENT_DISPATCHER_BUCKETS-1)]
+
+void AmEventDispatcher::Bucket::insert(QueueEntry* e,
+				       QueueEntry* QueueEntry::* next)
+{
+    e->*next = first;
+    first = e;
+    size++;
+}
 
-    return h & (EVENT_DISPATCHER_BUCKETS-1);
+void AmEventDispatcher::Bucket::remove(QueueEntry* e,
+				       QueueEntry* QueueEntry::* next)
+{
+    for(QueueEntry** p = &first; *p; p = &((*p)->*next)) {
+      if(*p == e) {
+	*p = e->*next;
+	e->*next = NULL;
+	size--;
+	return;
+      }
+    }
 }
 
 AmEventDispatcher* AmEventDispatcher::_instance=NULL;
@@ -53,21 +83,161 @@ AmEventDispatcher* AmEventDispatcher::instance()
   return _instance ? _instance : ((_instance = new AmEventDispatcher()));
 }
 
+AmEventDispatcher::AmEventDispatcher()
+  : n_slots(0)
+{
+  memset(slot_pages,0,sizeof(slot_pages));
+}
 
-bool AmEventDispatcher::addEventQueue(const string& local_tag,
-				      AmEventQueueInterface* q)
+AmEventDispatcher::~AmEventDispatcher()
+{
+  for (size_t i=0;i<EVENT_DISPATCHER_BUCKETS;i++) {
+    while(queues[i].first) {
+      QueueEntry* e = queues[i].first;
+      queues[i].first = e->next_tag;
+      delete e;
+    }
+  }
+
+  for (size_t i=0;i<EVENT_DISPATCHER_SLOT_PAGES;i++)
+    delete [] slot_pages[i];
+}
+
+/** must be called with queues[BUCKET(h)] locked */
+AmEventDispatcher::QueueEntry* 
+AmEventDispatcher::find(const string& local_tag, unsigned int h)
+{
+    for(QueueEntry* e = queues[BUCKET(h)].first; e; e = e->next_tag) {
+      if((e->tag_hash == h) && (e->local_tag == local_tag))
+	return e;
+    }
+    return NULL;
+}
+
+/** must be called with id_lookup[BUCKET(h)] locked */
+AmEventDispatcher::QueueEntry* 
+AmEventDispatcher::find(const string& callid,
+			const string& remote_tag,
+			const string& via_branch,
+			unsigned int h)
+{
+    for(QueueEntry* e = id_lookup[BUCKET(h)].first; e; e = e->next_id) {
+      if((e->id_hash == h) &&
+	 (e->callid == callid) &&
+	 (e->remote_tag == remote_tag) &&
+	 (!AmConfig::AcceptForkedDialogs || (e->via_branch == via_branch)))
+	return e;
+    }
+    return NULL;
+}
+
+bool AmEventDispatcher::alloc_slot(QueueEntry* e, QueueHandle* handle)
 {
-    unsigned int queue_bucket = hash(local_tag);
+    unsigned int slot;
+
+    slots_mut.lock();
+    if(!free_slots.empty()) {
+      slot = free_slots.front();
+      free_slots.pop_front();
+    }
+    else {
+      if(n_slots == EVENT_DISPATCHER_SLOT_PAGES * EVENT_DISPATCHER_SLOT_PAGE) {
+	slots_mut.unlock();
+	ERROR("too many event queues (%u)\n",n_slots);
+	return false;
+      }
+
+      slot = n_slots++;
+      unsigned int page = slot / EVENT_DISPATCHER_SLOT_PAGE;
+      if(!slot_pages[page]) {
+	slot_pages[page] = new Slot[EVENT_DISPATCHER_SLOT_PAGE];
+	memset(slot_pages[page],0,EVENT_DISPATCHER_SLOT_PAGE*sizeof(Slot));
+      }
+    }
+    slots_mut.unlock();
+
+    AmRWLock& l = SLOT_LOCK(slot);
+    l.lock_write();
+    Slot& s = get_slot(slot);
+    if(!s.gen) s.gen = 1;
+    s.e = e;
+    e->slot = slot;
+    if(handle)
+      *handle = ((QueueHandle)s.gen << 32) | slot;
+    l.unlock();
 
-    queues_mut[queue_bucket].lock();
+    return true;
+}
 
-    if (queues[queue_bucket].find(local_tag) != queues[queue_bucket].end()) {
-      queues_mut[queue_bucket].unlock();
+void AmEventDispatcher::free_slot(unsigned int slot)
+{
+    AmRWLock& l = SLOT_LOCK(slot);
+    l.lock_write();
+    Slot& s = get_slot(slot);
+    s.e = NULL;
+    // outstanding handles become invalid
+    if(!++s.gen) s.gen = 1;
+    l.unlock();
+
+    slots_mut.lock();
+    free_slots.push_back(slot);
+    slots_mut.unlock();
+}
+
+/** 
+ * Insert e into the local tag table, and into the ID table if e->has_id.
+ * @return false if one of the keys already exists
+ */
+bool AmEventDispatcher::insert(QueueEntry* e, QueueHandle* handle)
+{
+    e->tag_hash = hash(e->local_tag);
+    Bucket& queue_bucket = queues[BUCKET(e->tag_hash)];
+
+    queue_bucket.lock.lock_write();
+
+    if (find(e->local_tag,e->tag_hash)) {
+      queue_bucket.lock.unlock();
       return false;
     }
 
-    queues[queue_bucket][local_tag] = QueueEntry(q);
-    queues_mut[queue_bucket].unlock();
+    Bucket* id_bucket = NULL;
+    if(e->has_id) {
+      e->id_hash = hash(e->callid,e->remote_tag,e->via_branch);
+      id_bucket = &id_lookup[BUCKET(e->id_hash)];
+
+      id_bucket->lock.lock_write();
+      if (find(e->callid,e->remote_tag,e->via_branch,e->id_hash)) {
+	id_bucket->lock.unlock();
+	queue_bucket.lock.unlock();
+	return false;
+      }
+    }
+
+    if(!alloc_slot(e,handle)) {
+      if(id_bucket) id_bucket->lock.unlock();
+      queue_bucket.lock.unlock();
+      return false;
+    }
+
+    queue_bucket.insert(e,&QueueEntry::next_tag);
+    if(id_bucket) {
+      id_bucket->insert(e,&QueueEntry::next_id);
+      id_bucket->lock.unlock();
+    }
+    queue_bucket.lock.unlock();
+
+    return true;
+}
+
+bool AmEventDispatcher::addEventQueue(const string& local_tag,
+				      AmEventQueueInterface* q,
+				      QueueHandle* handle)
+{
+    QueueEntry* e = new QueueEntry(q,local_tag);
+    if(!insert(e,handle)) {
+      delete e;
+      return false;
+    }
     
     return true;
 }
@@ -78,76 +248,79 @@ bool AmEventDispatcher::addEventQueue(const string& local_tag,
 				      AmEventQueueInterface* q,
 				      const string& callid, 
 				      const string& remote_tag,
-				      const string& via_branch)
+				      const string& via_branch,
+				      QueueHandle* handle)
 {
     if(local_tag.empty () ||callid.empty() || remote_tag.empty() | via_branch.empty()) {
       ERROR("local_tag, callid, remote_tag or via_branch is empty");
       return false;
     }
 
-    unsigned int queue_bucket = hash(local_tag);
-
-    queues_mut[queue_bucket].lock();
-
-    if (queues[queue_bucket].find(local_tag) != queues[queue_bucket].end()) {
-      queues_mut[queue_bucket].unlock();
-      return false;
-    }
-
-    // try to find via id_lookup
-    string id = callid+remote_tag;
+    QueueEntry* e = new QueueEntry(q,local_tag);
+    e->has_id = true;
+    e->callid = callid;
+    e->remote_tag = remote_tag;
     if(AmConfig::AcceptForkedDialogs){
-      id += via_branch;
+      e->via_branch = via_branch;
     }
-    unsigned int id_bucket = hash(id);
 
-    id_lookup_mut[id_bucket].lock();
-    
-    if (id_lookup[id_bucket].find(id) != 
-	id_lookup[id_bucket].end()) {
-      id_lookup_mut[id_bucket].unlock();
-      queues_mut[queue_bucket].unlock();
+    if(!insert(e,handle)) {
+      delete e;
       return false;
     }
-
-    queues[queue_bucket][local_tag] = QueueEntry(q,id);
-    id_lookup[id_bucket][id] = local_tag;
-
-    id_lookup_mut[id_bucket].unlock();
-    queues_mut[queue_bucket].unlock();
     
     return true;
 }
 
+AmEventDispatcher::QueueHandle
+AmEventDispatcher::getQueueHandle(const string& local_tag)
+{
+    QueueHandle handle = 0;
+    unsigned int h = hash(local_tag);
+    Bucket& queue_bucket = queues[BUCKET(h)];
+
+    queue_bucket.lock.lock_read();
+    QueueEntry* e = find(local_tag,h);
+    if(e) {
+      AmRWLock& l = SLOT_LOCK(e->slot);
+      l.lock_read();
+      handle = ((QueueHandle)get_slot(e->slot).gen << 32) | e->slot;
+      l.unlock();
+    }
+    queue_bucket.lock.unlock();
+
+    return handle;
+}
+
 AmEventQueueInterface* AmEventDispatcher::delEventQueue(const string& local_tag)
 {
     AmEventQueueInterface* q = NULL;
-    unsigned int queue_bucket = hash(local_tag);
+    unsigned int h = hash(local_tag);
+    Bucket& queue_bucket = queues[BUCKET(h)];
 
-    queues_mut[queue_bucket].lock();
+    queue_bucket.lock.lock_write();
     
-    EvQueueMapIter qi = queues[queue_bucket].find(local_tag);
-    if(qi != queues[queue_bucket].end()) {
+    QueueEntry* e = find(local_tag,h);
+    if(e) {
 
-      QueueEntry qe(qi->second);
-      queues[queue_bucket].erase(qi);
-      q = qe.q;
+      queue_bucket.remove(e,&QueueEntry::next_tag);
+      q = e->q;
       
-      if(!qe.id.empty()) {
-	unsigned int id_bucket = hash(qe.id);
-	
-	id_lookup_mut[id_bucket].lock();
-	
-	DictIter di = id_lookup[id_bucket].find(qe.id);
-	if(di != id_lookup[id_bucket].end()) {	    
-	  id_lookup[id_bucket].erase(di);
-	}
-	
-	id_lookup_mut[id_bucket].unlock();
+      if(e->has_id) {
+	Bucket& id_bucket = id_lookup[BUCKET(e->id_hash)];
+	id_bucket.lock.lock_write();
+	id_bucket.remove(e,&QueueEntry::next_id);
+	id_bucket.lock.unlock();
       }
+
+      free_slot(e->slot);
     }
-    queues_mut[queue_bucket].unlock();
-    
+    queue_bucket.lock.unlock();
+
+    // nobody can reach e anymore: all the lookups 
+    // holding it were waiting for our write locks
+    delete e;
+
     return q;
 }
 
@@ -155,17 +328,18 @@ bool AmEventDispatcher::post(const string& local_tag, AmEvent* ev)
 {
     bool posted = false;
   
-    unsigned int queue_bucket = hash(local_tag);
+    unsigned int h = hash(local_tag);
+    Bucket& queue_bucket = queues[BUCKET(h)];
   
-    queues_mut[queue_bucket].lock();
+    queue_bucket.lock.lock_read();
  
-    EvQueueMapIter it = queues[queue_bucket].find(local_tag);
-    if(it != queues[queue_bucket].end()){
-	it->second.q->postEvent(ev);
+    QueueEntry* e = find(local_tag,h);
+    if(e){
+	e->q->postEvent(ev);
 	posted = true;
     }
 
-    queues_mut[queue_bucket].unlock();
+    queue_bucket.lock.unlock();
     
     return posted;
 }
@@ -176,23 +350,49 @@ bool AmEventDispatcher::post(const string& callid,
 			     const string& via_branch,
 			     AmEvent* ev)
 {
-    string id = callid+remote_tag;
-    if(AmConfig::AcceptForkedDialogs){
-      id += via_branch;
+    bool posted = false;
+
+    unsigned int h = hash(callid,remote_tag,via_branch);
+    Bucket& id_bucket = id_lookup[BUCKET(h)];
+
+    id_bucket.lock.lock_read();
+
+    QueueEntry* e = find(callid,remote_tag,via_branch,h);
+    if(e){
+	e->q->postEvent(ev);
+	posted = true;
     }
-    unsigned int id_bucket = hash(id);
 
-    id_lookup_mut[id_bucket].lock();
+    id_bucket.lock.unlock();
+ 
+    return posted;
+}
 
-    DictIter di = id_lookup[id_bucket].find(id);
-    if (di == id_lookup[id_bucket].end()) {
-      id_lookup_mut[id_bucket].unlock();
+bool AmEventDispatcher::post(QueueHandle handle, AmEvent* ev)
+{
+    bool posted = false;
+
+    unsigned int slot = (unsigned int)(handle & 0xFFFFFFFF);
+    unsigned int gen  = (unsigned int)(handle >> 32);
+
+    if(!gen || (slot >= EVENT_DISPATCHER_SLOT_PAGES * EVENT_DISPATCHER_SLOT_PAGE))
       return false;
+
+    AmRWLock& l = SLOT_LOCK(slot);
+    l.lock_read();
+
+    // the page has been allocated before the handle was handed out
+    if(slot_pages[slot / EVENT_DISPATCHER_SLOT_PAGE]) {
+      Slot& s = get_slot(slot);
+      if(s.e && (s.gen == gen)) {
+	s.e->q->postEvent(ev);
+	posted = true;
+      }
     }
-    string local_tag = di->second;
-    id_lookup_mut[id_bucket].unlock();
- 
-    return post(local_tag, ev);
+
+    l.unlock();
+
+    return posted;
 }
 
 bool AmEventDispatcher::broadcast(AmEvent* ev)
@@ -202,18 +402,12 @@ bool AmEventDispatcher::broadcast(AmEvent* ev)
 
     bool posted = false;
     for (size_t i=0;i<EVENT_DISPATCHER_BUCKETS;i++) {
-      queues_mut[i].lock();
-
-      EvQueueMapIter it = queues[i].begin(); 
-      while (it != queues[i].end()) {
-	EvQueueMapIter this_evq = it;
-	it++;
-	queues_mut[i].unlock();
-	this_evq->second.q->postEvent(ev->clone());
-	queues_mut[i].lock();
+      queues[i].lock.lock_read();
+      for(QueueEntry* e = queues[i].first; e; e = e->next_tag) {
+	e->q->postEvent(ev->clone());
 	posted = true;
       }
-      queues_mut[i].unlock();
+      queues[i].lock.unlock();
     }
 
     delete ev;
@@ -224,9 +418,9 @@ bool AmEventDispatcher::broadcast(AmEvent* ev)
 bool AmEventDispatcher::empty() {
     bool res = true;
     for (size_t i=0;i<EVENT_DISPATCHER_BUCKETS;i++) {
-      queues_mut[i].lock();
-      res = res&queues[i].empty();
-      queues_mut[i].unlock();    
+      queues[i].lock.lock_read();
+      res = res&(queues[i].size == 0);
+      queues[i].lock.unlock();    
       if (!res)
 	break;
     }
@@ -237,21 +431,20 @@ void AmEventDispatcher::dump()
 {
     DBG("*** dumping Event dispatcher buckets ***\n");
     for (size_t i=0;i<EVENT_DISPATCHER_BUCKETS;i++) {
-      queues_mut[i].lock();
-      if(!queues[i].empty()) {
-	DBG("queues[%zu].size() = %zu",i,queues[i].size());
-	for(EvQueueMapIter it = queues[i].begin();
-	    it != queues[i].end(); it++){
-	  DBG("\t%s -> %p\n",it->first.c_str(),it->second.q);
+      queues[i].lock.lock_read();
+      if(queues[i].size) {
+	DBG("queues[%zu].size = %u",i,queues[i].size);
+	for(QueueEntry* e = queues[i].first; e; e = e->next_tag) {
+	  DBG("\t%s -> %p\n",e->local_tag.c_str(),e->q);
 	}
       }
-      queues_mut[i].unlock();
+      queues[i].lock.unlock();
 
-      id_lookup_mut[i].lock();
-      if(!id_lookup[i].empty()) {
-	DBG("id_lookup[%zu].size() = %zu",i,id_lookup[i].size());
+      id_lookup[i].lock.lock_read();
+      if(id_lookup[i].size) {
+	DBG("id_lookup[%zu].size = %u",i,id_lookup[i].size);
       }
-      id_lookup_mut[i].unlock();
+      id_lookup[i].lock.unlock();
     }
     DBG("*** End of Event dispatcher bucket dump ***\n");
 }
@@ -271,39 +464,20 @@ void AmEventDispatcher::dispose()
     - if the session does not exist, no event need to be created (req copied) */
 bool AmEventDispatcher::postSipRequest(const AmSipRequest& req)
 {
-    // get local tag
     bool posted = false;
-    string callid = req.callid;
-    string remote_tag = req.from_tag;
 
-    string id = callid+remote_tag;
-    if(AmConfig::AcceptForkedDialogs){
-      id += req.via_branch;
-    }
-    unsigned int id_bucket = hash(id);
+    unsigned int h = hash(req.callid,req.from_tag,req.via_branch);
+    Bucket& id_bucket = id_lookup[BUCKET(h)];
 
-    id_lookup_mut[id_bucket].lock();
+    id_bucket.lock.lock_read();
 
-    DictIter di = id_lookup[id_bucket].find(id);
-    if (di == id_lookup[id_bucket].end()) {
-      id_lookup_mut[id_bucket].unlock();
-      return false;
-    }
-    string local_tag = di->second;
-    id_lookup_mut[id_bucket].unlock();
- 
-    // post(local_tag)
-    unsigned int queue_bucket = hash(local_tag);
-  
-    queues_mut[queue_bucket].lock();
- 
-    EvQueueMapIter it = queues[queue_bucket].find(local_tag);
-    if(it != queues[queue_bucket].end()){
-	it->second.q->postEvent(new AmSipRequestEvent(req));
+    QueueEntry* e = find(req.callid,req.from_tag,req.via_branch,h);
+    if(e){
+	e->q->postEvent(new AmSipRequestEvent(req));
 	posted = true;
     }
 
-    queues_mut[queue_bucket].unlock();
+    id_bucket.lock.unlock();
     
     return posted;
 }
@@ -29,37 +29,75 @@
 
 #include "AmEventQueue.h"
 #include "AmSipMsg.h"
-#include <map>
+#include "AmThread.h"
+
+#include <deque>
 
 #define EVENT_DISPATCHER_POWER   10
 #define EVENT_DISPATCHER_BUCKETS (1<<EVENT_DISPATCHER_POWER)
 
+/** queue handle slots are allocated by pages of this size */
+#define EVENT_DISPATCHER_SLOT_PAGE  1024
+/** max. number of slot pages (=> max. number of event queues) */
+#define EVENT_DISPATCHER_SLOT_PAGES 4096
+
 class AmEventDispatcher
 {
 public:
 
+    /**
+     * Numeric handle to an event queue, returned by addEventQueue().
+     * Posting through the handle saves the hashing and string
+     * comparisons of the local tag lookup. A handle is never
+     * reused for another queue, 0 is never a valid handle.
+     */
+    typedef unsigned long long QueueHandle;
+
     struct QueueEntry {
       AmEventQueueInterface* q;
-      string                 id;
-
-      QueueEntry()
-	: q(NULL), id() {}
+      string                 local_tag;
+
+      /**
+       * Call ID + remote tag (+ via_branch, with AcceptForkedDialogs)
+       *  (needed for CANCELs)
+       *  (UAS sessions only)
+       */
+      bool                   has_id;
+      string                 callid;
+      string                 remote_tag;
+      string                 via_branch;
+
+      unsigned int           tag_hash;
+      unsigned int           id_hash;
+      unsigned int           slot;
+
+      QueueEntry*            next_tag;
+      QueueEntry*            next_id;
+
+      QueueEntry(AmEventQueueInterface* q, const string& local_tag)
+	: q(q), local_tag(local_tag), has_id(false),
+	  tag_hash(0), id_hash(0), slot(0),
+	  next_tag(NULL), next_id(NULL) {}
+    };
 
-      QueueEntry(AmEventQueueInterface* q)
-        : q(q), id() {} 
+private:
 
-      QueueEntry(AmEventQueueInterface* q, string id)
-	: q(q), id(id){} 
-    };
+    /** hash chain, guarded by a read-write lock */
+    struct Bucket {
+      AmRWLock    lock;
+      QueueEntry* first;
+      unsigned int size;
 
-    typedef std::map<string, QueueEntry> EvQueueMap;
-    typedef EvQueueMap::iterator         EvQueueMapIter;
-    
-    typedef std::map<string,string>  Dictionnary;
-    typedef Dictionnary::iterator    DictIter;
+      Bucket() : first(NULL), size(0) {}
 
+      void insert(QueueEntry* e, QueueEntry* QueueEntry::* next);
+      void remove(QueueEntry* e, QueueEntry* QueueEntry::* next);
+    };
 
-private:
+    struct Slot {
+      QueueEntry*  e;
+      unsigned int gen;
+    };
 
     static AmEventDispatcher *_instance;
 
@@ -67,22 +105,49 @@ private:
      * Container for active sessions 
      * local tag -> event queue
      */
-    EvQueueMap queues[EVENT_DISPATCHER_BUCKETS];
-    
-    // mutex for "queues" 
-    AmMutex queues_mut[EVENT_DISPATCHER_BUCKETS];
+    Bucket queues[EVENT_DISPATCHER_BUCKETS];
 
     /** 
-     * Call ID + remote tag + via_branch -> local tag 
-     *  (needed for CANCELs)
-     *  (UAS sessions only)
+     * Call ID + remote tag + via_branch -> event queue
      */
-    Dictionnary id_lookup[EVENT_DISPATCHER_BUCKETS];
-    // mutex for "id_lookup" 
-    AmMutex id_lookup_mut[EVENT_DISPATCHER_BUCKETS];
+    Bucket id_lookup[EVENT_DISPATCHER_BUCKETS];
+
+    /**
+     * Queue handle -> event queue
+     *  slot_locks[slot & (EVENT_DISPATCHER_BUCKETS-1)] guards the slot
+     */
+    Slot*    slot_pages[EVENT_DISPATCHER_SLOT_PAGES];
+    AmRWLock slot_locks[EVENT_DISPATCHER_BUCKETS];
+
+    // unused slots, oldest first; guarded by slots_mut
+    std::deque<unsigned int> free_slots;
+    unsigned int n_slots;
+    AmMutex      slots_mut;
+
+    static unsigned int hash(const string& s1);
+    static unsigned int hash(const string& callid,
+			     const string& remote_tag,
+			     const string& via_branch);
+
+    QueueEntry* find(const string& local_tag, unsigned int h);
+    QueueEntry* find(const string& callid,
+		     const string& remote_tag,
+		     const string& via_branch,
+		     unsigned int h);
+
+    Slot& get_slot(unsigned int slot) {
+      return slot_pages[slot / EVENT_DISPATCHER_SLOT_PAGE]
+	[slot % EVENT_DISPATCHER_SLOT_PAGE];
+    }
+
+    bool alloc_slot(QueueEntry* e, QueueHandle* handle);
+    void free_slot(unsigned int slot);
+
+    bool insert(QueueEntry* e, QueueHandle* handle);
+
+    AmEventDispatcher();
+    ~AmEventDispatcher();
 
-    unsigned int hash(const string& s1);
-    unsigned int hash(const string& s1, const string s2);
 public:
 
     static AmEventDispatcher* instance();
@@ -96,17 +161,26 @@ public:
 	      const string& via_branch,
 	      AmEvent* ev);
 
+    /** post to the queue identified by a handle */
+    bool post(QueueHandle handle, AmEvent* ev);
+
     /* send event to all event queues. Note: event instances will be cloned */
     bool broadcast(AmEvent* ev);
 
+    /** @param handle if not NULL, receives the handle of the new queue */
     bool addEventQueue(const string& local_tag,
-		       AmEventQueueInterface* q);
+		       AmEventQueueInterface* q,
+		       QueueHandle* handle = NULL);
 
     bool addEventQueue(const string& local_tag, 
 		       AmEventQueueInterface* q,
 		       const string& callid, 
 		       const string& remote_tag,
-		       const string& via_branch);
+		       const string& via_branch,
+		       QueueHandle* handle = NULL);
+
+    /** @return the handle of the queue, or 0 if not found */
+    QueueHandle getQueueHandle(const string& local_tag);
 
     AmEventQueueInterface* delEventQueue(const string& local_tag);
 
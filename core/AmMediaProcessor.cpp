@@ -24,26 +24,131 @@
  */
 
 #include "AmMediaProcessor.h"
+#include "AmPeriodicThread.h"
 #include "AmSession.h"
 #include "AmRtpStream.h"
 
 #include <assert.h>
 #include <sys/time.h>
 #include <signal.h>
-
-// Solaris seems to need this for nanosleep().
-#if defined (__SVR4) && defined (__sun)
 #include <time.h>
+#include <sched.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/timerfd.h>
+#define MEDIA_TICK_TIMERFD
 #endif
 
+#define TICK_NSEC (WC_INC_MS * 1000000LL)
+
+/** max. number of ticks processed at once for a migrated callgroup */
+#define MEDIA_MAX_CATCHUP_TICKS 5
+
+/** 
+ * Start of the tick grid shared by all media threads
+ * (zero: each thread starts its own grid).
+ */
+static struct timespec tick_epoch;
+
+/** upper bounds (exclusive, in us) of the media tick histogram classes */
+static const unsigned int tick_class_max[MEDIA_TICK_CLASSES-1] =
+  { 100, 250, 500, 1000, 2000, 5000, 10000 };
+
+static unsigned int tick_class(long long us)
+{
+  unsigned int c = 0;
+  while(c < MEDIA_TICK_CLASSES-1 && us >= tick_class_max[c])
+    c++;
+  return c;
+}
+
+static void monotonic_now(struct timespec& ts)
+{
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+}
+
+static long long ts_diff_ns(const struct timespec& a, const struct timespec& b)
+{
+  return (a.tv_sec - b.tv_sec) * 1000000000LL + (a.tv_nsec - b.tv_nsec);
+}
+
+static void ts_add_ns(struct timespec& ts, long long ns)
+{
+  ns += ts.tv_nsec;
+  ts.tv_sec += ns / 1000000000LL;
+  ts.tv_nsec = ns % 1000000000LL;
+}
+
+/** is wallclock ts a later than b? */
+static bool wc_after(unsigned long long a, unsigned long long b)
+{
+  unsigned long long d = (a - b) & WALLCLOCK_MASK;
+  return d && (d < (WALLCLOCK_MASK >> 1));
+}
+
 /** \brief Request event to the MediaProcessor (remove,...) */
 struct SchedRequest :
   public AmEvent
 {
   AmMediaSession* s;
+  /** InsertSession: estimated processing cost of s */
+  unsigned int cost;
 
-  SchedRequest(int id, AmMediaSession* s)
-    : AmEvent(id), s(s) {}
+  SchedRequest(int id, AmMediaSession* s, unsigned int cost = 0)
+    : AmEvent(id), s(s), cost(cost) {}
+};
+
+/** \brief Callgroup migration between media processor threads */
+struct MigrateRequest :
+  public SchedRequest
+{
+  string       callgroup;
+  unsigned int from;
+  unsigned int to;
+
+  /** InsertCallgroup: sessions handed over and their cost */
+  std::vector<std::pair<AmMediaSession*, unsigned int> > sessions;
+  /** InsertCallgroup: ts of the first tick not processed by 'from' */
+  unsigned long long next_ts;
+
+  MigrateRequest(int id, const string& callgroup,
+		 unsigned int from, unsigned int to)
+    : SchedRequest(id, NULL), callgroup(callgroup),
+      from(from), to(to), next_ts(0) {}
+};
+
+/** \brief Periodically calls AmMediaProcessor::rebalance() */
+class AmMediaRebalancer :
+  public AmPeriodicThread
+{
+  AmSharedVar<bool> stop_requested;
+
+  void run() {
+    struct timeval tick;
+    tick.tv_sec  = AmConfig::MediaRebalanceInterval / 1000;
+    tick.tv_usec = (AmConfig::MediaRebalanceInterval % 1000) * 1000;
+    infinite_loop(&tick,1,NULL);
+  }
+
+  void on_stop() {
+    stop_requested.set(true);
+  }
+
+  bool looping_step(void*) {
+    if(stop_requested.get())
+      return false;
+    AmMediaProcessor::instance()->rebalance();
+    return true;
+  }
+
+public:
+  AmMediaRebalancer() : stop_requested(false) {}
 };
 
 /*         session scheduler              */
@@ -51,7 +156,7 @@ struct SchedRequest :
 AmMediaProcessor* AmMediaProcessor::_instance = NULL;
 
 AmMediaProcessor::AmMediaProcessor()
-  : threads(NULL),num_threads(0)
+  : threads(NULL),num_threads(0),rebalancer(NULL)
 {
 }
 
@@ -65,11 +170,19 @@ void AmMediaProcessor::init() {
   num_threads = AmConfig::MediaProcessorThreads;
   assert(num_threads > 0);
   DBG("Starting %u MediaProcessorThreads.\n", num_threads);
+  monotonic_now(tick_epoch);
   threads = new AmMediaProcessorThread*[num_threads];
   for (unsigned int i=0;i<num_threads;i++) {
-    threads[i] = new AmMediaProcessorThread();
+    threads[i] = new AmMediaProcessorThread(i);
     threads[i]->start();
   }
+
+  if (AmConfig::MediaRebalanceInterval && (num_threads > 1)) {
+    DBG("Rebalancing media processor threads every %u ms.\n",
+	AmConfig::MediaRebalanceInterval);
+    rebalancer = new AmMediaRebalancer();
+    rebalancer->start();
+  }
 }
 
 AmMediaProcessor* AmMediaProcessor::instance()
@@ -84,6 +197,10 @@ void AmMediaProcessor::addSession(AmMediaSession* s,
 				  const string& callgroup)
 {
   s->onMediaProcessingStarted();
+
+  // until it gets measured, count the session 
+  // as an average one
+  unsigned int cost = sessionCostEstimate();
  
   // evaluate correct scheduler
   unsigned int sched_thread = 0;
@@ -98,10 +215,13 @@ void AmMediaProcessor::addSession(AmMediaSession* s,
   } else {
     // no, find the thread with lowest load
     unsigned int lowest_load = threads[0]->getLoad();
+    unsigned int lowest_count = threads[0]->getSessionCount();
     for (unsigned int i=1;i<num_threads;i++) {
-      unsigned int lower = threads[i]->getLoad();
-      if (lower < lowest_load) {
-	lowest_load = lower; sched_thread = i;
+      unsigned int load = threads[i]->getLoad();
+      unsigned int count = threads[i]->getSessionCount();
+      if ((load < lowest_load) ||
+	  ((load == lowest_load) && (count < lowest_count))) {
+	lowest_load = load; lowest_count = count; sched_thread = i;
       }
     }
     // create callgroup->thread mapping
@@ -111,12 +231,25 @@ void AmMediaProcessor::addSession(AmMediaSession* s,
   // join the callgroup
   callgroupmembers.insert(make_pair(callgroup, s));
   session2callgroup[s]=callgroup;
+
+  threads[sched_thread]->pending_load.inc(cost);
     
   group_mut.unlock();
     
   // add the session to selected thread
   threads[sched_thread]->
-    postRequest(new SchedRequest(InsertSession,s));
+    postRequest(new SchedRequest(InsertSession,s,cost));
+}
+
+unsigned int AmMediaProcessor::sessionCostEstimate()
+{
+  unsigned long long total = 0;
+  unsigned int n = 0;
+  for (unsigned int i=0;i<num_threads;i++) {
+    total += threads[i]->load.get();
+    n += threads[i]->getSessionCount();
+  }
+  return n ? total / n : 0;
 }
 
 void AmMediaProcessor::clearSession(AmMediaSession* s) {
@@ -171,8 +304,182 @@ void AmMediaProcessor::removeFromProcessor(AmMediaSession* s,
   threads[sched_thread]->postRequest(new SchedRequest(r_type,s));
 }
 
+bool AmMediaProcessor::migrateCallgroup(const string& callgroup,
+					unsigned int thread)
+{
+  if (thread >= num_threads)
+    return false;
+
+  AmLock l(group_mut);
+  std::map<std::string, unsigned int>::iterator it =
+    callgroup2thread.find(callgroup);
+  if ((it == callgroup2thread.end()) || (it->second == thread))
+    return false;
+
+  // the current thread hands the sessions over between two ticks
+  threads[it->second]->
+    postRequest(new MigrateRequest(MigrateCallgroup,callgroup,
+				   it->second,thread));
+  return true;
+}
+
+void AmMediaProcessor::handOver(AmMediaProcessorThread* from,
+				MigrateRequest* mr)
+{
+  AmLock l(group_mut);
+
+  std::map<std::string, unsigned int>::iterator it =
+    callgroup2thread.find(mr->callgroup);
+  if ((it == callgroup2thread.end()) || (it->second != from->id)) {
+    DBG("callgroup '%s' gone or moved, not migrating it\n",
+	mr->callgroup.c_str());
+    return;
+  }
+
+  MigrateRequest* ir =
+    new MigrateRequest(InsertCallgroup,mr->callgroup,mr->from,mr->to);
+  ir->next_ts = from->next_ts;
+
+  // members not inserted yet are forwarded later (see redirectInsert)
+  unsigned int total = 0;
+  std::multimap<std::string, AmMediaSession*>::iterator m_it =
+    callgroupmembers.lower_bound(mr->callgroup);
+  for (; (m_it != callgroupmembers.end()) && (m_it->first == mr->callgroup);
+       m_it++) {
+    unsigned int cost;
+    if (from->handOver(m_it->second,cost)) {
+      ir->sessions.push_back(std::make_pair(m_it->second,cost));
+      total += cost;
+    }
+  }
+
+  // requests for the callgroup are sent to the new thread from now on,
+  // they will be processed after the sessions are inserted there
+  it->second = mr->to;
+  threads[mr->to]->pending_load.inc(total);
+  threads[mr->to]->postRequest(ir);
+}
+
+bool AmMediaProcessor::redirectInsert(AmMediaProcessorThread* t,
+				      AmMediaSession* s, unsigned int cost)
+{
+  AmLock l(group_mut);
+
+  std::map<AmMediaSession*, string>::iterator s_it =
+    session2callgroup.find(s);
+  if (s_it == session2callgroup.end())
+    return false;
+
+  std::map<std::string, unsigned int>::iterator it =
+    callgroup2thread.find(s_it->second);
+  if ((it == callgroup2thread.end()) || (it->second == t->id))
+    return false;
+
+  t->pending_load.dec(cost);
+  threads[it->second]->pending_load.inc(cost);
+  threads[it->second]->
+    postRequest(new SchedRequest(InsertSession,s,cost));
+  return true;
+}
+
+bool AmMediaProcessor::redirectClear(AmMediaProcessorThread* t,
+				     AmMediaSession* s)
+{
+  AmLock l(group_mut);
+
+  // sessions removed from their callgroup have not been migrated
+  std::map<AmMediaSession*, string>::iterator s_it =
+    session2callgroup.find(s);
+  if (s_it == session2callgroup.end())
+    return false;
+
+  std::map<std::string, unsigned int>::iterator it =
+    callgroup2thread.find(s_it->second);
+  if ((it == callgroup2thread.end()) || (it->second == t->id))
+    return false;
+
+  threads[it->second]->
+    postRequest(new SchedRequest(ClearSession,s));
+  return true;
+}
+
+void AmMediaProcessor::rebalance()
+{
+  if (num_threads < 2)
+    return;
+
+  unsigned int max_t = 0, min_t = 0;
+  long long max_load = threads[0]->getLoad();
+  long long min_load = max_load;
+  for (unsigned int i=1;i<num_threads;i++) {
+    long long load = threads[i]->getLoad();
+    if (load > max_load) { max_load = load; max_t = i; }
+    if (load < min_load) { min_load = load; min_t = i; }
+  }
+
+  if (max_load - min_load < AmConfig::MediaRebalanceThreshold * 1000LL)
+    return;
+
+  std::map<AmMediaSession*, unsigned int> costs;
+  threads[max_t]->getSessionCosts(costs);
+
+  // pick the callgroup which best evens out the two threads
+  string best;
+  long long best_peak = max_load;
+
+  group_mut.lock();
+  std::map<string, long long> cg_costs;
+  for (std::map<AmMediaSession*, unsigned int>::iterator it = costs.begin();
+       it != costs.end(); it++) {
+    std::map<AmMediaSession*, string>::iterator s_it =
+      session2callgroup.find(it->first);
+    if (s_it == session2callgroup.end())
+      continue;
+    std::map<std::string, unsigned int>::iterator t_it =
+      callgroup2thread.find(s_it->second);
+    if ((t_it != callgroup2thread.end()) && (t_it->second == max_t))
+      cg_costs[s_it->second] += it->second;
+  }
+  group_mut.unlock();
+
+  for (std::map<string, long long>::iterator it = cg_costs.begin();
+       it != cg_costs.end(); it++) {
+    long long peak = std::max(max_load - it->second, min_load + it->second);
+    if (peak < best_peak) {
+      best_peak = peak;
+      best = it->first;
+    }
+  }
+
+  if (best.empty())
+    return;
+
+  DBG("rebalancing: moving callgroup '%s' (%lld ns/tick) from media "
+      "processor %u (%lld ns/tick) to %u (%lld ns/tick)\n",
+      best.c_str(), cg_costs[best], max_t, max_load, min_t, min_load);
+  migrateCallgroup(best,min_t);
+}
+
+void AmMediaProcessor::getStats(AmArg& ret)
+{
+  ret.assertArray();
+  for (unsigned int i=0;i<num_threads;i++) {
+    AmArg entry;
+    threads[i]->getStats(entry);
+    ret.push(entry);
+  }
+}
+
 void AmMediaProcessor::stop() {
   assert(threads);
+  if (rebalancer) {
+    rebalancer->stop();
+    while (!rebalancer->is_stopped())
+      usleep(10000);
+    delete rebalancer;
+    rebalancer = NULL;
+  }
+
   for (unsigned int i=0;i<num_threads;i++) {
     if(threads[i] != NULL) {
       threads[i]->stop();
@@ -213,8 +520,8 @@ void AmMediaProcessor::dispose()
 
 /* the actual media processing thread */
 
-AmMediaProcessorThread::AmMediaProcessorThread()
-  : events(this), stop_requested(false)
+AmMediaProcessorThread::AmMediaProcessorThread(unsigned int id)
+  : id(id), events(this), next_ts(0), stop_requested(false)
 {
 }
 AmMediaProcessorThread::~AmMediaProcessorThread()
@@ -227,43 +534,129 @@ void AmMediaProcessorThread::on_stop()
   stop_requested.set(true);
 }
 
-void AmMediaProcessorThread::run()
+void AmMediaProcessorThread::setupScheduling()
 {
-  stop_requested = false;
-  struct timeval now,next_tick,diff,tick;
-
-  // wallclock time
-  unsigned long long ts = 0;//4294417296;
+  if(!AmConfig::MediaProcessorCPUs.empty()) {
+    int cpu = AmConfig::MediaProcessorCPUs[id % AmConfig::MediaProcessorCPUs.size()];
+#ifdef __linux__
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu,&cpus);
+    int err = pthread_setaffinity_np(pthread_self(),sizeof(cpus),&cpus);
+    if(err) {
+      ERROR("media processor %u: could not pin thread to CPU %i: %s\n",
+	    id,cpu,strerror(err));
+    }
+    else {
+      DBG("media processor %u pinned to CPU %i\n",id,cpu);
+    }
+#else
+    WARN("media processor %u: CPU affinity not supported on this platform\n",id);
+#endif
+  }
 
-  tick.tv_sec  = 0;
-  tick.tv_usec = 1000*WC_INC_MS;
+  if(AmConfig::MediaProcessorRTPriority > 0) {
+    struct sched_param param;
+    memset(&param,0,sizeof(param));
+    param.sched_priority = AmConfig::MediaProcessorRTPriority;
+    int err = pthread_setschedparam(pthread_self(),SCHED_FIFO,&param);
+    if(err) {
+      ERROR("media processor %u: could not set SCHED_FIFO priority %i: %s "
+	    "(try to run SEMS with CAP_SYS_NICE)\n",
+	    id,param.sched_priority,strerror(err));
+    }
+    else {
+      DBG("media processor %u runs with SCHED_FIFO priority %i\n",
+	  id,param.sched_priority);
+    }
+  }
+}
 
-  gettimeofday(&now,NULL);
-  timeradd(&tick,&now,&next_tick);
+void AmMediaProcessorThread::run()
+{
+  stop_requested = false;
+  setupScheduling();
+
+  // the ticks are scheduled on the monotonic clock:
+  // they are not affected by changes of the system time
+  struct timespec now,next_tick;
+  monotonic_now(now);
+
+  // all media threads tick on the same grid, with the same
+  // wallclock ts: callgroups can move from one thread to
+  // another without skipping or repeating a tick
+  struct timespec epoch = tick_epoch;
+  if(!epoch.tv_sec && !epoch.tv_nsec)
+    epoch = now;
+
+  unsigned long long tick_no = ts_diff_ns(now,epoch) / TICK_NSEC + 1;
+  next_tick = epoch;
+  ts_add_ns(next_tick,tick_no * TICK_NSEC);
+  next_ts = (tick_no * WC_INC) & WALLCLOCK_MASK;
+
+#ifdef MEDIA_TICK_TIMERFD
+  int tfd = timerfd_create(CLOCK_MONOTONIC,0);
+  if(tfd < 0) {
+    ERROR("media processor %u: timerfd_create: %s\n",id,strerror(errno));
+  }
+  else {
+    struct itimerspec its;
+    its.it_value = next_tick;
+    its.it_interval.tv_sec = 0;
+    its.it_interval.tv_nsec = TICK_NSEC;
+    if(timerfd_settime(tfd,TFD_TIMER_ABSTIME,&its,NULL)) {
+      ERROR("media processor %u: timerfd_settime: %s\n",id,strerror(errno));
+      close(tfd);
+      tfd = -1;
+    }
+  }
+#endif
     
   while(!stop_requested.get()){
 
-    gettimeofday(&now,NULL);
-
-    if(timercmp(&now,&next_tick,<)){
-
-      struct timespec sdiff,rem;
-      timersub(&next_tick,&now,&diff);
-
-      sdiff.tv_sec  = diff.tv_sec;
-      sdiff.tv_nsec = diff.tv_usec * 1000;
-
-      if(sdiff.tv_nsec > 2000000) // 2 ms
+    monotonic_now(now);
+
+    // wait for the tick; when late, catch up without waiting
+    while(ts_diff_ns(next_tick,now) > 0) {
+#ifdef MEDIA_TICK_TIMERFD
+      if(tfd >= 0) {
+	uint64_t expirations;
+	if(read(tfd,&expirations,sizeof(expirations)) < 0 && errno != EINTR) {
+	  ERROR("media processor %u: reading timerfd: %s\n",id,strerror(errno));
+	  close(tfd);
+	  tfd = -1;
+	}
+      }
+      else
+#endif
+      {
+	struct timespec sdiff,rem;
+	long long ns = ts_diff_ns(next_tick,now);
+	sdiff.tv_sec  = ns / 1000000000LL;
+	sdiff.tv_nsec = ns % 1000000000LL;
 	nanosleep(&sdiff,&rem);
+      }
+      monotonic_now(now);
     }
 
-    processAudio(ts);
+    long long late_ns = ts_diff_ns(now,next_tick);
+    ticks.inc();
+    late[tick_class(late_ns / 1000)].inc();
+    if(late_ns >= TICK_NSEC)
+      overruns.inc();
+
+    processAudio(next_ts);
+    next_ts = (next_ts + WC_INC) & WALLCLOCK_MASK;
     events.processEvents();
     processDtmfEvents();
 
-    ts = (ts + WC_INC) & WALLCLOCK_MASK;
-    timeradd(&tick,&next_tick,&next_tick);
+    ts_add_ns(next_tick,TICK_NSEC);
   }
+
+#ifdef MEDIA_TICK_TIMERFD
+  if(tfd >= 0)
+    close(tfd);
+#endif
 }
 
 /**
@@ -271,33 +664,153 @@ void AmMediaProcessorThread::run()
  */
 void AmMediaProcessorThread::processDtmfEvents()
 {
-  for(set<AmMediaSession*>::iterator it = sessions.begin();
+  for(SessionMap::iterator it = sessions.begin();
       it != sessions.end(); it++)
     {
-      AmMediaSession* s = (*it);
+      AmMediaSession* s = it->first;
       s->processDtmfEvents();
     }
 }
 
 void AmMediaProcessorThread::processAudio(unsigned long long ts)
 {
+  struct timespec start,now,last;
+  monotonic_now(start);
+  last = start;
+
   // receiving
-  for(set<AmMediaSession*>::iterator it = sessions.begin();
+  for(SessionMap::iterator it = sessions.begin();
       it != sessions.end(); it++)
   {
-    if ((*it)->readStreams(ts, buffer) < 0)
-      postRequest(new SchedRequest(AmMediaProcessor::ClearSession, *it));
+    SessionInfo& si = it->second;
+    si.cur = 0;
+
+    if(si.resuming) {
+      // migrated: this tick has been processed by the other thread
+      if(wc_after(si.resume_ts,ts))
+	continue;
+      si.resuming = false;
+    }
+
+    if (it->first->readStreams(ts, buffer) < 0)
+      postRequest(new SchedRequest(AmMediaProcessor::ClearSession, it->first));
+
+    monotonic_now(now);
+    si.cur = ts_diff_ns(now,last);
+    last = now;
   }
 
+  read_time[tick_class(ts_diff_ns(last,start) / 1000)].inc();
+  start = last;
+
   // sending
-  for(set<AmMediaSession*>::iterator it = sessions.begin();
+  for(SessionMap::iterator it = sessions.begin();
       it != sessions.end(); it++)
   {
-    if ((*it)->writeStreams(ts, buffer) < 0)
-      postRequest(new SchedRequest(AmMediaProcessor::ClearSession, *it));
+    SessionInfo& si = it->second;
+    if(!si.resuming) {
+      if (it->first->writeStreams(ts, buffer) < 0)
+	postRequest(new SchedRequest(AmMediaProcessor::ClearSession, it->first));
+
+      monotonic_now(now);
+      si.cur += ts_diff_ns(now,last);
+      last = now;
+    }
+
+    // smoothed over ~16 ticks
+    si.cost = si.cost - (si.cost >> 4) + (si.cur >> 4);
+  }
+
+  write_time[tick_class(ts_diff_ns(last,start) / 1000)].inc();
+
+  updateLoad();
+
+  if(!(ticks.get() % MEDIA_COST_SNAPSHOT_TICKS)) {
+    AmLock l(cost_mut);
+    cost_snapshot.clear();
+    for(SessionMap::iterator it = sessions.begin();
+	it != sessions.end(); it++)
+      cost_snapshot[it->first] = it->second.cost;
   }
 }
 
+void AmMediaProcessorThread::updateLoad()
+{
+  unsigned long long total = 0;
+  for(SessionMap::iterator it = sessions.begin();
+      it != sessions.end(); it++)
+    total += it->second.cost;
+
+  load.set(total > 0xFFFFFFFF ? 0xFFFFFFFF : (unsigned int)total);
+  n_sessions.set(sessions.size());
+}
+
+void AmMediaProcessorThread::insertSession(AmMediaSession* s, 
+					   unsigned int cost)
+{
+  sessions.insert(std::make_pair(s,SessionInfo(cost)));
+  s->clearRTPTimeout();
+  updateLoad();
+}
+
+bool AmMediaProcessorThread::handOver(AmMediaSession* s, unsigned int& cost)
+{
+  SessionMap::iterator s_it = sessions.find(s);
+  if(s_it == sessions.end())
+    return false;
+
+  cost = s_it->second.cost;
+  sessions.erase(s_it);
+  return true;
+}
+
+void AmMediaProcessorThread::insertCallgroup(MigrateRequest* mr)
+{
+  unsigned int total = 0;
+  for(unsigned int i=0; i<mr->sessions.size(); i++) {
+    sessions.insert(std::make_pair(mr->sessions[i].first,
+				   SessionInfo(mr->sessions[i].second)));
+    total += mr->sessions[i].second;
+  }
+  pending_load.dec(total);
+
+  if(wc_after(mr->next_ts,next_ts)) {
+    // we are late: skip the ticks already processed by the other thread
+    for(unsigned int i=0; i<mr->sessions.size(); i++) {
+      SessionInfo& si = sessions[mr->sessions[i].first];
+      si.resuming = true;
+      si.resume_ts = mr->next_ts;
+    }
+  }
+  else {
+    // we are ahead: process the ticks the other thread did not process
+    unsigned int missed = ((next_ts - mr->next_ts) & WALLCLOCK_MASK) / WC_INC;
+    if(missed > MEDIA_MAX_CATCHUP_TICKS) {
+      WARN("callgroup '%s' migrated with %u ticks missed\n",
+	   mr->callgroup.c_str(),missed);
+      missed = 0;
+    }
+
+    for(unsigned int t=0; t<missed; t++) {
+      unsigned long long ts = (mr->next_ts + t * WC_INC) & WALLCLOCK_MASK;
+      for(unsigned int i=0; i<mr->sessions.size(); i++) {
+	AmMediaSession* s = mr->sessions[i].first;
+	if(s->readStreams(ts, buffer) < 0)
+	  postRequest(new SchedRequest(AmMediaProcessor::ClearSession, s));
+      }
+      for(unsigned int i=0; i<mr->sessions.size(); i++) {
+	AmMediaSession* s = mr->sessions[i].first;
+	if(s->writeStreams(ts, buffer) < 0)
+	  postRequest(new SchedRequest(AmMediaProcessor::ClearSession, s));
+      }
+    }
+  }
+
+  updateLoad();
+  DBG("callgroup '%s' (%zu sessions) migrated from media processor %u to %u\n",
+      mr->callgroup.c_str(),mr->sessions.size(),mr->from,mr->to);
+}
+
 void AmMediaProcessorThread::process(AmEvent* e)
 {
   SchedRequest* sr = dynamic_cast<SchedRequest*>(e);
@@ -309,16 +822,20 @@ void AmMediaProcessorThread::process(AmEvent* e)
   switch(sr->event_id){
 
   case AmMediaProcessor::InsertSession:
+    // callgroup migrated before the session could be inserted?
+    if(AmMediaProcessor::instance()->redirectInsert(this,sr->s,sr->cost))
+      break;
     DBG("Session inserted to the scheduler\n");
-    sessions.insert(sr->s);
-    sr->s->clearRTPTimeout();
+    insertSession(sr->s,sr->cost);
+    pending_load.dec(sr->cost);
     break;
 
   case AmMediaProcessor::RemoveSession:{
     AmMediaSession* s = sr->s;
-    set<AmMediaSession*>::iterator s_it = sessions.find(s);
+    SessionMap::iterator s_it = sessions.find(s);
     if(s_it != sessions.end()){
       sessions.erase(s_it);
+      updateLoad();
       s->onMediaProcessingTerminated();
       DBG("Session removed from the scheduler\n");
     }
@@ -327,27 +844,43 @@ void AmMediaProcessorThread::process(AmEvent* e)
 
   case AmMediaProcessor::ClearSession:{
     AmMediaSession* s = sr->s;
-    set<AmMediaSession*>::iterator s_it = sessions.find(s);
+    SessionMap::iterator s_it = sessions.find(s);
     if(s_it != sessions.end()){
       sessions.erase(s_it);
+      updateLoad();
       s->clearAudio();
       s->onMediaProcessingTerminated();
       DBG("Session removed from the scheduler\n");
     }
+    else {
+      // posted by this thread before the callgroup has been migrated?
+      AmMediaProcessor::instance()->redirectClear(this,s);
+    }
   }
     break;
 
 
   case AmMediaProcessor::SoftRemoveSession:{
     AmMediaSession* s = sr->s;
-    set<AmMediaSession*>::iterator s_it = sessions.find(s);
+    SessionMap::iterator s_it = sessions.find(s);
     if(s_it != sessions.end()){
       sessions.erase(s_it);
+      updateLoad();
       DBG("Session removed softly from the scheduler\n");
     }
   }
     break;
 
+  case AmMediaProcessor::MigrateCallgroup:
+    AmMediaProcessor::instance()->
+      handOver(this,static_cast<MigrateRequest*>(sr));
+    updateLoad();
+    break;
+
+  case AmMediaProcessor::InsertCallgroup:
+    insertCallgroup(static_cast<MigrateRequest*>(sr));
+    break;
+
   default:
     ERROR("AmMediaProcessorThread::process: unknown event id.");
     break;
@@ -355,8 +888,43 @@ void AmMediaProcessorThread::process(AmEvent* e)
 }
 
 unsigned int AmMediaProcessorThread::getLoad() {
-  // lock ? 
-  return sessions.size();
+  return load.get() + pending_load.get();
+}
+
+unsigned int AmMediaProcessorThread::getSessionCount() {
+  return n_sessions.get();
+}
+
+void AmMediaProcessorThread::getSessionCosts(std::map<AmMediaSession*,
+					     unsigned int>& costs)
+{
+  AmLock l(cost_mut);
+  costs = cost_snapshot;
+}
+
+void AmMediaProcessorThread::getStats(AmArg& ret)
+{
+  ret["sessions"] = (int)getSessionCount();
+  ret["load_ns"] = (int)getLoad();
+  ret["ticks"] = (int)ticks.get();
+  ret["overruns"] = (int)overruns.get();
+
+  AmArg& late_us = ret["late_us"];
+  AmArg& read_us = ret["read_us"];
+  AmArg& write_us = ret["write_us"];
+  for(unsigned int c=0; c<MEDIA_TICK_CLASSES; c++) {
+
+    string range;
+    if(c == MEDIA_TICK_CLASSES-1)
+      range = ">=" + int2str(tick_class_max[c-1]);
+    else
+      range = int2str(c ? tick_class_max[c-1] : 0) + "-" +
+	int2str(tick_class_max[c] - 1);
+
+    late_us[range] = (int)late[c].get();
+    read_us[range] = (int)read_time[c].get();
+    write_us[range] = (int)write_time[c].get();
+  }
 }
 
 inline void AmMediaProcessorThread::postRequest(SchedRequest* sr) {
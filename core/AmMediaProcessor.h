@@ -29,6 +29,8 @@
 #define _AmMediaProcessor_h_
 
 #include "AmEventQueue.h"
+#include "AmArg.h"
+#include "atomic_types.h"
 #include "amci/amci.h" // AUDIO_BUFFER_SIZE
 
 #include <set>
@@ -36,6 +38,14 @@ using std::set;
 #include <map>
 
 struct SchedRequest;
+struct MigrateRequest;
+class AmMediaRebalancer;
+
+/** number of classes of the media tick histograms */
+#define MEDIA_TICK_CLASSES 8
+
+/** session costs are published for the rebalancer every n ticks */
+#define MEDIA_COST_SNAPSHOT_TICKS 100
 
 /** Interface for basic media session processing.
  *
@@ -158,16 +168,68 @@ class AmMediaProcessorThread :
   public AmThread,
   public AmEventHandler
 {
+  /** media session and its processing cost */
+  struct SessionInfo {
+    /** smoothed processing time per tick (ns) */
+    unsigned int cost;
+    /** processing time in the current tick (ns) */
+    unsigned int cur;
+    /** after a migration: ts of the first tick to process */
+    unsigned long long resume_ts;
+    bool resuming;
+
+    SessionInfo(unsigned int cost = 0)
+      : cost(cost), cur(0), resume_ts(0), resuming(false) {}
+  };
+  typedef std::map<AmMediaSession*, SessionInfo> SessionMap;
+
+  unsigned int    id;
   AmEventQueue    events;
   unsigned char   buffer[AUDIO_BUFFER_SIZE];
-  set<AmMediaSession*> sessions;
-  
+  SessionMap      sessions;
+
+  /** ts of the next tick to process */
+  unsigned long long next_ts;
+
+  /** sum of the session costs (ns per tick) */
+  atomic_int load;
+  /** estimated cost of the sessions waiting to be inserted */
+  atomic_int pending_load;
+  /** number of sessions, for other threads */
+  atomic_int n_sessions;
+
+  /** session costs as published for the rebalancer */
+  std::map<AmMediaSession*, unsigned int> cost_snapshot;
+  AmMutex cost_mut;
+
+  /**
+   * Media tick accounting:
+   *  ticks processed, ticks processed more than one period late,
+   *  histograms of the tick lateness and of the time spent
+   *  in readStreams / writeStreams per tick.
+   */
+  atomic_int ticks;
+  atomic_int overruns;
+  atomic_int late[MEDIA_TICK_CLASSES];
+  atomic_int read_time[MEDIA_TICK_CLASSES];
+  atomic_int write_time[MEDIA_TICK_CLASSES];
+
+  /** apply CPU affinity and real-time priority from config */
+  void setupScheduling();
+
   void processAudio(unsigned long long ts);
   /**
    * Process pending DTMF events
    */
   void processDtmfEvents();
 
+  void insertSession(AmMediaSession* s, unsigned int cost);
+  /** take over a callgroup migrated from another thread */
+  void insertCallgroup(MigrateRequest* mr);
+  /** remove a session handed over to another thread */
+  bool handOver(AmMediaSession* s, unsigned int& cost);
+  void updateLoad();
+
   // AmThread interface
   void run();
   void on_stop();
@@ -176,12 +238,26 @@ class AmMediaProcessorThread :
   // AmEventHandler interface
   void process(AmEvent* e);
 public:
-  AmMediaProcessorThread();
+  AmMediaProcessorThread(unsigned int id);
   ~AmMediaProcessorThread();
 
   inline void postRequest(SchedRequest* sr);
   
+  /** 
+   * Media processing load: smoothed processing time per tick 
+   * of the sessions (ns), plus the estimated cost of the 
+   * sessions about to be inserted.
+   */
   unsigned int getLoad();
+
+  unsigned int getSessionCount();
+
+  /** last published processing cost per session (ns per tick) */
+  void getSessionCosts(std::map<AmMediaSession*, unsigned int>& costs);
+
+  void getStats(AmArg& ret);
+
+  friend class AmMediaProcessor;
 };
 
 /**
@@ -204,18 +280,46 @@ class AmMediaProcessor
   std::map<AmMediaSession*, string> session2callgroup;
   AmMutex group_mut;
 
+  AmMediaRebalancer* rebalancer;
+
   AmMediaProcessor();
   ~AmMediaProcessor();
 	
   void removeFromProcessor(AmMediaSession* s, unsigned int r_type);
+
+  /** average processing cost of a session (ns per tick) */
+  unsigned int sessionCostEstimate();
+
+  /** called by the media thread the callgroup is migrated from */
+  void handOver(AmMediaProcessorThread* from, MigrateRequest* mr);
+  /** 
+   * called by a media thread before inserting s:
+   * @return true if s has been forwarded to the thread
+   *         its callgroup has been migrated to meanwhile
+   */
+  bool redirectInsert(AmMediaProcessorThread* t, 
+		      AmMediaSession* s, unsigned int cost);
+  /**
+   * called by a media thread which does not process s (anymore)
+   * on ClearSession:
+   * @return true if the request has been forwarded to the thread
+   *         s has been migrated to with its callgroup
+   */
+  bool redirectClear(AmMediaProcessorThread* t, AmMediaSession* s);
+
+  friend class AmMediaProcessorThread;
+
 public:
   /** 
    * InsertSession     : inserts the session to the processor
    * RemoveSession     : remove the session from the processor
    * SoftRemoveSession : remove the session from the processor but leave it attached
    * ClearSession      : remove the session from processor and clear audio
+   * MigrateCallgroup  : hand a callgroup over to another thread
+   * InsertCallgroup   : take over a callgroup from another thread
    */
-  enum { InsertSession, RemoveSession, SoftRemoveSession, ClearSession };
+  enum { InsertSession, RemoveSession, SoftRemoveSession, ClearSession,
+	 MigrateCallgroup, InsertCallgroup };
 
   static AmMediaProcessor* instance();
 
@@ -232,6 +336,22 @@ public:
   void changeCallgroup(AmMediaSession* s, 
 		       const string& new_callgroup);
 
+  /** 
+   * Move a callgroup with all its sessions to another media 
+   * thread. The sessions do not skip or repeat any tick.
+   * @return false if the callgroup is unknown or already there
+   */
+  bool migrateCallgroup(const string& callgroup, unsigned int thread);
+
+  /** 
+   * Migrate a callgroup from the most to the least loaded
+   * thread, if that reduces the imbalance.
+   */
+  void rebalance();
+
+  /** per-thread media tick statistics */
+  void getStats(AmArg& ret);
+
   void stop();
   static void dispose();
 };
@@ -0,0 +1,302 @@
+/*
+ * Copyright (C) 2026 SEMS contributors
+ *
+ * This file is part of SEMS, a free SIP media server.
+ *
+ * SEMS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version. This program is released under
+ * the GPL with the additional exemption that compiling, linking,
+ * and/or using OpenSSL is allowed.
+ *
+ * For a license to use the SEMS software under conditions
+ * other than those described here, or to purchase support for this
+ * software, please contact iptel.org by e-mail at the following addresses:
+ *    info@iptel.org
+ *
+ * SEMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+/** @file AmMixerKernels.cpp */
+#include "AmMixerKernels.h"
+
+#include <stdlib.h>
+
+// PCM16 range: [-32767:32768]
+#define MAX_LINEAR_SAMPLE 32737
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define MIXER_SSE2
+#include <emmintrin.h>
+
+#if defined(__clang__) || (__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+#define MIXER_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+/*
+ * generic
+ */
+
+static void add_generic(int* dest, const int* src1, const short* src2,
+			unsigned int size)
+{
+  int* end_dest = dest + size;
+
+  while(dest != end_dest)
+    *(dest++) = *(src1++) + int(*(src2++));
+}
+
+static void sub_generic(int* dest, const int* src1, const short* src2,
+			unsigned int size)
+{
+  int* end_dest = dest + size;
+
+  while(dest != end_dest)
+    *(dest++) = *(src1++) - int(*(src2++));
+}
+
+/** scale without changing the factor first (shared by all kernels) */
+static void scale_tail(short* buffer, const int* tmp_buf, unsigned int size,
+		       int& scaling_factor)
+{
+  short* end_dest = buffer + size;
+
+  while(buffer != end_dest){
+
+    int s = (*tmp_buf * scaling_factor) >> 6;
+    if(abs(s) > MAX_LINEAR_SAMPLE){
+      scaling_factor = abs( (MAX_LINEAR_SAMPLE<<6) / (*tmp_buf) );
+      if(s < 0)
+	s = -MAX_LINEAR_SAMPLE;
+      else
+	s = MAX_LINEAR_SAMPLE;
+    }
+    *(buffer++) = short(s);
+    tmp_buf++;
+  }
+}
+
+static void scale_generic(short* buffer, const int* tmp_buf, unsigned int size,
+			  int& scaling_factor)
+{
+  if(scaling_factor<64)
+    scaling_factor++;
+
+  scale_tail(buffer,tmp_buf,size,scaling_factor);
+}
+
+#ifdef MIXER_SSE2
+
+/*
+ * SSE2: 8 samples per step
+ */
+
+static void add_sse2(int* dest, const int* src1, const short* src2,
+		     unsigned int size)
+{
+  unsigned int i = 0;
+  for(; i + 8 <= size; i += 8) {
+    __m128i s = _mm_loadu_si128((const __m128i*)(src2 + i));
+    // sign extension: duplicate the 16 bit values, shift them back
+    __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s,s),16);
+    __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s,s),16);
+    _mm_storeu_si128((__m128i*)(dest + i),
+		     _mm_add_epi32(_mm_loadu_si128((const __m128i*)(src1 + i)),lo));
+    _mm_storeu_si128((__m128i*)(dest + i + 4),
+		     _mm_add_epi32(_mm_loadu_si128((const __m128i*)(src1 + i + 4)),hi));
+  }
+  add_generic(dest + i, src1 + i, src2 + i, size - i);
+}
+
+static void sub_sse2(int* dest, const int* src1, const short* src2,
+		     unsigned int size)
+{
+  unsigned int i = 0;
+  for(; i + 8 <= size; i += 8) {
+    __m128i s = _mm_loadu_si128((const __m128i*)(src2 + i));
+    __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s,s),16);
+    __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s,s),16);
+    _mm_storeu_si128((__m128i*)(dest + i),
+		     _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(src1 + i)),lo));
+    _mm_storeu_si128((__m128i*)(dest + i + 4),
+		     _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(src1 + i + 4)),hi));
+  }
+  sub_generic(dest + i, src1 + i, src2 + i, size - i);
+}
+
+/** low 32 bit of a * b (SSE2 has no 32 bit multiplication) */
+static inline __m128i mullo_sse2(__m128i a, __m128i b)
+{
+  __m128i even = _mm_mul_epu32(a,b);
+  __m128i odd  = _mm_mul_epu32(_mm_srli_si128(a,4),_mm_srli_si128(b,4));
+  return _mm_unpacklo_epi32(_mm_shuffle_epi32(even,_MM_SHUFFLE(0,0,2,0)),
+			    _mm_shuffle_epi32(odd,_MM_SHUFFLE(0,0,2,0)));
+}
+
+static void scale_sse2(short* buffer, const int* tmp_buf, unsigned int size,
+		       int& scaling_factor)
+{
+  if(scaling_factor<64)
+    scaling_factor++;
+
+  const __m128i f   = _mm_set1_epi32(scaling_factor);
+  const __m128i max = _mm_set1_epi32(MAX_LINEAR_SAMPLE);
+  const __m128i min = _mm_set1_epi32(-MAX_LINEAR_SAMPLE);
+
+  unsigned int i = 0;
+  for(; i + 8 <= size; i += 8) {
+    __m128i a = _mm_srai_epi32(mullo_sse2(_mm_loadu_si128((const __m128i*)(tmp_buf + i)),f),6);
+    __m128i b = _mm_srai_epi32(mullo_sse2(_mm_loadu_si128((const __m128i*)(tmp_buf + i + 4)),f),6);
+
+    __m128i clip = _mm_or_si128(_mm_or_si128(_mm_cmpgt_epi32(a,max),_mm_cmplt_epi32(a,min)),
+				_mm_or_si128(_mm_cmpgt_epi32(b,max),_mm_cmplt_epi32(b,min)));
+    if(_mm_movemask_epi8(clip))
+      break; // the factor changes within these samples
+
+    _mm_storeu_si128((__m128i*)(buffer + i),_mm_packs_epi32(a,b));
+  }
+  scale_tail(buffer + i, tmp_buf + i, size - i, scaling_factor);
+}
+
+#endif // MIXER_SSE2
+
+#ifdef MIXER_AVX2
+
+/*
+ * AVX2: 8 (add, sub) / 16 (scale) samples per step
+ */
+
+__attribute__((target("avx2")))
+static void add_avx2(int* dest, const int* src1, const short* src2,
+		     unsigned int size)
+{
+  unsigned int i = 0;
+  for(; i + 8 <= size; i += 8) {
+    __m256i s = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(src2 + i)));
+    _mm256_storeu_si256((__m256i*)(dest + i),
+			_mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(src1 + i)),s));
+  }
+  add_generic(dest + i, src1 + i, src2 + i, size - i);
+}
+
+__attribute__((target("avx2")))
+static void sub_avx2(int* dest, const int* src1, const short* src2,
+		     unsigned int size)
+{
+  unsigned int i = 0;
+  for(; i + 8 <= size; i += 8) {
+    __m256i s = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(src2 + i)));
+    _mm256_storeu_si256((__m256i*)(dest + i),
+			_mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(src1 + i)),s));
+  }
+  sub_generic(dest + i, src1 + i, src2 + i, size - i);
+}
+
+__attribute__((target("avx2")))
+static void scale_avx2(short* buffer, const int* tmp_buf, unsigned int size,
+		       int& scaling_factor)
+{
+  if(scaling_factor<64)
+    scaling_factor++;
+
+  const __m256i f   = _mm256_set1_epi32(scaling_factor);
+  const __m256i max = _mm256_set1_epi32(MAX_LINEAR_SAMPLE);
+  const __m256i min = _mm256_set1_epi32(-MAX_LINEAR_SAMPLE);
+
+  unsigned int i = 0;
+  for(; i + 16 <= size; i += 16) {
+    __m256i a = _mm256_srai_epi32(_mm256_mullo_epi32(_mm256_loadu_si256((const __m256i*)(tmp_buf + i)),f),6);
+    __m256i b = _mm256_srai_epi32(_mm256_mullo_epi32(_mm256_loadu_si256((const __m256i*)(tmp_buf + i + 8)),f),6);
+
+    __m256i clip = _mm256_or_si256(_mm256_or_si256(_mm256_cmpgt_epi32(a,max),_mm256_cmpgt_epi32(min,a)),
+				   _mm256_or_si256(_mm256_cmpgt_epi32(b,max),_mm256_cmpgt_epi32(min,b)));
+    if(_mm256_movemask_epi8(clip))
+      break; // the factor changes within these samples
+
+    // packs works per 128 bit lane: a0-3 b0-3 a4-7 b4-7
+    __m256i p = _mm256_packs_epi32(a,b);
+    _mm256_storeu_si256((__m256i*)(buffer + i),
+			_mm256_permute4x64_epi64(p,_MM_SHUFFLE(3,1,2,0)));
+  }
+  scale_tail(buffer + i, tmp_buf + i, size - i, scaling_factor);
+}
+
+#endif // MIXER_AVX2
+
+/*
+ * dispatching
+ */
+
+struct mixer_impl
+{
+  const char* name;
+  void (*add)(int*, const int*, const short*, unsigned int);
+  void (*sub)(int*, const int*, const short*, unsigned int);
+  void (*scale)(short*, const int*, unsigned int, int&);
+};
+
+static const mixer_impl generic_impl =
+  { "generic", add_generic, sub_generic, scale_generic };
+
+static mixer_impl best_impl()
+{
+#ifdef MIXER_AVX2
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2")) {
+    mixer_impl avx2 = { "avx2", add_avx2, sub_avx2, scale_avx2 };
+    return avx2;
+  }
+#endif
+#ifdef MIXER_SSE2
+  mixer_impl sse2 = { "sse2", add_sse2, sub_sse2, scale_sse2 };
+  return sse2;
+#else
+  return generic_impl;
+#endif
+}
+
+// generic until the static initialization below has run
+static mixer_impl impl = { "generic", add_generic, sub_generic, scale_generic };
+
+static struct mixer_impl_select
+{
+  mixer_impl_select() { impl = best_impl(); }
+} _mixer_impl_select;
+
+void mixer_add(int* dest, const int* src1, const short* src2, unsigned int size)
+{
+  impl.add(dest,src1,src2,size);
+}
+
+void mixer_sub(int* dest, const int* src1, const short* src2, unsigned int size)
+{
+  impl.sub(dest,src1,src2,size);
+}
+
+void mixer_scale(short* dest, const int* src, unsigned int size, int& scaling_factor)
+{
+  impl.scale(dest,src,size,scaling_factor);
+}
+
+const char* mixer_kernels()
+{
+  return impl.name;
+}
+
+void mixer_use_generic_kernels(bool generic)
+{
+  impl = generic ? generic_impl : best_impl();
+}
+
+// Local Variables:
+// mode:C++
+// End:
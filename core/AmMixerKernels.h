@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2026 SEMS contributors
+ *
+ * This file is part of SEMS, a free SIP media server.
+ *
+ * SEMS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version. This program is released under
+ * the GPL with the additional exemption that compiling, linking,
+ * and/or using OpenSSL is allowed.
+ *
+ * For a license to use the SEMS software under conditions
+ * other than those described here, or to purchase support for this
+ * software, please contact iptel.org by e-mail at the following addresses:
+ *    info@iptel.org
+ *
+ * SEMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+/** @file AmMixerKernels.h */
+#ifndef _AmMixerKernels_h_
+#define _AmMixerKernels_h_
+
+/**
+ * Sample processing kernels of the conference mixer.
+ *
+ * The best implementation for the CPU (AVX2, SSE2 or
+ * generic C) is selected at startup. All of them produce
+ * exactly the same output.
+ */
+
+/** dest[i] = src1[i] + src2[i] */
+void mixer_add(int* dest, const int* src1, const short* src2, unsigned int size);
+
+/** dest[i] = src1[i] - src2[i] */
+void mixer_sub(int* dest, const int* src1, const short* src2, unsigned int size);
+
+/**
+ * dest[i] = src[i] * scaling_factor / 64, clipped to the PCM16 range.
+ *
+ * The scaling factor is increased by one per call (up to 64), and
+ * lowered as soon as a sample would clip, so that the following
+ * samples fit.
+ */
+void mixer_scale(short* dest, const int* src, unsigned int size, int& scaling_factor);
+
+/** @return the name of the kernels in use ("avx2", "sse2" or "generic") */
+const char* mixer_kernels();
+
+/** switch to the generic kernels (or back to the best ones) */
+void mixer_use_generic_kernels(bool generic);
+
+#endif
+
+// Local Variables:
+// mode:C++
+// End:
@@ -24,15 +24,13 @@
  */
 
 #include "AmMultiPartyMixer.h"
+#include "AmMixerKernels.h"
 #include "AmRtpStream.h"
 #include "log.h"
 
 #include <assert.h>
 #include <math.h>
 
-// PCM16 range: [-32767:32768]
-#define MAX_LINEAR_SAMPLE 32737
-
 // the internal delay of the mixer (between put and get)
 #define MIXER_DELAY_MS 20
 
@@ -52,7 +50,9 @@ void DEBUG_MIXER_BUFFER_STATE(const MixerBufferState& mbs, const string& context
 AmMultiPartyMixer::AmMultiPartyMixer()
   : sampleratemap(), samplerates(),
     channelids(), scaling_factor(16),
-    buffer_state(), audio_mut()
+    buffer_state(), audio_mut(),
+    mixed_buffer_src(NULL), mixed_buffer_ts(0),
+    mixed_buffer_samples(0)
 {
 }
 
@@ -133,8 +133,9 @@ void AmMultiPartyMixer::PutChannelPacket(unsigned int   channel_id,
     channel->put(user_put_ts,(short*)buffer,samples);
     bstate->mixed_channel->get(user_put_ts,tmp_buffer,samples);
 
-    mix_add(tmp_buffer,tmp_buffer,(short*)buffer,samples);
+    mixer_add(tmp_buffer,tmp_buffer,(short*)buffer,samples);
     bstate->mixed_channel->put(user_put_ts,tmp_buffer,samples);
+    mixed_buffer_src = NULL;
     bstate->last_ts = put_ts + (samples * (WALLCLOCK_RATE/100) / (GetCurrentSampleRate()/100));
   } else {
     /*
@@ -167,11 +168,17 @@ void AmMultiPartyMixer::GetChannelPacket(unsigned int   channel_id,
     assert(samples <= PCM16_B2S(AUDIO_BUFFER_SIZE));
 
     unsigned long long cur_ts = system_ts * (bstate->sample_rate/100) / (WALLCLOCK_RATE/100);
-    bstate->mixed_channel->get(cur_ts,tmp_buffer,samples);
+    if((mixed_buffer_src != bstate->mixed_channel) ||
+       (mixed_buffer_ts != cur_ts) || (mixed_buffer_samples != samples)) {
+      bstate->mixed_channel->get(cur_ts,mixed_buffer,samples);
+      mixed_buffer_src = bstate->mixed_channel;
+      mixed_buffer_ts = cur_ts;
+      mixed_buffer_samples = samples;
+    }
     channel->get(cur_ts,(short*)buffer,samples);
 
-    mix_sub(tmp_buffer,tmp_buffer,(short*)buffer,samples);
-    scale((short*)buffer,tmp_buffer,samples);
+    mixer_sub(tmp_buffer,mixed_buffer,(short*)buffer,samples);
+    mixer_scale((short*)buffer,tmp_buffer,samples,scaling_factor);
     size = PCM16_S2B(samples);
     output_sample_rate = bstate->sample_rate;
   } else if (bstate != buffer_state.end()) {
@@ -201,48 +208,6 @@ int AmMultiPartyMixer::GetCurrentSampleRate()
   }
 }
 
-// int   dest[size/2]
-// int   src1[size/2]
-// short src2[size/2]
-//
-void AmMultiPartyMixer::mix_add(int* dest,int* src1,short* src2,unsigned int size)
-{
-  int* end_dest = dest + size;
-
-  while(dest != end_dest)
-    *(dest++) = *(src1++) + int(*(src2++));
-}
-
-void AmMultiPartyMixer::mix_sub(int* dest,int* src1,short* src2,unsigned int size)
-{
-  int* end_dest = dest + size;
-
-  while(dest != end_dest)
-    *(dest++) = *(src1++) - int(*(src2++));
-}
-
-void AmMultiPartyMixer::scale(short* buffer,int* tmp_buf,unsigned int size)
-{
-  short* end_dest = buffer + size;
-    
-  if(scaling_factor<64)
-    scaling_factor++;
-    
-  while(buffer != end_dest){
-	
-    int s = (*tmp_buf * scaling_factor) >> 6;
-    if(abs(s) > MAX_LINEAR_SAMPLE){
-      scaling_factor = abs( (MAX_LINEAR_SAMPLE<<6) / (*tmp_buf) );
-      if(s < 0)
-	s = -MAX_LINEAR_SAMPLE;
-      else
-	s = MAX_LINEAR_SAMPLE;
-    }
-    *(buffer++) = short(s);
-    tmp_buf++;
-  }
-}
-
 std::deque<MixerBufferState>::iterator AmMultiPartyMixer::findOrCreateBufferState(unsigned int sample_rate)
 {
   for (std::deque<MixerBufferState>::iterator it = buffer_state.begin(); it != buffer_state.end(); it++) {
@@ -291,6 +256,8 @@ void AmMultiPartyMixer::cleanupBufferStates(unsigned int last_ts)
 	 && (unsigned int)GetCurrentSampleRate() != buffer_state.front().sample_rate) {
 
     //DEBUG_MIXER_BUFFER_STATE(buffer_state.front(), "freed in cleanupBufferStates");
+    if(mixed_buffer_src == buffer_state.front().mixed_channel)
+      mixed_buffer_src = NULL;
     buffer_state.front().free_channels();
     buffer_state.pop_front();
   }
@@ -80,15 +80,21 @@ class AmMultiPartyMixer
   int              scaling_factor; 
   int              tmp_buffer[AUDIO_BUFFER_SIZE/2];
 
+  /**
+   * Mixed channel as read by the last GetChannelPacket():
+   * all the channels of a conference read the same samples
+   * of the mixed channel in a row.
+   */
+  int              mixed_buffer[AUDIO_BUFFER_SIZE/2];
+  SampleArrayInt*  mixed_buffer_src;
+  unsigned long long mixed_buffer_ts;
+  unsigned int     mixed_buffer_samples;
+
   std::deque<MixerBufferState>::iterator findOrCreateBufferState(unsigned int sample_rate);
   std::deque<MixerBufferState>::iterator findBufferStateForReading(unsigned int sample_rate, 
 								   unsigned long long last_ts);
   void cleanupBufferStates(unsigned int last_ts);
 
-  void mix_add(int* dest,int* src1,short* src2,unsigned int size);
-  void mix_sub(int* dest,int* src1,short* src2,unsigned int size);
-  void scale(short* buffer,int* tmp_buf,unsigned int size);
-
 public:
   AmMultiPartyMixer();
   ~AmMultiPartyMixer();
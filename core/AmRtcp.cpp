@@ -0,0 +1,670 @@
+/*
+ * Copyright (C) 2026 SEMS contributors
+ *
+ * This file is part of SEMS, a free SIP media server.
+ *
+ * SEMS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version. This program is released under
+ * the GPL with the additional exemption that compiling, linking,
+ * and/or using OpenSSL is allowed.
+ *
+ * For a license to use the SEMS software under conditions
+ * other than those described here, or to purchase support for this
+ * software, please contact iptel.org by e-mail at the following addresses:
+ *    info@iptel.org
+ *
+ * SEMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "AmRtcp.h"
+#include "AmArg.h"
+#include "AmUtils.h"
+#include "log.h"
+
+#include <string.h>
+
+/* RFC 3550, A.1 */
+#define RTP_SEQ_MOD    (1<<16)
+#define MAX_DROPOUT    3000
+#define MAX_MISORDER   100
+#define MIN_SEQUENTIAL 2
+
+/* seconds between 1900 (NTP) and 1970 (unix) */
+#define NTP_UNIX_OFFSET 2208988800UL
+
+/* XR VoIP metrics: value not available */
+#define XR_UNAVAILABLE 127
+
+static inline void put16(unsigned char* p, unsigned int v)
+{
+  p[0] = (v >> 8) & 0xff;
+  p[1] = v & 0xff;
+}
+
+static inline void put32(unsigned char* p, unsigned int v)
+{
+  p[0] = (v >> 24) & 0xff;
+  p[1] = (v >> 16) & 0xff;
+  p[2] = (v >> 8) & 0xff;
+  p[3] = v & 0xff;
+}
+
+static inline unsigned int get16(const unsigned char* p)
+{
+  return (p[0] << 8) | p[1];
+}
+
+static inline unsigned int get32(const unsigned char* p)
+{
+  return ((unsigned int)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+/** RTCP common header; 'len' in bytes, including the header */
+static inline void put_header(unsigned char* p, unsigned int count,
+			      unsigned int pt, unsigned int len)
+{
+  p[0] = 0x80 | (count & 0x1f);
+  p[1] = pt;
+  put16(p + 2, len/4 - 1);
+}
+
+static inline void ntp_time(const struct timeval& tv,
+			    unsigned int& sec, unsigned int& frac)
+{
+  sec = tv.tv_sec + NTP_UNIX_OFFSET;
+  frac = (unsigned int)(((unsigned long long)tv.tv_usec << 32) / 1000000);
+}
+
+/** middle 32 bits of the NTP timestamp (LSR, DLSR, RTT) */
+static inline unsigned int ntp_middle(const struct timeval& tv)
+{
+  unsigned int sec, frac;
+  ntp_time(tv, sec, frac);
+  return (sec << 16) | (frac >> 16);
+}
+
+/** 'v' / 'total' in 1/256 (XR rates and densities) */
+static inline unsigned char rate256(unsigned int v, unsigned int total)
+{
+  if (!total)
+    return 0;
+  unsigned long long r = ((unsigned long long)v << 8) / total;
+  return r > 255 ? 255 : r;
+}
+
+static inline unsigned int clamp16(double v)
+{
+  if (v < 0) return 0;
+  return v > 65535 ? 65535 : (unsigned int)v;
+}
+
+AmRtcpReporter::AmRtcpReporter()
+  : l_ssrc(0),
+    packets_sent(0), octets_sent(0), last_sent_ts(0), send_clock_rate(0),
+    have_source(false), r_ssrc(0),
+    max_seq(0), cycles(0), base_seq(0), bad_seq(0), probation(0),
+    received(0), expected_prior(0), received_prior(0),
+    transit(0), have_transit(false), jitter(0.0),
+    recv_clock_rate(0), last_recv_ts(0), discarded(0), fraction_lost(0),
+    pkts_since_loss(0), cand_pkts(0), cand_lost(0),
+    bursts(0), burst_pkts(0), burst_lost(0), gap_lost(0), packet_ms(0.0),
+    lsr(0),
+    rr_received(0), sr_received(0), xr_received(0),
+    r_fraction_lost(0), r_cum_lost(0), r_jitter(0), rtt_ms(-1),
+    r_loss_rate(0), r_discard_rate(0), r_r_factor(XR_UNAVAILABLE),
+    r_mos_lq(XR_UNAVAILABLE), r_mos_cq(XR_UNAVAILABLE), r_packets_sent(0),
+    reports_sent(0)
+{
+  timerclear(&last_sent);
+  timerclear(&lsr_recv);
+  timerclear(&next_report);
+}
+
+void AmRtcpReporter::init(unsigned int ssrc, const string& _cname)
+{
+  AmLock l(mut);
+  l_ssrc = ssrc;
+  cname = _cname.substr(0, 64);
+}
+
+void AmRtcpReporter::onRtpSent(unsigned int ts, unsigned int payload_len,
+			       unsigned int clock_rate)
+{
+  struct timeval now;
+  gettimeofday(&now, NULL);
+
+  AmLock l(mut);
+  packets_sent++;
+  octets_sent += payload_len;
+  last_sent_ts = ts;
+  send_clock_rate = clock_rate;
+  last_sent = now;
+}
+
+void AmRtcpReporter::initSource(unsigned int ssrc, unsigned short seq)
+{
+  have_source = true;
+  r_ssrc = ssrc;
+
+  base_seq = seq;
+  max_seq = seq - 1;
+  bad_seq = RTP_SEQ_MOD + 1;
+  cycles = 0;
+  received = 0;
+  received_prior = 0;
+  expected_prior = 0;
+  probation = MIN_SEQUENTIAL;
+
+  have_transit = false;
+  jitter = 0.0;
+  discarded = 0;
+  fraction_lost = 0;
+
+  pkts_since_loss = cand_pkts = cand_lost = 0;
+  bursts = burst_pkts = burst_lost = gap_lost = 0;
+}
+
+/** RFC 3550, A.1 (update_seq); also feeds the burst/gap metrics */
+bool AmRtcpReporter::updateSeq(unsigned short seq)
+{
+  unsigned short udelta = seq - max_seq;
+
+  if (probation) {
+    if (seq == (unsigned short)(max_seq + 1)) {
+      probation--;
+      max_seq = seq;
+      if (probation == 0) {
+	base_seq = seq;
+	bad_seq = RTP_SEQ_MOD + 1;
+	cycles = 0;
+	received = 1;
+	received_prior = expected_prior = 0;
+	pkts_since_loss = 1;
+	return true;
+      }
+    } else {
+      probation = MIN_SEQUENTIAL - 1;
+      max_seq = seq;
+    }
+    return false;
+  }
+  else if (udelta < MAX_DROPOUT) {
+    // in order, with permissible gap
+    if (seq < max_seq)
+      cycles += RTP_SEQ_MOD;
+    max_seq = seq;
+
+    if (udelta > 1)
+      onLoss(udelta - 1);
+    if (udelta > 0)
+      pkts_since_loss++;
+  }
+  else if (udelta <= RTP_SEQ_MOD - MAX_MISORDER) {
+    // the sequence number made a very large jump
+    if (seq == bad_seq) {
+      // two sequential packets: assume that the other side
+      // restarted without telling us
+      initSource(r_ssrc, seq);
+      probation = 0;
+      max_seq = seq;
+      received = 1;
+      pkts_since_loss = 1;
+      return true;
+    }
+    bad_seq = (seq + 1) & (RTP_SEQ_MOD - 1);
+    return false;
+  }
+  // else: duplicate or reordered packet
+
+  received++;
+  return true;
+}
+
+/**
+ * Burst/gap classification (RFC 3611, 4.7.2): a burst is a period
+ * of losses not interrupted by RTCP_XR_GMIN or more received packets.
+ * Loss periods with a single loss count as gap losses.
+ */
+void AmRtcpReporter::onLoss(unsigned int n)
+{
+  if (!cand_lost || (pkts_since_loss >= RTCP_XR_GMIN)) {
+    // the previous loss period is over
+    if (cand_lost >= 2) {
+      bursts++;
+      burst_pkts += cand_pkts;
+      burst_lost += cand_lost;
+    }
+    else {
+      gap_lost += cand_lost;
+    }
+    cand_pkts = cand_lost = 0;
+  }
+  else {
+    // received packets within the loss period
+    cand_pkts += pkts_since_loss;
+  }
+
+  cand_pkts += n;
+  cand_lost += n;
+  pkts_since_loss = 0;
+}
+
+void AmRtcpReporter::onRtpReceived(unsigned int ssrc, unsigned short seq,
+				   unsigned int ts, unsigned int clock_rate,
+				   const struct timeval& arrival)
+{
+  if (!clock_rate)
+    return;
+
+  AmLock l(mut);
+
+  if (!have_source || (ssrc != r_ssrc))
+    initSource(ssrc, seq);
+
+  unsigned short prev_seq = max_seq;
+  if (!updateSeq(seq))
+    return;
+
+  if ((seq == (unsigned short)(prev_seq + 1)) && received > 1) {
+    unsigned int d = ts - last_recv_ts;
+    if (d && (d < clock_rate))
+      packet_ms = d * 1000.0 / clock_rate;
+  }
+  if ((unsigned short)(seq - prev_seq) < MAX_DROPOUT)
+    last_recv_ts = ts;
+
+  // RFC 3550, A.8
+  unsigned int arrival_ts = (unsigned int)
+    ((unsigned long long)arrival.tv_sec * clock_rate +
+     (unsigned long long)arrival.tv_usec * clock_rate / 1000000);
+  unsigned int t = arrival_ts - ts;
+
+  if (have_transit && (clock_rate == recv_clock_rate)) {
+    int d = (int)(t - transit);
+    if (d < 0) d = -d;
+    jitter += (1.0/16.0) * ((double)d - jitter);
+  }
+  else {
+    have_transit = true;
+  }
+
+  transit = t;
+  recv_clock_rate = clock_rate;
+}
+
+void AmRtcpReporter::onRtpDiscarded()
+{
+  AmLock l(mut);
+  discarded++;
+}
+
+unsigned int AmRtcpReporter::expected() const
+{
+  if (!have_source || probation)
+    return 0;
+  return cycles + max_seq - base_seq + 1;
+}
+
+int AmRtcpReporter::cumLost() const
+{
+  return (int)(expected() - received);
+}
+
+double AmRtcpReporter::jitterMs(double j, unsigned int clock_rate)
+{
+  if (!clock_rate)
+    return 0.0;
+  return j * 1000.0 / clock_rate;
+}
+
+/** RFC 3550, 6.4.1 report block about the remote source */
+unsigned int AmRtcpReporter::writeReportBlock(unsigned char* p,
+					      const struct timeval& now)
+{
+  // RFC 3550, A.3
+  unsigned int exp = expected();
+  unsigned int expected_interval = exp - expected_prior;
+  unsigned int received_interval = received - received_prior;
+  int lost_interval = (int)(expected_interval - received_interval);
+
+  expected_prior = exp;
+  received_prior = received;
+
+  if (!expected_interval || (lost_interval <= 0))
+    fraction_lost = 0;
+  else
+    fraction_lost = rate256(lost_interval, expected_interval);
+
+  int lost = cumLost();
+  if (lost > 0x7fffff) lost = 0x7fffff;
+  else if (lost < -0x800000) lost = -0x800000;
+
+  put32(p, r_ssrc);
+  put32(p + 4, ((unsigned int)fraction_lost << 24) | (lost & 0xffffff));
+  put32(p + 8, cycles + max_seq);
+  put32(p + 12, (unsigned int)jitter);
+
+  if (lsr) {
+    struct timeval diff;
+    timersub(&now, &lsr_recv, &diff);
+    unsigned int dlsr = (unsigned int)
+      (((unsigned long long)diff.tv_sec << 16) +
+       ((unsigned long long)diff.tv_usec << 16) / 1000000);
+    put32(p + 16, lsr);
+    put32(p + 20, dlsr);
+  }
+  else {
+    put32(p + 16, 0);
+    put32(p + 20, 0);
+  }
+
+  return 24;
+}
+
+unsigned int AmRtcpReporter::writeSdes(unsigned char* p, unsigned int len)
+{
+  unsigned int cname_len = cname.length();
+  // header, SSRC, CNAME item, end of list, padded to 32 bits
+  unsigned int sdes_len = (4 + 4 + 2 + cname_len + 1 + 3) & ~3;
+  if (sdes_len > len)
+    return 0;
+
+  memset(p, 0, sdes_len);
+  put_header(p, 1, RTCP_SDES, sdes_len);
+  put32(p + 4, l_ssrc);
+  p[8] = RTCP_SDES_CNAME;
+  p[9] = cname_len;
+  memcpy(p + 10, cname.c_str(), cname_len);
+
+  return sdes_len;
+}
+
+/** RFC 3611, 4.7 VoIP metrics about the remote source */
+unsigned int AmRtcpReporter::writeXr(unsigned char* p)
+{
+  unsigned int b = bursts, b_pkts = burst_pkts,
+    b_lost = burst_lost, g_lost = gap_lost;
+
+  // the current loss period
+  if (cand_lost >= 2) {
+    b++;
+    b_pkts += cand_pkts;
+    b_lost += cand_lost;
+  }
+  else {
+    g_lost += cand_lost;
+  }
+
+  unsigned int exp = expected();
+  unsigned int g_pkts = exp > b_pkts ? exp - b_pkts : 0;
+  int lost = cumLost();
+
+  put_header(p, 0, RTCP_XR, 44);
+  put32(p + 4, l_ssrc);
+
+  unsigned char* m = p + 8;
+  memset(m, 0, 36);
+  m[0] = RTCP_XR_VOIP_METRICS;
+  put16(m + 2, 8);
+  put32(m + 4, r_ssrc);
+  m[8]  = rate256(lost > 0 ? lost : 0, exp);
+  m[9]  = rate256(discarded, exp);
+  m[10] = rate256(b_lost, b_pkts);
+  m[11] = rate256(g_lost, g_pkts);
+  put16(m + 12, b ? clamp16(b_pkts * packet_ms / b) : 0);
+  put16(m + 14, clamp16(g_pkts * packet_ms / (b + 1)));
+  put16(m + 16, rtt_ms > 0 ? clamp16(rtt_ms) : 0);
+  // end system delay: unknown (0)
+  m[20] = XR_UNAVAILABLE; // signal level
+  m[21] = XR_UNAVAILABLE; // noise level
+  m[22] = XR_UNAVAILABLE; // RERL
+  m[23] = RTCP_XR_GMIN;
+  m[24] = XR_UNAVAILABLE; // R factor
+  m[25] = XR_UNAVAILABLE; // ext. R factor
+  m[26] = XR_UNAVAILABLE; // MOS-LQ
+  m[27] = XR_UNAVAILABLE; // MOS-CQ
+  // RX config and jitter buffer: unknown (0)
+
+  return 44;
+}
+
+bool AmRtcpReporter::reportDue(const struct timeval& now, unsigned int interval)
+{
+  AmLock l(mut);
+
+  if (!timerisset(&next_report)) {
+    if (!packets_sent && !received)
+      return false;
+
+    // first report after half an interval
+    struct timeval first = { (time_t)interval, 0 };
+    first.tv_usec = (first.tv_sec % 2) * 500000;
+    first.tv_sec /= 2;
+    timeradd(&now, &first, &next_report);
+    return false;
+  }
+
+  return !timercmp(&now, &next_report, <);
+}
+
+unsigned int AmRtcpReporter::buildReport(const struct timeval& now,
+					 unsigned int interval,
+					 unsigned char* buf, unsigned int len)
+{
+  AmLock l(mut);
+
+  // time since the last RTP packet sent
+  struct timeval diff;
+  timersub(&now, &last_sent, &diff);
+  if (diff.tv_sec < 0)
+    timerclear(&diff);
+
+  bool sender = packets_sent && (diff.tv_sec < (time_t)(2 * interval));
+
+  bool block = have_source && !probation;
+  unsigned int n = 0;
+
+  // SR / RR
+  unsigned int r_len = (sender ? 28 : 8) + (block ? 24 : 0);
+  if (r_len + 44 > len)
+    return 0;
+
+  put_header(buf, block ? 1 : 0, sender ? RTCP_SR : RTCP_RR, r_len);
+  put32(buf + 4, l_ssrc);
+  n = 8;
+
+  if (sender) {
+    unsigned int sec, frac;
+    ntp_time(now, sec, frac);
+
+    unsigned int rtp_ts = last_sent_ts + (unsigned int)
+      ((diff.tv_sec * 1000000ULL + diff.tv_usec) * send_clock_rate / 1000000);
+
+    put32(buf + 8, sec);
+    put32(buf + 12, frac);
+    put32(buf + 16, rtp_ts);
+    put32(buf + 20, packets_sent);
+    put32(buf + 24, octets_sent);
+    n = 28;
+  }
+
+  if (block)
+    n += writeReportBlock(buf + n, now);
+
+  // SDES CNAME (mandatory)
+  unsigned int sdes_len = writeSdes(buf + n, len - n);
+  if (!sdes_len)
+    return 0;
+  n += sdes_len;
+
+  // XR VoIP metrics
+  if (block && (n + 44 <= len))
+    n += writeXr(buf + n);
+
+  reports_sent++;
+
+  // RFC 3550, 6.3.1: randomized to [0.5, 1.5] * interval
+  unsigned long long next_us = interval * 1000000ULL / 2 +
+    (unsigned long long)get_random() % (interval * 1000000ULL + 1);
+  struct timeval next = { (time_t)(next_us / 1000000),
+			  (suseconds_t)(next_us % 1000000) };
+  timeradd(&now, &next, &next_report);
+
+  return n;
+}
+
+void AmRtcpReporter::parseReportBlocks(const unsigned char* p,
+				       unsigned int count,
+				       const struct timeval& now)
+{
+  for (unsigned int i=0; i<count; i++, p += 24) {
+    if (get32(p) != l_ssrc)
+      continue;
+
+    r_fraction_lost = p[4];
+    r_cum_lost = (int)(get32(p + 4) << 8) >> 8; // 24 bit signed
+    r_jitter = get32(p + 12);
+
+    unsigned int b_lsr = get32(p + 16);
+    unsigned int b_dlsr = get32(p + 20);
+    if (b_lsr) {
+      // RFC 3550, 6.4.1
+      int rtt = (int)(ntp_middle(now) - b_lsr - b_dlsr);
+      if (rtt >= 0)
+	rtt_ms = (int)(((unsigned long long)rtt * 1000) >> 16);
+    }
+  }
+}
+
+void AmRtcpReporter::parseXr(const unsigned char* p, unsigned int len)
+{
+  while (len >= 4) {
+    unsigned int bt = p[0];
+    unsigned int b_len = (get16(p + 2) + 1) * 4;
+    if (b_len > len)
+      break;
+
+    if ((bt == RTCP_XR_VOIP_METRICS) && (b_len == 36) &&
+	(get32(p + 4) == l_ssrc)) {
+      xr_received++;
+      r_loss_rate = p[8];
+      r_discard_rate = p[9];
+      r_r_factor = p[24];
+      r_mos_lq = p[26];
+      r_mos_cq = p[27];
+    }
+
+    p += b_len;
+    len -= b_len;
+  }
+}
+
+bool AmRtcpReporter::onRtcpReceived(const unsigned char* buf, unsigned int len,
+				    const struct timeval& now)
+{
+  if ((len < 8) || ((buf[0] >> 6) != 2))
+    return false;
+
+  AmLock l(mut);
+
+  while (len >= 4) {
+    if ((buf[0] >> 6) != 2)
+      return false;
+
+    unsigned int count = buf[0] & 0x1f;
+    unsigned int pt = buf[1];
+    unsigned int p_len = (get16(buf + 2) + 1) * 4;
+    if (p_len > len)
+      return false;
+
+    switch (pt) {
+    case RTCP_SR:
+      if (p_len >= 28) {
+	sr_received++;
+	lsr = (get32(buf + 8) << 16) | (get32(buf + 12) >> 16);
+	lsr_recv = now;
+	r_packets_sent = get32(buf + 20);
+	unsigned int max_count = (p_len - 28) / 24;
+	parseReportBlocks(buf + 28, count < max_count ? count : max_count, now);
+      }
+      break;
+
+    case RTCP_RR:
+      if (p_len >= 8) {
+	rr_received++;
+	unsigned int max_count = (p_len - 8) / 24;
+	parseReportBlocks(buf + 8, count < max_count ? count : max_count, now);
+      }
+      break;
+
+    case RTCP_XR:
+      if (p_len >= 8)
+	parseXr(buf + 8, p_len - 8);
+      break;
+
+    default: break;
+    }
+
+    buf += p_len;
+    len -= p_len;
+  }
+
+  return true;
+}
+
+int AmRtcpReporter::getRtt()
+{
+  AmLock l(mut);
+  return rtt_ms;
+}
+
+void AmRtcpReporter::getStats(AmArg& ret)
+{
+  AmLock l(mut);
+
+  ret["ssrc"] = (int)l_ssrc;
+  ret["reports_sent"] = (int)reports_sent;
+
+  AmArg& tx = ret["tx"];
+  tx["packets"] = (int)packets_sent;
+  tx["octets"] = (int)octets_sent;
+
+  AmArg& rx = ret["rx"];
+  rx["ssrc"] = (int)r_ssrc;
+  rx["packets"] = (int)received;
+  rx["expected"] = (int)expected();
+  rx["lost"] = cumLost();
+  rx["discarded"] = (int)discarded;
+  rx["fraction_lost"] = fraction_lost / 256.0;
+  rx["jitter_ms"] = jitterMs(jitter, recv_clock_rate);
+
+  // as reported by the remote side
+  AmArg& remote = ret["remote"];
+  remote["sr_received"] = (int)sr_received;
+  remote["rr_received"] = (int)rr_received;
+  remote["xr_received"] = (int)xr_received;
+  remote["packets_sent"] = (int)r_packets_sent;
+  remote["fraction_lost"] = r_fraction_lost / 256.0;
+  remote["lost"] = r_cum_lost;
+  remote["jitter_ms"] = jitterMs(r_jitter, send_clock_rate);
+  remote["rtt_ms"] = rtt_ms;
+  if (xr_received) {
+    remote["xr_loss_rate"] = r_loss_rate / 256.0;
+    remote["xr_discard_rate"] = r_discard_rate / 256.0;
+    if (r_r_factor != XR_UNAVAILABLE)
+      remote["xr_r_factor"] = (int)r_r_factor;
+    if (r_mos_lq != XR_UNAVAILABLE)
+      remote["xr_mos_lq"] = r_mos_lq / 10.0;
+    if (r_mos_cq != XR_UNAVAILABLE)
+      remote["xr_mos_cq"] = r_mos_cq / 10.0;
+  }
+}
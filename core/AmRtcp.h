@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2026 SEMS contributors
+ *
+ * This file is part of SEMS, a free SIP media server.
+ *
+ * SEMS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version. This program is released under
+ * the GPL with the additional exemption that compiling, linking,
+ * and/or using OpenSSL is allowed.
+ *
+ * For a license to use the SEMS software under conditions
+ * other than those described here, or to purchase support for this
+ * software, please contact iptel.org by e-mail at the following addresses:
+ *    info@iptel.org
+ *
+ * SEMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+/** @file AmRtcp.h */
+#ifndef _AmRtcp_h_
+#define _AmRtcp_h_
+
+#include "AmThread.h"
+
+#include <sys/time.h>
+#include <string>
+using std::string;
+
+class AmArg;
+
+/* RTCP packet types (RFC 3550, RFC 3611) */
+#define RTCP_SR   200
+#define RTCP_RR   201
+#define RTCP_SDES 202
+#define RTCP_BYE  203
+#define RTCP_XR   207
+
+#define RTCP_SDES_CNAME 1
+
+/** XR VoIP metrics report block (RFC 3611, 4.7) */
+#define RTCP_XR_VOIP_METRICS 7
+
+/** minimum number of received packets between two losses outside a burst */
+#define RTCP_XR_GMIN 16
+
+/** default interval between two reports (seconds) */
+#define RTCP_REPORT_INTERVAL 5
+
+/** period of the report timer of the RTP receiver threads (ms) */
+#define RTCP_TIMER_INTERVAL_MS 200
+
+/** maximum size of a report generated by AmRtcpReporter */
+#define RTCP_MAX_REPORT_SIZE 256
+
+/**
+ * \brief RTCP report generation and statistics of one RTP stream.
+ *
+ * Keeps the reception statistics of the remote source (RFC 3550,
+ * appendix A.1, A.3 and A.8) and the counters of the sent packets,
+ * builds compound SR/RR + SDES + XR (VoIP metrics) reports and
+ * parses the reports received from the remote side.
+ *
+ * onRtpSent() is called by the sending (media) thread, onRtpReceived()
+ * and onRtpDiscarded() by the RTP receiver thread, onRtcpReceived()
+ * and buildReport() by the receiver thread of the RTCP socket; all of
+ * them only update counters under a per-stream mutex.
+ */
+class AmRtcpReporter
+{
+  AmMutex mut;
+
+  unsigned int l_ssrc;
+  string       cname;
+
+  /* sender */
+  unsigned int   packets_sent;
+  unsigned int   octets_sent;
+  unsigned int   last_sent_ts;
+  unsigned int   send_clock_rate;
+  struct timeval last_sent;
+
+  /* remote source (RFC 3550, A.1) */
+  bool           have_source;
+  unsigned int   r_ssrc;
+  unsigned short max_seq;
+  unsigned int   cycles;
+  unsigned int   base_seq;
+  unsigned int   bad_seq;
+  unsigned int   probation;
+  unsigned int   received;
+  unsigned int   expected_prior;
+  unsigned int   received_prior;
+  unsigned int   transit;
+  bool           have_transit;
+  double         jitter;
+  unsigned int   recv_clock_rate;
+  unsigned int   last_recv_ts;
+  unsigned int   discarded;
+  unsigned char  fraction_lost;
+
+  /* burst/gap classification of the losses (RFC 3611, 4.7.2) */
+  unsigned int   pkts_since_loss;
+  unsigned int   cand_pkts;  // packets of the current loss period
+  unsigned int   cand_lost;
+  unsigned int   bursts;
+  unsigned int   burst_pkts;
+  unsigned int   burst_lost;
+  unsigned int   gap_lost;
+  double         packet_ms;
+
+  /* last SR received (for LSR/DLSR) */
+  unsigned int   lsr;
+  struct timeval lsr_recv;
+
+  /* reported by the remote side about our stream */
+  unsigned int   rr_received;
+  unsigned int   sr_received;
+  unsigned int   xr_received;
+  unsigned char  r_fraction_lost;
+  int            r_cum_lost;
+  unsigned int   r_jitter;
+  int            rtt_ms;     // -1: unknown
+  unsigned char  r_loss_rate;
+  unsigned char  r_discard_rate;
+  unsigned char  r_r_factor;
+  unsigned char  r_mos_lq;
+  unsigned char  r_mos_cq;
+  unsigned int   r_packets_sent;
+
+  /* reports sent */
+  unsigned int   reports_sent;
+  struct timeval next_report;
+
+  void initSource(unsigned int ssrc, unsigned short seq);
+  bool updateSeq(unsigned short seq);
+  void onLoss(unsigned int n);
+
+  unsigned int expected() const;
+  int cumLost() const;
+
+  /** jitter in ms (jitter in timestamp units) */
+  static double jitterMs(double j, unsigned int clock_rate);
+
+  unsigned int writeReportBlock(unsigned char* p, const struct timeval& now);
+  unsigned int writeSdes(unsigned char* p, unsigned int len);
+  unsigned int writeXr(unsigned char* p);
+
+  void parseReportBlocks(const unsigned char* p, unsigned int count,
+			 const struct timeval& now);
+  void parseXr(const unsigned char* p, unsigned int len);
+
+public:
+  AmRtcpReporter();
+
+  /** (re-)set the own SSRC and SDES CNAME */
+  void init(unsigned int ssrc, const string& cname);
+
+  /** an RTP packet with 'payload_len' bytes has been sent */
+  void onRtpSent(unsigned int ts, unsigned int payload_len,
+		 unsigned int clock_rate);
+
+  /** an RTP packet has been received */
+  void onRtpReceived(unsigned int ssrc, unsigned short seq, unsigned int ts,
+		     unsigned int clock_rate, const struct timeval& arrival);
+
+  /** a received RTP packet was late or a duplicate */
+  void onRtpDiscarded();
+
+  /**
+   * Parses a received compound RTCP packet.
+   * @return false if the packet is not valid RTCP
+   */
+  bool onRtcpReceived(const unsigned char* buf, unsigned int len,
+		      const struct timeval& now);
+
+  /**
+   * Is a report due? The first report is scheduled
+   * once some RTP has been sent or received.
+   */
+  bool reportDue(const struct timeval& now, unsigned int interval);
+
+  /**
+   * Builds a compound report (SR or RR, SDES CNAME, XR VoIP metrics)
+   * and schedules the next one (randomized 0.5 - 1.5 * interval).
+   * @return the length of the report, 0 if the buffer is too small
+   */
+  unsigned int buildReport(const struct timeval& now, unsigned int interval,
+			   unsigned char* buf, unsigned int len);
+
+  /** round trip time in ms, -1 if unknown */
+  int getRtt();
+
+  /** quality counters of the stream */
+  void getStats(AmArg& ret);
+};
+
+#endif
+
+// Local Variables:
+// mode:C++
+// End:
@@ -374,6 +374,7 @@ int AmRtpAudio::setCurrentPayload(int payload)
     }
     
     this->payload = payload;
+    rtp_clock_rate = payloads[index].advertised_clock_rate;
     int res = ((AmAudioRtpFormat*)fmt.get())->setCurrentPayload(payloads[index]);
 
     amci_codec_t* codec = fmt->getCodec();
@@ -45,8 +45,10 @@
 
 #include "sip/msg_logger.h"
 
-AmRtpPacket::AmRtpPacket()
-  : data_offset(0)
+AmRtpPacket::AmRtpPacket(unsigned char* buf, unsigned int _buf_len)
+  : buffer(buf), buf_len(_buf_len), b_size(0),
+    data_offset(0), d_size(0),
+    pool(NULL), next_free(NULL), buf_class(0)
 {
   // buffer will be overwritten by received packet 
   // of hdr+data - does not need to be set to 0s
@@ -142,12 +144,11 @@ int AmRtpPacket::compile(unsigned char* data_buf, unsigned int size)
 
   d_size = size;
   b_size = d_size + sizeof(rtp_hdr_t);
-  assert(b_size <= 4096);
   rtp_hdr_t* hdr = (rtp_hdr_t*)buffer;
 
-  if(b_size>sizeof(buffer)){
-    ERROR("builtin buffer size (%d) exceeded: %d\n",
-	  (int)sizeof(buffer), b_size);
+  if(b_size>buf_len){
+    ERROR("packet buffer size (%u) exceeded: %u\n",
+	  buf_len, b_size);
     return -1;
   }
 
@@ -171,13 +172,14 @@ int AmRtpPacket::compile_raw(unsigned char* data_buf, unsigned int size)
   if ((!size) || (!data_buf))
     return -1;
 
-  if(size>sizeof(buffer)){
-    ERROR("builtin buffer size (%d) exceeded: %d\n",
-	  (int)sizeof(buffer), size);
+  if(size>buf_len){
+    ERROR("packet buffer size (%u) exceeded: %u\n",
+	  buf_len, size);
     return -1;
   }
 
-  memcpy(&buffer[0], data_buf, size);
+  if(data_buf != buffer)
+    memcpy(&buffer[0], data_buf, size);
   b_size = size;
 
   return size;
@@ -267,13 +269,13 @@ int AmRtpPacket::send(int sd, unsigned int sys_if_idx,
 int AmRtpPacket::recv(int sd)
 {
   socklen_t recv_addr_len = sizeof(struct sockaddr_storage);
-  int ret = recvfrom(sd,buffer,sizeof(buffer),0,
+  int ret = recvfrom(sd,buffer,buf_len,MSG_TRUNC,
 		     (struct sockaddr*)&addr,
 		     &recv_addr_len);
 
   if(ret > 0){
 
-    if(ret > 4096)
+    if((unsigned int)ret > buf_len)
       return -1;
 
     b_size = ret;
@@ -33,20 +33,36 @@
 #include <netinet/in.h>
 
 class AmRtpPacketTracer;
+class AmRtpPacketPool;
 class msg_logger;
 
+/** size of the MTU-sized receive buffers */
+#define RTP_PACKET_BUF_SIZE       1500
+/** size of the jumbo receive buffers */
+#define RTP_PACKET_JUMBO_BUF_SIZE 9000
+/** size of the buffers used to compile outgoing packets */
+#define RTP_PACKET_SEND_BUF_SIZE  4096
+
 /** \brief RTP packet implementation */
 class AmRtpPacket {
 
-  unsigned char  buffer[4096];
+  unsigned char* buffer;
+  unsigned int   buf_len;
   unsigned int   b_size;
 
   unsigned int   data_offset;
   unsigned int   d_size;
 
+  // pool the packet has been allocated from (NULL if none)
+  AmRtpPacketPool* pool;
+  AmRtpPacket*     next_free;
+  unsigned char    buf_class;
+
   int sendto(int sd);
   int sendmsg(int sd, unsigned int sys_if_idx);
 
+  friend class AmRtpPacketPool;
+
 public:
   unsigned char  payload;
   bool           marker;
@@ -58,7 +74,11 @@ public:
   struct timeval recv_time;
   struct sockaddr_storage addr;
 
-  AmRtpPacket();
+  /**
+   * @param buf     packet buffer (not owned by the packet)
+   * @param buf_len size of the packet buffer
+   */
+  AmRtpPacket(unsigned char* buf, unsigned int buf_len);
   ~AmRtpPacket();
 
   void setAddr(struct sockaddr_storage* a);
@@ -78,6 +98,7 @@ public:
   unsigned char* getData();
 
   unsigned int   getBufferSize() const { return b_size; }
+  unsigned int   getBufferCapacity() const { return buf_len; }
   unsigned char* getBuffer();
   void setBufferSize(unsigned int b) { b_size = b; }
 
@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2026 SEMS contributors
+ *
+ * This file is part of SEMS, a free SIP media server.
+ *
+ * SEMS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version. This program is released under
+ * the GPL with the additional exemption that compiling, linking,
+ * and/or using OpenSSL is allowed.
+ *
+ * For a license to use the SEMS software under conditions
+ * other than those described here, or to purchase support for this
+ * software, please contact iptel.org by e-mail at the following addresses:
+ *    info@iptel.org
+ *
+ * SEMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "AmRtpPacketPool.h"
+#include "AmConfig.h"
+#include "AmArg.h"
+#include "log.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+// packet header of a slot, the buffer follows
+#define RTP_POOL_SLOT_HDR ((sizeof(AmRtpPacket) + 15) & ~15)
+
+AmRtpPacketPool::AmRtpPacketPool()
+  : mtu(RTP_PACKET_BUF_SIZE, RTP_POOL_SLAB_PACKETS),
+    jumbo(RTP_PACKET_JUMBO_BUF_SIZE, RTP_POOL_JUMBO_SLAB_PACKETS)
+{
+  ovf_buf = (unsigned char*)malloc(RTP_POOL_OVERFLOW_SIZE);
+}
+
+AmRtpPacketPool::~AmRtpPacketPool()
+{
+  for(vector<unsigned char*>::iterator it = slabs.begin();
+      it != slabs.end(); it++) {
+    free(*it);
+  }
+  free(ovf_buf);
+}
+
+bool AmRtpPacketPool::grow(FreeList& l, unsigned char buf_class)
+{
+  unsigned int slot_size = RTP_POOL_SLOT_HDR + l.buf_size;
+  unsigned char* slab = (unsigned char*)malloc(slot_size * l.slab_packets);
+  if(!slab) {
+    ERROR("could not allocate RTP packet slab (%u bytes)\n",
+	  slot_size * l.slab_packets);
+    return false;
+  }
+
+  for(unsigned int i=0; i<l.slab_packets; i++) {
+    unsigned char* slot = slab + i*slot_size;
+    AmRtpPacket* p = new (slot) AmRtpPacket(slot + RTP_POOL_SLOT_HDR,
+					    l.buf_size);
+    p->pool = this;
+    p->buf_class = buf_class;
+    p->next_free = l.local;
+    l.local = p;
+  }
+
+  slabs.push_back(slab);
+  l.capacity.inc(l.slab_packets);
+
+  DBG("RTP packet pool [%p]: new slab of %u x %u bytes\n",
+      this,l.slab_packets,l.buf_size);
+
+  return true;
+}
+
+AmRtpPacket* AmRtpPacketPool::alloc(FreeList& l, unsigned char buf_class)
+{
+  if(!l.local) {
+    // take over everything released in the meantime
+#if HAVE_ATOMIC_CAS
+    l.local = __sync_lock_test_and_set(&l.remote,(AmRtpPacket*)NULL);
+#else
+    l.remote_mut.lock();
+    l.local = l.remote;
+    l.remote = NULL;
+    l.remote_mut.unlock();
+#endif
+    if(!l.local && !grow(l,buf_class))
+      return NULL;
+  }
+
+  AmRtpPacket* p = l.local;
+  l.local = p->next_free;
+  p->next_free = NULL;
+
+  l.in_use.inc();
+  inc_ref(this);
+  return p;
+}
+
+AmRtpPacket* AmRtpPacketPool::allocOversized(unsigned int size)
+{
+  if(AmConfig::RtpJumboBuffers && (size <= jumbo.buf_size))
+    return alloc(jumbo,JumboBuf);
+
+  unsigned char* slot = (unsigned char*)malloc(RTP_POOL_SLOT_HDR + size);
+  if(!slot)
+    return NULL;
+
+  AmRtpPacket* p = new (slot) AmRtpPacket(slot + RTP_POOL_SLOT_HDR, size);
+  p->pool = this;
+  p->buf_class = HeapBuf;
+
+  heap_in_use.inc();
+  inc_ref(this);
+  return p;
+}
+
+AmRtpPacket* AmRtpPacketPool::newPacket()
+{
+  return alloc(mtu,MtuBuf);
+}
+
+void AmRtpPacketPool::release(AmRtpPacket* p)
+{
+  if(p->buf_class == HeapBuf) {
+    p->~AmRtpPacket();
+    free(p);
+    heap_in_use.dec();
+    dec_ref(this);
+    return;
+  }
+
+  FreeList& l = (p->buf_class == JumboBuf) ? jumbo : mtu;
+
+#if HAVE_ATOMIC_CAS
+  // push-only: the owner takes the whole list at once,
+  // so that there is no ABA problem here.
+  AmRtpPacket* head;
+  do {
+    head = l.remote;
+    p->next_free = head;
+  } while(!__sync_bool_compare_and_swap(&l.remote,head,p));
+#else
+  l.remote_mut.lock();
+  p->next_free = l.remote;
+  l.remote = p;
+  l.remote_mut.unlock();
+#endif
+
+  l.in_use.dec();
+
+  // might delete the pool: do not touch it anymore
+  dec_ref(this);
+}
+
+void AmRtpPacketPool::freePacket(AmRtpPacket* p)
+{
+  if(!p || !p->pool)
+    return;
+
+  p->pool->release(p);
+}
+
+int AmRtpPacketPool::recv(AmRtpPacket*& p, int sd)
+{
+  struct iovec iov[2];
+  iov[0].iov_base = p->buffer;
+  iov[0].iov_len  = p->buf_len;
+  iov[1].iov_base = ovf_buf;
+  iov[1].iov_len  = RTP_POOL_OVERFLOW_SIZE;
+
+  struct msghdr hdr;
+  memset(&hdr,0,sizeof(hdr));
+  hdr.msg_name    = &p->addr;
+  hdr.msg_namelen = sizeof(struct sockaddr_storage);
+  hdr.msg_iov     = iov;
+  hdr.msg_iovlen  = 2;
+
+  int ret = recvmsg(sd,&hdr,0);
+  if(ret <= 0)
+    return ret;
+
+  if((unsigned int)ret > p->buf_len) {
+
+    AmRtpPacket* big = allocOversized(ret);
+    if(!big) {
+      dropped.inc();
+      return -1;
+    }
+
+    memcpy(big->buffer, p->buffer, p->buf_len);
+    memcpy(big->buffer + p->buf_len, ovf_buf, ret - p->buf_len);
+    memcpy(&big->addr, &p->addr, sizeof(struct sockaddr_storage));
+
+    freePacket(p);
+    p = big;
+    oversized.inc();
+  }
+
+  p->b_size = ret;
+  return ret;
+}
+
+void AmRtpPacketPool::drop(int sd)
+{
+  struct sockaddr_storage addr;
+  socklen_t addr_len = sizeof(addr);
+  recvfrom(sd,ovf_buf,RTP_POOL_OVERFLOW_SIZE,0,
+	   (struct sockaddr*)&addr,&addr_len);
+  dropped.inc();
+}
+
+void AmRtpPacketPool::getStats(AmArg& ret)
+{
+  ret["mtu_buf_size"] = (int)mtu.buf_size;
+  ret["mtu_capacity"] = (int)mtu.capacity.get();
+  ret["mtu_in_use"] = (int)mtu.in_use.get();
+  ret["jumbo_buf_size"] = (int)jumbo.buf_size;
+  ret["jumbo_capacity"] = (int)jumbo.capacity.get();
+  ret["jumbo_in_use"] = (int)jumbo.in_use.get();
+  ret["heap_in_use"] = (int)heap_in_use.get();
+  ret["oversized"] = (int)oversized.get();
+  ret["dropped"] = (int)dropped.get();
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2026 SEMS contributors
+ *
+ * This file is part of SEMS, a free SIP media server.
+ *
+ * SEMS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version. This program is released under
+ * the GPL with the additional exemption that compiling, linking,
+ * and/or using OpenSSL is allowed.
+ *
+ * For a license to use the SEMS software under conditions
+ * other than those described here, or to purchase support for this
+ * software, please contact iptel.org by e-mail at the following addresses:
+ *    info@iptel.org
+ *
+ * SEMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+/** @file AmRtpPacketPool.h */
+#ifndef _AmRtpPacketPool_h_
+#define _AmRtpPacketPool_h_
+
+#include "AmRtpPacket.h"
+#include "atomic_types.h"
+
+#include <vector>
+using std::vector;
+
+class AmArg;
+
+/** packets per MTU-sized slab */
+#define RTP_POOL_SLAB_PACKETS       64
+/** packets per jumbo slab */
+#define RTP_POOL_JUMBO_SLAB_PACKETS 8
+/** size of the overflow buffer used to receive oversized packets */
+#define RTP_POOL_OVERFLOW_SIZE      65536
+
+/**
+ * \brief slab allocator for received RTP packets.
+ *
+ * Each RTP receiver thread owns one pool. Packets are carved
+ * out of slabs of MTU-sized (and, if enabled, jumbo) buffers.
+ * Packets bigger than the biggest size class are allocated
+ * from the heap.
+ *
+ * Only the owner thread allocates packets. Any thread may
+ * return them with freePacket(): released packets are pushed
+ * onto a lock-free list which the owner thread takes over as
+ * a whole once its private free list runs empty.
+ *
+ * The pool is reference counted: the owner holds one reference
+ * and every packet handed out another one, so that streams may
+ * still return packets after the owner thread has gone.
+ */
+class AmRtpPacketPool
+  : public atomic_ref_cnt
+{
+public:
+  enum BufClass {
+    MtuBuf=0,
+    JumboBuf,
+    HeapBuf
+  };
+
+private:
+  struct FreeList {
+    unsigned int buf_size;
+    unsigned int slab_packets;
+
+    // owner thread only
+    AmRtpPacket* local;
+
+    // packets released by any thread
+    AmRtpPacket* volatile remote;
+#if !HAVE_ATOMIC_CAS
+    AmMutex remote_mut;
+#endif
+
+    atomic_int capacity;
+    atomic_int in_use;
+
+    FreeList(unsigned int _buf_size, unsigned int _slab_packets)
+      : buf_size(_buf_size), slab_packets(_slab_packets),
+	local(NULL), remote(NULL)
+    {}
+  };
+
+  FreeList mtu;
+  FreeList jumbo;
+
+  // owner thread only
+  vector<unsigned char*> slabs;
+
+  // receives the tail of oversized packets
+  unsigned char* ovf_buf;
+
+  atomic_int heap_in_use;
+  atomic_int oversized;
+  atomic_int dropped;
+
+  bool grow(FreeList& l, unsigned char buf_class);
+  AmRtpPacket* alloc(FreeList& l, unsigned char buf_class);
+  AmRtpPacket* allocOversized(unsigned int size);
+  void release(AmRtpPacket* p);
+
+public:
+  AmRtpPacketPool();
+  ~AmRtpPacketPool();
+
+  /**
+   * Get an MTU-sized packet (owner thread only).
+   * @return NULL if no memory is available.
+   */
+  AmRtpPacket* newPacket();
+
+  /**
+   * Receive one datagram into p (owner thread only).
+   * If the datagram does not fit into p, p is released
+   * and replaced by a bigger packet.
+   * @return as recvmsg(), -1 if no bigger packet could be allocated.
+   */
+  int recv(AmRtpPacket*& p, int sd);
+
+  /** Receive and discard one datagram (owner thread only). */
+  void drop(int sd);
+
+  /** Return a packet to the pool it has been allocated from. */
+  static void freePacket(AmRtpPacket* p);
+
+  /** Fill ret with the pool occupancy counters */
+  void getStats(AmArg& ret);
+};
+
+#endif
+
+// Local Variables:
+// mode:C++
+// End:
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2026 SEMS contributors
+ *
+ * This file is part of SEMS, a free SIP media server.
+ *
+ * SEMS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version. This program is released under
+ * the GPL with the additional exemption that compiling, linking,
+ * and/or using OpenSSL is allowed.
+ *
+ * For a license to use the SEMS software under conditions
+ * other than those described here, or to purchase support for this
+ * software, please contact iptel.org by e-mail at the following addresses:
+ *    info@iptel.org
+ *
+ * SEMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "AmRtpReceiveRing.h"
+#include "AmRtpPacket.h"
+#include "atomic_types.h"
+
+#include <string.h>
+
+// slots are published with release/acquire semantics;
+// fall back to a full barrier on older compilers.
+#ifdef __ATOMIC_RELEASE
+#define RING_RELEASE() __atomic_thread_fence(__ATOMIC_RELEASE)
+#define RING_ACQUIRE() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#else
+#define RING_RELEASE() __sync_synchronize()
+#define RING_ACQUIRE() __sync_synchronize()
+#endif
+
+// a filled slot is taken by whoever clears it first: get(),
+// drain() or recycle(). Without CAS, recycle() never takes
+// any and get()/drain() must not run concurrently.
+#if HAVE_ATOMIC_CAS
+#define RING_TAKE(slot,p) __sync_bool_compare_and_swap(&(slot),p,(AmRtpPacket*)NULL)
+#else
+#define RING_TAKE(slot,p) ((slot) = NULL, true)
+#endif
+
+AmRtpReceiveRing::AmRtpReceiveRing(bool reorder)
+  : w_max(0), w_max_seq(0),
+    w_first(0), w_end(0), w_recycled(0),
+    r_next(0), r_gap(0), r_gap_since(0), r_pos(0),
+    reorder(reorder),
+    late(0), busy(0), recycled(0)
+{
+  memset((void*)slots,0,sizeof(slots));
+  memset(slot_seq,0,sizeof(slot_seq));
+}
+
+bool AmRtpReceiveRing::put(AmRtpPacket* p)
+{
+  // extended sequence numbers start at 1<<16,
+  // so that 0 means 'nothing received yet'.
+  unsigned int ext;
+  if(!w_max) {
+    ext = (1<<16) | p->sequence;
+    w_first = ext;
+  }
+  else {
+    int delta = (short)(unsigned short)(p->sequence - w_max_seq);
+    if((delta > RTP_RING_RESYNC) || (delta < -RTP_RING_RESYNC)) {
+      // sequence restarted: continue beyond the current window
+      ext = w_max + RTP_RING_SIZE + 1;
+    }
+    else {
+      ext = w_max + delta;
+    }
+  }
+
+  unsigned int r = r_pos;
+  if(r && ((int)(ext - r) < 0)) {
+    late++;
+    return false;
+  }
+
+  unsigned int idx = ext & RTP_RING_MASK;
+  if(slots[idx]) {
+    busy++;
+    return false;
+  }
+
+  slot_seq[idx] = ext;
+
+  // reordered before the consumer has started:
+  // let it start at the lowest packet of the window
+  if(!r && ((int)(ext - w_first) < 0) &&
+     ((int)(w_max - ext) < RTP_RING_SIZE))
+    w_first = ext;
+
+  RING_RELEASE();
+  slots[idx] = p;
+
+  if(!w_max || ((int)(ext - w_max) > 0)) {
+    w_max = ext;
+    w_max_seq = p->sequence;
+    RING_RELEASE();
+    w_end = ext + 1;
+  }
+
+  return true;
+}
+
+AmRtpPacket* AmRtpReceiveRing::get(unsigned int now_ms)
+{
+  unsigned int end = w_end;
+  if(!end)
+    return NULL;
+
+  RING_ACQUIRE();
+
+  if(!r_next)
+    r_next = w_first;
+
+  // everything below the window is lost
+  if(end - r_next > RTP_RING_SIZE)
+    r_next = end - RTP_RING_SIZE;
+
+  AmRtpPacket* p = NULL;
+  while(r_next != end) {
+
+    unsigned int idx = r_next & RTP_RING_MASK;
+    p = slots[idx];
+    if(!p) {
+      // missing packet: wait for it, unless it is
+      // too far behind or has been missing for too long
+      // (nothing to wait for up to the last recycled packet)
+      unsigned int rec = w_recycled;
+      if(reorder && (!rec || ((int)(rec - r_next) < 0))) {
+	if(r_gap != r_next) {
+	  r_gap = r_next;
+	  r_gap_since = now_ms;
+	}
+	if((end - r_next <= RTP_RING_REORDER) &&
+	   (now_ms - r_gap_since < RTP_RING_REORDER_MS))
+	  break;
+      }
+
+      // skip it, together with the following missing ones
+      do {
+	r_next++;
+      } while((r_next != end) && !slots[r_next & RTP_RING_MASK]);
+      continue;
+    }
+
+    RING_ACQUIRE();
+    unsigned int seq = slot_seq[idx];
+
+    // hand the slot back to the producer
+    RING_RELEASE();
+    if(!RING_TAKE(slots[idx],p)) {
+      // recycled by the producer meanwhile
+      p = NULL;
+      r_next++;
+      continue;
+    }
+
+    if(seq == r_next)
+      r_next++;
+    // else: packet from an older round, return it anyway
+    break;
+  }
+
+  r_pos = r_next;
+  return p;
+}
+
+AmRtpPacket* AmRtpReceiveRing::drain()
+{
+  for(unsigned int i=0; i<RTP_RING_SIZE; i++) {
+    AmRtpPacket* p = slots[i];
+    if(p && RING_TAKE(slots[i],p)) {
+      RING_ACQUIRE();
+      return p;
+    }
+  }
+
+  return NULL;
+}
+
+AmRtpPacket* AmRtpReceiveRing::recycle()
+{
+#if HAVE_ATOMIC_CAS
+  unsigned int end = w_end;
+  if(!end)
+    return NULL;
+
+  // oldest packet first: the consumer has not reached it yet
+  unsigned int pos = r_pos;
+  if(!pos || (end - pos > RTP_RING_SIZE))
+    pos = end - RTP_RING_SIZE;
+
+  for(; pos != end; pos++) {
+    unsigned int idx = pos & RTP_RING_MASK;
+    AmRtpPacket* p = slots[idx];
+    if(p && RING_TAKE(slots[idx],p)) {
+      w_recycled = slot_seq[idx];
+      recycled++;
+      return p;
+    }
+  }
+#endif
+
+  return NULL;
+}
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2026 SEMS contributors
+ *
+ * This file is part of SEMS, a free SIP media server.
+ *
+ * SEMS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version. This program is released under
+ * the GPL with the additional exemption that compiling, linking,
+ * and/or using OpenSSL is allowed.
+ *
+ * For a license to use the SEMS software under conditions
+ * other than those described here, or to purchase support for this
+ * software, please contact iptel.org by e-mail at the following addresses:
+ *    info@iptel.org
+ *
+ * SEMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+/** @file AmRtpReceiveRing.h */
+#ifndef _AmRtpReceiveRing_h_
+#define _AmRtpReceiveRing_h_
+
+class AmRtpPacket;
+
+#define RTP_RING_BITS 6
+#define RTP_RING_SIZE (1<<RTP_RING_BITS)
+#define RTP_RING_MASK (RTP_RING_SIZE-1)
+
+/**
+ * sequence number jump (in packets) above which the
+ * sender is considered to have restarted its sequence
+ */
+#define RTP_RING_RESYNC 1000
+
+/**
+ * a missing packet is waited for (it might arrive reordered)
+ * until more than RTP_RING_REORDER packets after it are there,
+ * or for at most RTP_RING_REORDER_MS
+ */
+#define RTP_RING_REORDER    8
+#define RTP_RING_REORDER_MS 60
+
+/**
+ * \brief single-producer/single-consumer receive buffer.
+ *
+ * Packets are slotted by their (extended) RTP sequence number,
+ * so that inserting and draining them in order takes no lock
+ * and no allocation. put() may only be called by one thread
+ * (the RTP receiver), get() by one other thread at a time
+ * (the media processor). drain() may run concurrently to get().
+ *
+ * A slot belongs to the producer while it is empty; once it
+ * holds a packet, it is taken by compare-and-swap, by the consumer
+ * or by the producer recycling it. get() returns the packets in
+ * sequence order, skipping missing ones once the reorder window
+ * is exceeded (or at once, for a ring created without reordering);
+ * packets arriving after the consumer has passed their sequence
+ * number are refused.
+ */
+class AmRtpReceiveRing
+{
+  AmRtpPacket* volatile slots[RTP_RING_SIZE];
+  unsigned int          slot_seq[RTP_RING_SIZE];
+
+  // producer only
+  unsigned int   w_max;
+  unsigned short w_max_seq;
+
+  // written by the producer
+  volatile unsigned int w_first;
+  volatile unsigned int w_end;
+  volatile unsigned int w_recycled; // last recycled packet
+
+  // consumer only
+  unsigned int r_next;
+  unsigned int r_gap;       // missing packet waited for
+  unsigned int r_gap_since; // ms
+
+  // written by the consumer
+  volatile unsigned int r_pos;
+
+  // wait for missing packets?
+  bool reorder;
+
+public:
+  /** packets refused because they arrived too late (producer) */
+  unsigned int late;
+  /** packets refused because their slot was still in use (producer) */
+  unsigned int busy;
+  /** buffered packets taken back by recycle() (producer) */
+  unsigned int recycled;
+
+  /**
+   * @param reorder false if the sequence numbers of the packets
+   *        put here have gaps anyway (e.g. RTP telephone events
+   *        which share the sequence of the audio stream)
+   */
+  AmRtpReceiveRing(bool reorder = true);
+
+  /**
+   * Insert a parsed packet (producer).
+   * @return false if the packet has not been inserted.
+   */
+  bool put(AmRtpPacket* p);
+
+  /**
+   * Take the next packet in sequence order (consumer).
+   * @param now_ms consumer clock, to time out missing packets
+   * @return NULL if no packet is available.
+   */
+  AmRtpPacket* get(unsigned int now_ms);
+
+  /**
+   * Take any packet still held by the ring (consumer),
+   * used to empty the ring.
+   * @return NULL if the ring is empty.
+   */
+  AmRtpPacket* drain();
+
+  /**
+   * Take back the oldest packet not read yet (producer),
+   * to reuse it when no other packet is available.
+   * @return NULL if the ring is empty.
+   */
+  AmRtpPacket* recycle();
+};
+
+#endif
+
+// Local Variables:
+// mode:C++
+// End:
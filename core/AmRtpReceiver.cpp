@@ -30,8 +30,13 @@
 #include "AmRtpPacket.h"
 #include "log.h"
 #include "AmConfig.h"
+#include "AmArg.h"
+#include "AmRtcp.h"
 
 #include <errno.h>
+#include <sys/time.h>
+
+#include <algorithm>
 
 // Not on Solaris!
 #if !defined (__SVR4) && !defined (__sun)
@@ -50,14 +55,20 @@ _AmRtpReceiver::~_AmRtpReceiver()
 }
 
 AmRtpReceiverThread::AmRtpReceiverThread()
-  : stop_requested(false)
+  : stop_requested(false),
+    callbacks(0)
 {
   // libevent event base
   ev_base = event_base_new();
+
+  // released by the streams' packets as well
+  pool = new AmRtpPacketPool();
+  inc_ref(pool);
 }
 
 AmRtpReceiverThread::~AmRtpReceiverThread()
 {
+  dec_ref(pool);
   event_base_free(ev_base);
   INFO("RTP receiver has been recycled.\n");
 }
@@ -96,10 +107,29 @@ void AmRtpReceiverThread::run()
 	      NULL,NULL);
   event_add(ev_default,NULL);
 
+  // RTCP reports: sent from here, not from the media processing
+  struct event* ev_rtcp = NULL;
+  if(AmConfig::RtcpInterval) {
+    ev_rtcp = event_new(ev_base,-1,EV_PERSIST,
+			AmRtpReceiverThread::_rtcp_timer_cb,this);
+    struct timeval tv = { 0, RTCP_TIMER_INTERVAL_MS * 1000 };
+    event_add(ev_rtcp,&tv);
+  }
+
+  // packet rates of the streams
+  struct event* ev_stats =
+    event_new(ev_base,-1,EV_PERSIST,
+	      AmRtpReceiverThread::_stats_timer_cb,this);
+  struct timeval stats_tv = { 1, 0 };
+  event_add(ev_stats,&stats_tv);
+
   // run the event loop
   event_base_loop(ev_base,0);
 
   // clean-up fake fds/event
+  event_free(ev_stats);
+  if(ev_rtcp)
+    event_free(ev_rtcp);
   event_free(ev_default);
   close(fake_fds[0]);
   close(fake_fds[1]);
@@ -117,10 +147,138 @@ void AmRtpReceiverThread::_rtp_receiver_read_cb(evutil_socket_t sd,
     p_si->thread->streams_mut.unlock();
     return;
   }
-  p_si->stream->recvPacket(sd);
+  p_si->thread->callbacks++;
+  p_si->stream->recvPacket(sd,p_si->thread->pool);
   p_si->thread->streams_mut.unlock();
 }
 
+void AmRtpReceiverThread::_rtcp_timer_cb(evutil_socket_t sd,
+					 short what, void* arg)
+{
+  static_cast<AmRtpReceiverThread*>(arg)->rtcpTimer();
+}
+
+void AmRtpReceiverThread::rtcpTimer()
+{
+  struct timeval now;
+  gettimeofday(&now,NULL);
+
+  streams_mut.lock();
+  for(Streams::iterator it = streams.begin();
+      it != streams.end(); ++it) {
+    if(it->second.stream)
+      it->second.stream->rtcpTimer(it->first,now);
+  }
+  streams_mut.unlock();
+}
+
+void AmRtpReceiverThread::getRtcpStats(AmArg& ret)
+{
+  streams_mut.lock();
+  for(Streams::iterator it = streams.begin();
+      it != streams.end(); ++it) {
+    AmRtpStream* stream = it->second.stream;
+    if(!stream || !stream->isLocalRtcp(it->first))
+      continue;
+
+    AmArg entry;
+    stream->getRtcpStats(entry);
+    ret.push(entry);
+  }
+  streams_mut.unlock();
+}
+
+void AmRtpReceiverThread::_stats_timer_cb(evutil_socket_t sd,
+					  short what, void* arg)
+{
+  static_cast<AmRtpReceiverThread*>(arg)->statsTimer();
+}
+
+void AmRtpReceiverThread::statsTimer()
+{
+  streams_mut.lock();
+  for(Streams::iterator it = streams.begin();
+      it != streams.end(); ++it) {
+    AmRtpStream* stream = it->second.stream;
+    AmRtpRecvStats tmp;
+    if(stream && stream->addRecvStats(it->first,tmp))
+      stream->updateRecvRate();
+  }
+  streams_mut.unlock();
+}
+
+bool AmRtpReceiverThread::addStreamStats(int sd, const StreamInfo& si,
+					 AmRtpRecvStats& total)
+{
+  AmRtpRecvStats s;
+  bool rtp = si.stream->addRecvStats(sd,s);
+  s.sub(si.base);
+  total.add(s);
+  return rtp;
+}
+
+void AmRtpReceiverThread::getStats(AmArg& ret)
+{
+  AmRtpRecvStats total;
+  unsigned int n_streams = 0;
+
+  streams_mut.lock();
+  total.add(retired);
+  for(Streams::iterator it = streams.begin();
+      it != streams.end(); ++it) {
+    if(it->second.stream && addStreamStats(it->first,it->second,total))
+      n_streams++;
+  }
+  streams_mut.unlock();
+
+  ret["streams"] = (int)n_streams;
+  ret["callbacks"] = (long)callbacks;
+  ret["pps"] = (long)total.pps;
+  ret["packets"] = (long)total.packets;
+  ret["bytes"] = (long)total.bytes;
+  ret["dropped"] = (long)total.dropped;
+  ret["parse_errors"] = (long)total.parse_errors;
+  ret["late"] = (long)total.late;
+  ret["relayed"] = (long)total.relayed;
+  ret["relay_errors"] = (long)total.relay_errors;
+  ret["rtcp_packets"] = (long)total.rtcp_packets;
+}
+
+struct TalkerCmp
+{
+  bool operator()(const std::pair<unsigned long, AmArg>& a,
+		  const std::pair<unsigned long, AmArg>& b) const {
+    return a.first > b.first;
+  }
+};
+
+void AmRtpReceiverThread::getTopTalkers(std::vector<std::pair<unsigned long, AmArg> >& top,
+					unsigned int n)
+{
+  // (pps, sd) of the RTP sockets; only the top n are described
+  std::vector<std::pair<unsigned long, int> > rates;
+
+  streams_mut.lock();
+  for(Streams::iterator it = streams.begin();
+      it != streams.end(); ++it) {
+    AmRtpRecvStats tmp;
+    AmRtpStream* stream = it->second.stream;
+    if(stream && stream->addRecvStats(it->first,tmp))
+      rates.push_back(std::make_pair(stream->getRecvStats().pps, it->first));
+  }
+
+  if(n > rates.size())
+    n = rates.size();
+  std::partial_sort(rates.begin(),rates.begin() + n,rates.end(),
+		    greater<std::pair<unsigned long, int> >());
+
+  for(unsigned int i=0; i<n; i++) {
+    top.push_back(std::make_pair(rates[i].first,AmArg()));
+    streams[rates[i].second].stream->getRecvStats(top.back().second);
+  }
+  streams_mut.unlock();
+}
+
 void AmRtpReceiverThread::addStream(int sd, AmRtpStream* stream)
 {
   streams_mut.lock();
@@ -133,6 +291,9 @@ void AmRtpReceiverThread::addStream(int sd, AmRtpStream* stream)
 
   StreamInfo& si = streams[sd];
   si.stream = stream;
+  // a stream may be removed and added again (on hold)
+  stream->addRecvStats(sd,si.base);
+  si.base.pps = 0;
   event* ev_read = event_new(ev_base,sd,EV_READ|EV_PERSIST,
 			     AmRtpReceiverThread::_rtp_receiver_read_cb,&si);
   si.ev_read = ev_read;
@@ -159,6 +320,9 @@ void AmRtpReceiverThread::removeStream(int sd)
     return;
   }
 
+  addStreamStats(sd,si,retired);
+  retired.pps = 0;
+
   si.stream = NULL;
   event* ev_read = si.ev_read;
   si.ev_read = NULL;
@@ -195,3 +359,49 @@ void _AmRtpReceiver::removeStream(int sd)
   unsigned int i = sd % n_receivers;
   receivers[i].removeStream(sd);
 }
+
+void _AmRtpReceiver::getPoolStats(AmArg& ret)
+{
+  ret.assertArray();
+  for(unsigned int i=0; i<n_receivers; i++) {
+    AmArg entry;
+    receivers[i].getPoolStats(entry);
+    ret.push(entry);
+  }
+}
+
+void _AmRtpReceiver::getRtcpStats(AmArg& ret)
+{
+  ret.assertArray();
+  for(unsigned int i=0; i<n_receivers; i++)
+    receivers[i].getRtcpStats(ret);
+}
+
+void _AmRtpReceiver::getStats(AmArg& ret)
+{
+  ret.assertArray();
+  for(unsigned int i=0; i<n_receivers; i++) {
+    AmArg entry;
+    receivers[i].getStats(entry);
+    ret.push(entry);
+  }
+}
+
+void _AmRtpReceiver::getTopTalkers(AmArg& ret, unsigned int n)
+{
+  std::vector<std::pair<unsigned long, AmArg> > top;
+  for(unsigned int i=0; i<n_receivers; i++) {
+    std::vector<std::pair<unsigned long, AmArg> > t;
+    receivers[i].getTopTalkers(t,n);
+    for(unsigned int j=0; j<t.size(); j++) {
+      t[j].second["thread"] = (int)i;
+      top.push_back(t[j]);
+    }
+  }
+
+  std::stable_sort(top.begin(),top.end(),TalkerCmp());
+
+  ret.assertArray();
+  for(unsigned int i=0; i<top.size() && i<n; i++)
+    ret.push(top[i].second);
+}
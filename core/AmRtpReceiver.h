@@ -31,14 +31,21 @@
 #include "AmThread.h"
 #include "atomic_types.h"
 #include "singleton.h"
+#include "AmRtpPacketPool.h"
+#include "AmRtpStream.h"
 
 #include <event2/event.h>
 
 #include <map>
+#include <vector>
 using std::greater;
 
+/** number of streams listed by default by getTopTalkers() */
+#define RTP_TOP_TALKERS 10
+
 class AmRtpStream;
 class _AmRtpReceiver;
+class AmArg;
 
 /**
  * \brief receiver for RTP for all streams.
@@ -55,6 +62,8 @@ class AmRtpReceiverThread
     AmRtpStream* stream;
     struct event* ev_read;
     AmRtpReceiverThread* thread;
+    /** stream's counters of sd when added to this thread */
+    AmRtpRecvStats base;
 
     StreamInfo()
       : stream(NULL),
@@ -71,9 +80,40 @@ class AmRtpReceiverThread
   Streams  streams;
   AmMutex  streams_mut;
 
+  /** buffers for the packets received by this thread (referenced) */
+  AmRtpPacketPool* pool;
+
   AmSharedVar<bool> stop_requested;
 
+  /*
+   * Counters of this thread, written only by this thread (no atomics);
+   * padded so that they do not share a cache line with other threads'
+   * data. Read without locking for statistics.
+   */
+  char stats_pad_begin[RTP_RECEIVER_CACHE_LINE];
+  /** read events handled */
+  unsigned long callbacks;
+  /** counters of the streams removed from this thread */
+  AmRtpRecvStats retired;
+  char stats_pad_end[RTP_RECEIVER_CACHE_LINE];
+
   static void _rtp_receiver_read_cb(evutil_socket_t sd, short what, void* arg);
+  static void _rtcp_timer_cb(evutil_socket_t sd, short what, void* arg);
+  static void _stats_timer_cb(evutil_socket_t sd, short what, void* arg);
+
+  /** sends the RTCP reports due (see AmConfig::RtcpInterval) */
+  void rtcpTimer();
+
+  /** updates the packet rates of the streams (every second) */
+  void statsTimer();
+
+  /**
+   * adds the counters of socket sd since it has been added
+   * to this thread (streams_mut must be locked)
+   * @return true if sd is the stream's RTP socket
+   */
+  static bool addStreamStats(int sd, const StreamInfo& si,
+			     AmRtpRecvStats& total);
 
 public:    
   AmRtpReceiverThread();
@@ -86,6 +126,21 @@ public:
   void removeStream(int sd);
 
   void stop_and_wait();
+
+  void getPoolStats(AmArg& ret) { pool->getStats(ret); }
+
+  /** RTCP quality counters of the streams with local media */
+  void getRtcpStats(AmArg& ret);
+
+  /** receive counters of this thread (its current and removed streams) */
+  void getStats(AmArg& ret);
+
+  /**
+   * Adds the receive counters of the (at most) n streams
+   * with the highest packet rate to 'top'.
+   */
+  void getTopTalkers(std::vector<std::pair<unsigned long, AmArg> >& top,
+		     unsigned int n);
 };
 
 class _AmRtpReceiver
@@ -106,6 +161,18 @@ public:
 
   void addStream(int sd, AmRtpStream* stream);
   void removeStream(int sd);
+
+  /** get packet pool occupancy of all receiver threads */
+  void getPoolStats(AmArg& ret);
+
+  /** get RTCP quality counters of all streams with local media */
+  void getRtcpStats(AmArg& ret);
+
+  /** get receive counters of all receiver threads */
+  void getStats(AmArg& ret);
+
+  /** get receive counters of the n streams with the highest packet rate */
+  void getTopTalkers(AmArg& ret, unsigned int n = RTP_TOP_TALKERS);
 };
 
 typedef singleton<_AmRtpReceiver> AmRtpReceiver;
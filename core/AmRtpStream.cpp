@@ -27,12 +27,14 @@
 
 #include "AmRtpStream.h"
 #include "AmRtpPacket.h"
+#include "AmRtpPacketPool.h"
 #include "AmRtpReceiver.h"
 #include "AmConfig.h"
 #include "AmPlugIn.h"
 #include "AmAudio.h"
 #include "AmUtils.h"
 #include "AmSession.h"
+#include "AmArg.h"
 
 #include "AmDtmfDetector.h"
 #include "rtp/telephone_event.h"
@@ -62,6 +64,11 @@
 
 #include "rtp/rtp.h"
 
+#ifdef USE_MONITORING
+#include "AmSessionContainer.h"
+#include "ampi/MonitoringAPI.h"
+#endif
+
 #include <set>
 using std::set;
 
@@ -88,6 +95,31 @@ PayloadMask::PayloadMask(const PayloadMask &src)
   memcpy(bits, src.bits, sizeof(bits));
 }
 
+void AmRtpRecvStats::add(const AmRtpRecvStats& s)
+{
+  packets += s.packets;
+  bytes += s.bytes;
+  dropped += s.dropped;
+  parse_errors += s.parse_errors;
+  late += s.late;
+  relayed += s.relayed;
+  relay_errors += s.relay_errors;
+  rtcp_packets += s.rtcp_packets;
+  pps += s.pps;
+}
+
+void AmRtpRecvStats::sub(const AmRtpRecvStats& s)
+{
+  packets -= s.packets;
+  bytes -= s.bytes;
+  dropped -= s.dropped;
+  parse_errors -= s.parse_errors;
+  late -= s.late;
+  relayed -= s.relayed;
+  relay_errors -= s.relay_errors;
+  rtcp_packets -= s.rtcp_packets;
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 /*
@@ -217,6 +249,8 @@ void AmRtpStream::setLocalPort(unsigned short p)
 
   memcpy(&l_rtcp_saddr, &l_saddr, sizeof(l_saddr));
   am_set_port(&l_rtcp_saddr, l_rtcp_port);
+
+  rtcp.init(l_ssrc, "sems@" + get_addr_str(&l_saddr));
 }
 
 int AmRtpStream::ping()
@@ -230,7 +264,8 @@ int AmRtpStream::ping()
   ping_chr[0] = 0;
   ping_chr[1] = 0;
 
-  AmRtpPacket rp;
+  unsigned char rp_buf[RTP_PACKET_SEND_BUF_SIZE];
+  AmRtpPacket rp(rp_buf,sizeof(rp_buf));
   rp.payload = payload;
   rp.marker = true;
   rp.sequence = sequence++;
@@ -249,7 +284,8 @@ int AmRtpStream::ping()
 
 int AmRtpStream::compile_and_send(const int payload, bool marker, unsigned int ts, 
 				  unsigned char* buffer, unsigned int size) {
-  AmRtpPacket rp;
+  unsigned char rp_buf[RTP_PACKET_SEND_BUF_SIZE];
+  AmRtpPacket rp(rp_buf,sizeof(rp_buf));
   rp.payload = payload;
   rp.timestamp = ts;
   rp.marker = marker;
@@ -299,6 +335,8 @@ int AmRtpStream::compile_and_send(const int payload, bool marker, unsigned int t
   }
  
   if (logger) rp.logSent(logger, &l_saddr);
+
+  rtcp.onRtpSent(ts, size, rtp_clock_rate);
  
   return size;
 }
@@ -328,7 +366,8 @@ int AmRtpStream::send_raw( char* packet, unsigned int length )
   if ((mute) || (hold))
     return 0;
 
-  AmRtpPacket rp;
+  // send directly from the caller's buffer
+  AmRtpPacket rp((unsigned char*)packet, length);
   rp.compile_raw((unsigned char*)packet, length);
   rp.setAddr(&r_saddr);
 
@@ -366,21 +405,21 @@ int AmRtpStream::receive( unsigned char* buffer, unsigned int size,
   last_payload = rp->payload;
 
   if(!rp->getDataSize()) {
-    mem.freePacket(rp);
+    freePacket(rp);
     return RTP_EMPTY;
   }
 
   if (rp->payload == getLocalTelephoneEventPT())
     {
       recvDtmfPacket(rp);
-      mem.freePacket(rp);
+      freePacket(rp);
       return RTP_DTMF;
     }
 
   assert(rp->getData());
   if(rp->getDataSize() > size){
     ERROR("received too big RTP packet\n");
-    mem.freePacket(rp);
+    freePacket(rp);
     return RTP_BUFFER_SIZE;
   }
 
@@ -389,7 +428,7 @@ int AmRtpStream::receive( unsigned char* buffer, unsigned int size,
   out_payload = rp->payload;
 
   int res = rp->getDataSize();
-  mem.freePacket(rp);
+  freePacket(rp);
   return res;
 }
 
@@ -409,6 +448,7 @@ AmRtpStream::AmRtpStream(AmSession* _s, int _if)
     hold(false),
     receiving(true),
     monitor_rtp_timeout(true),
+    event_ring(false),
     relay_stream(NULL),
     relay_enabled(false),
     relay_raw(false),
@@ -416,6 +456,8 @@ AmRtpStream::AmRtpStream(AmSession* _s, int _if)
     relay_transparent_ssrc(true),
     relay_transparent_seqno(true),
     relay_filter_dtmf(false),
+    relay_batch(NULL),
+    rtp_clock_rate(0),
     force_receive_dtmf(false)
 {
 
@@ -440,6 +482,11 @@ AmRtpStream::~AmRtpStream()
     close(l_sd);
     close(l_rtcp_sd);
   }
+
+  receive_mut.lock();
+  clearReceiveBuffer();
+  receive_mut.unlock();
+
   if (logger) dec_ref(logger);
 }
 
@@ -683,6 +730,9 @@ int AmRtpStream::init(const AmSdp& local,
     ++sdp_it;
   }
 
+  if(session && monitoring_id.empty())
+    monitoring_id = session->getLocalTag();
+
   if(!l_port){
     // only if socket not yet bound:
     if(session) {
@@ -752,6 +802,7 @@ int AmRtpStream::init(const AmSdp& local,
   }
   DBG("default payload selected = %i\n",payload);
   last_payload = payload;
+  rtp_clock_rate = payloads[pl_map[payload].index].advertised_clock_rate;
 
   active = false; // mark as nothing received yet
   return 0;
@@ -780,10 +831,7 @@ void AmRtpStream::resume()
   DBG("RTP Stream instance [%p] resuming (receiving=true, clearing biffers/TS/TO)\n", this);
   clearRTPTimeout();
   receive_mut.lock();
-  mem.clear();
-  receive_buf.clear();
-  while (!rtp_ev_qu.empty())
-    rtp_ev_qu.pop();
+  clearReceiveBuffer();
   receive_mut.unlock();
   receiving = true;
 
@@ -827,7 +875,7 @@ void AmRtpStream::bufferPacket(AmRtpPacket* p)
       recvDtmfPacket(p);
     }
 
-    mem.freePacket(p);
+    freePacket(p);
     return;
   }
 
@@ -854,10 +902,15 @@ void AmRtpStream::bufferPacket(AmRtpPacket* p)
 
       if (NULL != relay_stream &&
 	  (!(relay_filter_dtmf && is_dtmf_packet))) {
-        relay_stream->relay(p);
+	if (relay_batch) {
+	  // relayed and freed at the end of the batch
+	  relay_batch->pkts[relay_batch->n++] = p;
+	  return;
+	}
+        relayPackets(&p,1);
       }
 
-      mem.freePacket(p);
+      freePacket(p);
       return;
     }
   }
@@ -865,20 +918,17 @@ void AmRtpStream::bufferPacket(AmRtpPacket* p)
 #ifndef WITH_ZRTP
   // throw away ZRTP packets 
   if(p->version != RTP_VERSION) {
-      mem.freePacket(p);
+      freePacket(p);
       return;
   }
 #endif
 
-  receive_mut.lock();
-
 #ifdef WITH_ZRTP
   if (session && session->enable_zrtp) {
 
     if (NULL == session->zrtp_session_state.zrtp_audio) {
       WARN("dropping received packet, as there's no ZRTP stream initialized\n");
-      receive_mut.unlock();
-      mem.freePacket(p);
+      freePacket(p);
       return;      
     }
  
@@ -890,18 +940,9 @@ void AmRtpStream::bufferPacket(AmRtpPacket* p)
 	p->setBufferSize(size);
 	if (p->parse() < 0) {
 	  ERROR("parsing decoded packet!\n");
-	  mem.freePacket(p);
+	  freePacket(p);
 	} else {
-
-          if(p->payload == getLocalTelephoneEventPT()) {
-            rtp_ev_qu.push(p);
-          } else {
-	    if(!receive_buf.insert(ReceiveBuffer::value_type(p->timestamp,p)).second) {
-	      // insert failed
-	      mem.freePacket(p);
-	    }
-          }
-
+	  storePacket(p);
 	}
       }	break;
 
@@ -910,7 +951,7 @@ void AmRtpStream::bufferPacket(AmRtpPacket* p)
 	// This is a protocol ZRTP packet or masked RTP media.
 	// In either case the packet must be dropped to protect your 
 	// media codec
-	mem.freePacket(p);
+	freePacket(p);
 	
       } break;
 
@@ -920,25 +961,33 @@ void AmRtpStream::bufferPacket(AmRtpPacket* p)
         //
         // This is some kind of error - see logs for more information
         //
-	mem.freePacket(p);
+	freePacket(p);
       } break;
       }
   } else {
 #endif // WITH_ZRTP
 
-    if(p->payload == getLocalTelephoneEventPT()) {
-      rtp_ev_qu.push(p);
-    } else {
-      if(!receive_buf.insert(ReceiveBuffer::value_type(p->timestamp,p)).second) {
-	// insert failed
-	mem.freePacket(p);
-      }
-    }
+    storePacket(p);
 
 #ifdef WITH_ZRTP
   }
 #endif
-  receive_mut.unlock();
+}
+
+void AmRtpStream::storePacket(AmRtpPacket* p)
+{
+  AmRtpReceiveRing& ring =
+    (p->payload == getLocalTelephoneEventPT()) ? event_ring : receive_ring;
+
+  rtcp.onRtpReceived(p->ssrc, p->sequence, p->timestamp,
+		     rtp_clock_rate, p->recv_time);
+
+  if(!ring.put(p)) {
+    // late or duplicate
+    recv_stats.late++;
+    rtcp.onRtpDiscarded();
+    freePacket(p);
+  }
 }
 
 void AmRtpStream::clearRTPTimeout(struct timeval* recv_time) {
@@ -978,7 +1027,6 @@ int AmRtpStream::nextPacket(AmRtpPacket*& p)
   struct timeval diff;
   gettimeofday(&now,NULL);
 
-  receive_mut.lock();
   timersub(&now,&last_recv_time,&diff);
   if(monitor_rtp_timeout &&
      AmConfig::DeadRtpTime && 
@@ -986,86 +1034,188 @@ int AmRtpStream::nextPacket(AmRtpPacket*& p)
      ((unsigned int)diff.tv_sec > AmConfig::DeadRtpTime)){
     WARN("RTP Timeout detected. Last received packet is too old "
 	 "(diff.tv_sec = %i\n",(unsigned int)diff.tv_sec);
-    receive_mut.unlock();
     return RTP_TIMEOUT;
   }
 
-  if(!rtp_ev_qu.empty()) {
-    // first return RTP telephone event payloads
-    p = rtp_ev_qu.front();
-    rtp_ev_qu.pop();
-    receive_mut.unlock();
-    return 1;
-  }
+  // first return RTP telephone event payloads
+  unsigned int now_ms = now.tv_sec * 1000 + now.tv_usec / 1000;
+  p = event_ring.get(now_ms);
+  if(!p)
+    p = receive_ring.get(now_ms);
 
-  if(receive_buf.empty()){
-    receive_mut.unlock();
-    return RTP_EMPTY;
+  return p ? 1 : RTP_EMPTY;
+}
+
+void AmRtpStream::clearReceiveBuffer()
+{
+  AmRtpPacket* p;
+  while ((p = receive_ring.drain()) != NULL)
+    freePacket(p);
+  while ((p = event_ring.drain()) != NULL)
+    freePacket(p);
+}
+
+AmRtpPacket* AmRtpStream::newPacket(AmRtpPacketPool* pool)
+{
+  AmRtpPacket* p = NULL;
+  if(n_packets.get() < MAX_PACKETS) {
+    p = pool->newPacket();
+    if(p) {
+      n_packets.inc();
+      return p;
+    }
   }
 
-  p = receive_buf.begin()->second;
-  receive_buf.erase(receive_buf.begin());
-  receive_mut.unlock();
+  // reuse the oldest buffered packet
+  p = receive_ring.recycle();
+  if(p) recv_stats.dropped++;
+  return p;
+}
+
+void AmRtpStream::freePacket(AmRtpPacket* p)
+{
+  if (!p) return;
 
-  return 1;
+  n_packets.dec();
+  AmRtpPacketPool::freePacket(p);
 }
 
-AmRtpPacket *AmRtpStream::reuseBufferedPacket()
+void AmRtpStream::processPacket(AmRtpPacket* p)
 {
-  AmRtpPacket *p = NULL;
+  int parse_res = 0;
 
-  receive_mut.lock();
-  if(!receive_buf.empty()) {
-    p = receive_buf.begin()->second;
-    receive_buf.erase(receive_buf.begin());
+  if (logger) p->logReceived(logger, &l_saddr);
+
+  recv_stats.packets++;
+  recv_stats.bytes += p->getBufferSize();
+
+  if(!relay_raw
+#ifdef WITH_ZRTP
+     && !(session && session->enable_zrtp)
+#endif
+     ) {
+    parse_res = p->parse();
+  }
+
+  if (parse_res == -1) {
+    DBG("error while parsing RTP packet.\n");
+    recv_stats.parse_errors++;
+    clearRTPTimeout(&p->recv_time);
+    freePacket(p);	  
+  } else {
+    bufferPacket(p);
   }
-  receive_mut.unlock();
-  return p;
 }
 
-void AmRtpStream::recvPacket(int fd)
+void AmRtpStream::recvPacket(int fd, AmRtpPacketPool* pool)
 {
   if(fd == l_rtcp_sd){
     recvRtcpPacket();
     return;
   }
 
-  AmRtpPacket* p = mem.newPacket();
-  if (!p) p = reuseBufferedPacket();
+#ifdef MSG_WAITFORONE
+  if(relay_enabled && relay_stream && (AmConfig::RtpRelayBatchSize > 1)) {
+    recvRelayBatch(pool);
+    return;
+  }
+#endif
+
+  AmRtpPacket* p = newPacket(pool);
   if (!p) {
     DBG("out of buffers for RTP packets, dropping (stream [%p])\n",
 	this);
     // drop received data
-    AmRtpPacket dummy;
-    dummy.recv(l_sd);
+    pool->drop(l_sd);
+    recv_stats.dropped++;
     return;
   }
   
-  if(p->recv(l_sd) > 0){
-    int parse_res = 0;
+  if(pool->recv(p,l_sd) > 0){
+    gettimeofday(&p->recv_time,NULL);
+    processPacket(p);
+  } else {
+    freePacket(p);
+  }
+}
 
-    if (logger) p->logReceived(logger, &l_saddr);
+void AmRtpStream::recvRelayBatch(AmRtpPacketPool* pool)
+{
+#ifdef MSG_WAITFORONE
+  AmRtpPacket*   pkts[RTP_RELAY_MAX_BATCH];
+  struct mmsghdr msgs[RTP_RELAY_MAX_BATCH];
+  struct iovec   iov[RTP_RELAY_MAX_BATCH];
+
+  unsigned int batch_size = AmConfig::RtpRelayBatchSize;
+  if(batch_size > RTP_RELAY_MAX_BATCH)
+    batch_size = RTP_RELAY_MAX_BATCH;
+
+  unsigned int n = 0;
+  for(; n < batch_size; n++) {
+    AmRtpPacket* p = newPacket(pool);
+    if(!p) break;
+
+    pkts[n] = p;
+    iov[n].iov_base = p->getBuffer();
+    iov[n].iov_len  = p->getBufferCapacity();
+
+    memset(&msgs[n],0,sizeof(struct mmsghdr));
+    msgs[n].msg_hdr.msg_name    = &p->addr;
+    msgs[n].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+    msgs[n].msg_hdr.msg_iov     = &iov[n];
+    msgs[n].msg_hdr.msg_iovlen  = 1;
+  }
 
-    gettimeofday(&p->recv_time,NULL);
-    
-    if(!relay_raw
-#ifdef WITH_ZRTP
-       && !(session && session->enable_zrtp)
-#endif
-       ) {
-      parse_res = p->parse();
-    }
+  if(!n) {
+    DBG("out of buffers for RTP packets, dropping (stream [%p])\n",
+	this);
+    pool->drop(l_sd);
+    recv_stats.dropped++;
+    return;
+  }
 
-    if (parse_res == -1) {
-      DBG("error while parsing RTP packet.\n");
-      clearRTPTimeout(&p->recv_time);
-      mem.freePacket(p);	  
-    } else {
-      bufferPacket(p);
+  int ret = recvmmsg(l_sd,msgs,n,MSG_DONTWAIT,NULL);
+  relay_stream->relay_stats.recv_calls++;
+
+  struct timeval now;
+  gettimeofday(&now,NULL);
+
+  RelayBatch batch;
+  batch.n = 0;
+  relay_batch = &batch;
+
+  unsigned int i = 0;
+  for(; (ret > 0) && (i < (unsigned int)ret); i++) {
+    AmRtpPacket* p = pkts[i];
+    if(msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+      DBG("RTP packet too big for relay batch, dropping (stream [%p])\n",
+	  this);
+      relay_stream->relay_stats.truncated++;
+      recv_stats.dropped++;
+      freePacket(p);
+      continue;
     }
-  } else {
-    mem.freePacket(p);
+
+    p->setBufferSize(msgs[i].msg_len);
+    p->recv_time = now;
+    processPacket(p);
   }
+
+  relay_batch = NULL;
+
+  // unused buffers
+  for(; i < n; i++)
+    freePacket(pkts[i]);
+
+  if(!batch.n)
+    return;
+
+  if(relay_stream)
+    relayPackets(batch.pkts,batch.n);
+
+  for(i=0; i < batch.n; i++)
+    freePacket(batch.pkts[i]);
+#endif
 }
 
 void AmRtpStream::recvRtcpPacket()
@@ -1088,6 +1238,8 @@ void AmRtpStream::recvRtcpPacket()
   else
     if(!recved_bytes) return;
 
+  recv_stats.rtcp_packets++;
+
   static const cstring empty;
   if (logger)
     logger->log((const char *)buffer, recved_bytes, &recv_addr, &l_rtcp_saddr, empty);
@@ -1097,8 +1249,16 @@ void AmRtpStream::recvRtcpPacket()
 
   handleSymmetricRtp(&recv_addr,true);
 
-  if(!relay_enabled || !relay_stream ||
-     !relay_stream->l_sd)
+  if(!relay_enabled) {
+    // reports about our own stream
+    struct timeval now;
+    gettimeofday(&now,NULL);
+    if(!rtcp.onRtcpReceived(buffer,recved_bytes,now))
+      DBG("received invalid RTCP packet (%d bytes)\n",recved_bytes);
+    return;
+  }
+
+  if(!relay_stream || !relay_stream->l_sd)
     return;
 
   if((size_t)recved_bytes > sizeof(buffer)) {
@@ -1133,15 +1293,135 @@ void AmRtpStream::recvRtcpPacket()
 
 }
 
-void AmRtpStream::relay(AmRtpPacket* p)
+int AmRtpStream::sendRtcpPacket(const unsigned char* buf, unsigned int len)
+{
+  struct sockaddr_storage rtcp_raddr;
+  memcpy(&rtcp_raddr,&r_saddr,sizeof(rtcp_raddr));
+  am_set_port(&rtcp_raddr, r_rtcp_port);
+
+  int err;
+  if(AmConfig::UseRawSockets) {
+    err = raw_sender::send((char*)buf,len,
+			   AmConfig::RTP_Ifs[l_if].NetIfIdx,
+			   &l_rtcp_saddr,
+			   &rtcp_raddr);
+  }
+  else {
+    err = sendto(l_rtcp_sd,buf,len,0,
+		 (const struct sockaddr *)&rtcp_raddr,
+		 SA_len(&rtcp_raddr));
+  }
+
+  if(err < 0){
+    ERROR("could not send RTCP packet: %s\n",strerror(errno));
+    return -1;
+  }
+
+  static const cstring empty;
+  if (logger)
+    logger->log((const char *)buf, len, &l_rtcp_saddr, &rtcp_raddr, empty);
+
+  return len;
+}
+
+void AmRtpStream::rtcpTimer(int fd, const struct timeval& now)
+{
+  if((fd != l_rtcp_sd) || relay_enabled || hold || !r_rtcp_port)
+    return;
+
+  // no remote address (yet)
+  if(((r_saddr.ss_family != AF_INET) ||
+      (SAv4(&r_saddr)->sin_addr.s_addr == INADDR_ANY)) &&
+     ((r_saddr.ss_family != AF_INET6) ||
+      IN6_IS_ADDR_UNSPECIFIED(&SAv6(&r_saddr)->sin6_addr)))
+    return;
+
+  if(!rtcp.reportDue(now,AmConfig::RtcpInterval))
+    return;
+
+  unsigned char buf[RTCP_MAX_REPORT_SIZE];
+  unsigned int len = rtcp.buildReport(now,AmConfig::RtcpInterval,
+				      buf,sizeof(buf));
+  if(len)
+    sendRtcpPacket(buf,len);
+
+#ifdef USE_MONITORING
+  if(!monitoring_id.empty()) {
+    AmArg stats;
+    rtcp.getStats(stats);
+    MONITORING_LOG(monitoring_id.c_str(), "rtp_quality", stats);
+  }
+#endif
+}
+
+bool AmRtpStream::addRecvStats(int fd, AmRtpRecvStats& total)
+{
+  if(fd == l_rtcp_sd) {
+    total.rtcp_packets += recv_stats.rtcp_packets;
+    return false;
+  }
+
+  if(fd != l_sd)
+    return false;
+
+  AmRtpRecvStats rtp = recv_stats;
+  rtp.rtcp_packets = 0;
+  total.add(rtp);
+  return true;
+}
+
+void AmRtpStream::getRecvStats(AmArg& ret)
+{
+  ret["local_port"] = (int)l_port;
+
+  struct sockaddr_storage raddr;
+  memcpy(&raddr,&r_saddr,sizeof(raddr));
+  if(raddr.ss_family == AF_INET || raddr.ss_family == AF_INET6)
+    ret["remote"] = get_addr_str(&raddr) + ":" + int2str(am_get_port(&raddr));
+
+  if(!monitoring_id.empty())
+    ret["session"] = monitoring_id.c_str();
+
+  ret["relay"] = relay_enabled;
+  ret["pps"] = (long)recv_stats.pps;
+  ret["packets"] = (long)recv_stats.packets;
+  ret["bytes"] = (long)recv_stats.bytes;
+  ret["dropped"] = (long)recv_stats.dropped;
+  ret["parse_errors"] = (long)recv_stats.parse_errors;
+  ret["late"] = (long)recv_stats.late;
+  ret["relayed"] = (long)recv_stats.relayed;
+  ret["relay_errors"] = (long)recv_stats.relay_errors;
+  ret["rtcp_packets"] = (long)recv_stats.rtcp_packets;
+
+  if(relay_enabled) {
+    // written by the thread relaying to this stream: approximate values
+    AmArg& r = ret["relay_out"];
+    r["packets"] = (long)relay_stats.packets;
+    r["bytes"] = (long)relay_stats.bytes;
+    r["send_calls"] = (long)relay_stats.send_calls;
+    r["send_errors"] = (long)relay_stats.send_errors;
+    r["recv_calls"] = (long)relay_stats.recv_calls;
+    r["truncated"] = (long)relay_stats.truncated;
+  }
+}
+
+void AmRtpStream::getRtcpStats(AmArg& ret)
+{
+  rtcp.getStats(ret);
+  ret["local_port"] = (int)l_port;
+  if(!monitoring_id.empty())
+    ret["session"] = monitoring_id.c_str();
+}
+
+bool AmRtpStream::prepareRelay(AmRtpPacket* p)
 {
   // not yet initialized
   // or muted/on-hold
   if (!l_port || mute || hold) 
-    return;
+    return false;
 
   if(session && !session->onBeforeRTPRelay(p,&r_saddr))
-    return;
+    return false;
 
   rtp_hdr_t* hdr = (rtp_hdr_t*)p->getBuffer();
   if (!relay_raw && !relay_transparent_seqno)
@@ -1150,16 +1430,104 @@ void AmRtpStream::relay(AmRtpPacket* p)
     hdr->ssrc = htonl(l_ssrc);
   p->setAddr(&r_saddr);
 
+  return true;
+}
+
+void AmRtpStream::afterRelay(AmRtpPacket* p)
+{
+  if (logger) p->logSent(logger, &l_saddr);
+  if(session) session->onAfterRTPRelay(p,&r_saddr);
+
+  relay_stats.packets++;
+  relay_stats.bytes += p->getBufferSize();
+}
+
+void AmRtpStream::relayPackets(AmRtpPacket** pkts, unsigned int n)
+{
+  // relay_stream's relay_stats are written by this thread only
+  const AmRtpRelayStats& rs = relay_stream->relay_stats;
+  unsigned long packets = rs.packets;
+  unsigned long errors = rs.send_errors;
+
+  if(n == 1)
+    relay_stream->relay(pkts[0]);
+  else
+    relay_stream->relayBatch(pkts,n);
+
+  recv_stats.relayed += rs.packets - packets;
+  recv_stats.relay_errors += rs.send_errors - errors;
+}
+
+void AmRtpStream::relay(AmRtpPacket* p)
+{
+  if (!prepareRelay(p))
+    return;
+
+  relay_stats.send_calls++;
   if(p->send(l_sd, AmConfig::RTP_Ifs[l_if].NetIfIdx, &l_saddr) < 0){
     ERROR("while sending RTP packet to '%s':%i\n",
 	  get_addr_str(&r_saddr).c_str(),am_get_port(&r_saddr));
+    relay_stats.send_errors++;
   }
   else {
-    if (logger) p->logSent(logger, &l_saddr);
-    if(session) session->onAfterRTPRelay(p,&r_saddr);
+    afterRelay(p);
   }
 }
 
+void AmRtpStream::relayBatch(AmRtpPacket** pkts, unsigned int n)
+{
+#ifdef MSG_WAITFORONE
+  // raw sockets and forced outbound interfaces
+  // need the per-packet send path
+  if(!AmConfig::UseRawSockets &&
+     !(AmConfig::ForceOutboundIf && AmConfig::RTP_Ifs[l_if].NetIfIdx)) {
+
+    struct mmsghdr msgs[RTP_RELAY_MAX_BATCH];
+    struct iovec   iov[RTP_RELAY_MAX_BATCH];
+    AmRtpPacket*   sent[RTP_RELAY_MAX_BATCH];
+
+    unsigned int m = 0;
+    for(unsigned int i=0; i < n; i++) {
+      AmRtpPacket* p = pkts[i];
+      if (!prepareRelay(p))
+	continue;
+
+      iov[m].iov_base = p->getBuffer();
+      iov[m].iov_len  = p->getBufferSize();
+
+      memset(&msgs[m],0,sizeof(struct mmsghdr));
+      msgs[m].msg_hdr.msg_name    = &p->addr;
+      msgs[m].msg_hdr.msg_namelen = SA_len(&p->addr);
+      msgs[m].msg_hdr.msg_iov     = &iov[m];
+      msgs[m].msg_hdr.msg_iovlen  = 1;
+      sent[m++] = p;
+    }
+
+    unsigned int done = 0;
+    while(done < m) {
+      relay_stats.send_calls++;
+      int ret = sendmmsg(l_sd,msgs + done,m - done,0);
+      if(ret <= 0) {
+	ERROR("while sending %u RTP packets to '%s':%i: %s\n",
+	      m - done,get_addr_str(&r_saddr).c_str(),
+	      am_get_port(&r_saddr),strerror(errno));
+	relay_stats.send_errors += m - done;
+	break;
+      }
+      done += ret;
+    }
+
+    for(unsigned int i=0; i < done; i++)
+      afterRelay(sent[i]);
+
+    return;
+  }
+#endif
+
+  for(unsigned int i=0; i < n; i++)
+    relay(pkts[i]);
+}
+
 int AmRtpStream::getLocalTelephoneEventRate()
 {
   if (local_telephone_event_pt.get())
@@ -1263,52 +1631,6 @@ string AmRtpStream::getPayloadName(int payload_type)
   return string("");
 }
 
-PacketMem::PacketMem()
-  : cur_idx(0), n_used(0)
-{
-  memset(used, 0, sizeof(used));
-}
-
-inline AmRtpPacket* PacketMem::newPacket() 
-{
-  if(n_used >= MAX_PACKETS)
-    return NULL; // full
-
-  while(used[cur_idx])
-    cur_idx = (cur_idx + 1) & MAX_PACKETS_MASK;
-
-  used[cur_idx] = true;
-  n_used++;
-
-  AmRtpPacket* p = &packets[cur_idx];
-  cur_idx = (cur_idx + 1) & MAX_PACKETS_MASK;
-
-  return p;
-}
-
-inline void PacketMem::freePacket(AmRtpPacket* p) 
-{
-  if (!p)  return;
-
-  int idx = p-packets;
-  assert(idx >= 0);
-  assert(idx < MAX_PACKETS);
-
-  if(!used[idx]) {
-    ERROR("freePacket() double free: n_used = %d, idx = %d",n_used,idx);
-    return;
-  }
-
-  used[p-packets] = false;
-  n_used--;
-}
-
-inline void PacketMem::clear() 
-{
-  memset(used, 0, sizeof(used));
-  n_used = cur_idx = 0;
-}
-
 void AmRtpStream::setLogger(msg_logger* _logger)
 {
   if (logger) dec_ref(logger);
@@ -1337,5 +1659,21 @@ void AmRtpStream::debug()
   DBG("\tmute: %s, hold: %s, receiving: %s",
       BOOL_STR(mute), BOOL_STR(hold), BOOL_STR(receiving));
 
+  if (relay_stats.packets || relay_stats.send_errors) {
+    DBG("\trelayed to remote: %lu packets, %lu bytes, %lu send calls, "
+	"%lu send errors, %lu recv calls, %lu truncated",
+	relay_stats.packets, relay_stats.bytes, relay_stats.send_calls,
+	relay_stats.send_errors, relay_stats.recv_calls,
+	relay_stats.truncated);
+  }
+
+  if (recv_stats.packets || recv_stats.dropped) {
+    DBG("\treceived: %lu packets, %lu bytes, %lu dropped, %lu parse errors, "
+	"%lu late, %lu relayed, %lu relay errors",
+	recv_stats.packets, recv_stats.bytes, recv_stats.dropped,
+	recv_stats.parse_errors, recv_stats.late, recv_stats.relayed,
+	recv_stats.relay_errors);
+  }
+
 #undef BOOL_STR
 }
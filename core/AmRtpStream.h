@@ -33,8 +33,11 @@
 #include "AmThread.h"
 #include "SampleArray.h"
 #include "AmRtpPacket.h"
+#include "AmRtpReceiveRing.h"
 #include "AmEvent.h"
 #include "AmDtmfSender.h"
+#include "AmRtcp.h"
+#include "atomic_types.h"
 
 #include <netinet/in.h>
 
@@ -64,29 +67,73 @@ class  AmSession;
 struct SdpPayload;
 struct amci_payload_t;
 class msg_logger;
+class AmRtpPacketPool;
+class AmArg;
 
-/**
- * This provides the memory for the receive buffer.
- */
-struct PacketMem {
-#define MAX_PACKETS_BITS 5
-#define MAX_PACKETS (1<<MAX_PACKETS_BITS)
-#define MAX_PACKETS_MASK (MAX_PACKETS-1)
-
-  AmRtpPacket packets[MAX_PACKETS];
-  bool        used[MAX_PACKETS];
+/** maximum number of packets received/relayed at once in relay mode */
+#define RTP_RELAY_MAX_BATCH 32
 
-  PacketMem();
+/** padding between counters written by different threads */
+#define RTP_RECEIVER_CACHE_LINE 64
 
-  inline AmRtpPacket* newPacket();
-  inline void freePacket(AmRtpPacket* p);
-  inline void clear();
+/** counters of the packets relayed to the remote side of a stream */
+struct AmRtpRelayStats
+{
+  unsigned long packets;
+  unsigned long bytes;
+  // sendto()/sendmmsg() calls
+  unsigned long send_calls;
+  unsigned long send_errors;
+  // recvmmsg() calls on the relaying side
+  unsigned long recv_calls;
+  // packets too big for a batch buffer (dropped)
+  unsigned long truncated;
+
+  AmRtpRelayStats()
+    : packets(0), bytes(0), send_calls(0), send_errors(0),
+      recv_calls(0), truncated(0)
+  {}
+};
 
-private:
-  unsigned int cur_idx;
-  unsigned int n_used;
+/**
+ * receive counters of a stream. Written only by the AmRtpReceiver
+ * threads serving the stream's sockets, read without locking for
+ * statistics.
+ */
+struct AmRtpRecvStats
+{
+  unsigned long packets;
+  unsigned long bytes;
+  // no packet buffer available (dropped unread,
+  // or the oldest buffered packet dropped instead)
+  unsigned long dropped;
+  unsigned long parse_errors;
+  // late or duplicate (refused by the receive buffer)
+  unsigned long late;
+  // relayed to the relay stream / failed to send
+  unsigned long relayed;
+  unsigned long relay_errors;
+  unsigned long rtcp_packets;
+
+  // packets/s during the last second (RTP receiver thread's timer)
+  unsigned long pps;
+  unsigned long pps_base;
+
+  AmRtpRecvStats()
+    : packets(0), bytes(0), dropped(0), parse_errors(0), late(0),
+      relayed(0), relay_errors(0), rtcp_packets(0), pps(0), pps_base(0)
+  {}
+
+  /** adds the counters (and rate) of s */
+  void add(const AmRtpRecvStats& s);
+  /** subtracts the counters (not the rate) of s */
+  void sub(const AmRtpRecvStats& s);
 };
 
+/** maximum number of packets held by a stream at a time */
+#define MAX_PACKETS_BITS 5
+#define MAX_PACKETS (1<<MAX_PACKETS_BITS)
+
 /** \brief event fired on RTP timeout */
 class AmRtpTimeoutEvent
   : public AmEvent
@@ -166,8 +213,6 @@ protected:
     uint8_t index;
   };
 
-  typedef std::map<unsigned int, AmRtpPacket*, ts_less> ReceiveBuffer;
-  typedef std::queue<AmRtpPacket*>                      RtpEventQueue;
   typedef std::map<unsigned char, PayloadMapping>       PayloadMappingTable;
   
   // mapping from local payload type to PayloadMapping
@@ -245,12 +290,14 @@ protected:
   AmDtmfSender   dtmf_sender;
 
   /**
-   * Receive buffer, queue and mutex
+   * Receive buffers, filled by the RTP receiver thread and
+   * read without locking by the media processor.
+   * receive_mut only serializes clearing them.
    */
-  PacketMem       mem;
-  ReceiveBuffer   receive_buf;
-  RtpEventQueue   rtp_ev_qu;
-  AmMutex         receive_mut;
+  atomic_int       n_packets; // packets taken from the pool
+  AmRtpReceiveRing receive_ring;
+  AmRtpReceiveRing event_ring; // RTP telephone events (not reordered)
+  AmMutex          receive_mut;
 
   /** should we receive packets? if not -> drop */
   bool receiving;
@@ -270,6 +317,34 @@ protected:
   /** filter RTP DTMF (2833 / 4733) in relaying */
   bool            relay_filter_dtmf;
 
+  /** packets to be relayed at the end of the current receive batch */
+  struct RelayBatch {
+    AmRtpPacket* pkts[RTP_RELAY_MAX_BATCH];
+    unsigned int n;
+  };
+  /** set while a receive batch is being processed, NULL otherwise */
+  RelayBatch*     relay_batch;
+
+  /** written only by the AmRtpReceiver thread relaying to this stream */
+  AmRtpRelayStats relay_stats;
+
+  /*
+   * Written only by the AmRtpReceiver threads of this stream's sockets
+   * (no atomics); padded so that they do not share a cache line with
+   * the fields written by the media processor or the relaying thread.
+   * Read without locking for statistics.
+   */
+  char            recv_stats_pad_begin[RTP_RECEIVER_CACHE_LINE];
+  AmRtpRecvStats  recv_stats;
+  char            recv_stats_pad_end[RTP_RECEIVER_CACHE_LINE];
+
+  /** RTCP reports and quality counters of locally terminated media */
+  AmRtcpReporter  rtcp;
+  /** RTP clock rate of the current payload */
+  unsigned int    rtp_clock_rate;
+  /** key of the stream's quality counters in the monitoring */
+  string          monitoring_id;
+
   /** Session owning this stream */
   AmSession*         session;
 
@@ -283,20 +358,49 @@ protected:
 
   /** Insert an RTP packet to the buffer queue */
   void bufferPacket(AmRtpPacket* p);
+  /** Store a parsed packet into its receive ring */
+  void storePacket(AmRtpPacket* p);
   /* Get next packet from the buffer queue */
   int nextPacket(AmRtpPacket*& p);
   
-  /** Try to reuse oldest buffered packet for newly coming packet */
-  AmRtpPacket *reuseBufferedPacket();
+  /**
+   * Get a packet from the pool (limited to MAX_PACKETS per stream),
+   * or else take back the oldest buffered one
+   */
+  AmRtpPacket* newPacket(AmRtpPacketPool* pool);
+  /** Return a packet to its pool */
+  void freePacket(AmRtpPacket* p);
+  /** Free all buffered packets (receive_mut must be locked) */
+  void clearReceiveBuffer();
 
   /** handle symmetric RTP/RTCP - if in passive mode, update raddr from rp */
   void handleSymmetricRtp(struct sockaddr_storage* recv_addr, bool rtcp);
 
   void relay(AmRtpPacket* p);
 
+  /** Relay several packets at once (sendmmsg if available) */
+  void relayBatch(AmRtpPacket** pkts, unsigned int n);
+
+  /** Relay packets through relay_stream, counting them in recv_stats */
+  void relayPackets(AmRtpPacket** pkts, unsigned int n);
+
+  /** Checks and header rewriting before relaying a packet */
+  bool prepareRelay(AmRtpPacket* p);
+  /** Logging, call-backs and counters after relaying a packet */
+  void afterRelay(AmRtpPacket* p);
+
+  /** Process a freshly received packet */
+  void processPacket(AmRtpPacket* p);
+
+  /** Receive and relay a batch of packets (recvmmsg if available) */
+  void recvRelayBatch(AmRtpPacketPool* pool);
+
   /** Sets generic parameters on SDP media */
   void getSdp(SdpMedia& m);
 
+  /** Send a locally generated RTCP packet to the remote side */
+  int sendRtcpPacket(const unsigned char* buf, unsigned int len);
+
   /** Clear RTP timeout at time recv_time */
   void clearRTPTimeout(struct timeval* recv_time);
 
@@ -354,10 +458,21 @@ public:
   int receive( unsigned char* buffer, unsigned int size,
 	       unsigned int& ts, int& payload );
 
-  void recvPacket(int fd);
+  /**
+   * Receive a packet from fd (called by the RTP receiver thread).
+   * @param pool packet pool of the calling receiver thread
+   */
+  void recvPacket(int fd, AmRtpPacketPool* pool);
 
   void recvRtcpPacket();
 
+  /**
+   * Sends an RTCP report if one is due (called periodically by
+   * the RTP receiver thread, for each of its sockets).
+   * @param fd socket the call is made for (only the RTCP socket counts)
+   */
+  void rtcpTimer(int fd, const struct timeval& now);
+
   /** ping the remote side, to open NATs and enable symmetric RTP */
   int ping();
 
@@ -516,6 +631,29 @@ public:
   void setLogger(msg_logger *_logger);
 
   void debug();
+
+  /** RTCP quality counters (local reception and remote reports) */
+  void getRtcpStats(AmArg& ret);
+
+  /** is fd the RTCP socket of this stream, and the media not relayed? */
+  bool isLocalRtcp(int fd) { return (fd == l_rtcp_sd) && !relay_enabled; }
+
+  /**
+   * Adds the receive counters of socket fd to 'total'
+   * (RTP counters for the RTP socket, RTCP ones for the RTCP socket).
+   * @return true if fd is the RTP socket
+   */
+  bool addRecvStats(int fd, AmRtpRecvStats& total);
+
+  /** Updates the packet rate (called every second for the RTP socket) */
+  void updateRecvRate() {
+    recv_stats.pps = recv_stats.packets - recv_stats.pps_base;
+    recv_stats.pps_base = recv_stats.packets;
+  }
+
+  /** receive counters, addresses and owner of the stream */
+  void getRecvStats(AmArg& ret);
+  const AmRtpRecvStats& getRecvStats() const { return recv_stats; }
 };
 
 #endif
@@ -1228,7 +1228,7 @@ bool AmSession::setTimer(int timer_id, double timeout) {
   }
 
   DBG("setting timer %d with timeout %f\n", timer_id, timeout);
-  AmAppTimer::instance()->setTimer(getLocalTag(), timer_id, timeout);
+  AmAppTimer::instance()->setTimer(&app_timers, getLocalTag(), timer_id, timeout);
 
   return true;
 }
@@ -1236,7 +1236,7 @@ bool AmSession::setTimer(int timer_id, double timeout) {
 bool AmSession::removeTimer(int timer_id) {
 
   DBG("removing timer %d\n", timer_id);
-  AmAppTimer::instance()->removeTimer(getLocalTag(), timer_id);
+  AmAppTimer::instance()->removeTimer(&app_timers, timer_id);
 
   return true;
 }
@@ -1244,7 +1244,7 @@ bool AmSession::removeTimer(int timer_id) {
 bool AmSession::removeTimers() {
 
   DBG("removing timers\n");
-  AmAppTimer::instance()->removeTimers(getLocalTag());
+  AmAppTimer::instance()->removeTimers(&app_timers);
 
   return true;
 }
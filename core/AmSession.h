@@ -40,6 +40,7 @@
 #include "AmApi.h"
 #include "AmSessionEventHandler.h"
 #include "AmMediaProcessor.h"
+#include "AmAppTimer.h"
 
 #include "AmZRTP.h"
 
@@ -134,6 +135,9 @@ private:
   /** Sets the application parameters from the original request */
   void setAppParams(const AmSipRequest& req);
 
+  /** application timers (setTimer() etc.) */
+  AmAppTimerQueue app_timers;
+
 protected:
 
   AmCondition<bool> sess_stopped;
@@ -212,6 +212,10 @@ unsigned int AmSIPRegistration::getExpiresLeft() {
 time_t AmSIPRegistration::getExpiresTS() {
   return reg_begin + reg_expires;
 }
+
+time_t AmSIPRegistration::getSendTimeoutTS() {
+  return reg_send_begin + REGISTER_SEND_TIMEOUT;
+}
 	
 void AmSIPRegistration::onRegisterExpired() {
   if (sess_link.length()) {
@@ -141,6 +141,8 @@ class AmSIPRegistration
   unsigned int getExpiresLeft();
   /** return the expires TS for the registration */
   time_t getExpiresTS();
+  /** return the TS after which a pending request times out */
+  time_t getSendTimeoutTS();
 
   bool getUnregistering();
 
@@ -62,6 +62,36 @@ void AmMutex::unlock()
   pthread_mutex_unlock(&m);
 }
 
+bool AmMutex::try_lock()
+{
+  return pthread_mutex_trylock(&m) == 0;
+}
+
+AmRWLock::AmRWLock()
+{
+  pthread_rwlock_init(&l,NULL);
+}
+
+AmRWLock::~AmRWLock()
+{
+  pthread_rwlock_destroy(&l);
+}
+
+void AmRWLock::lock_read()
+{
+  pthread_rwlock_rdlock(&l);
+}
+
+void AmRWLock::lock_write()
+{
+  pthread_rwlock_wrlock(&l);
+}
+
+void AmRWLock::unlock()
+{
+  pthread_rwlock_unlock(&l);
+}
+
 AmThread::AmThread()
   : _stopped(true)
 {
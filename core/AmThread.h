@@ -47,6 +47,9 @@ public:
   ~AmMutex();
   void lock();
   void unlock();
+
+  /** @return true if the mutex has been locked */
+  bool try_lock();
 };
 
 /**
@@ -64,6 +67,21 @@ public:
   }
 };
 
+/**
+ * \brief C++ Wrapper class for pthread read-write lock
+ */
+class AmRWLock
+{
+  pthread_rwlock_t l;
+
+public:
+  AmRWLock();
+  ~AmRWLock();
+  void lock_read();
+  void lock_write();
+  void unlock();
+};
+
 /**
  * \brief Shared variable.
  *
@@ -1071,7 +1071,8 @@ size_t skip_to_end_of_brackets(const string& s, size_t start) {
 
 bool read_regex_mapping(const string& fname, const char* sep,
 			const char* dbg_type,
-			RegexMappingVector& result) {
+			RegexMappingVector& result,
+			std::vector<string>* patterns) {
   std::ifstream appcfg(fname.c_str());
   if (!appcfg.good()) {
     ERROR("could not load %s file at '%s'\n",
@@ -1102,6 +1103,8 @@ bool read_regex_mapping(const string& fname, const char* sep,
       DBG("adding %s '%s' => '%s'\n",
 	  dbg_type, re_v[0].c_str(),re_v[1].c_str());
       result.push_back(make_pair(app_re, re_v[1]));
+      if (patterns)
+	patterns->push_back(re_v[0]);
     }
   }
   return true;
@@ -1118,28 +1121,35 @@ void ReplaceStringInPlace(std::string& subject, const std::string& search,
 
 #define MAX_GROUPS 9
 
+bool run_regex_mapping_entry(const regex_t& re, const string& repl,
+			     const char* test_s, string& result) {
+  regmatch_t groups[MAX_GROUPS];
+  if (regexec(&re, test_s, MAX_GROUPS, groups, 0))
+    return false;
+
+  result = repl;
+  string soh(1, char(1));
+  ReplaceStringInPlace(result, "\\\\", soh);
+  unsigned int g = 0;
+  for (g = 1; g < MAX_GROUPS; g++) {
+    if (groups[g].rm_so == (int)(size_t)-1) break;
+    DBG("group %u: [%2u-%2u]: %.*s\n",
+	g, groups[g].rm_so, groups[g].rm_eo,
+	groups[g].rm_eo - groups[g].rm_so, test_s + groups[g].rm_so);
+    std::string match(test_s + groups[g].rm_so,
+		      groups[g].rm_eo - groups[g].rm_so);
+    ReplaceStringInPlace(result, "\\" + int2str(g), match);
+  }
+  ReplaceStringInPlace(result, soh, "\\");
+  return true;
+}
+
 bool run_regex_mapping(const RegexMappingVector& mapping, const char* test_s,
                        string& result) {
-  regmatch_t groups[MAX_GROUPS];
   for (RegexMappingVector::const_iterator it = mapping.begin();
        it != mapping.end(); it++) {
-    if (!regexec(&it->first, test_s, MAX_GROUPS, groups, 0)) {
-      result = it->second;
-      string soh(1, char(1));
-      ReplaceStringInPlace(result, "\\\\", soh);
-      unsigned int g = 0;
-      for (g = 1; g < MAX_GROUPS; g++) {
-        if (groups[g].rm_so == (int)(size_t)-1) break;
-        DBG("group %u: [%2u-%2u]: %.*s\n",
-            g, groups[g].rm_so, groups[g].rm_eo,
-            groups[g].rm_eo - groups[g].rm_so, test_s + groups[g].rm_so);
-	std::string match(test_s + groups[g].rm_so,
-			  groups[g].rm_eo - groups[g].rm_so);
-        ReplaceStringInPlace(result, "\\" + int2str(g), match);
-      }
-      ReplaceStringInPlace(result, soh, "\\");
+    if (run_regex_mapping_entry(it->first, it->second, test_s, result))
       return true;
-    }
   }
   return false;
 }
@@ -271,11 +271,13 @@ size_t skip_to_end_of_brackets(const string& s, size_t start);
 typedef std::vector<std::pair<regex_t, string> > RegexMappingVector;
 
 /** read a regex=>string mapping from file
+    @param patterns if set, receives the source of the regexes
     @return true on success
  */
 bool read_regex_mapping(const string& fname, const char* sep,
 			const char* dbg_type,
-			RegexMappingVector& result);
+			RegexMappingVector& result,
+			std::vector<string>* patterns = NULL);
 
 /** run a regex mapping - result is the first matching entry 
     @return true if matched
@@ -283,6 +285,12 @@ bool read_regex_mapping(const string& fname, const char* sep,
 bool run_regex_mapping(const RegexMappingVector& mapping, const char* test_s,
 		       string& result);
 
+/** run a single regex mapping entry (\1... replaced by the groups)
+    @return true if matched
+ */
+bool run_regex_mapping_entry(const regex_t& re, const string& repl,
+			     const char* test_s, string& result);
+
 
 /** convert a binary MD5 hash to hex representation */
 void cvt_hex(HASH bin, HASHHEX hex);
@@ -57,13 +57,18 @@
 #include "AmSipDispatcher.h"
 #include "AmEventDispatcher.h"
 #include "AmSipEvent.h"
+#include "AmArg.h"
 
 bool _SipCtrlInterface::log_parsed_messages = true;
 int _SipCtrlInterface::udp_rcvbuf = -1;
+unsigned int _SipCtrlInterface::udp_batch_size = 1;
+bool _SipCtrlInterface::udp_reuseport = false;
 
 int _SipCtrlInterface::alloc_udp_structs()
 {
-    udp_sockets = new udp_trsp_socket*[ AmConfig::SIP_Ifs.size() ];
+    udp_sockets = new udp_trsp_socket*[ (udp_reuseport ?
+					 AmConfig::SIPServerThreads : 1)
+					* AmConfig::SIP_Ifs.size() ];
     udp_servers = new udp_trsp* [ AmConfig::SIPServerThreads
 				  * AmConfig::SIP_Ifs.size() ];
 
@@ -73,7 +78,7 @@ int _SipCtrlInterface::alloc_udp_structs()
     return -1;
 }
 
-int _SipCtrlInterface::init_udp_servers(int if_num)
+udp_trsp_socket* _SipCtrlInterface::create_udp_socket(int if_num)
 {
     udp_trsp_socket* udp_socket = 
 	new udp_trsp_socket(if_num,AmConfig::SIP_Ifs[if_num].SigSockOpts
@@ -87,6 +92,8 @@ int _SipCtrlInterface::init_udp_servers(int if_num)
 	udp_socket->set_public_ip(AmConfig::SIP_Ifs[if_num].PublicIP);
     }
 
+    udp_socket->set_reuse_port(udp_reuseport);
+
     if(udp_socket->bind(AmConfig::SIP_Ifs[if_num].LocalIP,
 			AmConfig::SIP_Ifs[if_num].LocalPort) < 0){
 
@@ -95,27 +102,94 @@ int _SipCtrlInterface::init_udp_servers(int if_num)
 	      AmConfig::SIP_Ifs[if_num].LocalPort);
 
 	delete udp_socket;
-	return -1;
+	return NULL;
     }
 
     if(udp_rcvbuf > 0) {
 	udp_socket->set_recvbuf_size(udp_rcvbuf);
     }
 
-    trans_layer::instance()->register_transport(udp_socket);
-    udp_sockets[if_num] = udp_socket;
+    udp_sockets[nr_udp_sockets] = udp_socket;
     inc_ref(udp_socket);
     nr_udp_sockets++;
 
+    return udp_socket;
+}
+
+int _SipCtrlInterface::init_udp_servers(int if_num)
+{
+    udp_trsp_socket* udp_socket = create_udp_socket(if_num);
+    if(!udp_socket)
+	return -1;
+
+    // only the first socket is used for sending
+    trans_layer::instance()->register_transport(udp_socket);
+
     for(int j=0; j<AmConfig::SIPServerThreads;j++){
+
+	// with SO_REUSEPORT, each worker gets its own socket,
+	// letting the kernel spread the flows over the workers.
+	if(udp_reuseport && (j > 0)) {
+	    udp_socket = create_udp_socket(if_num);
+	    if(!udp_socket)
+		return -1;
+	}
+
 	udp_servers[if_num * AmConfig::SIPServerThreads + j] = 
-	    new udp_trsp(udp_socket);
+	    new udp_trsp(udp_socket,udp_batch_size);
 	nr_udp_servers++;
     }
 
     return 0;
 }
 
+void _SipCtrlInterface::get_udp_stats(AmArg& ret)
+{
+    ret.assertArray();
+    if (NULL == udp_servers)
+	return;
+
+    for(int i=0; i<nr_udp_servers;i++){
+
+	udp_trsp_stats& st = udp_servers[i]->get_stats();
+	trsp_socket* sock = udp_servers[i]->get_sock();
+
+	AmArg entry;
+	entry["address"] = string(sock->get_ip()) + ":"
+	    + int2str(sock->get_port());
+	entry["fd"] = sock->get_sd();
+	entry["recv_calls"] = (long)st.recv_calls.get();
+	entry["recv_msgs"] = (long)st.recv_msgs.get();
+	entry["dropped_msgs"] = (long)st.dropped_msgs.get();
+	entry["recv_errors"] = (long)st.recv_errors.get();
+	ret.push(entry);
+    }
+}
+
+void _SipCtrlInterface::get_trans_stats(AmArg& ret)
+{
+    trans_table_stats st;
+    get_trans_table_stats(st);
+
+    ret["buckets"] = (int)st.buckets;
+    ret["transactions"] = (int)st.transactions;
+    ret["max_chain"] = (int)st.max_chain;
+
+    AmArg& chains = ret["chains"];
+    AmArg& lookups = ret["lookups"];
+    for(unsigned int c=0; c<TRANS_CHAIN_CLASSES; c++) {
+
+	string len = int2str(trans_chain_class_min(c));
+	if(c == TRANS_CHAIN_CLASSES-1)
+	    len = ">=" + len;
+	else if(trans_chain_class_min(c+1) - 1 > trans_chain_class_min(c))
+	    len += "-" + int2str(trans_chain_class_min(c+1) - 1);
+
+	chains[len] = (int)st.chains[c];
+	lookups[len] = (int)st.lookups[c];
+    }
+}
+
 int _SipCtrlInterface::alloc_tcp_structs()
 {
     tcp_sockets = new tcp_server_socket*[ AmConfig::SIP_Ifs.size() ];
@@ -218,6 +292,22 @@ int _SipCtrlInterface::load()
 	    DBG("udp_rcvbuf = %d\n", udp_rcvbuf);
 	}
 
+	if (cfg.hasParameter("udp_batch_size")) {
+	    unsigned int config_udp_batch_size = 0;
+	    if (str2i(cfg.getParameter("udp_batch_size"), config_udp_batch_size)
+		|| !config_udp_batch_size) {
+		ERROR("invalid value specified for udp_batch_size\n");
+		return -1;
+	    }
+	    udp_batch_size = config_udp_batch_size;
+	}
+	DBG("udp_batch_size = %u\n", udp_batch_size);
+
+	if (cfg.hasParameter("udp_reuseport")) {
+	    udp_reuseport = cfg.getParameter("udp_reuseport") == "yes";
+	}
+	DBG("udp_reuseport = %s\n", udp_reuseport?"yes":"no");
+
     } else {
 	DBG("assuming SIP default settings.\n");
     }
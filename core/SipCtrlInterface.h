@@ -39,6 +39,7 @@ using std::list;
 
 class AmSipRequest;
 class AmSipReply;
+class AmArg;
 
 struct sip_msg;
 struct sip_header;
@@ -77,6 +78,7 @@ class _SipCtrlInterface:
     tcp_trsp**        tcp_servers;
 
     int alloc_udp_structs();
+    udp_trsp_socket* create_udp_socket(int if_num);
     int init_udp_servers(int if_num);
 
     int alloc_tcp_structs();
@@ -88,12 +90,26 @@ public:
     static unsigned int outbound_port;
     static bool log_parsed_messages;
     static int udp_rcvbuf;
+    static unsigned int udp_batch_size;
+    static bool udp_reuseport;
 
     _SipCtrlInterface();
     ~_SipCtrlInterface(){}
 
     int load();
 
+    /**
+     * Fills 'ret' with the receive counters of every
+     * SIP/UDP server thread.
+     */
+    void get_udp_stats(AmArg& ret);
+
+    /**
+     * Fills 'ret' with the transaction table occupancy
+     * and the transaction matching counters.
+     */
+    void get_trans_stats(AmArg& ret);
+
     int run();
     void stop();
     void cleanup();
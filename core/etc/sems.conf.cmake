@@ -468,3 +468,18 @@ use_default_signature=yes
 # Default: 4
 #
 # sip_server_threads=8
+
+# Max. number of SIP UDP datagrams fetched by a receiver thread
+# with one system call (recvmmsg). 1 reads one datagram at a time.
+#
+# Default: 1
+#
+# udp_batch_size=32
+
+# Open one SIP UDP socket per receiver thread (SO_REUSEPORT),
+# letting the kernel spread the incoming flows over the threads.
+# Per-thread receive counters: 'sip_udp_stats' (stats module).
+#
+# Default: no
+#
+# udp_reuseport=yes
@@ -39,8 +39,11 @@
 
 #include "AmApi.h"	/* AmLoggingFacility */
 #include "AmThread.h"   /* AmMutex */
+#include "atomic_types.h"
 #include "log.h"
 
+#include <string.h>
+
 
 int log_level  = AmConfig::LogLevel;	/**< log level */
 int log_stderr = AmConfig::LogStderr;	/**< non-zero if logging to stderr */
@@ -181,9 +184,9 @@ void init_logging()
 }
 
 /**
- * Run log hooks
+ * Run log hooks in the calling thread
  */
-void run_log_hooks(int level, pid_t pid, pthread_t tid, const char* func, const char* file, int line, char* msg)
+static void run_log_hooks_sync(int level, pid_t pid, pthread_t tid, const char* func, const char* file, int line, char* msg)
 {
   log_hooks_mutex.lock();
 
@@ -197,6 +200,339 @@ void run_log_hooks(int level, pid_t pid, pthread_t tid, const char* func, const
   log_hooks_mutex.unlock();
 }
 
+/*
+ * Asynchronous logging
+ *
+ * Every thread writes its messages into its own ring buffer
+ * (single producer, single consumer), which is drained by the
+ * log writer thread. Once the ring of a thread has been
+ * created, queuing a message does not take any lock.
+ */
+
+/** Log writer wake-up interval in ms */
+#define LOG_WRITER_INTERVAL 10
+
+/** Level of the records padding the end of a ring */
+#define LOG_RECORD_SKIP -1
+
+#define LOG_RECORD_ALIGN(s) (((s) + sizeof(void*) - 1) & ~(sizeof(void*) - 1))
+
+/** Queued message, followed by the 0-terminated text */
+struct log_record
+{
+  unsigned int len;   /**< length incl. header and padding */
+  int          level;
+  pid_t        pid;
+  pthread_t    tid;
+  const char*  func;
+  const char*  file;
+  int          line;
+};
+
+struct log_ring
+{
+  char*        buf;
+  unsigned int size;             /**< power of 2 */
+  volatile unsigned int head;    /**< written by the owner thread */
+  volatile unsigned int tail;    /**< written by the log writer */
+  volatile bool orphaned;        /**< owner thread has exited */
+  log_ring*    next;
+
+  log_ring(unsigned int size)
+    : buf(new char[size]), size(size),
+      head(0), tail(0), orphaned(false), next(NULL)
+  {}
+
+  ~log_ring() { delete [] buf; }
+
+  unsigned int used() const { return head - tail; }
+
+  bool put(int level, pid_t pid, pthread_t tid, const char* func,
+	   const char* file, int line, const char* msg);
+
+  void drain();
+};
+
+static atomic_int log_dropped_cnt;
+
+/** All rings, new ones are pushed to the front */
+static log_ring* volatile log_rings = NULL;
+static AmMutex log_rings_mutex;
+
+/** held while draining, so that only one thread drains at a time */
+static AmMutex log_drain_mutex;
+
+static pthread_key_t  log_ring_key;
+static pthread_once_t log_ring_key_once = PTHREAD_ONCE_INIT;
+
+static volatile bool log_async = false;
+static unsigned int  log_ring_size = 0;
+
+class AmLogWriter : public AmThread
+{
+  AmCondition<bool> wakeup;
+  volatile bool running;
+
+protected:
+  void run();
+  void on_stop() {}
+
+public:
+  AmLogWriter() : wakeup(false), running(false) {}
+
+  void wake() { wakeup.set(true); }
+
+  void start() {
+    running = true;
+    AmThread::start();
+  }
+
+  void finish() {
+    running = false;
+    wake();
+    join();
+  }
+
+  /** drains all rings, frees those of exited threads */
+  static void drain_all();
+};
+
+static AmLogWriter log_writer;
+
+bool log_ring::put(int level, pid_t pid, pthread_t tid, const char* func,
+		   const char* file, int line, const char* msg)
+{
+  size_t msg_len = strlen(msg) + 1;
+  unsigned int len = LOG_RECORD_ALIGN(sizeof(log_record) + msg_len);
+
+  unsigned int h = head;
+  unsigned int pos = h & (size - 1);
+
+  // records are contiguous: pad up to the end of the buffer
+  unsigned int pad = (pos + len > size) ? size - pos : 0;
+
+  if(size - (h - tail) < pad + len) {
+    log_dropped_cnt.inc();
+    return false;
+  }
+
+  // the log writer is done with the memory up to tail
+  __sync_synchronize();
+
+  if(pad) {
+    log_record* r = (log_record*)(buf + pos);
+    r->len = pad;
+    r->level = LOG_RECORD_SKIP;
+    h += pad;
+    pos = 0;
+  }
+
+  log_record* r = (log_record*)(buf + pos);
+  r->len = len;
+  r->level = level;
+  r->pid = pid;
+  r->tid = tid;
+  r->func = func;
+  r->file = file;
+  r->line = line;
+  memcpy(r + 1, msg, msg_len);
+
+  // publish the record
+  __sync_synchronize();
+  head = h + len;
+
+  return true;
+}
+
+void log_ring::drain()
+{
+  unsigned int h = head;
+  __sync_synchronize();
+
+  unsigned int t = tail;
+  while(t != h) {
+    log_record* r = (log_record*)(buf + (t & (size - 1)));
+    if(r->level != LOG_RECORD_SKIP) {
+      run_log_hooks_sync(r->level, r->pid, r->tid, r->func,
+			 r->file, r->line, (char*)(r + 1));
+    }
+    t += r->len;
+
+    // release the record before running the next hooks
+    __sync_synchronize();
+    tail = t;
+  }
+}
+
+static void log_ring_orphan(void* r)
+{
+  ((log_ring*)r)->orphaned = true;
+}
+
+static void log_ring_key_create()
+{
+  pthread_key_create(&log_ring_key, log_ring_orphan);
+}
+
+/** Ring of the calling thread, created on first use */
+static log_ring* get_log_ring()
+{
+  log_ring* r = (log_ring*)pthread_getspecific(log_ring_key);
+  if(r) return r;
+
+  r = new log_ring(log_ring_size);
+  pthread_setspecific(log_ring_key, r);
+
+  AmLock l(log_rings_mutex);
+  r->next = log_rings;
+  log_rings = r;
+
+  return r;
+}
+
+void AmLogWriter::drain_all()
+{
+  AmLock d(log_drain_mutex);
+  log_ring* prev = NULL;
+  log_ring* r = log_rings;
+
+  // only the log writer unlinks rings, so that
+  // the list can be walked without holding the lock
+  while(r) {
+    bool orphaned = r->orphaned;
+    r->drain();
+
+    if(orphaned && !r->used()) {
+      log_ring* n = r->next;
+      log_rings_mutex.lock();
+      if(prev) {
+	prev->next = n;
+      }
+      else if(log_rings == r) {
+	log_rings = n;
+      }
+      else {
+	// new rings have been pushed in front of r
+	log_ring* p = log_rings;
+	while(p->next != r) p = p->next;
+	p->next = n;
+      }
+      log_rings_mutex.unlock();
+
+      delete r;
+      r = n;
+      continue;
+    }
+
+    prev = r;
+    r = r->next;
+  }
+}
+
+void AmLogWriter::run()
+{
+  unsigned int reported = 0;
+
+  while(running) {
+    wakeup.wait_for_to(LOG_WRITER_INTERVAL);
+    wakeup.set(false);
+
+    drain_all();
+
+    unsigned int dropped = log_dropped_cnt.get();
+    if(dropped != reported) {
+      char msg[128];
+      snprintf(msg, sizeof(msg), "%u log messages dropped (log ring full)",
+	       dropped - reported);
+      run_log_hooks_sync(L_WARN, GET_PID(), GET_TID(), FUNC_NAME,
+			 __FILE__, __LINE__, msg);
+      reported = dropped;
+    }
+  }
+
+  drain_all();
+}
+
+/**
+ * Start asynchronous logging
+ */
+void start_async_logging(unsigned int ring_size)
+{
+  if(log_async)
+    return;
+
+  // power of 2, big enough for a few messages
+  log_ring_size = 4 * LOG_BUFFER_LEN;
+  while(log_ring_size < ring_size)
+    log_ring_size <<= 1;
+
+  pthread_once(&log_ring_key_once, log_ring_key_create);
+
+  // rings of a previous run have been drained
+  log_rings_mutex.lock();
+  for(log_ring* r = log_rings; r; r = r->next) {
+    if(r->size != log_ring_size) {
+      delete [] r->buf;
+      r->buf = new char[log_ring_size];
+      r->size = log_ring_size;
+      r->head = r->tail = 0;
+    }
+  }
+  log_rings_mutex.unlock();
+
+  log_writer.start();
+  log_async = true;
+}
+
+/**
+ * Stop asynchronous logging
+ */
+void stop_async_logging()
+{
+  if(!log_async)
+    return;
+
+  log_async = false;
+  __sync_synchronize();
+  log_writer.finish();
+
+  // messages queued while stopping; later ones
+  // are drained by the thread which queued them
+  AmLogWriter::drain_all();
+}
+
+unsigned int log_dropped()
+{
+  return log_dropped_cnt.get();
+}
+
+/**
+ * Run log hooks
+ */
+void run_log_hooks(int level, pid_t pid, pthread_t tid, const char* func, const char* file, int line, char* msg)
+{
+  if (!log_async) {
+    run_log_hooks_sync(level, pid, tid, func, file, line, msg);
+    return;
+  }
+
+  log_ring* r = get_log_ring();
+  if (!r->put(level, pid, tid, func, file, line, msg))
+    return;
+
+  // pairs with the barrier in stop_async_logging()
+  __sync_synchronize();
+  if (!log_async) {
+    // stopped meanwhile: the final drain may have missed this one
+    AmLock d(log_drain_mutex);
+    r->drain();
+    return;
+  }
+
+  if (r->used() > r->size / 2)
+    log_writer.wake();
+}
+
 /**
  * Register the log hook
  */
@@ -174,6 +174,21 @@ extern const char* log_level2str[];
 void init_logging(void);
 void run_log_hooks(int, pid_t, pthread_t, const char*, const char*, int, char*);
 
+/**
+ * Asynchronous logging: run_log_hooks() only queues the message
+ * into a ring buffer of the calling thread (ring_size bytes), and
+ * the log hooks are run by a dedicated writer thread.
+ */
+void start_async_logging(unsigned int ring_size);
+/**
+ * Returns to synchronous logging, after flushing the rings of all
+ * threads. Messages queued while stopping are flushed by the thread
+ * which queued them.
+ */
+void stop_async_logging(void);
+/** Number of messages dropped because a ring buffer was full */
+unsigned int log_dropped(void);
+
 #ifndef DISABLE_SYSLOG_LOG
 int set_syslog_facility(const char*);
 #endif
@@ -37,6 +37,9 @@
 #include "AmApi.h"
 
 #include "sip/trans_table.h"
+#include "SipCtrlInterface.h"
+#include "AmRtpReceiver.h"
+#include "AmMediaProcessor.h"
 
 #include <string>
 using std::string;
@@ -304,6 +307,13 @@ int StatsUDPServer::execute(char* msg_buf, string& reply,
       "get_cpsmax                         -  get maximum of CPS since the last query\n"
 
       "dump_transactions                  -  dump transaction table to log (loglevel debug)\n"
+      "sip_udp_stats                      -  per-thread SIP/UDP receive counters\n"
+      "sip_trans_stats                    -  transaction table chain lengths and lookups\n"
+      "rtp_pool_stats                     -  per-thread RTP packet pool occupancy\n"
+      "rtcp_stats                         -  RTCP quality counters of the streams with local media\n"
+      "rtp_recv_stats                     -  per-thread RTP receive counters\n"
+      "rtp_top_talkers [<n>]              -  receive counters of the n streams with the highest packet rate\n"
+      "media_stats                        -  per-thread media tick lateness and processing times\n"
 
       "DI <factory> <function> (<args>)*  -  invoke DI command\n"
       "\n"
@@ -318,6 +328,48 @@ int StatsUDPServer::execute(char* msg_buf, string& reply,
     dumps_transactions();
     reply = "200 OK";
   }
+  else if (cmd_str == "sip_udp_stats") {
+    AmArg ret;
+    SipCtrlInterface::instance()->get_udp_stats(ret);
+    reply = AmArg::print(ret) + "\n";
+  }
+  else if (cmd_str == "sip_trans_stats") {
+    AmArg ret;
+    SipCtrlInterface::instance()->get_trans_stats(ret);
+    reply = AmArg::print(ret) + "\n";
+  }
+  else if (cmd_str == "rtp_pool_stats") {
+    AmArg ret;
+    AmRtpReceiver::instance()->getPoolStats(ret);
+    reply = AmArg::print(ret) + "\n";
+  }
+  else if (cmd_str == "rtcp_stats") {
+    AmArg ret;
+    AmRtpReceiver::instance()->getRtcpStats(ret);
+    reply = AmArg::print(ret) + "\n";
+  }
+  else if (cmd_str == "rtp_recv_stats") {
+    AmArg ret;
+    AmRtpReceiver::instance()->getStats(ret);
+    reply = AmArg::print(ret) + "\n";
+  }
+  else if (cmd_str.substr(0, 15) == "rtp_top_talkers") {
+    unsigned int n = RTP_TOP_TALKERS;
+    if ((cmd_str.length() > 15) &&
+	(sscanf(&cmd_str.c_str()[15],"%u",&n) != 1)) {
+      reply = "invalid number of streams\n";
+    }
+    else {
+      AmArg ret;
+      AmRtpReceiver::instance()->getTopTalkers(ret,n);
+      reply = AmArg::print(ret) + "\n";
+    }
+  }
+  else if (cmd_str == "media_stats") {
+    AmArg ret;
+    AmMediaProcessor::instance()->getStats(ret);
+    reply = AmArg::print(ret) + "\n";
+  }
   else if (cmd_str.length() > 4 && cmd_str.substr(0, 4) == "set_") {
     // setters 
     if (cmd_str.substr(4, 8) == "loglevel") {
@@ -43,6 +43,7 @@
 #include "SipCtrlInterface.h"
 #include "sip/trans_table.h"
 #include "sip/async_file_writer.h"
+#include "sip/dns_client.h"
 
 #include "log.h"
 
@@ -574,6 +575,12 @@ int main(int argc, char* argv[])
 
   if(set_sighandler(signal_handler))
     goto error;
+
+  // after fork(): the log writer is a thread
+  if(AmConfig::LogAsync) {
+    INFO("Starting asynchronous logging\n");
+    start_async_logging(AmConfig::LogRingSize * 1024);
+  }
     
 #ifdef WITH_ZRTP
   if (AmZRTP::init()) {
@@ -655,9 +662,15 @@ int main(int argc, char* argv[])
   AmEventDispatcher::dispose();
 
  error:
+  // the log hooks of plug-ins must not be run anymore
+  stop_async_logging();
+
   INFO("Disposing plug-ins\n");
   AmPlugIn::dispose();
 
+  INFO("Disposing DNS client\n");
+  dns_client::dispose();
+
   async_file_writer::instance()->stop();
   async_file_writer::instance()->join();
 
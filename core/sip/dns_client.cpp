@@ -0,0 +1,840 @@
+/*
+ * Copyright (C) 2026 SEMS contributors
+ *
+ * This file is part of SEMS, a free SIP media server.
+ *
+ * SEMS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version. This program is released under
+ * the GPL with the additional exemption that compiling, linking,
+ * and/or using OpenSSL is allowed.
+ *
+ * For a license to use the SEMS software under conditions
+ * other than those described here, or to purchase support for this
+ * software, please contact iptel.org by e-mail at the following addresses:
+ *    info@iptel.org
+ *
+ * SEMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "dns_client.h"
+#include "resolver.h"
+#include "ip_util.h"
+
+#include "log.h"
+
+#include <event2/event_struct.h>
+#include <event2/buffer.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <resolv.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+#define DNS_HDR_LEN 12
+
+// flags (2nd 16-bit word of the header)
+#define DNS_FLAG_QR 0x8000
+#define DNS_FLAG_TC 0x0200
+#define DNS_FLAG_RD 0x0100
+#define DNS_RCODE_MASK 0x000f
+
+#define DNS_RCODE_SERVFAIL 2
+#define DNS_RCODE_NXDOMAIN 3
+#define DNS_RCODE_REFUSED  5
+
+// random source ports are picked from [1024;65535]
+#define DNS_PORT_MIN       1024
+#define DNS_BIND_TRIES     8
+
+unsigned int _dns_client::timeout = 1000; // 1 second
+unsigned int _dns_client::retries = 2;
+
+struct _dns_client::dns_query
+{
+    _dns_client*  client;
+
+    // name as requested by the application
+    string        name;
+    dns_rr_type   type;
+
+    // names to try, in order (see search_names())
+    vector<string> names;
+    unsigned int   name_idx;
+
+    unsigned short id;
+
+    // attempt number (0 = first transmission)
+    unsigned int  attempt;
+    // index of the name server in use
+    unsigned int  ns_idx;
+    // name server of the current attempt
+    sockaddr_storage ns;
+
+    struct event* ev_timer;
+
+    // UDP transport (new socket per attempt)
+    int           sd;
+    struct event* ev_read;
+
+    // TCP transport (after a truncated reply)
+    bool          tcp;
+    struct bufferevent* bev;
+
+    u_char        pkt[NS_PACKETSZ];
+    int           pkt_len;
+
+    list<dns_query_cb*> waiters;
+
+    dns_query(_dns_client* client, const string& name, dns_rr_type type)
+	: client(client), name(name), type(type), name_idx(0), id(0),
+	  attempt(0), ns_idx(0), ev_timer(NULL), sd(-1), ev_read(NULL),
+	  tcp(false), bev(NULL), pkt_len(0)
+    {
+	memset(&ns,0,sizeof(ns));
+    }
+
+    ~dns_query() {
+	close_transport();
+	if(ev_timer) event_free(ev_timer);
+    }
+
+    const string& qname() const { return names[name_idx]; }
+
+    void close_transport() {
+	if(ev_read) {
+	    event_free(ev_read);
+	    ev_read = NULL;
+	}
+	if(sd >= 0) {
+	    close(sd);
+	    sd = -1;
+	}
+	if(bev) {
+	    bufferevent_free(bev);
+	    bev = NULL;
+	}
+    }
+};
+
+/**
+ * Builds a standard query (RD set) into 'buf'.
+ * @return the query length or -1 if the name is invalid.
+ */
+static int dns_build_query(const string& name, dns_rr_type t,
+			   unsigned short id, u_char* buf, int len)
+{
+    if(len < DNS_HDR_LEN + 2 + 4)
+	return -1;
+
+    memset(buf,0,DNS_HDR_LEN);
+    buf[0] = id >> 8;
+    buf[1] = id & 0xff;
+    buf[2] = DNS_FLAG_RD >> 8;
+    buf[5] = 1; // QDCOUNT
+
+    u_char* p   = buf + DNS_HDR_LEN;
+    u_char* end = buf + len - 4 /* type + class */;
+
+    const char* c = name.c_str();
+    const char* name_end = c + name.length();
+    if((c != name_end) && (*(name_end-1) == '.'))
+	name_end--;
+
+    while(c < name_end) {
+	const char* dot = (const char*)memchr(c,'.',name_end - c);
+	if(!dot) dot = name_end;
+
+	int label_len = dot - c;
+	if(!label_len || (label_len > 63) || (p + 1 + label_len >= end))
+	    return -1;
+
+	*(p++) = label_len;
+	memcpy(p,c,label_len);
+	p += label_len;
+	c = dot + 1;
+    }
+
+    if(p - (buf + DNS_HDR_LEN) > NS_MAXDNAME)
+	return -1;
+
+    *(p++) = 0; // root label
+
+    *(p++) = (u_char)(t >> 8);
+    *(p++) = (u_char)(t & 0xff);
+    *(p++) = 0;
+    *(p++) = ns_c_in;
+
+    return p - buf;
+}
+
+static bool same_addr(const sockaddr_storage* a, const sockaddr_storage* b)
+{
+    if(a->ss_family != b->ss_family)
+	return false;
+
+    if(am_get_port(a) != am_get_port(b))
+	return false;
+
+    if(a->ss_family == AF_INET)
+	return !memcmp(&((const sockaddr_in*)a)->sin_addr,
+		       &((const sockaddr_in*)b)->sin_addr,
+		       sizeof(in_addr));
+
+    return !memcmp(&((const sockaddr_in6*)a)->sin6_addr,
+		   &((const sockaddr_in6*)b)->sin6_addr,
+		   sizeof(in6_addr));
+}
+
+/**
+ * Opens a non-blocking UDP socket for talking to 'ns',
+ * bound to a random local port.
+ * @return the socket or -1 on error.
+ */
+static int dns_open_socket(const sockaddr_storage* ns)
+{
+    int sd = socket(ns->ss_family,SOCK_DGRAM,0);
+    if(sd < 0) {
+	ERROR("socket(): %s\n",strerror(errno));
+	return -1;
+    }
+
+    if(evutil_make_socket_nonblocking(sd) < 0) {
+	ERROR("could not make DNS socket non-blocking\n");
+	close(sd);
+	return -1;
+    }
+
+    sockaddr_storage local;
+    memset(&local,0,sizeof(local));
+    local.ss_family = ns->ss_family;
+
+    for(int i=0; i<DNS_BIND_TRIES; i++) {
+
+	unsigned short port;
+	evutil_secure_rng_get_bytes(&port,sizeof(port));
+	port = DNS_PORT_MIN + port % (65536 - DNS_PORT_MIN);
+
+	am_set_port(&local,port);
+	if(!::bind(sd,(const sockaddr*)&local,SA_len(&local)))
+	    return sd;
+
+	if(errno != EADDRINUSE)
+	    break;
+    }
+
+    // let the kernel choose
+    am_set_port(&local,0);
+    if(::bind(sd,(const sockaddr*)&local,SA_len(&local)) < 0) {
+	ERROR("bind(): %s\n",strerror(errno));
+	close(sd);
+	return -1;
+    }
+
+    return sd;
+}
+
+_dns_client::_dns_client()
+    : ev_base(NULL), ev_submit(NULL),
+      ndots(1), stopping(false)
+{
+    ev_base = event_base_new();
+    ev_submit = event_new(ev_base,-1,EV_PERSIST,submit_cb,this);
+
+    load_resolv_conf();
+
+    event_add(ev_submit,NULL);
+    start();
+}
+
+_dns_client::~_dns_client()
+{
+    event_free(ev_submit);
+    event_base_free(ev_base);
+}
+
+void _dns_client::load_resolv_conf()
+{
+    if(res_init() != 0) {
+	ERROR("res_init() failed: no name server available\n");
+	return;
+    }
+
+    for(int i=0; i<_res.nscount; i++) {
+
+	sockaddr_storage ss;
+	memset(&ss,0,sizeof(ss));
+
+	if(_res.nsaddr_list[i].sin_family == AF_INET) {
+	    memcpy(&ss,&_res.nsaddr_list[i],sizeof(sockaddr_in));
+	}
+#ifdef __GLIBC__
+	else if(_res._u._ext.nsaddrs[i]) {
+	    // IPv6 name servers are only kept here
+	    memcpy(&ss,_res._u._ext.nsaddrs[i],sizeof(sockaddr_in6));
+	}
+#endif
+	else {
+	    WARN("DNS name server #%i: unsupported address family, ignored\n",
+		 i+1);
+	    continue;
+	}
+
+	DBG("DNS name server: %s:%u\n",
+	    am_inet_ntop(&ss).c_str(),am_get_port(&ss));
+
+	nameservers.push_back(ss);
+    }
+
+    // 'search' and 'domain' lines
+    if(_res.options & RES_DNSRCH) {
+	for(int i=0; (i < MAXDNSRCH) && _res.dnsrch[i]; i++) {
+	    DBG("DNS search domain: %s\n",_res.dnsrch[i]);
+	    search.push_back(_res.dnsrch[i]);
+	}
+    }
+
+    ndots = _res.ndots;
+}
+
+void _dns_client::set_nameservers(const vector<sockaddr_storage>& ns)
+{
+    AmLock _l(queries_mut);
+    nameservers = ns;
+}
+
+void _dns_client::set_search(const vector<string>& domains, unsigned int n)
+{
+    AmLock _l(queries_mut);
+    search = domains;
+    ndots = n;
+}
+
+bool _dns_client::has_nameservers()
+{
+    AmLock _l(queries_mut);
+    return !nameservers.empty();
+}
+
+/**
+ * Lists the names to query for 'name', like res_search():
+ * absolute names are tried as-is only; names with at least
+ * 'ndots' dots are tried as-is first, then with the search
+ * domains; other names are tried with the search domains first.
+ */
+void _dns_client::search_names(const string& name, vector<string>& names)
+{
+    if(name[name.length()-1] == '.') {
+	names.push_back(name);
+	return;
+    }
+
+    unsigned int dots = 0;
+    for(string::const_iterator it = name.begin(); it != name.end(); ++it)
+	if(*it == '.') dots++;
+
+    if(dots >= ndots)
+	names.push_back(name);
+
+    for(vector<string>::iterator it = search.begin();
+	it != search.end(); ++it) {
+	names.push_back(name + "." + *it);
+    }
+
+    if(dots < ndots)
+	names.push_back(name);
+}
+
+void _dns_client::run()
+{
+    // sockets only exist while queries are pending
+    event_base_loop(ev_base,EVLOOP_NO_EXIT_ON_EMPTY);
+
+    // fail everything still pending, so that
+    // nobody waits forever for a reply
+    queries_mut.lock();
+    stopping = true;
+    list<dns_query*> pending;
+    for(query_name_map::iterator it = by_name.begin();
+	it != by_name.end(); ++it) {
+	pending.push_back(it->second);
+    }
+    by_name.clear();
+    new_queries.clear();
+    queries_mut.unlock();
+
+    for(list<dns_query*>::iterator it = pending.begin();
+	it != pending.end(); ++it) {
+
+	dns_entry_map empty_map;
+	for(list<dns_query_cb*>::iterator cb_it = (*it)->waiters.begin();
+	    cb_it != (*it)->waiters.end(); ++cb_it) {
+	    (*cb_it)->on_dns_result((*it)->name,-1,empty_map);
+	}
+	delete *it;
+    }
+}
+
+void _dns_client::on_stop()
+{
+    event_base_loopexit(ev_base,NULL);
+}
+
+void _dns_client::dispose()
+{
+    if(!is_stopped()) {
+	stop();
+	while(!is_stopped())
+	    usleep(10000);
+    }
+}
+
+int _dns_client::query(const string& name, dns_rr_type t, dns_query_cb* cb)
+{
+    if(!cb || name.empty())
+	return -1;
+
+    stats.queries.inc();
+
+    AmLock _l(queries_mut);
+    if(stopping || nameservers.empty())
+	return -1;
+
+    query_key key(name,t);
+    query_name_map::iterator it = by_name.find(key);
+    if(it != by_name.end()) {
+	// identical query in-flight: just wait for its result
+	it->second->waiters.push_back(cb);
+	stats.coalesced.inc();
+	return 0;
+    }
+
+    dns_query* q = new dns_query(this,name,t);
+    search_names(name,q->names);
+
+    // skip names which do not fit into a query
+    q->name_idx = (unsigned int)-1;
+    if(!next_name(q)) {
+	DBG("invalid DNS name '%s'\n",name.c_str());
+	delete q;
+	return -1;
+    }
+
+    q->ns_idx = random() % nameservers.size();
+    q->waiters.push_back(cb);
+
+    by_name[key] = q;
+    new_queries.push_back(q);
+
+    // wake-up the event loop
+    event_active(ev_submit,0,0);
+
+    return 0;
+}
+
+/**
+ * Prepares the query for the next name of the search list.
+ * @return false if there is none left.
+ */
+bool _dns_client::next_name(dns_query* q)
+{
+    while(++q->name_idx < q->names.size()) {
+
+	evutil_secure_rng_get_bytes(&q->id,sizeof(q->id));
+	q->pkt_len = dns_build_query(q->qname(),q->type,q->id,
+				     q->pkt,NS_PACKETSZ);
+	if(q->pkt_len > 0) {
+	    q->attempt = 0;
+	    q->tcp = false;
+	    return true;
+	}
+    }
+
+    return false;
+}
+
+void _dns_client::submit_cb(evutil_socket_t sd, short what, void* ctx)
+{
+    ((_dns_client*)ctx)->on_submit();
+}
+
+void _dns_client::on_submit()
+{
+    queries_mut.lock();
+    list<dns_query*> to_send;
+    to_send.swap(new_queries);
+    queries_mut.unlock();
+
+    for(list<dns_query*>::iterator it = to_send.begin();
+	it != to_send.end(); ++it) {
+	send_query(*it);
+    }
+}
+
+void _dns_client::send_query(dns_query* q)
+{
+    queries_mut.lock();
+    q->ns = nameservers[q->ns_idx % nameservers.size()];
+    queries_mut.unlock();
+
+    // a late reply to the previous attempt is not accepted
+    q->close_transport();
+
+    DBG("DNS query '%s' (%s) id=%u attempt=%u to %s:%u\n",
+	q->qname().c_str(),dns_rr_type_str(q->type),q->id,q->attempt,
+	am_inet_ntop(&q->ns).c_str(),am_get_port(&q->ns));
+
+    q->sd = dns_open_socket(&q->ns);
+    if(q->sd >= 0) {
+	q->ev_read = event_new(ev_base,q->sd,EV_READ|EV_PERSIST,udp_read_cb,q);
+	event_add(q->ev_read,NULL);
+
+	if(::sendto(q->sd,q->pkt,q->pkt_len,0,
+		    (const sockaddr*)&q->ns,SA_len(&q->ns)) < 0) {
+	    WARN("sendto(%s:%u): %s\n",am_inet_ntop(&q->ns).c_str(),
+		 am_get_port(&q->ns),strerror(errno));
+	}
+	else {
+	    stats.sent_packets.inc();
+	}
+    }
+
+    // a failed send is handled like a lost packet
+    if(!q->ev_timer)
+	q->ev_timer = evtimer_new(ev_base,timer_cb,q);
+
+    struct timeval tv;
+    tv.tv_sec  = timeout / 1000;
+    tv.tv_usec = (timeout % 1000) * 1000;
+    evtimer_add(q->ev_timer,&tv);
+}
+
+void _dns_client::send_query_tcp(dns_query* q)
+{
+    queries_mut.lock();
+    q->ns = nameservers[q->ns_idx % nameservers.size()];
+    queries_mut.unlock();
+
+    q->close_transport();
+    q->tcp = true;
+
+    DBG("DNS query '%s' (%s) id=%u attempt=%u to %s:%u (TCP)\n",
+	q->qname().c_str(),dns_rr_type_str(q->type),q->id,q->attempt,
+	am_inet_ntop(&q->ns).c_str(),am_get_port(&q->ns));
+
+    q->bev = bufferevent_socket_new(ev_base,-1,BEV_OPT_CLOSE_ON_FREE);
+    if(q->bev) {
+	bufferevent_setcb(q->bev,tcp_read_cb,NULL,tcp_event_cb,q);
+	bufferevent_enable(q->bev,EV_READ|EV_WRITE);
+
+	// RFC 1035 4.2.2: 2 bytes length prefix
+	u_char len_buf[2] = { (u_char)(q->pkt_len >> 8),
+			      (u_char)(q->pkt_len & 0xff) };
+	bufferevent_write(q->bev,len_buf,sizeof(len_buf));
+	bufferevent_write(q->bev,q->pkt,q->pkt_len);
+
+	if(bufferevent_socket_connect(q->bev,(sockaddr*)&q->ns,
+				      SA_len(&q->ns)) < 0) {
+	    WARN("connect(%s:%u) failed\n",am_inet_ntop(&q->ns).c_str(),
+		 am_get_port(&q->ns));
+	    bufferevent_free(q->bev);
+	    q->bev = NULL;
+	}
+	else {
+	    stats.sent_packets.inc();
+	}
+    }
+
+    struct timeval tv;
+    tv.tv_sec  = timeout / 1000;
+    tv.tv_usec = (timeout % 1000) * 1000;
+    evtimer_add(q->ev_timer,&tv);
+}
+
+void _dns_client::timer_cb(evutil_socket_t sd, short what, void* ctx)
+{
+    dns_query* q = (dns_query*)ctx;
+    q->client->on_timeout(q);
+}
+
+void _dns_client::on_timeout(dns_query* q)
+{
+    if(q->attempt < retries) {
+	q->attempt++;
+	q->ns_idx++;
+	stats.retransmissions.inc();
+
+	// stay on TCP once a reply has been truncated
+	if(q->tcp) send_query_tcp(q);
+	else send_query(q);
+	return;
+    }
+
+    DBG("DNS query '%s' (%s) timed out\n",
+	q->qname().c_str(),dns_rr_type_str(q->type));
+    stats.timeouts.inc();
+
+    dns_entry_map empty_map;
+    finish_query(q,-1,empty_map);
+}
+
+void _dns_client::finish_query(dns_query* q, int err, dns_entry_map& entries)
+{
+    queries_mut.lock();
+    by_name.erase(query_key(q->name,q->type));
+    queries_mut.unlock();
+
+    if(!err && (q->qname() != q->name)) {
+	// found through the search list: make the
+	// entry available under the requested name too.
+	string qname = q->qname();
+	if(qname[qname.length()-1] == '.')
+	    qname.erase(qname.length()-1);
+
+	for(dns_entry_map::iterator it = entries.begin();
+	    it != entries.end(); ++it) {
+	    if(!strcasecmp(it->first.c_str(),qname.c_str())) {
+		entries.insert(q->name,it->second);
+		break;
+	    }
+	}
+    }
+
+    if(!err) {
+	resolver::instance()->update_cache(entries);
+    }
+
+    // no more waiters can be added now
+    for(list<dns_query_cb*>::iterator it = q->waiters.begin();
+	it != q->waiters.end(); ++it) {
+	(*it)->on_dns_result(q->name,err,entries);
+    }
+
+    delete q;
+}
+
+void _dns_client::udp_read_cb(evutil_socket_t sd, short what, void* ctx)
+{
+    dns_query* q = (dns_query*)ctx;
+    q->client->on_udp_read(q);
+}
+
+void _dns_client::on_udp_read(dns_query* q)
+{
+    u_char buf[NS_PACKETSZ];
+    sockaddr_storage from;
+
+    while(true) {
+	socklen_t from_len = sizeof(from);
+	int len = recvfrom(q->sd,buf,NS_PACKETSZ,0,(sockaddr*)&from,&from_len);
+	if(len < 0) {
+	    if((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+		ERROR("recvfrom(): %s\n",strerror(errno));
+	    return;
+	}
+
+	if(!same_addr(&from,&q->ns)) {
+	    DBG("DNS reply for '%s' from unexpected source %s:%u\n",
+		q->qname().c_str(),am_inet_ntop(&from).c_str(),
+		am_get_port(&from));
+	    continue;
+	}
+
+	// 'q' might be gone after a valid reply
+	if(process_reply(q,buf,len,false))
+	    return;
+    }
+}
+
+void _dns_client::tcp_read_cb(struct bufferevent* bev, void* ctx)
+{
+    dns_query* q = (dns_query*)ctx;
+    q->client->on_tcp_read(q);
+}
+
+void _dns_client::on_tcp_read(dns_query* q)
+{
+    struct evbuffer* input = bufferevent_get_input(q->bev);
+
+    u_char len_buf[2];
+    if(evbuffer_copyout(input,len_buf,sizeof(len_buf)) < 2)
+	return;
+
+    size_t len = (len_buf[0] << 8) | len_buf[1];
+    if(evbuffer_get_length(input) < len + 2)
+	return;
+
+    vector<u_char> buf(len+2);
+    evbuffer_remove(input,&buf[0],len+2);
+
+    if(!process_reply(q,&buf[0]+2,len,true)) {
+	// nothing else will come on this connection
+	evtimer_del(q->ev_timer);
+	on_timeout(q);
+    }
+}
+
+void _dns_client::tcp_event_cb(struct bufferevent* bev, short what, void* ctx)
+{
+    if(!(what & (BEV_EVENT_EOF|BEV_EVENT_ERROR)))
+	return;
+
+    dns_query* q = (dns_query*)ctx;
+    DBG("DNS query '%s' (%s): TCP connection to %s:%u closed\n",
+	q->qname().c_str(),dns_rr_type_str(q->type),
+	am_inet_ntop(&q->ns).c_str(),am_get_port(&q->ns));
+
+    // handled like a lost packet
+    evtimer_del(q->ev_timer);
+    q->client->on_timeout(q);
+}
+
+bool _dns_client::process_reply(dns_query* q, u_char* reply, int len, bool tcp)
+{
+    if(len < DNS_HDR_LEN) {
+	DBG("DNS reply too short (%i bytes)\n",len);
+	return false;
+    }
+
+    unsigned short id = dns_get_16(reply);
+    unsigned short flags = dns_get_16(reply + 2);
+
+    if(!(flags & DNS_FLAG_QR))
+	return false;
+
+    if(id != q->id) {
+	DBG("DNS reply for '%s' with wrong ID %u (late reply?)\n",
+	    q->qname().c_str(),id);
+	return false;
+    }
+
+    // the question section must match ours
+    int q_len = q->pkt_len - DNS_HDR_LEN;
+    if(len < DNS_HDR_LEN + q_len)
+	return false;
+
+    for(int i=0; i<q_len; i++) {
+	if(tolower(reply[DNS_HDR_LEN+i]) != tolower(q->pkt[DNS_HDR_LEN+i])) {
+	    DBG("DNS reply id=%u: question does not match\n",id);
+	    return false;
+	}
+    }
+
+    // from here on, the reply is for this query
+    evtimer_del(q->ev_timer);
+
+    if((flags & DNS_FLAG_TC) && !tcp) {
+	// never use a partial reply: repeat over TCP
+	DBG("DNS reply for '%s' truncated: retrying over TCP\n",
+	    q->qname().c_str());
+	stats.truncated.inc();
+	send_query_tcp(q);
+	return true;
+    }
+
+    int rcode = flags & DNS_RCODE_MASK;
+    if(rcode && (rcode != DNS_RCODE_NXDOMAIN)) {
+	stats.error_replies.inc();
+	if(((rcode == DNS_RCODE_SERVFAIL) || (rcode == DNS_RCODE_REFUSED))
+	   && (q->attempt < retries)) {
+	    // try the next name server right away
+	    q->attempt++;
+	    q->ns_idx++;
+	    if(tcp) send_query_tcp(q);
+	    else send_query(q);
+	    return true;
+	}
+
+	DBG("DNS query '%s' (%s) failed (rcode=%i)\n",
+	    q->qname().c_str(),dns_rr_type_str(q->type),rcode);
+
+	dns_entry_map empty_map;
+	finish_query(q,-1,empty_map);
+	return true;
+    }
+
+    dns_entry_map entries;
+    if(rcode) {
+	stats.error_replies.inc();
+    }
+    else {
+	stats.replies.inc();
+	if(dns_reply_to_entries(reply,len,entries) < 0) {
+	    DBG("Could not parse DNS reply\n");
+	    finish_query(q,-1,entries);
+	    return true;
+	}
+    }
+
+    if(entries.empty()) {
+	// NXDOMAIN or no data: next name from the search list
+	if(next_name(q)) {
+	    send_query(q);
+	    return true;
+	}
+
+	DBG("DNS query '%s' (%s): no such name\n",
+	    q->name.c_str(),dns_rr_type_str(q->type));
+    }
+
+    finish_query(q,entries.empty() ? -1 : 0,entries);
+    return true;
+}
+
+/**
+ * Waits for the result of a single query.
+ */
+struct dns_sync_query
+    : public dns_query_cb
+{
+    AmCondition<bool> done;
+    int               err;
+    dns_entry_map&    entries;
+
+    dns_sync_query(dns_entry_map& entries)
+	: done(false), err(-1), entries(entries)
+    {}
+
+    void on_dns_result(const string& name, int res, dns_entry_map& result)
+    {
+	err = res;
+	for(dns_entry_map::iterator it = result.begin();
+	    it != result.end(); ++it) {
+	    entries.insert(it->first,it->second);
+	}
+	done.set(true);
+    }
+};
+
+int _dns_client::query_sync(const string& name, dns_rr_type t,
+			    dns_entry_map& entries)
+{
+    dns_sync_query sq(entries);
+    if(query(name,t,&sq) < 0)
+	return -1;
+
+    // always terminates: on timeout, or when
+    // the client is stopped.
+    sq.done.wait_for();
+    return sq.err;
+}
+
+/** EMACS **
+ * Local variables:
+ * mode: c++
+ * c-basic-offset: 4
+ * End:
+ */
@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2026 SEMS contributors
+ *
+ * This file is part of SEMS, a free SIP media server.
+ *
+ * SEMS is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version. This program is released under
+ * the GPL with the additional exemption that compiling, linking,
+ * and/or using OpenSSL is allowed.
+ *
+ * For a license to use the SEMS software under conditions
+ * other than those described here, or to purchase support for this
+ * software, please contact iptel.org by e-mail at the following addresses:
+ *    info@iptel.org
+ *
+ * SEMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef _dns_client_h_
+#define _dns_client_h_
+
+#include "AmThread.h"
+#include "singleton.h"
+#include "atomic_types.h"
+#include "parse_dns.h"
+
+#include <event2/event.h>
+#include <event2/bufferevent.h>
+#include <sys/socket.h>
+#include <arpa/nameser.h>
+
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+using std::string;
+using std::vector;
+using std::list;
+using std::map;
+using std::pair;
+
+class dns_entry_map;
+
+/**
+ * Result call-back for asynchronous DNS queries.
+ *
+ * on_dns_result() is called exactly once per query, from the
+ * DNS client thread. The call-back object must stay valid
+ * until then. It MUST NOT issue blocking DNS queries.
+ */
+class dns_query_cb
+{
+public:
+    virtual ~dns_query_cb() {}
+
+    /**
+     * @param name  queried name
+     * @param err   0 on success, -1 on failure (timeout, error reply)
+     * @param entries RRsets of the reply (answer+additional sections)
+     */
+    virtual void on_dns_result(const string& name, int err,
+			       dns_entry_map& entries)=0;
+};
+
+struct dns_client_stats
+{
+    // queries submitted by the application
+    atomic_int queries;
+    // queries answered by an already pending query
+    atomic_int coalesced;
+    // packets sent to a name server (including retransmissions)
+    atomic_int sent_packets;
+    // retransmissions after a timeout
+    atomic_int retransmissions;
+    // queries failed after the last retry
+    atomic_int timeouts;
+    // error replies (NXDOMAIN, SERVFAIL, ...)
+    atomic_int error_replies;
+    // valid replies
+    atomic_int replies;
+    // truncated replies (query repeated over TCP)
+    atomic_int truncated;
+};
+
+/**
+ * Non-blocking DNS stub resolver.
+ *
+ * Runs a libevent loop in its own thread. Each attempt uses a new
+ * UDP socket bound to a random port and a random query ID from
+ * a cryptographically secure generator. Identical queries
+ * in-flight (same name and type) are coalesced into one. Every
+ * query is retried 'retries' times on the next name server, each
+ * attempt waiting 'timeout' ms. Truncated replies are not used:
+ * the query is repeated over TCP.
+ *
+ * Name servers, search domains and 'ndots' are taken from
+ * resolv.conf; names are searched like res_search() does.
+ */
+class _dns_client
+    : public AmThread
+{
+    struct dns_query;
+    typedef pair<string,int>             query_key;
+    typedef map<query_key,dns_query*>    query_name_map;
+
+    struct event_base* ev_base;
+    struct event*      ev_submit;
+
+    // protects everything below
+    AmMutex queries_mut;
+
+    vector<sockaddr_storage> nameservers;
+    vector<string>           search;
+    unsigned int             ndots;
+
+    // pending queries
+    query_name_map by_name;
+
+    // new queries waiting to be sent by the event loop
+    list<dns_query*> new_queries;
+
+    // set once the event loop has been left
+    bool stopping;
+
+    dns_client_stats stats;
+
+    static void udp_read_cb(evutil_socket_t sd, short what, void* ctx);
+    static void tcp_read_cb(struct bufferevent* bev, void* ctx);
+    static void tcp_event_cb(struct bufferevent* bev, short what, void* ctx);
+    static void submit_cb(evutil_socket_t sd, short what, void* ctx);
+    static void timer_cb(evutil_socket_t sd, short what, void* ctx);
+
+    void on_udp_read(dns_query* q);
+    void on_tcp_read(dns_query* q);
+    void on_submit();
+    void on_timeout(dns_query* q);
+
+    void send_query(dns_query* q);
+    void send_query_tcp(dns_query* q);
+    bool next_name(dns_query* q);
+    void finish_query(dns_query* q, int err, dns_entry_map& entries);
+    bool process_reply(dns_query* q, u_char* reply, int len, bool tcp);
+
+    void search_names(const string& name, vector<string>& names);
+    void load_resolv_conf();
+
+protected:
+    _dns_client();
+    ~_dns_client();
+
+    void run();
+    void on_stop();
+
+public:
+    /** timeout for a single attempt (ms) */
+    static unsigned int timeout;
+    /** number of retransmissions before a query fails */
+    static unsigned int retries;
+
+    /**
+     * Starts an asynchronous query.
+     * @return 0 if the query has been started or joined an
+     *         identical pending query, -1 on error (call-back
+     *         will not be called).
+     */
+    int query(const string& name, dns_rr_type t, dns_query_cb* cb);
+
+    /**
+     * Blocking wrapper around query(): waits until the
+     * query has been answered or has timed out.
+     *
+     * Only for start-up and tools: SIP stack threads must use
+     * query() (see _resolver::resolve_targets()).
+     */
+    int query_sync(const string& name, dns_rr_type t,
+		   dns_entry_map& entries);
+
+    /**
+     * Overrides the name servers read from resolv.conf.
+     */
+    void set_nameservers(const vector<sockaddr_storage>& ns);
+
+    /**
+     * Overrides the search domains and 'ndots' read from resolv.conf.
+     */
+    void set_search(const vector<string>& domains, unsigned int ndots);
+
+    /**
+     * @return true if at least one name server is known.
+     */
+    bool has_nameservers();
+
+    const dns_client_stats& get_stats() const { return stats; }
+
+    /**
+     * Stops the event loop and waits for the thread to finish.
+     * Pending queries fail.
+     */
+    void dispose();
+};
+
+typedef singleton<_dns_client> dns_client;
+
+#endif
+
+/** EMACS **
+ * Local variables:
+ * mode: c++
+ * c-basic-offset: 4
+ * End:
+ */
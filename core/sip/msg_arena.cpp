@@ -0,0 +1,118 @@
+#include "msg_arena.h"
+#include "AmThread.h"
+
+#include <new>
+
+// every object is preceded by a tag telling where it comes from
+union obj_tag
+{
+    enum { HEAP=0, ARENA };
+
+    int    from;
+    void*  align_p;
+    double align_d;
+};
+
+#define ARENA_ALIGN(s) (((s) + sizeof(obj_tag) - 1) & ~(sizeof(obj_tag) - 1))
+
+static AmThreadLocalStorage<msg_arena> _current_arena;
+
+msg_arena::msg_arena()
+    : chunks(NULL), cur(NULL), end(NULL),
+      n_allocs(0), n_chunks(0), used(0)
+{
+}
+
+msg_arena::msg_arena(const msg_arena&)
+    : chunks(NULL), cur(NULL), end(NULL),
+      n_allocs(0), n_chunks(0), used(0)
+{
+}
+
+msg_arena::~msg_arena()
+{
+    while(chunks) {
+	chunk* c = chunks;
+	chunks = c->next;
+	::operator delete(c);
+    }
+}
+
+msg_arena::chunk* msg_arena::new_chunk(size_t size)
+{
+    chunk* c = (chunk*)::operator new(ARENA_ALIGN(sizeof(chunk)) + size);
+    c->next = chunks;
+    chunks = c;
+    n_chunks++;
+    return c;
+}
+
+void* msg_arena::alloc(size_t size)
+{
+    size = ARENA_ALIGN(size);
+    n_allocs++;
+    used += size;
+
+    if(size > (size_t)(end - cur)) {
+
+	if(size > MSG_ARENA_CHUNK / 4) {
+	    // big object: own chunk, keep the current one
+	    return (char*)new_chunk(size) + ARENA_ALIGN(sizeof(chunk));
+	}
+
+	cur = (char*)new_chunk(MSG_ARENA_CHUNK) + ARENA_ALIGN(sizeof(chunk));
+	end = cur + MSG_ARENA_CHUNK;
+    }
+
+    void* p = cur;
+    cur += size;
+    return p;
+}
+
+msg_arena* msg_arena::current()
+{
+    return _current_arena.get();
+}
+
+msg_arena::scope::scope(msg_arena* a)
+    : prev(_current_arena.get())
+{
+    _current_arena.set(a);
+}
+
+msg_arena::scope::~scope()
+{
+    _current_arena.set(prev);
+}
+
+void* msg_arena_obj::operator new(size_t size)
+{
+    obj_tag* tag;
+    msg_arena* a = msg_arena::current();
+    if(a) {
+	tag = (obj_tag*)a->alloc(sizeof(obj_tag) + size);
+	tag->from = obj_tag::ARENA;
+    }
+    else {
+	tag = (obj_tag*)::operator new(sizeof(obj_tag) + size);
+	tag->from = obj_tag::HEAP;
+    }
+    return tag + 1;
+}
+
+void msg_arena_obj::operator delete(void* p)
+{
+    if(!p) return;
+
+    // arena memory is released with the arena
+    obj_tag* tag = (obj_tag*)p - 1;
+    if(tag->from == obj_tag::HEAP)
+	::operator delete(tag);
+}
+
+/** EMACS **
+ * Local variables:
+ * mode: c++
+ * c-basic-offset: 4
+ * End:
+ */
@@ -0,0 +1,88 @@
+#ifndef _msg_arena_h_
+#define _msg_arena_h_
+
+#include <stddef.h>
+
+/** Size of the arena chunks (fits a typical INVITE) */
+#define MSG_ARENA_CHUNK 4096
+
+/**
+ * Bump allocator owned by a sip_msg.
+ *
+ * While a message is being parsed (see msg_arena::scope),
+ * the parsed headers and sub-structures (msg_arena_obj) are
+ * carved out of the arena of that message, and released all
+ * at once with the message. Objects allocated outside of a
+ * parsing scope are allocated from the heap, as usual.
+ */
+class msg_arena
+{
+    struct chunk
+    {
+	chunk* next;
+    };
+
+    chunk* chunks;
+    char*  cur;
+    char*  end;
+
+    unsigned int n_allocs;
+    unsigned int n_chunks;
+    size_t       used;
+
+    chunk* new_chunk(size_t size);
+
+    // not shared between copies of a message
+    msg_arena& operator=(const msg_arena&);
+
+public:
+    msg_arena();
+    msg_arena(const msg_arena&);
+    ~msg_arena();
+
+    void* alloc(size_t size);
+
+    /** Number of objects allocated */
+    unsigned int get_allocs() const { return n_allocs; }
+
+    /** Number of chunks (= heap allocations) */
+    unsigned int get_chunks() const { return n_chunks; }
+
+    /** Bytes handed out */
+    size_t get_used() const { return used; }
+
+    /** Arena used by the calling thread, if any */
+    static msg_arena* current();
+
+    /**
+     * Makes 'a' the arena of the calling thread
+     * for the lifetime of the scope object.
+     */
+    class scope
+    {
+	msg_arena* prev;
+
+    public:
+	scope(msg_arena* a);
+	~scope();
+    };
+};
+
+/**
+ * Base class for the parser structures which
+ * can be allocated from the current msg_arena.
+ */
+struct msg_arena_obj
+{
+    static void* operator new(size_t size);
+    static void  operator delete(void* p);
+};
+
+#endif
+
+/** EMACS **
+ * Local variables:
+ * mode: c++
+ * c-basic-offset: 4
+ * End:
+ */
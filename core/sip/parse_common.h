@@ -31,6 +31,7 @@
 #define _parse_common_h
 
 #include "cstring.h"
+#include "msg_arena.h"
 
 #include <list>
 using std::list;
@@ -142,6 +143,7 @@ enum {
 //
 
 struct sip_avp
+    : public msg_arena_obj
 {
     cstring name;
     cstring value;
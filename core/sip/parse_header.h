@@ -31,17 +31,20 @@
 #define _parse_header_h
 
 #include "cstring.h"
+#include "msg_arena.h"
 
 #include <list>
 using std::list;
 
 struct sip_parsed_hdr
+    : public msg_arena_obj
 {
     virtual ~sip_parsed_hdr(){}
 };
 
 
 struct sip_header
+    : public msg_arena_obj
 {
     //
     // Header types
@@ -29,8 +29,10 @@
 #define _parse_nameaddr_h_
 
 #include "parse_uri.h"
+#include "msg_arena.h"
 
 struct sip_nameaddr
+    : public msg_arena_obj
 {
 
     cstring name;
@@ -35,6 +35,7 @@ struct sip_nameaddr;
 struct sip_uri;
 
 struct route_elmt
+  : public msg_arena_obj
 {
   sip_nameaddr* addr;
   cstring       route;
@@ -50,6 +50,7 @@ struct sip_transport
 };
 
 struct sip_via_parm
+    : public msg_arena_obj
 {
     const char* eop;
 
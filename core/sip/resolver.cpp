@@ -28,6 +28,7 @@
  */
 
 #include "resolver.h"
+#include "dns_client.h"
 #include "hash.h"
 
 #include "parse_dns.h"
@@ -599,7 +600,7 @@ int rr_to_dns_entry(dns_record* rr, dns_section_type t,
 }
 
 dns_handle::dns_handle() 
-  : srv_e(0), srv_n(0), ip_e(0), ip_n(0) 
+  : srv_e(0), srv_n(0), ip_e(0), ip_n(0), async_ctx(0)
 {}
 
 dns_handle::dns_handle(const dns_handle& h)
@@ -823,7 +824,7 @@ dns_entry_map::insert(const dns_entry_map::value_type& x)
 bool dns_entry_map::insert(const string& key, dns_entry* e)
 {
     std::pair<iterator, bool> res =
-    	insert(make_pair<const key_type&,mapped_type>(key,e));
+    	insert(value_type(key,e));
 
     if(res.second) {
 	inc_ref(e);
@@ -854,14 +855,45 @@ _resolver::~_resolver()
     
 }
 
-int _resolver::query_dns(const char* name, dns_entry_map& entry_map, dns_rr_type t)
+int dns_reply_to_entries(u_char* reply, int len, dns_entry_map& entry_map)
 {
-    u_char dns_res[NS_PACKETSZ];
+    /*
+     * Initialize a handle to this response.  The handle will
+     * be used later to extract information from the response.
+     */
+    dns_search_h h;
+    if (dns_msg_parse(reply, len, rr_to_dns_entry, &h) < 0) {
+	return -1;
+    }
+
+    for(dns_entry_map::iterator it = h.entry_map.begin();
+	it != h.entry_map.end(); it++) {
 
+	dns_entry* e = it->second;
+	if(!e || e->ip_vec.empty()) continue;
+
+	e->init();
+	entry_map.insert(it->first,e);
+    }
+
+    return 0;
+}
+
+int _resolver::query_dns(const char* name, dns_entry_map& entry_map, dns_rr_type t)
+{
     if(!name) return -1;
 
     DBG("Querying '%s' (%s)...",name,dns_rr_type_str(t));
 
+    if(dns_client::instance()->has_nameservers()) {
+	// bounded by the DNS client's timeout/retries;
+	// identical concurrent queries share one request.
+	return dns_client::instance()->query_sync(name,t,entry_map);
+    }
+
+    // no name server known to the DNS client:
+    // fallback to the system's (blocking) resolver
+    u_char dns_res[NS_PACKETSZ];
     int dns_res_len = res_search(name,ns_c_in,(ns_type)t,
 				 dns_res,NS_PACKETSZ);
     if(dns_res_len < 0){
@@ -869,27 +901,49 @@ int _resolver::query_dns(const char* name, dns_entry_map& entry_map, dns_rr_type
 	return -1;
     }
 
-    /*
-     * Initialize a handle to this response.  The handle will
-     * be used later to extract information from the response.
-     */
-    dns_search_h h;
-    if (dns_msg_parse(dns_res, dns_res_len, rr_to_dns_entry, &h) < 0) {
+    if (dns_reply_to_entries(dns_res, dns_res_len, entry_map) < 0) {
 	DBG("Could not parse DNS reply");
 	return -1;
     }
 
-    for(dns_entry_map::iterator it = h.entry_map.begin();
-	it != h.entry_map.end(); it++) {
+    update_cache(entry_map);
+    return 0;
+}
 
-	dns_entry* e = it->second;
-	if(!e || e->ip_vec.empty()) continue;
+int _resolver::query_dns_async(const char* name, dns_rr_type t,
+			       dns_query_cb* cb)
+{
+    if(!name || !cb) return -1;
 
-	e->init();
-	entry_map.insert(it->first,e);
+    dns_bucket* b = cache.get_bucket(hashlittle(name,strlen(name),0));
+    dns_entry* e = b->find(name);
+    if(e) {
+	dns_entry_map entry_map;
+	entry_map.insert(name,e);
+	dec_ref(e);
+	cb->on_dns_result(name,0,entry_map);
+	return 0;
     }
 
-    return 0;
+    return dns_client::instance()->query(name,t,cb);
+}
+
+void _resolver::update_cache(dns_entry_map& entry_map)
+{
+    for(dns_entry_map::iterator it = entry_map.begin();
+	it != entry_map.end(); it++) {
+
+	if(!it->second) continue;
+
+	dns_bucket* b = cache.get_bucket(hashlittle(it->first.c_str(),
+						    it->first.length(),0));
+	// cache the new record
+	if(b->insert(it->first,it->second)) {
+	    // cache insert successful
+	    DBG("new DNS cache entry: '%s' -> %s",
+		it->first.c_str(), it->second->to_str().c_str());
+	}
+    }
 }
 
 int _resolver::resolve_name(const char* name,
@@ -925,32 +979,27 @@ int _resolver::resolve_name(const char* name,
     // first attempt to get a valid IP
     // (from the cache)
     if(e){
+	if(h->async_ctx && (t == dns_r_srv))
+	    srv_targets_missing(e,h->async_ctx);
+
 	int ret = e->next_ip(h,sa);
 	dec_ref(e);
 	return ret;
     }
 
+    if(h->async_ctx) {
+	// to be queried by the caller
+	h->async_ctx->miss(name,t);
+	return -1;
+    }
+
     // no valid IP, query the DNS
     dns_entry_map entry_map;
     if(query_dns(name,entry_map,t) < 0) {
 	return -1;
     }
 
-    for(dns_entry_map::iterator it = entry_map.begin();
-	it != entry_map.end(); it++) {
-
-	if(!it->second) continue;
-
-	b = cache.get_bucket(hashlittle(it->first.c_str(),
-					it->first.length(),0));
-	// cache the new record
-	if(b->insert(it->first,it->second)) {
-	    // cache insert successful
-	    DBG("new DNS cache entry: '%s' -> %s",
-		it->first.c_str(), it->second->to_str().c_str());
-	}
-    }
-
+    // query_dns() has already cached the entries
     e = entry_map.fetch(name);
     if(e) {
 	// now we should have a valid IP
@@ -1046,6 +1095,9 @@ int _resolver::set_destination_ip(const cstring& next_hop,
 						     h_dns,remote_ip,
 						     IPv4);
 	if(err < 0){
+	    if(h_dns->async_ctx && h_dns->async_ctx->pending())
+		return -1;
+
 	    ERROR("Unresolvable Request URI domain\n");
 	    return -478;
 	}
@@ -1066,13 +1118,15 @@ int _resolver::set_destination_ip(const cstring& next_hop,
 }
 
 int _resolver::resolve_targets(const list<sip_destination>& dest_list,
-			       sip_target_set* targets)
+			       sip_target_set* targets,
+			       dns_async_ctx* ctx)
 {
     for(list<sip_destination>::const_iterator it = dest_list.begin();
 	it != dest_list.end(); it++) {
 	
 	sip_target t;
 	dns_handle h_dns;
+	h_dns.async_ctx = ctx;
 
 	DBG("sip_destination: %.*s:%u/%.*s",
 	    it->host.len,it->host.s,
@@ -1080,6 +1134,10 @@ int _resolver::resolve_targets(const list<sip_destination>& dest_list,
 	    it->trsp.len,it->trsp.s);
 
 	if(set_destination_ip(it->host,it->port,it->trsp,&t.ss,&h_dns) != 0) {
+	    if(ctx && ctx->pending()) {
+		// collect the missing names of all destinations
+		continue;
+	    }
 	    ERROR("Unresolvable destination");
 	    return -478;
 	}
@@ -1100,6 +1158,42 @@ int _resolver::resolve_targets(const list<sip_destination>& dest_list,
     return 0;
 }
 
+void _resolver::srv_targets_missing(dns_entry* e, dns_async_ctx* ctx)
+{
+    sockaddr_storage sa;
+    for(vector<dns_base_entry*>::iterator it = e->ip_vec.begin();
+	it != e->ip_vec.end(); ++it) {
+
+	const string& target = ((srv_entry*)*it)->target;
+	if(am_inet_pton(target.c_str(),&sa) == 1)
+	    continue;
+
+	dns_bucket* b = cache.get_bucket(hashlittle(target.c_str(),
+						    target.length(),0));
+	dns_entry* t_e = b->find(target);
+	if(t_e) {
+	    dec_ref(t_e);
+	    continue;
+	}
+
+	ctx->miss(target,dns_r_a);
+    }
+}
+
+void dns_async_ctx::miss(const string& name, dns_rr_type t)
+{
+    if(queried.find(name) != queried.end())
+	return;
+
+    for(list<pair<string,dns_rr_type> >::iterator it = missing.begin();
+	it != missing.end(); ++it) {
+	if(it->first == name)
+	    return;
+    }
+
+    missing.push_back(std::make_pair(name,t));
+}
+
 void _resolver::run()
 {
     struct timespec tick,rem;
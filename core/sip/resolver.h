@@ -38,9 +38,14 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
+#include <list>
 using std::string;
 using std::vector;
 using std::map;
+using std::set;
+using std::list;
+using std::pair;
 
 #include <netinet/in.h>
 
@@ -148,6 +153,27 @@ public:
 
 class dns_srv_entry;
 
+/**
+ * Collects the names missing from the cache while resolving
+ * without blocking (see _resolver::resolve_targets()).
+ */
+struct dns_async_ctx
+{
+    // names queried already (answered or failed)
+    set<string> queried;
+
+    // names to be queried before resolving again
+    list<pair<string,dns_rr_type> > missing;
+
+    bool pending() const { return !missing.empty(); }
+
+    /**
+     * Records a cache miss, unless 'name'
+     * has been queried already.
+     */
+    void miss(const string& name, dns_rr_type t);
+};
+
 struct dns_handle
 {
     dns_handle();
@@ -173,6 +199,9 @@ private:
 
     dns_ip_entry*  ip_e;
     int            ip_n;
+
+    // set while resolving without blocking
+    dns_async_ctx* async_ctx;
 };
 
 struct naptr_record
@@ -256,6 +285,15 @@ private:
     std::pair<iterator, bool> insert(const value_type& x);
 };
 
+/**
+ * Parses a DNS reply into 'entry_map' (one entry per
+ * name found in the answer and additional sections).
+ * @return -1 if the reply could not be parsed.
+ */
+int dns_reply_to_entries(u_char* reply, int len, dns_entry_map& entry_map);
+
+class dns_query_cb;
+
 class _resolver
     : AmThread
 {
@@ -273,15 +311,37 @@ public:
 	       sockaddr_storage* sa,
 	       const address_type types);
 
+    /**
+     * Blocking query; the result is added to the cache.
+     */
     int query_dns(const char* name, dns_entry_map& entry_map, dns_rr_type t);
 
+    /**
+     * Non-blocking version of query_dns(): the result is
+     * passed to 'cb' from the DNS client thread (or immediately
+     * from the calling thread if the name is cached).
+     * @return -1 if the query could not be started.
+     */
+    int query_dns_async(const char* name, dns_rr_type t, dns_query_cb* cb);
+
+    /**
+     * Inserts all entries from 'entry_map' into the cache.
+     */
+    void update_cache(dns_entry_map& entry_map);
+
     /**
      * Transforms all elements of a destination list into
      * a target set, thus resolving all DNS names and
      * converting IPs into a sockaddr_storage.
+     *
+     * With 'ctx', only the cache is used: names missing from
+     * it are collected in 'ctx' and the target set is not
+     * complete if ctx->pending() (query the missing names and
+     * call again with the same 'ctx').
      */
     int resolve_targets(const list<sip_destination>& dest_list,
-			sip_target_set* targets);
+			sip_target_set* targets,
+			dns_async_ctx* ctx = NULL);
 
 protected:
     _resolver();
@@ -298,6 +358,9 @@ protected:
 
 private:
     dns_cache cache;
+
+    // records the SRV targets missing from the cache
+    void srv_targets_missing(dns_entry* e, dns_async_ctx* ctx);
 };
 
 typedef singleton<_resolver> resolver;
@@ -459,6 +459,8 @@ static int parse_first_line(sip_msg* msg, char** c, char* end)
 
 int parse_headers(sip_msg* msg, char** c, char* end)
 {
+    msg_arena::scope arena_scope(&msg->arena);
+
     list<sip_header*> hdrs;
     int err = parse_headers(hdrs,c,end);
     if(!err) {
@@ -531,6 +533,8 @@ int parse_headers(sip_msg* msg, char** c, char* end)
 
 int parse_sip_msg(sip_msg* msg, char*& err_msg)
 {
+    msg_arena::scope arena_scope(&msg->arena);
+
     char* c = msg->buf;
     char* end = msg->buf + msg->len;
 
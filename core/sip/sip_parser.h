@@ -33,6 +33,7 @@
 #include "cstring.h"
 #include "parse_uri.h"
 #include "resolver.h"
+#include "msg_arena.h"
 
 #include <list>
 using std::list;
@@ -59,6 +60,7 @@ enum {
 
 
 struct sip_request
+    : public msg_arena_obj
 {
     //
     // Request methods
@@ -84,6 +86,7 @@ struct sip_request
 
 
 struct sip_reply
+    : public msg_arena_obj
 {
     int     code;
     cstring reason;
@@ -137,6 +140,9 @@ struct sip_msg
 
     sockaddr_storage   remote_ip;
 
+    /** holds the structures allocated while parsing */
+    msg_arena          arena;
+
     sip_msg();
     sip_msg(const char* msg_buf, int msg_len);
     ~sip_msg();
@@ -74,7 +74,11 @@ sip_trans::sip_trans()
       retr_len(0),
       last_rseq(0),
       logger(NULL),
-      canceled(false)
+      canceled(false),
+      pending_id(0),
+      bucket(NULL),
+      bucket_prev(NULL),
+      bucket_next(NULL)
 {
     memset(timers,0,SIP_TRANS_TIMERS*sizeof(void*));
 }
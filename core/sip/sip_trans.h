@@ -79,6 +79,7 @@ enum {
 #define SIP_TRANS_TIMERS 3
 
 class sip_trans;
+class trans_bucket;
 
 class trans_timer
     : protected timer
@@ -159,6 +160,18 @@ class sip_trans
     /** request canceled? */
     bool canceled;
 
+    /**
+     * id of the pending request this transaction
+     * has been sent for, once the DNS answers were
+     * there (0 if it has been sent at once)
+     */
+    unsigned long pending_id;
+
+    /** Bucket chaining (owned by trans_bucket) */
+    trans_bucket* bucket;
+    sip_trans*    bucket_prev;
+    sip_trans*    bucket_next;
+
     /**
      * Tells if a specific timer is set
      *
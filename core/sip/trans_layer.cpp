@@ -42,6 +42,7 @@
 #include "udp_trsp.h"
 #include "ip_util.h"
 #include "resolver.h"
+#include "dns_client.h"
 #include "sip_ua.h"
 #include "msg_logger.h"
 
@@ -77,7 +78,8 @@ bool _trans_layer::less_case_i::operator () (const string& lhs, const string& rh
 
 _trans_layer::_trans_layer()
     : ua(NULL),
-      transports()
+      transports(),
+      last_pending_id(0)
 {
 }
 
@@ -1202,11 +1204,188 @@ static int generate_and_parse_new_msg(sip_msg* msg, sip_msg*& p_msg)
     return 0;
 }
  
+/**
+ * Request waiting for DNS answers before it can be sent.
+ *
+ * Holds a copy of the request, as the caller's message
+ * is gone once send_request() has returned.
+ */
+struct pending_request
+    : public dns_query_cb
+{
+    unsigned long id;
+    trans_bucket* bucket;
+
+    // not through dns_client::instance(): the call-back
+    // might run while the DNS client is being disposed.
+    _dns_client*  dns;
+
+    string method;
+    string ruri;
+    string hdrs;
+    string body;
+
+    string        dialog_id;
+    string        next_hop;
+    int           out_interface;
+    unsigned int  flags;
+    msg_logger*   logger;
+
+    bool          invite;
+
+    // protected by _trans_layer::pending_mut
+    bool          registered;
+    bool          canceled;
+
+    dns_async_ctx dns_ctx;
+
+    // DNS answers still expected
+    AmMutex       outstanding_mut;
+    unsigned int  outstanding;
+
+    pending_request(sip_msg* msg, const cstring& dialog_id,
+		    const cstring& next_hop, int out_interface,
+		    unsigned int flags, msg_logger* logger);
+    ~pending_request();
+
+    /**
+     * @return a new message built from the copy
+     *         (NULL if the copy could not be parsed).
+     */
+    sip_msg* get_msg();
+
+    /**
+     * Queries the names missing in 'dns_ctx'.
+     * resume_request() is called once all have been answered.
+     */
+    void start_queries();
+    void query_done();
+
+    void on_dns_result(const string& name, int err, dns_entry_map& entries);
+};
+
+pending_request::pending_request(sip_msg* msg, const cstring& dialog_id,
+				 const cstring& next_hop, int out_interface,
+				 unsigned int flags, msg_logger* logger)
+    : id(0), bucket(NULL),
+      dns(dns_client::instance()),
+      method(c2stlstr(msg->u.request->method_str)),
+      ruri(c2stlstr(msg->u.request->ruri_str)),
+      body(c2stlstr(msg->body)),
+      dialog_id(c2stlstr(dialog_id)),
+      next_hop(c2stlstr(next_hop)),
+      out_interface(out_interface),
+      flags(flags), logger(logger),
+      invite(method == "INVITE"),
+      registered(false), canceled(false),
+      outstanding(0)
+{
+    vector<char> hdrs_buf(copy_hdrs_len(msg->hdrs)+1);
+    char* c = &hdrs_buf[0];
+    copy_hdrs_wr(&c,msg->hdrs);
+    hdrs.assign(&hdrs_buf[0],c - &hdrs_buf[0]);
+
+    // the bucket of the future transaction
+    sip_cseq cseq;
+    if(msg->cseq && msg->callid &&
+       !parse_cseq(&cseq,msg->cseq->value.s,msg->cseq->value.len)) {
+	bucket = get_trans_bucket(msg->callid->value,cseq.num_str);
+    }
+
+    if(logger) inc_ref(logger);
+}
+
+pending_request::~pending_request()
+{
+    if(logger) dec_ref(logger);
+}
+
+sip_msg* pending_request::get_msg()
+{
+    sip_msg* msg = new sip_msg();
+    msg->type = SIP_REQUEST;
+    msg->u.request = new sip_request();
+    msg->u.request->method_str = stl2cstr(method);
+    msg->u.request->ruri_str = stl2cstr(ruri);
+
+    msg->copy_msg_buf(hdrs.c_str(),hdrs.length());
+    char* c = msg->buf;
+    if(parse_headers(msg,&c,c+msg->len)) {
+	ERROR("could not parse the headers of a pending request\n");
+	delete msg;
+	return NULL;
+    }
+
+    msg->body = stl2cstr(body);
+    return msg;
+}
+
+void pending_request::start_queries()
+{
+    list<pair<string,dns_rr_type> > names;
+    names.swap(dns_ctx.missing);
+
+    // keeps the request from being resumed
+    // before all queries have been started
+    outstanding_mut.lock();
+    outstanding = 1;
+    outstanding_mut.unlock();
+
+    for(list<pair<string,dns_rr_type> >::iterator it = names.begin();
+	it != names.end(); ++it) {
+
+	// not to be queried again, even if it fails
+	dns_ctx.queried.insert(it->first);
+
+	outstanding_mut.lock();
+	outstanding++;
+	outstanding_mut.unlock();
+
+	DBG("request to '%s' waits for DNS query '%s' (%s)\n",
+	    ruri.c_str(),it->first.c_str(),dns_rr_type_str(it->second));
+
+	if(dns->query(it->first,it->second,this) < 0) {
+	    outstanding_mut.lock();
+	    outstanding--;
+	    outstanding_mut.unlock();
+	}
+    }
+
+    query_done();
+}
+
+void pending_request::query_done()
+{
+    outstanding_mut.lock();
+    bool last = !(--outstanding);
+    outstanding_mut.unlock();
+
+    if(last) trans_layer::instance()->resume_request(this);
+}
+
+void pending_request::on_dns_result(const string& name, int err,
+				    dns_entry_map& entries)
+{
+    // answered names are in the cache now
+    query_done();
+}
+
 int _trans_layer::send_request(sip_msg* msg, trans_ticket* tt,
 			       const cstring& dialog_id,
 			       const cstring& _next_hop, 
 			       int out_interface, unsigned int flags,
 			       msg_logger* logger)
+{
+    pending_request* pr = NULL;
+    return send_request(msg,tt,dialog_id,_next_hop,
+			out_interface,flags,logger,pr);
+}
+
+int _trans_layer::send_request(sip_msg* msg, trans_ticket* tt,
+			       const cstring& dialog_id,
+			       const cstring& _next_hop, 
+			       int out_interface, unsigned int flags,
+			       msg_logger* logger, pending_request*& pr)
 {
     // Request-URI
     // To
@@ -1242,8 +1421,50 @@ int _trans_layer::send_request(sip_msg* msg, trans_ticket* tt,
 	dest_list.push_back(dest);
     }
 
+    // without name server, the resolver falls back to blocking queries
+    dns_async_ctx  new_ctx;
+    dns_async_ctx* dns_ctx = NULL;
+    if(pr)
+	dns_ctx = &pr->dns_ctx;
+    else if(dns_client::instance()->has_nameservers())
+	dns_ctx = &new_ctx;
+
     auto_ptr<sip_target_set> targets(new sip_target_set());
-    res = resolver::instance()->resolve_targets(dest_list,targets.get());
+    res = resolver::instance()->resolve_targets(dest_list,targets.get(),
+						dns_ctx);
+    if(dns_ctx && dns_ctx->pending()) {
+
+	if(!pr) {
+	    pr = new pending_request(msg,dialog_id,_next_hop,
+				     out_interface,flags,logger);
+	    if(!pr->bucket) {
+		ERROR("missing or malformed Call-ID or CSeq\n");
+		delete pr;
+		return -1;
+	    }
+	    pr->dns_ctx = new_ctx;
+
+	    pending_mut.lock();
+	    pr->id = ++last_pending_id;
+	    pr->registered = true;
+	    pending_reqs[pr->id] = pr;
+	    pending_mut.unlock();
+
+	    // the ticket refers to the pending request
+	    // until the transaction exists
+	    tt->_bucket = pr->bucket;
+	    tt->_t = NULL;
+	    tt->_pending = pr->id;
+	}
+
+	// 'pr' might be resumed (and deleted)
+	// by the DNS client from now on
+	pending_request* p = pr;
+	pr = NULL;
+	p->start_queries();
+	return 0;
+    }
+
     if(res < 0){
 	DBG("resolve_targets failed\n");
 	return res;
@@ -1274,10 +1495,15 @@ int _trans_layer::send_request(sip_msg* msg, trans_ticket* tt,
 
     tt->_bucket = 0;
     tt->_t = 0;
+    tt->_pending = 0;
 
  try_next_dest:
     if(targets->get_next(&msg->remote_ip,next_trsp,flags) < 0) {
 	DBG("next_ip(): no more destinations! reply 500");
+	if(pr && !pending_request_done(pr)) {
+	    // already replied by cancel()
+	    return 0;
+	}
 	sip_msg err;
 	set_err_reply_from_req(&err,msg,500,
 			       "No destination available");
@@ -1305,6 +1531,13 @@ int _trans_layer::send_request(sip_msg* msg, trans_ticket* tt,
     tt->_bucket = get_trans_bucket(p_msg->callid->value,
 				   get_cseq(p_msg)->num_str);
     tt->_bucket->lock();
+
+    if(pr && !pending_request_done(pr)) {
+	DBG("pending request has been canceled: not sent\n");
+	tt->_bucket->unlock();
+	delete p_msg;
+	return 0;
+    }
     
     err = p_msg->send(flags);
     if(err < 0){
@@ -1340,6 +1573,10 @@ int _trans_layer::send_request(sip_msg* msg, trans_ticket* tt,
 	    // save flags & target set in transaction
 	    tt->_t->flags = flags;
 
+	    // the caller's ticket still refers to the pending request
+	    if(pr)
+		tt->_t->pending_id = pr->id;
+
 	    if(tt->_t->targets)	delete tt->_t->targets;
 	    tt->_t->targets = targets.release();
 
@@ -1391,23 +1628,120 @@ int _trans_layer::send_request(sip_msg* msg, trans_ticket* tt,
     return err;
 }
 
+void _trans_layer::resume_request(pending_request* pr)
+{
+    DBG("resuming request to '%s'\n",pr->ruri.c_str());
+
+    int res = -1;
+    sip_msg* msg = pr->get_msg();
+    if(msg) {
+	// the caller's ticket finds the transaction by pr->id
+	trans_ticket tt;
+	pending_request* p = pr;
+	res = send_request(msg,&tt,stl2cstr(pr->dialog_id),
+			   stl2cstr(pr->next_hop),pr->out_interface,
+			   pr->flags,pr->logger,p);
+	if(!p) {
+	    // waiting for more DNS answers
+	    delete msg;
+	    return;
+	}
+    }
+
+    bool active = pending_request_done(pr);
+    if(res && active && msg) {
+
+	sip_msg err;
+	if(res == -478) {
+	    set_err_reply_from_req(&err,msg,478,"Unresolvable destination");
+	}
+	else {
+	    set_err_reply_from_req(&err,msg,500,"Could not send request");
+	}
+	ua->handle_sip_reply(pr->dialog_id,&err);
+    }
+
+    delete msg;
+    delete pr;
+}
+
+bool _trans_layer::pending_request_done(pending_request* pr)
+{
+    AmLock _l(pending_mut);
+    if(pr->registered) {
+	pending_reqs.erase(pr->id);
+	pr->registered = false;
+    }
+    return !pr->canceled;
+}
+
+void _trans_layer::drop_pending_request(unsigned long id)
+{
+    AmLock _l(pending_mut);
+    map<unsigned long,pending_request*>::iterator it = pending_reqs.find(id);
+    if(it != pending_reqs.end()) {
+	DBG("dropping pending request to '%s'\n",it->second->ruri.c_str());
+	it->second->canceled = true;
+    }
+}
+
 int _trans_layer::cancel(trans_ticket* tt, const cstring& dialog_id,
 			 unsigned int inv_cseq, const cstring& hdrs)
 {
     assert(tt);
-    assert(tt->_bucket && tt->_t);
+    assert(tt->_bucket);
 
     trans_bucket* bucket = tt->_bucket;
     sip_trans*    t = tt->_t;
 
     bucket->lock();
-    if(!bucket->exist(t) || (t->state == TS_ABANDONED)){
+    if(!t || !bucket->exist(t) || (t->state == TS_ABANDONED)){
 	if(dialog_id.len)
 	    t = bucket->find_uac_trans(dialog_id,inv_cseq);
 	else
 	    t = NULL;
     }
 
+    if(!t && tt->_pending) {
+	// sent meanwhile, once the DNS answers were there?
+	t = bucket->find_pending_trans(tt->_pending);
+    }
+
+    if(!t && tt->_pending) {
+	// still waiting for DNS answers?
+	pending_mut.lock();
+	map<unsigned long,pending_request*>::iterator it =
+	    pending_reqs.find(tt->_pending);
+	if((it != pending_reqs.end()) && !it->second->canceled) {
+
+	    pending_request* pr = it->second;
+	    if(!pr->invite) {
+		pending_mut.unlock();
+		bucket->unlock();
+		ERROR("Trying to cancel a non-INVITE request (we SHOULD NOT do that); inv_cseq: %u, i:%.*s\n",
+		      inv_cseq, dialog_id.len,dialog_id.s);
+		return -1;
+	    }
+
+	    // the request will not be sent
+	    pr->canceled = true;
+	    string dlg_id = pr->dialog_id;
+	    auto_ptr<sip_msg> req(pr->get_msg());
+	    pending_mut.unlock();
+	    bucket->unlock();
+
+	    // Answer request internally to terminate the dialog...
+	    if(req.get()) {
+		sip_msg reply;
+		set_err_reply_from_req(&reply,req.get(),487,
+				       "Request Terminated");
+		ua->handle_sip_reply(dlg_id, &reply);
+	    }
+	    return 0;
+	}
+	pending_mut.unlock();
+    }
+
     if(!t){
 	bucket->unlock();
 	DBG("No transaction to cancel: wrong key or finally replied\n");
@@ -2821,7 +3155,22 @@ const sip_trans* trans_ticket::get_trans() const
 
 void trans_ticket::remove_trans()
 {
-    _bucket->remove(_t);
+    if(_t) {
+	// the transaction might have been deleted meanwhile
+	// (e.g. by the timer which sent the 408)
+	if(_bucket->exist(_t))
+	    _bucket->remove(_t);
+	return;
+    }
+
+    if(_pending) {
+	// sent meanwhile, once the DNS answers were there?
+	sip_trans* t = _bucket->find_pending_trans(_pending);
+	if(t)
+	    _bucket->remove(t);
+	else
+	    trans_layer::instance()->drop_pending_request(_pending);
+    }
 }
 
 /** EMACS **
@@ -57,6 +57,7 @@ struct sip_target_set;
 
 class trans_ticket;
 class trans_bucket;
+struct pending_request;
 class trans_timer;
 class trsp_socket;
 class sip_ua;
@@ -127,6 +128,14 @@ private:
 
     vector<prot_collection> transports;
 
+    // requests waiting for DNS answers (see send_request())
+    AmMutex pending_mut;
+    map<unsigned long,pending_request*> pending_reqs;
+    unsigned long last_pending_id;
+
+    friend struct pending_request;
+    friend class trans_ticket;
+
 public:
 
     /**
@@ -171,6 +180,12 @@ public:
      * Sends a UAC request.
      * Caution: Route headers should not be added to the
      * general header list (msg->hdrs).
+     *
+     * If the destination is not in the DNS cache, the request
+     * is copied and sent from the DNS client's call-back once
+     * the names have been resolved; errors are then reported
+     * as local replies (478 if unresolvable).
+     *
      * @param [in]  msg Pre-built message.
      * @param [out] tt transaction ticket (needed for replies & CANCEL)
      */
@@ -286,6 +301,34 @@ protected:
     int update_uas_request(trans_bucket* bucket, sip_trans* t, sip_msg* msg);
     int update_uas_reply(trans_bucket* bucket, sip_trans* t, int reply_code);
 
+    /**
+     * Sends a request; 'pr' is set if the request is resumed after
+     * a DNS query. If the request has to wait for (more) DNS
+     * answers, 'pr' is set to NULL: the pending request will
+     * be resumed later.
+     */
+    int send_request(sip_msg* msg, trans_ticket* tt, const cstring& dialog_id,
+		     const cstring& _next_hop, int out_interface,
+		     unsigned int flags, msg_logger* logger,
+		     pending_request*& pr);
+
+    /**
+     * Called once all DNS answers for 'pr' have been received.
+     */
+    void resume_request(pending_request* pr);
+
+    /**
+     * Removes 'pr' from the pending requests.
+     * @return false if 'pr' has been canceled meanwhile.
+     */
+    bool pending_request_done(pending_request* pr);
+
+    /**
+     * Drops a pending request silently (its
+     * dialog has been terminated).
+     */
+    void drop_pending_request(unsigned long id);
+
     /** Avoid external instantiation. @see singleton. */
     _trans_layer();
     ~_trans_layer();
@@ -302,18 +345,23 @@ class trans_ticket
 {
     sip_trans*    _t;
     trans_bucket* _bucket;
+
+    // request waiting for DNS answers (_t is NULL then);
+    // the transaction sent for it is found by this id
+    unsigned long _pending;
     
     friend class _trans_layer;
 
 public:
     trans_ticket()
-	: _t(0), _bucket(0) {}
+	: _t(0), _bucket(0), _pending(0) {}
 
     trans_ticket(sip_trans* t, trans_bucket* bucket)
-	: _t(t), _bucket(bucket) {}
+	: _t(t), _bucket(bucket), _pending(0) {}
 
     trans_ticket(const trans_ticket& ticket)
-	: _t(ticket._t), _bucket(ticket._bucket) {}
+	: _t(ticket._t), _bucket(ticket._bucket),
+	  _pending(ticket._pending) {}
 
     /**
      * Locks the transaction bucket before accessing the transaction pointer.
@@ -46,15 +46,93 @@
 // Global transaction table
 //
 
-hash_table<trans_bucket> _trans_table(H_TABLE_ENTRIES);
+unsigned int trans_table_size = H_TABLE_ENTRIES;
+
+// created on first use, once trans_table_size has been configured
+static hash_table<trans_bucket>& trans_table()
+{
+    static hash_table<trans_bucket> _trans_table(trans_table_size);
+    return _trans_table;
+}
+
+// transactions compared per lookup
+static atomic_int _lookups[TRANS_CHAIN_CLASSES];
+
+static inline unsigned int chain_class(unsigned int len)
+{
+    unsigned int c = 0;
+    if(len) {
+	len--;
+	c++;
+	while(len && (c < TRANS_CHAIN_CLASSES-1)) {
+	    len >>= 1;
+	    c++;
+	}
+    }
+    return c;
+}
+
+unsigned int trans_chain_class_min(unsigned int c)
+{
+    if(c < 2) return c;
+    return (1 << (c-2)) + 1;
+}
+
+static inline void count_lookup(unsigned int compared)
+{
+    _lookups[chain_class(compared)].inc();
+}
 
 trans_bucket::trans_bucket(unsigned long id)
-    : ht_bucket<sip_trans>::ht_bucket(id)
+    : id(id), first(NULL), last(NULL), n_elmts(0)
 {
 }
 
 trans_bucket::~trans_bucket()
 {
+    while(first) {
+	sip_trans* t = first;
+	first = t->bucket_next;
+	delete t;
+    }
+}
+
+bool trans_bucket::exist(sip_trans* t)
+{
+    for(sip_trans* it = first; it; it = it->bucket_next) {
+	if(it == t)
+	    return true;
+    }
+    return false;
+}
+
+void trans_bucket::remove(sip_trans* t)
+{
+    assert(t->bucket == this);
+
+    if(t->bucket_prev)
+	t->bucket_prev->bucket_next = t->bucket_next;
+    else
+	first = t->bucket_next;
+
+    if(t->bucket_next)
+	t->bucket_next->bucket_prev = t->bucket_prev;
+    else
+	last = t->bucket_prev;
+
+    n_elmts--;
+    delete t;
+}
+
+void trans_bucket::dump() const
+{
+    if(!first)
+	return;
+
+    DBG("*** Bucket ID: %i ***\n",(int)get_id());
+
+    for(sip_trans* it = first; it; it = it->bucket_next)
+	it->dump();
 }
 
 // return true if equal
@@ -101,11 +179,14 @@ sip_trans* trans_bucket::match_request(sip_msg* msg, unsigned int ttype)
     //this should have been checked before
     assert(msg->via_p1);
 
-    if(elmts.empty())
+    if(!first) {
+	count_lookup(0);
 	return NULL;
+    }
 
     bool do_3261_match = false;
     sip_trans* t = NULL;
+    unsigned int compared = 0;
 
     // Try first RFC 3261 matching
     if(msg->via_p1->branch.len > MAGIC_BRANCH_LEN){
@@ -121,41 +202,42 @@ sip_trans* trans_bucket::match_request(sip_msg* msg, unsigned int ttype)
 	const char* branch = msg->via_p1->branch.s + MAGIC_BRANCH_LEN;
 	int   len = msg->via_p1->branch.len - MAGIC_BRANCH_LEN;
 	
-	trans_list::iterator it = elmts.begin();
-	for(;it!=elmts.end();++it) {
+	sip_trans* it = first;
+	for(;it;it=it->bucket_next) {
+	    compared++;
 	    
-	    if( ((*it)->msg->type != SIP_REQUEST) ||
-		((*it)->type != ttype)){
+	    if( (it->msg->type != SIP_REQUEST) ||
+		(it->type != ttype)){
 		continue;
 	    }
 
-	    if(msg->u.request->method != (*it)->msg->u.request->method) {
+	    if(msg->u.request->method != it->msg->u.request->method) {
 
 		// ACK is the only request that should match an existing
 		// transaction without being a re-transmission
-		if( ((*it)->msg->u.request->method == sip_request::INVITE)
+		if( (it->msg->u.request->method == sip_request::INVITE)
 		    && (msg->u.request->method == sip_request::ACK)) {
 		
 		    // match non-200 ACK first
-		    if(compare_branch(*it,msg,branch,(unsigned int)len)) {
-			t = *it;
+		    if(compare_branch(it,msg,branch,(unsigned int)len)) {
+			t = it;
 			break;
 		    }
 
 		    // branches do not match,
 		    // try to match a 200-ACK
-		    if((t = match_200_ack(*it,msg)) != NULL)
+		    if((t = match_200_ack(it,msg)) != NULL)
 			break;
 		}
 
 		continue;
 	    }
 
-	    if(!compare_branch(*it,msg,branch,(unsigned int)len))
+	    if(!compare_branch(it,msg,branch,(unsigned int)len))
 		continue;
 
 	    // found matching transaction
-	    t = *it; 
+	    t = it; 
 	    break;
 	}
     }
@@ -169,8 +251,9 @@ sip_trans* trans_bucket::match_request(sip_msg* msg, unsigned int ttype)
 
 	assert(from && to && cseq);
 
-	trans_list::iterator it = elmts.begin();
-	for(;it!=elmts.end();++it) {
+	sip_trans* it = first;
+	for(;it;it=it->bucket_next) {
+	    compared++;
 
 	    
 	    //Request matching:
@@ -189,21 +272,21 @@ sip_trans* trans_bucket::match_request(sip_msg* msg, unsigned int ttype)
 	    // top Via
 	    // + To-tag of reply
 
-	    if( ((*it)->msg->type != SIP_REQUEST) ||
-		((*it)->type != ttype)){
+	    if( (it->msg->type != SIP_REQUEST) ||
+		(it->type != ttype)){
 		continue;
 	    }
 
-	    if( (msg->u.request->method != (*it)->msg->u.request->method) &&
+	    if( (msg->u.request->method != it->msg->u.request->method) &&
 		( (msg->u.request->method != sip_request::ACK) ||
-		  ((*it)->msg->u.request->method != sip_request::INVITE) ) )
+		  (it->msg->u.request->method != sip_request::INVITE) ) )
 		continue;
 
-	    sip_from_to* it_from = dynamic_cast<sip_from_to*>((*it)->msg->from->p);
+	    sip_from_to* it_from = dynamic_cast<sip_from_to*>(it->msg->from->p);
 	    if(from->tag.len != it_from->tag.len)
 		continue;
 
-	    sip_cseq* it_cseq = dynamic_cast<sip_cseq*>((*it)->msg->cseq->p);
+	    sip_cseq* it_cseq = dynamic_cast<sip_cseq*>(it->msg->cseq->p);
 	    if(cseq->num_str.len != it_cseq->num_str.len)
 		continue;
 
@@ -217,26 +300,26 @@ sip_trans* trans_bucket::match_request(sip_msg* msg, unsigned int ttype)
 	    if(msg->u.request->method == sip_request::ACK){
 		
 		// ACKs must include To-tag from previous reply
-		if(to->tag.len != (*it)->to_tag.len)
+		if(to->tag.len != it->to_tag.len)
 		    continue;
 
-		if(memcmp(to->tag.s,(*it)->to_tag.s,to->tag.len))
+		if(memcmp(to->tag.s,it->to_tag.s,to->tag.len))
 		    continue;
 
-		if((*it)->reply_status < 300){
+		if(it->reply_status < 300){
 
 		    // 2xx ACK matching
 
 		    // TODO: additional work for dialog matching???
 		    //      R-URI should match reply Contact ...
 		    //      Anyway, we don't keep the contact from reply.
-		    t = *it;
+		    t = it;
 		    break;
 		}
 	    }
 	    else { 
 		// non-ACK
-		sip_from_to* it_to = dynamic_cast<sip_from_to*>((*it)->msg->to->p);
+		sip_from_to* it_to = dynamic_cast<sip_from_to*>(it->msg->to->p);
 		if(to->tag.len != it_to->tag.len)
 		    continue;
 
@@ -246,31 +329,34 @@ sip_trans* trans_bucket::match_request(sip_msg* msg, unsigned int ttype)
 
 	    // non-ACK and non-2xx ACK matching
 
-	    if((*it)->msg->u.request->ruri_str.len != 
+	    if(it->msg->u.request->ruri_str.len != 
 	       msg->u.request->ruri_str.len )
 		continue;
 	    
 	    if(memcmp(msg->u.request->ruri_str.s,
-		      (*it)->msg->u.request->ruri_str.s,
+		      it->msg->u.request->ruri_str.s,
 		      msg->u.request->ruri_str.len))
 		continue;
 	    
 	    //TODO: missing top-Via matching
 	    
 	    // found matching transaction
-	    t = *it;
+	    t = it;
 	    break;
 	}
     }
 
+    count_lookup(compared);
     return t;
 }
 
 sip_trans* trans_bucket::match_reply(sip_msg* msg)
 {
 
-    if(elmts.empty())
+    if(!first) {
+	count_lookup(0);
 	return NULL;
+    }
 
     assert(msg->via_p1);
     if(msg->via_p1->branch.len <= MAGIC_BRANCH_LEN){
@@ -279,45 +365,48 @@ sip_trans* trans_bucket::match_reply(sip_msg* msg)
     }
     
     sip_trans* t = NULL;
+    unsigned int compared = 0;
 
     const char* branch = msg->via_p1->branch.s + MAGIC_BRANCH_LEN;
     int   len = msg->via_p1->branch.len - MAGIC_BRANCH_LEN;
     
     assert(get_cseq(msg));
 
-    trans_list::iterator it = elmts.begin();
-    for(;it!=elmts.end();++it) {
+    sip_trans* it = first;
+    for(;it;it=it->bucket_next) {
+	compared++;
 	
-	if((*it)->type != TT_UAC){
+	if(it->type != TT_UAC){
 	    continue;
 	}
 
-	if((*it)->msg->via_p1->branch.len != msg->via_p1->branch.len)
+	if(it->msg->via_p1->branch.len != msg->via_p1->branch.len)
 	    continue;
 	
-	if(get_cseq((*it)->msg)->num_str.len != get_cseq(msg)->num_str.len)
+	if(get_cseq(it->msg)->num_str.len != get_cseq(msg)->num_str.len)
 	    continue;
 
-	if(get_cseq((*it)->msg)->method_str.len != get_cseq(msg)->method_str.len)
+	if(get_cseq(it->msg)->method_str.len != get_cseq(msg)->method_str.len)
 	    continue;
 
-	if(memcmp((*it)->msg->via_p1->branch.s+MAGIC_BRANCH_LEN,
+	if(memcmp(it->msg->via_p1->branch.s+MAGIC_BRANCH_LEN,
 		  branch,len))
 	    continue;
 
-	if(memcmp(get_cseq((*it)->msg)->num_str.s,get_cseq(msg)->num_str.s,
+	if(memcmp(get_cseq(it->msg)->num_str.s,get_cseq(msg)->num_str.s,
 		  get_cseq(msg)->num_str.len))
 	    continue;
 
-	if(memcmp(get_cseq((*it)->msg)->method_str.s,get_cseq(msg)->method_str.s,
+	if(memcmp(get_cseq(it->msg)->method_str.s,get_cseq(msg)->method_str.s,
 		  get_cseq(msg)->method_str.len))
 	    continue;
 
 	// found matching transaction
-	t = *it;
+	t = it;
 	break;
     }
 
+    count_lookup(compared);
     return t;
 }
 
@@ -362,16 +451,20 @@ sip_trans* trans_bucket::match_1xx_prack(sip_msg* msg)
 	msg->u.request->method_str.len,
 	msg->u.request->method_str.s);
 
-    if(elmts.empty())
+    if(!first) {
+	count_lookup(0);
 	return NULL;
+    }
     
-    trans_list::iterator it = elmts.begin();
-    for(;it!=elmts.end();++it) {
+    unsigned int compared = 0;
+    sip_trans* it = first;
+    for(;it;it=it->bucket_next) {
+	compared++;
 	    
-	if( (*it)->msg->type != SIP_REQUEST ){
+	if( it->msg->type != SIP_REQUEST ){
 	    continue;
 	}
-	sip_trans* t = *it;
+	sip_trans* t = it;
 
 	/* first, check quickly if lenghts match (From tag, To tag, Call-ID) */
 
@@ -409,9 +502,11 @@ sip_trans* trans_bucket::match_1xx_prack(sip_msg* msg)
 	if(memcmp(to->tag.s,t->to_tag.s,to->tag.len))
 	    continue;
 
+	count_lookup(compared);
 	return t;
     }
 
+    count_lookup(compared);
     return NULL;
 }
 
@@ -421,13 +516,13 @@ sip_trans* trans_bucket::find_uac_trans(const cstring& dialog_id,
     DBG("Matching dialog_id = '%.*s'\n",
 	dialog_id.len, dialog_id.s);
 
-    if(elmts.empty())
+    if(!first)
 	return NULL;
     
-    trans_list::reverse_iterator it = elmts.rbegin();
-    for(;it!=elmts.rend();++it) {
+    sip_trans* it = last;
+    for(;it;it=it->bucket_prev) {
 	    
-	sip_trans* t = *it;
+	sip_trans* t = it;
 	if( t->type != TT_UAC ||
 	    t->msg->type != SIP_REQUEST ){
 	    continue;
@@ -442,6 +537,16 @@ sip_trans* trans_bucket::find_uac_trans(const cstring& dialog_id,
     return NULL;
 }
 
+sip_trans* trans_bucket::find_pending_trans(unsigned long pending_id)
+{
+    for(sip_trans* it = last; it; it = it->bucket_prev) {
+	if((it->type == TT_UAC) && (it->pending_id == pending_id))
+	    return it;
+    }
+
+    return NULL;
+}
+
 sip_trans* trans_bucket::add_trans(sip_msg* msg, unsigned int ttype)
 {
     sip_trans* t = new sip_trans();
@@ -463,14 +568,24 @@ sip_trans* trans_bucket::add_trans(sip_msg* msg, unsigned int ttype)
 	t->state = TS_TRYING;
     }
 
-    elmts.push_back(t);
+    append(t);
     
     return t;
 }
 
 void trans_bucket::append(sip_trans* t)
 {
-    elmts.push_back(t);
+    t->bucket = this;
+    t->bucket_prev = last;
+    t->bucket_next = NULL;
+
+    if(last)
+	last->bucket_next = t;
+    else
+	first = t;
+
+    last = t;
+    n_elmts++;
 }
 
 unsigned int hash(const cstring& ci, const cstring& cs)
@@ -560,17 +675,40 @@ void compute_branch(char* branch/*[8]*/, const cstring& callid, const cstring& c
 
 trans_bucket* get_trans_bucket(const cstring& callid, const cstring& cseq_num)
 {
-    return _trans_table[hash(callid,cseq_num)];
+    return trans_table()[hash(callid,cseq_num)];
 }
 
 trans_bucket* get_trans_bucket(unsigned int h)
 {
-    return _trans_table[h];
+    return trans_table()[h];
 }
 
 void dumps_transactions()
 {
-    _trans_table.dump();
+    trans_table().dump();
+}
+
+void get_trans_table_stats(trans_table_stats& st)
+{
+    hash_table<trans_bucket>& tbl = trans_table();
+    memset(&st,0,sizeof(st));
+
+    st.buckets = tbl.get_size();
+    for(unsigned long i=0; i<tbl.get_size(); i++) {
+
+	trans_bucket* bucket = tbl[i];
+	bucket->lock();
+	unsigned int len = bucket->size();
+	bucket->unlock();
+
+	st.transactions += len;
+	if(len > st.max_chain)
+	    st.max_chain = len;
+	st.chains[chain_class(len)]++;
+    }
+
+    for(unsigned int c=0; c<TRANS_CHAIN_CLASSES; c++)
+	st.lookups[c] = _lookups[c].get();
 }
 
 
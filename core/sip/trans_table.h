@@ -8,9 +8,27 @@
 #define H_TABLE_POWER   10
 #define H_TABLE_ENTRIES (1<<H_TABLE_POWER)
 
+/**
+ * Number of buckets in the transaction table
+ * (default: H_TABLE_ENTRIES). Must be set before
+ * the first transaction is created.
+ */
+extern unsigned int trans_table_size;
+
+/**
+ * Transactions are chained through their intrusive
+ * bucket_prev/bucket_next members, so that removing
+ * a transaction does not need to scan the bucket.
+ */
 class trans_bucket: 
-    public ht_bucket<sip_trans>
+    public AmMutex
 {
+    unsigned long id;
+
+    sip_trans*    first;
+    sip_trans*    last;
+    unsigned int  n_elmts;
+
     trans_bucket(unsigned long id);
     ~trans_bucket();
 
@@ -18,9 +36,41 @@ class trans_bucket:
 
 public:
 
-    typedef ht_bucket<sip_trans>::value_list trans_list;
+    /**
+     * Caution: The bucket MUST be locked before you can 
+     * do anything with it.
+     */
+
+    /**
+     * Checks if the transaction ptr still exists in this bucket.
+     * 't' might have been deleted already, and is thus
+     * only compared to the chained transactions.
+     */
+    bool exist(sip_trans* t);
+
+    /**
+     * Unlink the transaction from this bucket and delete it.
+     * 't' MUST still be chained here: use exist() first
+     * if it might have been deleted meanwhile.
+     */
+    void remove(sip_trans* t);
+
+    /**
+     * Returns the bucket id, which should be an index
+     * into the transaction table.
+     */
+    unsigned long get_id() const {
+	return id;
+    }
+
+    /** Number of transactions in this bucket */
+    unsigned int size() const {
+	return n_elmts;
+    }
+
+    // debug method
+    void dump() const;
 
-    
     // Match a request to UAS/UAC transactions
     // in this bucket
     sip_trans* match_request(sip_msg* msg, unsigned int ttype);
@@ -36,6 +86,9 @@ public:
     // Find the latest UAC transaction matching dialog_id
     sip_trans* find_uac_trans(const cstring& dialog_id, unsigned int inv_cseq);
 
+    // Find the UAC transaction sent for a pending request
+    sip_trans* find_pending_trans(unsigned long pending_id);
+
     // Add a new transaction using provided message and type
     sip_trans* add_trans(sip_msg* msg, unsigned int ttype);
 
@@ -46,6 +99,30 @@ private:
     sip_trans* match_200_ack(sip_trans* t,sip_msg* msg);
 };
 
+/**
+ * Chain length classes: 0, 1, 2, 3-4, 5-8, 9-16, 17-32, >32
+ */
+#define TRANS_CHAIN_CLASSES 8
+
+struct trans_table_stats
+{
+    unsigned int buckets;
+    unsigned int transactions;
+    unsigned int max_chain;
+
+    /** buckets per chain length class (snapshot) */
+    unsigned int chains[TRANS_CHAIN_CLASSES];
+
+    /** transactions compared per lookup, by class (since startup) */
+    unsigned int lookups[TRANS_CHAIN_CLASSES];
+};
+
+/** Lower bound of the chain length class 'c' */
+unsigned int trans_chain_class_min(unsigned int c);
+
+/** Walks (and locks) every bucket to fill 'st' */
+void get_trans_table_stats(trans_table_stats& st);
+
 trans_bucket* get_trans_bucket(const cstring& callid, const cstring& cseq_num);
 trans_bucket* get_trans_bucket(unsigned int h);
 
@@ -99,6 +99,20 @@ int udp_trsp_socket::bind(const string& bind_ip, unsigned short bind_port)
 	ERROR("socket: %s\n",strerror(errno));
 	return -1;
     } 
+
+    if(reuse_port) {
+#ifdef SO_REUSEPORT
+	int reuse_opt = 1;
+	if(setsockopt(sd, SOL_SOCKET, SO_REUSEPORT,
+		      (void*)&reuse_opt, sizeof(reuse_opt)) == -1) {
+	    ERROR("setsockopt(SO_REUSEPORT): %s\n",strerror(errno));
+	    close(sd);
+	    return -1;
+	}
+#else
+	WARN("SO_REUSEPORT not supported on this platform\n");
+#endif
+    }
     
     if(::bind(sd,(const struct sockaddr*)&addr,SA_len(&addr))) {
 
@@ -271,8 +285,9 @@ int udp_trsp_socket::send(const sockaddr_storage* sa,
 
 /** @see trsp_socket */
 
-udp_trsp::udp_trsp(udp_trsp_socket* sock)
-    : transport(sock)
+udp_trsp::udp_trsp(udp_trsp_socket* sock, unsigned int batch_size)
+    : transport(sock),
+      batch_size(batch_size ? batch_size : 1)
 {
 }
 
@@ -283,103 +298,209 @@ udp_trsp::~udp_trsp()
 
 /** @see AmThread */
 void udp_trsp::run()
+{
+    if(sock->get_sd()<=0){
+	ERROR("Transport instance not bound\n");
+	return;
+    }
+
+    INFO("Started SIP server UDP transport on %s:%i (fd=%i, batch=%u)\n",
+	 sock->get_ip(),sock->get_port(),sock->get_sd(),batch_size);
+
+#ifdef MSG_WAITFORONE
+    if(batch_size > 1) {
+	run_batched();
+	return;
+    }
+#else
+    if(batch_size > 1) {
+	WARN("recvmmsg() not supported on this platform:"
+	     " falling back to recvmsg()\n");
+    }
+#endif
+
+    run_single();
+}
+
+/**
+ * @return true if the receive loop should be left.
+ */
+static bool handle_recv_error(int err)
+{
+    ERROR("recvfrom returned error: %s\n",strerror(err));
+    switch(err){
+    case EBADF:
+    case ENOTSOCK:
+    case EOPNOTSUPP:
+	return true;
+    }
+    return false;
+}
+
+void udp_trsp::run_single()
 {
     char buf[MAX_UDP_MSGLEN];
     int buf_len;
 
     msghdr           msg;
-    cmsghdr*         cmsgptr; 
     sockaddr_storage from_addr;
     iovec            iov[1];
+    u_char           ctrl_buf[DSTADDR_DATASIZE];
 
     iov[0].iov_base = buf;
     iov[0].iov_len  = MAX_UDP_MSGLEN;
 
     memset(&msg,0,sizeof(msg));
     msg.msg_name       = &from_addr;
-    msg.msg_namelen    = sizeof(sockaddr_storage);
     msg.msg_iov        = iov;
     msg.msg_iovlen     = 1;
-    msg.msg_control    = new u_char[DSTADDR_DATASIZE];
-    msg.msg_controllen = DSTADDR_DATASIZE;
-
-    if(sock->get_sd()<=0){
-	ERROR("Transport instance not bound\n");
-	return;
-    }
-
-    INFO("Started SIP server UDP transport on %s:%i\n",
-	 sock->get_ip(),sock->get_port());
+    msg.msg_control    = ctrl_buf;
 
     while(true){
 
 	//DBG("before recvmsg (%s:%i)\n",sock->get_ip(),sock->get_port());
 
+	msg.msg_namelen    = sizeof(sockaddr_storage);
+	msg.msg_controllen = DSTADDR_DATASIZE;
+
 	buf_len = recvmsg(sock->get_sd(),&msg,0);
 	if(buf_len <= 0){
 	    if(!buf_len) continue;
-	    ERROR("recvfrom returned %d: %s\n",buf_len,strerror(errno));
-	    switch(errno){
-	    case EBADF:
-	    case ENOTSOCK:
-	    case EOPNOTSUPP:
+	    stats.recv_errors.inc();
+	    if(handle_recv_error(errno))
 		return;
-	    }
 	    continue;
 	}
 
-	if(buf_len > MAX_UDP_MSGLEN){
-	    ERROR("Message was too big (>%d)\n",MAX_UDP_MSGLEN);
-	    continue;
+	stats.recv_calls.inc();
+	process_msg(buf,buf_len,&msg);
+    }
+}
+
+#ifdef MSG_WAITFORONE
+void udp_trsp::run_batched()
+{
+    // one receive slot per datagram
+    struct recv_slot {
+	char             buf[MAX_UDP_MSGLEN];
+	sockaddr_storage from_addr;
+	u_char           ctrl_buf[DSTADDR_DATASIZE];
+	iovec            iov[1];
+    };
+
+    recv_slot* slots = new recv_slot[batch_size];
+    mmsghdr*   msgs  = new mmsghdr[batch_size];
+
+    memset(msgs,0,sizeof(mmsghdr) * batch_size);
+    for(unsigned int i=0; i<batch_size; i++) {
+
+	slots[i].iov[0].iov_base = slots[i].buf;
+	slots[i].iov[0].iov_len  = MAX_UDP_MSGLEN;
+
+	msghdr& hdr = msgs[i].msg_hdr;
+	hdr.msg_name    = &slots[i].from_addr;
+	hdr.msg_iov     = slots[i].iov;
+	hdr.msg_iovlen  = 1;
+	hdr.msg_control = slots[i].ctrl_buf;
+    }
+
+    while(true){
+
+	for(unsigned int i=0; i<batch_size; i++) {
+	    msgs[i].msg_hdr.msg_namelen    = sizeof(sockaddr_storage);
+	    msgs[i].msg_hdr.msg_controllen = DSTADDR_DATASIZE;
+	    msgs[i].msg_len = 0;
 	}
 
-	sockaddr_storage* sa = (sockaddr_storage*)msg.msg_name;
-	if(!am_get_port(sa)) {
-	    DBG("Source port is 0: dropping");
+	// block until at least one datagram is available,
+	// then fetch whatever else is queued without blocking.
+	int nr_msgs = recvmmsg(sock->get_sd(),msgs,batch_size,
+			       MSG_WAITFORONE,NULL);
+	if(nr_msgs <= 0){
+	    if(!nr_msgs) continue;
+	    stats.recv_errors.inc();
+	    if(errno == EINTR) continue;
+	    if(handle_recv_error(errno))
+		break;
 	    continue;
 	}
 
-	sip_msg* s_msg = new sip_msg(buf,buf_len);
-	memcpy(&s_msg->remote_ip,msg.msg_name,msg.msg_namelen);
-
-	if (trsp_socket::log_level_raw_msgs >= 0) {
-	    char host[NI_MAXHOST] = "";
-	    _LOG(trsp_socket::log_level_raw_msgs, 
-		 "vv M [|] u recvd msg via UDP from %s:%i vv\n"
-		 "--++--\n%.*s--++--\n",
-		 am_inet_ntop_sip(&s_msg->remote_ip,host,NI_MAXHOST),
-		 am_get_port(&s_msg->remote_ip),
-		 s_msg->len, s_msg->buf);
+	stats.recv_calls.inc();
+	for(int i=0; i<nr_msgs; i++) {
+	    if(!msgs[i].msg_len) continue;
+	    process_msg(slots[i].buf,msgs[i].msg_len,&msgs[i].msg_hdr);
 	}
+    }
 
-	s_msg->local_socket = sock;
-	inc_ref(sock);
+    delete [] msgs;
+    delete [] slots;
+}
+#else
+void udp_trsp::run_batched()
+{
+    run_single();
+}
+#endif
 
-	for (cmsgptr = CMSG_FIRSTHDR(&msg);
-             cmsgptr != NULL;
-             cmsgptr = CMSG_NXTHDR(&msg, cmsgptr)) {
+void udp_trsp::process_msg(char* buf, int buf_len, msghdr* hdr)
+{
+    cmsghdr* cmsgptr;
+
+    stats.recv_msgs.inc();
+
+    if(buf_len > MAX_UDP_MSGLEN){
+	ERROR("Message was too big (>%d)\n",MAX_UDP_MSGLEN);
+	stats.dropped_msgs.inc();
+	return;
+    }
+
+    sockaddr_storage* sa = (sockaddr_storage*)hdr->msg_name;
+    if(!am_get_port(sa)) {
+	DBG("Source port is 0: dropping");
+	stats.dropped_msgs.inc();
+	return;
+    }
+
+    sip_msg* s_msg = new sip_msg(buf,buf_len);
+    memcpy(&s_msg->remote_ip,hdr->msg_name,hdr->msg_namelen);
+
+    if (trsp_socket::log_level_raw_msgs >= 0) {
+	char host[NI_MAXHOST] = "";
+	_LOG(trsp_socket::log_level_raw_msgs, 
+	     "vv M [|] u recvd msg via UDP from %s:%i vv\n"
+	     "--++--\n%.*s--++--\n",
+	     am_inet_ntop_sip(&s_msg->remote_ip,host,NI_MAXHOST),
+	     am_get_port(&s_msg->remote_ip),
+	     s_msg->len, s_msg->buf);
+    }
+
+    s_msg->local_socket = sock;
+    inc_ref(sock);
+
+    for (cmsgptr = CMSG_FIRSTHDR(hdr);
+	 cmsgptr != NULL;
+	 cmsgptr = CMSG_NXTHDR(hdr, cmsgptr)) {
 	    
-            if (cmsgptr->cmsg_level == IPPROTO_IP &&
-                cmsgptr->cmsg_type == DSTADDR_SOCKOPT) {
+	if (cmsgptr->cmsg_level == IPPROTO_IP &&
+	    cmsgptr->cmsg_type == DSTADDR_SOCKOPT) {
 		
-		s_msg->local_ip.ss_family = AF_INET;
-	        am_set_port(&s_msg->local_ip,sock->get_port());
-                memcpy(&((sockaddr_in*)(&s_msg->local_ip))->sin_addr,
-		       dstaddr(cmsgptr),sizeof(in_addr));
-            }
-	    else if(cmsgptr->cmsg_level == IPPROTO_IPV6 &&
-		    cmsgptr->cmsg_type == IPV6_PKTINFO) {
-
-		s_msg->local_ip.ss_family = AF_INET6;
-	        am_set_port(&s_msg->local_ip,sock->get_port());
-                memcpy(&((sockaddr_in6*)(&s_msg->local_ip))->sin6_addr,
-		       dstaddr6(cmsgptr),sizeof(in6_addr));
-	    }
-        }
+	    s_msg->local_ip.ss_family = AF_INET;
+	    am_set_port(&s_msg->local_ip,sock->get_port());
+	    memcpy(&((sockaddr_in*)(&s_msg->local_ip))->sin_addr,
+		   dstaddr(cmsgptr),sizeof(in_addr));
+	}
+	else if(cmsgptr->cmsg_level == IPPROTO_IPV6 &&
+		cmsgptr->cmsg_type == IPV6_PKTINFO) {
 
-	// pass message to the parser / transaction layer
-	trans_layer::instance()->received_msg(s_msg);
+	    s_msg->local_ip.ss_family = AF_INET6;
+	    am_set_port(&s_msg->local_ip,sock->get_port());
+	    memcpy(&((sockaddr_in6*)(&s_msg->local_ip))->sin6_addr,
+		   dstaddr6(cmsgptr),sizeof(in6_addr));
+	}
     }
+
+    // pass message to the parser / transaction layer
+    trans_layer::instance()->received_msg(s_msg);
 }
 
 /** @see AmThread */
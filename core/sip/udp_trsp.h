@@ -30,6 +30,7 @@
 #define _udp_trsp_h_
 
 #include "transport.h"
+#include "atomic_types.h"
 
 /**
  * Maximum message length for UDP
@@ -44,13 +45,17 @@ using std::string;
 
 class udp_trsp_socket: public trsp_socket
 {
+    // bind with SO_REUSEPORT
+    bool reuse_port;
+
     int sendto(const sockaddr_storage* sa, const char* msg, const int msg_len);
     int sendmsg(const sockaddr_storage* sa, const char* msg, const int msg_len);
 
 public:
     udp_trsp_socket(unsigned short if_num, unsigned int opts,
 		    unsigned int sys_if_idx = 0)
-	: trsp_socket(if_num,opts,sys_if_idx) {}
+	: trsp_socket(if_num,opts,sys_if_idx),
+	  reuse_port(false) {}
 
     ~udp_trsp_socket() {}
 
@@ -65,6 +70,12 @@ public:
 
     int set_recvbuf_size(int rcvbuf_size);
 
+    /**
+     * Allows several sockets to be bound to the same address
+     * (SO_REUSEPORT). Must be called before bind().
+     */
+    void set_reuse_port(bool reuse) { reuse_port = reuse; }
+
     /**
      * Sends a message.
      * @return -1 if error(s) occured.
@@ -73,8 +84,46 @@ public:
 	     const int msg_len, unsigned int flags);
 };
 
+/**
+ * Per-worker receive counters, read
+ * by other threads for statistics.
+ */
+struct udp_trsp_stats
+{
+    // number of recvmsg()/recvmmsg() calls returning data
+    atomic_int64 recv_calls;
+    // number of datagrams received
+    atomic_int64 recv_msgs;
+    // number of datagrams dropped (too big, source port 0)
+    atomic_int64 dropped_msgs;
+    // number of receive errors
+    atomic_int64 recv_errors;
+};
+
 class udp_trsp: public transport
 {
+    // max. number of datagrams fetched per recvmmsg() call
+    unsigned int batch_size;
+
+    udp_trsp_stats stats;
+
+    /**
+     * Legacy receive loop: one recvmsg() per datagram.
+     */
+    void run_single();
+
+    /**
+     * Batched receive loop: drains up to 'batch_size'
+     * datagrams per recvmmsg() call.
+     */
+    void run_batched();
+
+    /**
+     * Builds a sip_msg from a received datagram
+     * and passes it to the transaction layer.
+     */
+    void process_msg(char* buf, int buf_len, msghdr* hdr);
+
 protected:
     /** @see AmThread */
     void run();
@@ -83,8 +132,12 @@ protected:
     
 public:
     /** @see transport */
-    udp_trsp(udp_trsp_socket* sock);
+    udp_trsp(udp_trsp_socket* sock, unsigned int batch_size = 1);
     ~udp_trsp();
+
+    udp_trsp_stats& get_stats() { return stats; }
+
+    trsp_socket* get_sock() const { return sock; }
 };
 
 #endif
@@ -42,8 +42,11 @@ timer::~timer()
     // DBG("timer::~timer(this=%p)\n",this);
 }
 
+unsigned int _wheeltimer::resolution = DEFAULT_TIMER_RESOLUTION;
+
 _wheeltimer::_wheeltimer()
-    : wall_clock(0)
+    : ins_reqs(NULL), rem_reqs(NULL),
+      wall_clock(0)
 {
     struct timeval now;
     gettimeofday(&now,NULL);
@@ -54,12 +57,44 @@ _wheeltimer::~_wheeltimer()
 {
 }
 
-void _wheeltimer::insert_timer(timer* t)
+void _wheeltimer::push_req(timer* volatile& head, timer* t, timer*& link)
 {
-    //add new timer to user request list
+#if HAVE_ATOMIC_CAS
+    // push-only, the timer thread takes the whole
+    // list at once: no ABA problem here.
+    timer* old_head;
+    do {
+	old_head = head;
+	link = old_head;
+    } while(!__sync_bool_compare_and_swap(&head,old_head,t));
+#else
+    reqs_m.lock();
+    link = head;
+    head = t;
+    reqs_m.unlock();
+#endif
+}
+
+timer* _wheeltimer::take_reqs(timer* volatile& head)
+{
+    if(!head)
+	return NULL;
+
+#if HAVE_ATOMIC_CAS
+    return __sync_lock_test_and_set(&head,(timer*)NULL);
+#else
     reqs_m.lock();
-    reqs_backlog.push_back(timer_req(t,true));
+    timer* t = head;
+    head = NULL;
     reqs_m.unlock();
+    return t;
+#endif
+}
+
+void _wheeltimer::insert_timer(timer* t)
+{
+    //add new timer to user request list
+    push_req(ins_reqs,t,t->next_ins);
 }
 
 void _wheeltimer::remove_timer(timer* t)
@@ -69,17 +104,49 @@ void _wheeltimer::remove_timer(timer* t)
     }
 
     //add timer to remove to user request list
-    reqs_m.lock();
-    reqs_backlog.push_back(timer_req(t,false));
-    reqs_m.unlock();
+    push_req(rem_reqs,t,t->next_rem);
+}
+
+void _wheeltimer::process_reqs()
+{
+    // take the removals first: the insertion of any timer
+    // removed here has been requested before, so that it
+    // is part of the insertions taken below.
+    timer* rem = take_reqs(rem_reqs);
+    timer* ins = take_reqs(ins_reqs);
+
+    // restore the order of the requests
+    timer* t = NULL;
+    while(ins) {
+	timer* n = ins->next_ins;
+	ins->next_ins = t;
+	t = ins;
+	ins = n;
+    }
+
+    while(t) {
+	timer* n = t->next_ins;
+	t->next_ins = NULL;
+	place_timer(t);
+	t = n;
+    }
+
+    while(rem) {
+	timer* n = rem->next_rem;
+	delete_timer(rem);
+	rem = n;
+    }
 }
 
 void _wheeltimer::run()
 {
   struct timeval now,next_tick,diff,tick;
 
-  tick.tv_sec = 0;
-  tick.tv_usec = TIMER_RESOLUTION;
+  tick.tv_sec = TIMER_RESOLUTION / 1000000;
+  tick.tv_usec = TIMER_RESOLUTION % 1000000;
+
+  // do not sleep for less than a tenth of a tick (2 ms by default)
+  long min_sleep_ns = TIMER_RESOLUTION * 100;
   
   gettimeofday(&now, NULL);
   timeradd(&tick,&now,&next_tick);
@@ -96,7 +163,7 @@ void _wheeltimer::run()
       sdiff.tv_sec = diff.tv_sec;
       sdiff.tv_nsec = diff.tv_usec * 1000;
 
-      if(sdiff.tv_nsec > 2000000) // 2 ms 
+      if(sdiff.tv_sec || (sdiff.tv_nsec > min_sleep_ns))
 	nanosleep(&sdiff,&rem);
     }
     //else {
@@ -154,22 +221,8 @@ void _wheeltimer::turn_wheel()
     // Update existing timer entries
     update_wheel(i);
 	
-    // Swap the lists for timer insertion/deletion requests
-    reqs_m.lock();
-    reqs_process.swap(reqs_backlog);
-    reqs_m.unlock();
-
-    while(!reqs_process.empty()) {
-	timer_req rq = reqs_process.front();
-	reqs_process.pop_front();
-
-	if(rq.insert) {
-	    place_timer(rq.t);
-	}
-	else {
-	    delete_timer(rq.t);
-	}
-    }
+    // Process timer insertion/deletion requests
+    process_reqs();
 	
     //check for expired timer to process
     process_current_timers();
@@ -32,15 +32,17 @@
 
 #include "../AmThread.h"
 #include <sys/types.h>
-#include <deque>
 
 #include "atomic_types.h"
 
 #define BITS_PER_WHEEL 8
 #define ELMTS_PER_WHEEL (1 << BITS_PER_WHEEL)
 
-// 20 ms == 20000 us
-#define TIMER_RESOLUTION 20000
+// default: 20 ms == 20000 us
+#define DEFAULT_TIMER_RESOLUTION 20000
+
+// timer tick length in us (see _wheeltimer::resolution)
+#define TIMER_RESOLUTION (_wheeltimer::resolution)
 
 // do not change
 #define WHEELS 4
@@ -60,14 +62,20 @@ public:
     base_timer*  prev;
     u_int32_t    expires;
 
+    // pending insert/remove requests (see _wheeltimer)
+    timer*       next_ins;
+    timer*       next_rem;
+
     timer() 
 	: base_timer(),
-	  prev(0), expires(0) 
+	  prev(0), expires(0),
+	  next_ins(0), next_rem(0)
     {}
 
     timer(unsigned int expires)
         : base_timer(),
-	  prev(0), expires(expires)
+	  prev(0), expires(expires),
+	  next_ins(0), next_rem(0)
     {}
 
     ~timer(); 
@@ -77,26 +85,32 @@ public:
 
 #include "singleton.h"
 
+/**
+ * Timer wheel driven by its own thread.
+ *
+ * insert_timer() and remove_timer() may be called from any
+ * thread: the requests are pushed onto two lock-free lists
+ * (linked through the timers themselves), which the timer
+ * thread takes over as a whole on every tick. Inserts are
+ * processed before removals, as a timer is always inserted
+ * before it gets removed.
+ */
 class _wheeltimer:
     public AmThread
 {
-    struct timer_req {
-
-	timer* t;
-	bool   insert; // false -> remove
-	
-	timer_req(timer* t, bool insert)
-	    : t(t), insert(insert)
-	{}
-    };
-
     //the timer wheel
     base_timer wheels[WHEELS][ELMTS_PER_WHEEL];
 
-    // request backlog lock (insert/remove)
-    AmMutex               reqs_m;
-    std::deque<timer_req> reqs_backlog;
-    std::deque<timer_req> reqs_process;
+    // pending requests (most recent first)
+    timer* volatile ins_reqs;
+    timer* volatile rem_reqs;
+#if !HAVE_ATOMIC_CAS
+    AmMutex reqs_m;
+#endif
+
+    void push_req(timer* volatile& head, timer* t, timer*& link);
+    timer* take_reqs(timer* volatile& head);
+    void process_reqs();
 
     void turn_wheel();
     void update_wheel(int wheel);
@@ -117,6 +131,9 @@ protected:
     ~_wheeltimer();
 
 public:
+    /** tick length in us, common to all timer wheels */
+    static unsigned int resolution;
+
     //clock reference
     volatile u_int32_t wall_clock; // 32 bits
 #ifdef __LP64__
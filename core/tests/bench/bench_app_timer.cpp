@@ -0,0 +1,129 @@
+/*
+ * Application timers: setting, resetting and removing the timers of
+ * 100k sessions from several threads, and firing a part of them.
+ */
+
+#include "sems_bench.h"
+
+#include "AmAppTimer.h"
+#include "AmEventDispatcher.h"
+#include "AmEvent.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <vector>
+using std::vector;
+
+#define AT_BENCH_THREADS  4
+#define AT_BENCH_SESSIONS 25000 // per thread
+
+/** counts the timeout events posted (from the timer thread) */
+struct timeout_queue
+  : public AmEventQueueInterface
+{
+  atomic_int events;
+
+  void postEvent(AmEvent* ev) {
+    events.inc();
+    delete ev;
+  }
+};
+
+/** sets, resets and removes the timers of its own session queues */
+class session_timer_thread
+  : public AmThread
+{
+  unsigned int n;
+
+public:
+  vector<AmAppTimerQueue*> queues;
+  double set_us;
+  double reset_us;
+  double remove_us;
+
+  session_timer_thread(unsigned int _n)
+    : n(_n), set_us(0), reset_us(0), remove_us(0) {}
+
+  ~session_timer_thread() {
+    for(unsigned int i=0; i<queues.size(); i++)
+      delete queues[i];
+  }
+
+  void run() {
+    _AmAppTimer* at = AmAppTimer::instance();
+    for(unsigned int i=0; i<n; i++)
+      queues.push_back(new AmAppTimerQueue());
+
+    // e.g. no-answer and session timer
+    double start = now_us();
+    for(unsigned int i=0; i<n; i++) {
+      at->setTimer(queues[i],"at-bench",1,3600.0 + i % 100);
+      at->setTimer(queues[i],"at-bench",2,1800.0);
+    }
+    set_us = now_us() - start;
+
+    start = now_us();
+    for(unsigned int i=0; i<n; i++)
+      at->setTimer(queues[i],"at-bench",2,1900.0);
+    reset_us = now_us() - start;
+
+    start = now_us();
+    for(unsigned int i=0; i<n; i++) {
+      if(i & 1) at->removeTimer(queues[i],1);
+      at->removeTimers(queues[i]);
+    }
+    remove_us = now_us() - start;
+  }
+
+  void on_stop() {}
+};
+
+void bench_app_timer(unsigned int min_ms, AmArg& res)
+{
+  AmAppTimer::instance()->start();
+
+  vector<session_timer_thread*> threads;
+  for(unsigned int i=0; i<AT_BENCH_THREADS; i++) {
+    threads.push_back(new session_timer_thread(AT_BENCH_SESSIONS));
+    threads.back()->start();
+  }
+  for(unsigned int i=0; i<AT_BENCH_THREADS; i++)
+    threads[i]->join();
+
+  double set_us = 0, reset_us = 0, remove_us = 0;
+  for(unsigned int i=0; i<AT_BENCH_THREADS; i++) {
+    set_us += threads[i]->set_us;
+    reset_us += threads[i]->reset_us;
+    remove_us += threads[i]->remove_us;
+  }
+
+  // short timers of the same sessions, all firing
+  timeout_queue q;
+  AmEventDispatcher::instance()->addEventQueue("at-bench",&q);
+  unsigned int n_fire = 0;
+  for(unsigned int i=0; i<AT_BENCH_THREADS; i++) {
+    for(unsigned int j=0; j<AT_BENCH_SESSIONS; j+=10, n_fire++)
+      AmAppTimer::instance()->setTimer(threads[i]->queues[j],"at-bench",
+				       3,0.05 + (j % 20) * 0.01);
+  }
+  if(!wait_for(q.events,n_fire,5000)) {
+    fprintf(stderr,"app timer: %u out of %u timers fired\n",
+	    q.events.get(),n_fire);
+  }
+  usleep(2 * TIMER_RESOLUTION);
+  if(q.events.get() > n_fire)
+    fprintf(stderr,"app timer: removed timers fired\n");
+  AmEventDispatcher::instance()->delEventQueue("at-bench");
+
+  for(unsigned int i=0; i<AT_BENCH_THREADS; i++)
+    delete threads[i];
+
+  // each thread sets two timers per session, resets one, removes two
+  unsigned int n_timers = 2 * AT_BENCH_THREADS * AT_BENCH_SESSIONS;
+  AmArg& r = res["app_timer"];
+  r["sessions"] = AT_BENCH_THREADS * AT_BENCH_SESSIONS;
+  r["set_per_sec"] = n_timers * 1e6 / set_us;
+  r["reset_per_sec"] = n_timers * 0.5e6 / reset_us;
+  r["remove_per_sec"] = n_timers * 1e6 / remove_us;
+  r["fired"] = (int)n_fire;
+}
@@ -0,0 +1,80 @@
+/*
+ * Event dispatcher: posting to one of many event queues,
+ * by local tag and by queue handle.
+ */
+
+#include "sems_bench.h"
+
+#include "AmEventDispatcher.h"
+#include "AmEvent.h"
+
+#include <stdio.h>
+#include <vector>
+using std::vector;
+
+#define ED_BENCH_QUEUES 10000
+
+/** counts and drops the events posted */
+struct counting_queue
+  : public AmEventQueueInterface
+{
+  unsigned int events;
+
+  counting_queue() : events(0) {}
+
+  void postEvent(AmEvent* ev) {
+    events++;
+    delete ev;
+  }
+};
+
+static vector<string> tags;
+static vector<AmEventDispatcher::QueueHandle> handles;
+static AmEvent ed_event(0);
+
+static unsigned int pass_post_tag()
+{
+  AmEventDispatcher* d = AmEventDispatcher::instance();
+  for(unsigned int i=0; i<tags.size(); i++)
+    d->post(tags[i],ed_event.clone());
+  return tags.size();
+}
+
+static unsigned int pass_post_handle()
+{
+  AmEventDispatcher* d = AmEventDispatcher::instance();
+  for(unsigned int i=0; i<handles.size(); i++)
+    d->post(handles[i],ed_event.clone());
+  return handles.size();
+}
+
+void bench_event_dispatcher(unsigned int min_ms, AmArg& res)
+{
+  AmEventDispatcher* d = AmEventDispatcher::instance();
+  counting_queue q;
+
+  tags.resize(ED_BENCH_QUEUES);
+  handles.resize(ED_BENCH_QUEUES);
+  for(unsigned int i=0; i<ED_BENCH_QUEUES; i++) {
+    char tag[32];
+    snprintf(tag,sizeof(tag),"ed-bench-%u",i);
+    tags[i] = tag;
+    if(!d->addEventQueue(tags[i],&q,&handles[i]))
+      fprintf(stderr,"event dispatcher: could not add queue '%s'\n",tag);
+  }
+
+  measure("event_post_tag",pass_post_tag,min_ms,res);
+  measure("event_post_handle",pass_post_handle,min_ms,res);
+
+  unsigned int posted =
+    res["event_post_tag"]["items"].asInt() +
+    res["event_post_handle"]["items"].asInt() + 2 * ED_BENCH_QUEUES;
+  if(q.events != posted) {
+    fprintf(stderr,"event dispatcher: %u out of %u events delivered\n",
+	    q.events,posted);
+  }
+
+  for(unsigned int i=0; i<ED_BENCH_QUEUES; i++)
+    d->delEventQueue(tags[i]);
+  res["event_post_tag"]["queues"] = ED_BENCH_QUEUES;
+}
@@ -0,0 +1,81 @@
+/*
+ * Asynchronous logging: time spent in the logging thread per message,
+ * with a log facility taking 20 us per message, synchronously and
+ * with the log rings.
+ */
+
+#include "sems_bench.h"
+
+#include "AmApi.h"
+#include "log.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+
+#define LOG_BENCH_PREFIX   "log ring bench"
+#define LOG_BENCH_MESSAGES 500
+#define LOG_BENCH_DELAY_US 20
+
+/** a slow log facility, e.g. syslog over the network */
+class SlowLogHook : public AmLoggingFacility
+{
+public:
+  volatile unsigned int logged;
+
+  SlowLogHook()
+    : AmLoggingFacility("log_ring_bench"), logged(0)
+  {}
+
+  int onLoad() { return 0; }
+
+  void log(int level, pid_t pid, pthread_t tid, const char* func,
+	   const char* file, int line, char* msg)
+  {
+    if(!strstr(msg, LOG_BENCH_PREFIX))
+      return;
+
+    usleep(LOG_BENCH_DELAY_US);
+    logged++;
+  }
+};
+
+static double log_messages()
+{
+  double start = now_us();
+  for(unsigned int i=0; i<LOG_BENCH_MESSAGES; i++)
+    INFO(LOG_BENCH_PREFIX " %u\n", i);
+  return now_us() - start;
+}
+
+void bench_log_ring(unsigned int min_ms, AmArg& res)
+{
+  SlowLogHook* hook = new SlowLogHook();
+  register_log_hook(hook);
+
+  int old_log_stderr = log_stderr;
+  log_stderr = 0;
+  LogLevelScope lls(L_INFO);
+
+  double sync_us = log_messages();
+
+  unsigned int dropped = log_dropped();
+  start_async_logging(1024*1024);
+  double async_us = log_messages();
+  stop_async_logging();
+  dropped = log_dropped() - dropped;
+
+  log_stderr = old_log_stderr;
+
+  if(hook->logged != 2 * LOG_BENCH_MESSAGES) {
+    fprintf(stderr,"log ring: %u out of %u messages logged\n",
+	    hook->logged,2 * LOG_BENCH_MESSAGES);
+  }
+
+  // (the hook stays registered)
+  AmArg& r = res["log_ring"];
+  r["messages"] = LOG_BENCH_MESSAGES;
+  r["ns_per_message"] = async_us * 1000.0 / LOG_BENCH_MESSAGES;
+  r["ns_per_message_sync"] = sync_us * 1000.0 / LOG_BENCH_MESSAGES;
+  r["dropped"] = (int)dropped;
+}
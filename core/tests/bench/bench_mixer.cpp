@@ -0,0 +1,73 @@
+/*
+ * Conference mixer: put/get 20 ms frames of n channels,
+ * with the generic and with the best mixing kernels.
+ */
+
+#include "sems_bench.h"
+
+#include "AmMixerKernels.h"
+#include "AmMultiPartyMixer.h"
+#include "AmAudio.h"
+#include "AmUtils.h"
+
+#include <string>
+#include <vector>
+using std::string;
+using std::vector;
+
+#define MIXER_BENCH_FRAMES 50
+
+static AmMultiPartyMixer* mixer = NULL;
+static vector<unsigned int> channels;
+static unsigned long long mixer_ts = 0;
+static short frame[160];
+
+/** MIXER_BENCH_FRAMES frames, returns the channel frames mixed */
+static unsigned int pass_mixer()
+{
+  for(unsigned int f=0; f<MIXER_BENCH_FRAMES; f++) {
+    mixer->lock();
+    for(unsigned int i=0; i<channels.size(); i++)
+      mixer->PutChannelPacket(channels[i],mixer_ts,
+			      (unsigned char*)frame,sizeof(frame));
+    for(unsigned int i=0; i<channels.size(); i++) {
+      unsigned char out[sizeof(frame)];
+      unsigned int size = sizeof(out), rate = 0;
+      mixer->GetChannelPacket(channels[i],mixer_ts,out,size,rate);
+    }
+    mixer->unlock();
+    mixer_ts += 2 * WC_INC;
+  }
+  return MIXER_BENCH_FRAMES * channels.size();
+}
+
+static void bench_conference(unsigned int n, unsigned int min_ms, AmArg& res)
+{
+  mixer = new AmMultiPartyMixer();
+  for(unsigned int i=0; i<n; i++)
+    channels.push_back(mixer->addChannel(8000));
+
+  string name = "mixer_" + int2str(n) + "_channels";
+  mixer_use_generic_kernels(true);
+  measure((name + "_generic").c_str(),pass_mixer,min_ms,res);
+  mixer_use_generic_kernels(false);
+  measure(name.c_str(),pass_mixer,min_ms,res);
+
+  for(unsigned int i=0; i<channels.size(); i++)
+    mixer->removeChannel(channels[i]);
+  channels.clear();
+  delete mixer;
+  mixer = NULL;
+}
+
+void bench_mixer(unsigned int min_ms, AmArg& res)
+{
+  for(unsigned int i=0; i<160; i++)
+    frame[i] = (short)((i * 37) % 2000 - 1000);
+
+  const unsigned int sizes[] = { 2, 10, 100 };
+  for(unsigned int i=0; i<sizeof(sizes)/sizeof(sizes[0]); i++)
+    bench_conference(sizes[i],min_ms,res);
+
+  res["mixer_kernels"] = mixer_kernels();
+}
@@ -0,0 +1,104 @@
+/*
+ * SBC parameter replacement: evaluation of a call profile with
+ * compiled templates, and replacing its fields with the compiled
+ * templates and with templates scanned for every call.
+ */
+
+#include "sems_bench.h"
+
+#include "AmSipMsg.h"
+
+#include "../../../apps/sbc/ParamReplacer.h"
+#include "../../../apps/sbc/SBCCallProfile.h"
+
+#include <stdio.h>
+
+#define PR_BENCH_CALLS 100
+
+static AmSipRequest pr_req;
+static SBCCallProfile* pr_profile = NULL;
+static bool pr_ok = true;
+
+static const string* pr_fields[6];
+static const unsigned int pr_n_fields = sizeof(pr_fields)/sizeof(pr_fields[0]);
+
+static unsigned int pass_evaluate()
+{
+  for(unsigned int i=0; i<PR_BENCH_CALLS; i++) {
+    SBCCallProfile call_profile(*pr_profile);
+    ParamReplacerCtx ctx(&call_profile);
+    pr_ok = call_profile.evaluate(ctx,pr_req) && pr_ok;
+  }
+  return PR_BENCH_CALLS;
+}
+
+static unsigned int pass_compiled()
+{
+  for(unsigned int i=0; i<PR_BENCH_CALLS; i++) {
+    ParamReplacerCtx ctx(pr_profile);
+    for(unsigned int f=0; f<pr_n_fields; f++)
+      ctx.replaceParameters(*pr_fields[f],"bench",pr_req);
+  }
+  return PR_BENCH_CALLS * pr_n_fields;
+}
+
+static unsigned int pass_scanned()
+{
+  for(unsigned int i=0; i<PR_BENCH_CALLS; i++) {
+    ParamReplacerCtx ctx(pr_profile);
+    for(unsigned int f=0; f<pr_n_fields; f++) {
+      ParamTemplate t(*pr_fields[f]);
+      ctx.replaceParameters(t,"bench",pr_req);
+    }
+  }
+  return PR_BENCH_CALLS * pr_n_fields;
+}
+
+void bench_param_replacer(unsigned int min_ms, AmArg& res)
+{
+  pr_req.method = "INVITE";
+  pr_req.r_uri = "sip:bob@biloxi.example.com:5062;user=phone";
+  pr_req.from = "\"Alice\" <sip:alice@atlanta.example.com;x=1>";
+  pr_req.from_tag = "9fxced76sl";
+  pr_req.to = "<sip:bob@biloxi.example.com>";
+  pr_req.callid = "3848276298220188511@atlanta.example.com";
+  pr_req.remote_ip = "192.0.2.101";
+  pr_req.remote_port = 5060;
+  pr_req.hdrs =
+    "P-Asserted-Identity: <sip:+4930123@atlanta.example.com>\r\n"
+    "X-Account: 1234\r\n";
+
+  SBCCallProfile* p = new SBCCallProfile();
+  p->ruri = "sip:$rU@gw.example.com;user=phone";
+  p->from = "\"$fn\" <sip:$fU@$Ri>";
+  p->to = "<sip:$tU@gw.example.com>";
+  p->callid = "$_5($ci)";
+  p->next_hop = "10.0.0.1:5060";
+  p->append_headers = "X-Orig-Src: $si:$sp\\r\\nX-Orig-PAI: $aU\\r\\n";
+  p->dlg_contact_params = "acc=$H(X-Account)";
+  p->fix_replaces_inv = "no";
+  p->fix_replaces_ref = "no";
+
+  pr_fields[0] = &p->ruri;
+  pr_fields[1] = &p->from;
+  pr_fields[2] = &p->to;
+  pr_fields[3] = &p->callid;
+  pr_fields[4] = &p->append_headers;
+  pr_fields[5] = &p->dlg_contact_params;
+
+  ParamTemplates* templates = new ParamTemplates();
+  for(unsigned int f=0; f<pr_n_fields; f++)
+    templates->add(*pr_fields[f]);
+  p->param_templates.reset(templates);
+  pr_profile = p;
+
+  measure("sbc_profile_evaluate",pass_evaluate,min_ms,res);
+  measure("param_replace_compiled",pass_compiled,min_ms,res);
+  measure("param_replace_scanned",pass_scanned,min_ms,res);
+
+  if(!pr_ok)
+    fprintf(stderr,"param replacer: call profile evaluation failed\n");
+
+  delete pr_profile;
+  pr_profile = NULL;
+}
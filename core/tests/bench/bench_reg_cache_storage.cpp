@@ -0,0 +1,101 @@
+/*
+ * SBC register cache persistence: cost of the journal per binding
+ * update, and time to write and to restore a snapshot.
+ */
+
+#include "sems_bench.h"
+
+#include "AmUtils.h"
+
+#include "../../../apps/sbc/RegisterCache.h"
+#include "../../../apps/sbc/RegCacheStorage.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <time.h>
+
+#define REG_BENCH_BINDINGS 20000
+
+static string storage_path()
+{
+  return "/tmp/sems_bench_reg_cache_" + int2str((unsigned int)getpid());
+}
+
+static void remove_storage(const string& path)
+{
+  unlink((path + ".snapshot").c_str());
+  unlink((path + ".journal").c_str());
+}
+
+static long file_size(const string& path)
+{
+  struct stat st;
+  if(stat(path.c_str(),&st))
+    return -1;
+  return st.st_size;
+}
+
+static AliasEntry make_ae(unsigned int i)
+{
+  AliasEntry ae;
+  ae.aor = "sip:user" + int2str(i) + "@example.com";
+  ae.alias = "alias" + int2str(i);
+  ae.contact_uri = "sip:user" + int2str(i) + "@10.0.0.1:5062;transport=udp";
+  ae.source_ip = "192.0.2." + int2str(i % 250);
+  ae.source_port = 1024 + i;
+  ae.trsp = "udp";
+  ae.local_if = 1;
+  ae.remote_ua = "SEMS bench UA";
+  return ae;
+}
+
+void bench_reg_cache_storage(unsigned int min_ms, AmArg& res)
+{
+  string path = storage_path();
+  remove_storage(path);
+  long now = time(NULL);
+
+  _RegisterCache* rc = RegisterCache::instance();
+  if(rc->enablePersistence(path,0)) {
+    fprintf(stderr,"reg cache storage: could not enable persistence\n");
+    RegisterCache::dispose();
+    return;
+  }
+
+  double start = now_us();
+  for(unsigned int i=0; i<REG_BENCH_BINDINGS; i++) {
+    AliasEntry ae = make_ae(i);
+    rc->update(ae.alias,now + 3600,ae);
+  }
+  double update_us = now_us() - start;
+
+  start = now_us();
+  if(!rc->snapshot())
+    fprintf(stderr,"reg cache storage: snapshot failed\n");
+  double snapshot_us = now_us() - start;
+  long snapshot_bytes = file_size(path + ".snapshot");
+
+  RegisterCache::dispose();
+
+  start = now_us();
+  rc = RegisterCache::instance();
+  if(rc->enablePersistence(path,0))
+    fprintf(stderr,"reg cache storage: restore failed\n");
+  double restore_us = now_us() - start;
+
+  if(rc->getActiveRegs() != REG_BENCH_BINDINGS) {
+    fprintf(stderr,"reg cache storage: %u out of %u bindings restored\n",
+	    (unsigned int)rc->getActiveRegs(),REG_BENCH_BINDINGS);
+  }
+
+  RegisterCache::dispose();
+  remove_storage(path);
+
+  AmArg& r = res["reg_cache_storage"];
+  r["bindings"] = REG_BENCH_BINDINGS;
+  r["ns_per_update"] = update_us * 1000.0 / REG_BENCH_BINDINGS;
+  r["snapshot_ms"] = snapshot_us / 1000.0;
+  r["snapshot_bytes"] = (int)snapshot_bytes;
+  r["restore_ms"] = restore_us / 1000.0;
+}
@@ -0,0 +1,111 @@
+/*
+ * SBC regex mappings: lookups in a large mapping with the indexed
+ * RegexMap, and with regexec on all rules (run_regex_mapping).
+ */
+
+#include "sems_bench.h"
+
+#include "AmUtils.h"
+
+#include "../../../apps/sbc/RegexMapper.h"
+
+#include <stdio.h>
+
+#include <vector>
+using std::vector;
+using std::make_pair;
+
+#define RM_BENCH_RULES   1000
+#define RM_BENCH_LOOKUPS 20000
+
+static RegexMappingVector rm_ref;
+static RegexMap* rm_map = NULL;
+static vector<string> rm_keys;
+
+static void add_rule(RegexMappingVector& v, vector<string>& patterns,
+		     const string& re, const string& repl)
+{
+  regex_t r;
+  if (regcomp(&r, re.c_str(), REG_EXTENDED)) {
+    fprintf(stderr, "regex mapper: could not compile '%s'\n", re.c_str());
+    return;
+  }
+  v.push_back(make_pair(r, repl));
+  patterns.push_back(re);
+}
+
+/** rules of a large mapping: mostly numbers and user names */
+static void bench_rules(RegexMappingVector& v, vector<string>& patterns,
+			unsigned int n)
+{
+  for (unsigned int i=0; i<n; i++) {
+    switch (i % 4) {
+    case 0: add_rule(v, patterns, "^user" + int2str(i) + "$",
+		     "profile" + int2str(i)); break;
+    case 1: add_rule(v, patterns, "^\\+49" + int2str(i),
+		     "profile" + int2str(i)); break;
+    case 2: add_rule(v, patterns, "^00" + int2str(i) + "([0-9]+)$",
+		     "profile\\1"); break;
+    case 3: add_rule(v, patterns, "^trunk" + int2str(i) + "\\.example\\.com$",
+		     "profile" + int2str(i)); break;
+    }
+  }
+}
+
+static unsigned int pass_map()
+{
+  string res;
+  for (unsigned int i=0; i<RM_BENCH_LOOKUPS; i++)
+    rm_map->match(rm_keys[i].c_str(), res);
+  return RM_BENCH_LOOKUPS;
+}
+
+static unsigned int pass_regexec()
+{
+  string res;
+  for (unsigned int i=0; i<RM_BENCH_LOOKUPS; i++)
+    run_regex_mapping(rm_ref, rm_keys[i].c_str(), res);
+  return RM_BENCH_LOOKUPS;
+}
+
+void bench_regex_mapper(unsigned int min_ms, AmArg& res)
+{
+  RegexMappingVector v;
+  vector<string> patterns;
+  bench_rules(rm_ref, patterns, RM_BENCH_RULES);
+  patterns.clear();
+  bench_rules(v, patterns, RM_BENCH_RULES);
+  rm_map = new RegexMap(v, patterns);
+
+  for (unsigned int i=0; i<RM_BENCH_LOOKUPS; i++) {
+    unsigned int r = (i * 7919) % (RM_BENCH_RULES + 100); // some do not match
+    switch (r % 4) {
+    case 0: rm_keys.push_back("user" + int2str(r)); break;
+    case 1: rm_keys.push_back("+49" + int2str(r) + "123"); break;
+    case 2: rm_keys.push_back("00" + int2str(r) + "4930"); break;
+    case 3: rm_keys.push_back("trunk" + int2str(r) + ".example.com"); break;
+    }
+  }
+
+  unsigned int differ = 0;
+  for (unsigned int i=0; i<1000; i++) {
+    string ref_res, map_res;
+    bool r1 = run_regex_mapping(rm_ref, rm_keys[i].c_str(), ref_res);
+    bool r2 = rm_map->match(rm_keys[i].c_str(), map_res);
+    differ += (r1 != r2) || (r1 && (ref_res != map_res));
+  }
+  if (differ)
+    fprintf(stderr, "regex mapper: %u out of 1000 lookups differ\n", differ);
+
+  measure("regex_map_lookup", pass_map, min_ms, res);
+  measure("regex_mapping_lookup", pass_regexec, min_ms, res);
+  res["regex_map_lookup"]["rules"] = RM_BENCH_RULES;
+  res["regex_map_lookup"]["literal_rules"] = (int)rm_map->literalRules();
+
+  delete rm_map;
+  rm_map = NULL;
+  for (unsigned int i=0; i<rm_ref.size(); i++)
+    regfree(&rm_ref[i].first);
+  rm_ref.clear();
+  rm_keys.clear();
+}
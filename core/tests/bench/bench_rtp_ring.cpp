@@ -0,0 +1,110 @@
+/*
+ * RTP receive buffer: the receiver thread inserts a burst of packets,
+ * the media processor drains the buffer - with the previous
+ * std::map + mutex receive buffer and with the receive ring.
+ */
+
+#include "sems_bench.h"
+
+#include "AmRtpReceiveRing.h"
+#include "AmRtpPacket.h"
+#include "AmThread.h"
+#include "SampleArray.h"
+
+#include <map>
+#include <vector>
+using std::map;
+using std::vector;
+
+#define RING_BENCH_PACKETS 256
+#define RING_BENCH_BURST   3
+
+typedef map<unsigned int, AmRtpPacket*, ts_less> ts_map;
+
+static unsigned char pkt_buf[8];
+static vector<AmRtpPacket*> pkts;
+static vector<unsigned int> order;
+
+/**
+ * Order of arrival: every 'reorder'-th pair is swapped,
+ * every 'loss'-th packet is lost (0 = never).
+ */
+static void set_arrival_order(unsigned int reorder, unsigned int loss)
+{
+  order.clear();
+  for(unsigned int i=0; i<pkts.size(); i++) {
+    if(loss && (i % loss == loss-1))
+      continue;
+    order.push_back(i);
+  }
+
+  if(!reorder) return;
+  for(unsigned int i=1; i<order.size(); i+=reorder) {
+    unsigned int t = order[i];
+    order[i] = order[i-1];
+    order[i-1] = t;
+  }
+}
+
+static unsigned int pass_map()
+{
+  ts_map m;
+  AmMutex mut;
+  for(unsigned int i=0; i<order.size(); i+=RING_BENCH_BURST) {
+    for(unsigned int j=i; (j<i+RING_BENCH_BURST) && (j<order.size()); j++) {
+      AmRtpPacket* p = pkts[order[j]];
+      mut.lock();
+      m.insert(ts_map::value_type(p->timestamp,p));
+      mut.unlock();
+    }
+    while(true) {
+      mut.lock();
+      if(m.empty()) { mut.unlock(); break; }
+      m.erase(m.begin());
+      mut.unlock();
+    }
+  }
+  return order.size();
+}
+
+static unsigned int pass_ring()
+{
+  AmRtpReceiveRing ring;
+  unsigned int now_ms = 0;
+  for(unsigned int i=0; i<order.size(); i+=RING_BENCH_BURST) {
+    for(unsigned int j=i; (j<i+RING_BENCH_BURST) && (j<order.size()); j++)
+      ring.put(pkts[order[j]]);
+    while(ring.get(now_ms)) {}
+    now_ms += 20 * RING_BENCH_BURST;
+  }
+  return order.size();
+}
+
+void bench_rtp_ring(unsigned int min_ms, AmArg& res)
+{
+  // includes a sequence number wrap
+  for(unsigned int i=0; i<RING_BENCH_PACKETS; i++) {
+    AmRtpPacket* p = new AmRtpPacket(pkt_buf,sizeof(pkt_buf));
+    p->sequence = 65000 + i;
+    p->timestamp = 160 * i;
+    pkts.push_back(p);
+  }
+
+  set_arrival_order(0,0);
+  measure("rtp_recv_map_in_order",pass_map,min_ms,res);
+  measure("rtp_recv_ring_in_order",pass_ring,min_ms,res);
+
+  // every 10th pair swapped
+  set_arrival_order(10,0);
+  measure("rtp_recv_map_reordered",pass_map,min_ms,res);
+  measure("rtp_recv_ring_reordered",pass_ring,min_ms,res);
+
+  // ...and every 20th packet lost
+  set_arrival_order(10,20);
+  measure("rtp_recv_map_lossy",pass_map,min_ms,res);
+  measure("rtp_recv_ring_lossy",pass_ring,min_ms,res);
+
+  for(unsigned int i=0; i<pkts.size(); i++)
+    delete pkts[i];
+  pkts.clear();
+}
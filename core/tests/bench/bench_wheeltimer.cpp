@@ -0,0 +1,148 @@
+/*
+ * Wheel timer: insertion and removal of long-living timers from
+ * several threads, and the firing jitter of short timers meanwhile.
+ */
+
+#include "sems_bench.h"
+
+#include "sip/wheeltimer.h"
+#include "AmThread.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+using std::vector;
+
+#define WT_BENCH_THREADS 4
+#define WT_BENCH_LIVE    30000 // per thread
+#define WT_BENCH_JITTER  2000
+
+static atomic_int timers_fired;
+static atomic_int timers_deleted;
+
+struct bench_timer
+  : public timer
+{
+  double fired_at;
+
+  bench_timer(unsigned int expires)
+    : timer(expires), fired_at(0) {}
+
+  ~bench_timer() { timers_deleted.inc(); }
+
+  void fire() {
+    fired_at = now_us() / 1000.0;
+    timers_fired.inc();
+  }
+};
+
+/** inserts (and removes) timers from its own thread */
+class timer_load_thread
+  : public AmThread
+{
+  unsigned int n;
+  unsigned int first_tick;
+
+public:
+  vector<bench_timer*> timers;
+  double insert_us;
+  double remove_us;
+
+  timer_load_thread(unsigned int _n, unsigned int _first_tick)
+    : n(_n), first_tick(_first_tick), insert_us(0), remove_us(0) {}
+
+  void run() {
+    _wheeltimer* wt = wheeltimer::instance();
+    timers.reserve(n);
+
+    double start = now_us();
+    for(unsigned int i=0; i<n; i++) {
+      bench_timer* t = new bench_timer(wt->wall_clock + first_tick + i % 256);
+      timers.push_back(t);
+      wt->insert_timer(t);
+    }
+    insert_us = now_us() - start;
+  }
+
+  void remove_all() {
+    _wheeltimer* wt = wheeltimer::instance();
+    double start = now_us();
+    for(unsigned int i=0; i<timers.size(); i++)
+      wt->remove_timer(timers[i]);
+    remove_us = now_us() - start;
+  }
+
+  void on_stop() {}
+};
+
+void bench_wheeltimer(unsigned int min_ms, AmArg& res)
+{
+  _wheeltimer* wt = wheeltimer::instance();
+  wt->start();
+
+  // long-living timers (> 100k in total)
+  vector<timer_load_thread*> threads;
+  for(unsigned int i=0; i<WT_BENCH_THREADS; i++) {
+    threads.push_back(new timer_load_thread(WT_BENCH_LIVE, 10000));
+    threads.back()->start();
+  }
+  for(unsigned int i=0; i<WT_BENCH_THREADS; i++)
+    threads[i]->join();
+
+  double insert_us = 0;
+  for(unsigned int i=0; i<WT_BENCH_THREADS; i++)
+    insert_us += threads[i]->insert_us;
+
+  // short timers, firing over the next ~25 ticks
+  vector<bench_timer*> short_timers;
+  unsigned int first = wt->wall_clock + 2;
+  for(unsigned int i=0; i<WT_BENCH_JITTER; i++) {
+    short_timers.push_back(new bench_timer(first + i % 25));
+    wt->insert_timer(short_timers.back());
+  }
+  if(!wait_for(timers_fired,WT_BENCH_JITTER,5000)) {
+    fprintf(stderr,"wheeltimer: %i out of %u timers fired\n",
+	    timers_fired.get(),WT_BENCH_JITTER);
+  }
+
+  // jitter relative to the first timer that fired
+  double t0 = 0;
+  for(unsigned int i=0; i<WT_BENCH_JITTER; i++) {
+    if(short_timers[i]->expires == first) {
+      t0 = short_timers[i]->fired_at;
+      break;
+    }
+  }
+
+  double max_jitter = 0, sum_jitter = 0;
+  for(unsigned int i=0; i<WT_BENCH_JITTER; i++) {
+    double nominal = t0 + (short_timers[i]->expires - first)
+      * (TIMER_RESOLUTION / 1000.0);
+    double j = fabs(short_timers[i]->fired_at - nominal);
+    sum_jitter += j;
+    if(j > max_jitter) max_jitter = j;
+    wt->remove_timer(short_timers[i]);
+  }
+
+  double remove_us = 0;
+  for(unsigned int i=0; i<WT_BENCH_THREADS; i++) {
+    threads[i]->remove_all();
+    remove_us += threads[i]->remove_us;
+  }
+  if(!wait_for(timers_deleted,WT_BENCH_JITTER + WT_BENCH_THREADS * WT_BENCH_LIVE,
+	       5000)) {
+    fprintf(stderr,"wheeltimer: not all timers deleted\n");
+  }
+
+  for(unsigned int i=0; i<WT_BENCH_THREADS; i++)
+    delete threads[i];
+
+  unsigned int n_ops = WT_BENCH_THREADS * WT_BENCH_LIVE;
+  AmArg& r = res["wheeltimer"];
+  r["live_timers"] = (int)n_ops;
+  r["insert_per_sec"] = n_ops * 1e6 / insert_us;
+  r["remove_per_sec"] = n_ops * 1e6 / remove_us;
+  r["jitter_avg_ms"] = sum_jitter / WT_BENCH_JITTER;
+  r["jitter_max_ms"] = max_jitter;
+}
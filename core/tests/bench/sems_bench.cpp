@@ -0,0 +1,702 @@
+/*
+ * Parser and transaction matching benchmark.
+ *
+ * Runs the SIP/SDP/URI/MIME parsers and the transaction matching
+ * over a corpus of recorded messages (one message per '*.sip' file,
+ * SDP bodies are also read from '*.sdp' files), and prints the
+ * results as JSON, so that they can be compared between releases:
+ *
+ *   sems_bench [-c <corpus dir>] [-t <min. ms per benchmark>]
+ *
+ * The DSM benchmark runs the events of a call through a small IVR
+ * chart (DSM core module actions and conditions only).
+ *
+ * The benchmarks of other modules are in bench_*.cpp.
+ *
+ * With '-f <iterations>', randomly mutated corpus messages are fed
+ * to the parsers instead (fuzzing), '-s <seed>' makes a run
+ * reproducible. Inputs making a parser throw are saved to
+ * 'fuzz-<seed>-<iteration>.sip' in the current directory.
+ */
+
+#include "sems_bench.h"
+
+#include "sip/sip_parser.h"
+#include "sip/parse_header.h"
+#include "sip/parse_cseq.h"
+#include "sip/parse_via.h"
+#include "sip/trans_table.h"
+#include "sip/msg_arena.h"
+
+#include "AmSdp.h"
+#include "AmUriParser.h"
+#include "AmMimeBody.h"
+#include "AmArg.h"
+#include "AmUtils.h"
+#include "jsonArg.h"
+#include "log.h"
+
+#include "../../../apps/dsm/DSMSession.h"
+#include "../../../apps/dsm/DSMStateEngine.h"
+#include "../../../apps/dsm/DSMChartReader.h"
+
+#include <sys/time.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <new>
+#include <exception>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+using std::string;
+using std::vector;
+
+//
+// Heap allocations of the whole process
+//
+
+static unsigned long n_allocs = 0;
+
+#if __cplusplus >= 201103L
+#define BENCH_THROW_BAD_ALLOC
+#define BENCH_NOTHROW noexcept
+#else
+#define BENCH_THROW_BAD_ALLOC throw(std::bad_alloc)
+#define BENCH_NOTHROW throw()
+#endif
+
+void* operator new(size_t size) BENCH_THROW_BAD_ALLOC
+{
+  n_allocs++;
+  void* p = malloc(size ? size : 1);
+  if(!p) throw std::bad_alloc();
+  return p;
+}
+
+void* operator new[](size_t size) BENCH_THROW_BAD_ALLOC
+{
+  n_allocs++;
+  void* p = malloc(size ? size : 1);
+  if(!p) throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void* p) BENCH_NOTHROW
+{
+  free(p);
+}
+
+void operator delete[](void* p) BENCH_NOTHROW
+{
+  free(p);
+}
+
+//
+// Corpus
+//
+
+struct corpus_msg
+{
+  string name;
+  string data;
+
+  // extracted once from the parsed message
+  string content_type;
+  string body;
+  vector<string> nameaddrs;
+  bool is_request;
+  bool is_ack;
+};
+
+static vector<corpus_msg> msgs;
+static vector<string>     sdps;
+
+static bool read_file(const string& path, string& data)
+{
+  std::ifstream f(path.c_str(), std::ios::in | std::ios::binary);
+  if(!f.good())
+    return false;
+
+  std::ostringstream ss;
+  ss << f.rdbuf();
+  data = ss.str();
+  return true;
+}
+
+static bool ends_with(const string& s, const string& suffix)
+{
+  return (s.length() >= suffix.length()) &&
+    !s.compare(s.length() - suffix.length(), suffix.length(), suffix);
+}
+
+static int load_corpus(const string& dir)
+{
+  DIR* d = opendir(dir.c_str());
+  if(!d) {
+    fprintf(stderr,"could not open corpus directory '%s'\n",dir.c_str());
+    return -1;
+  }
+
+  struct dirent* e;
+  while((e = readdir(d)) != NULL) {
+
+    string name = e->d_name;
+    string data;
+    if(!ends_with(name,".sip") && !ends_with(name,".sdp"))
+      continue;
+
+    if(!read_file(dir + "/" + name,data)) {
+      fprintf(stderr,"could not read '%s'\n",name.c_str());
+      continue;
+    }
+
+    if(ends_with(name,".sdp")) {
+      sdps.push_back(data);
+      continue;
+    }
+
+    sip_msg msg(data.c_str(),data.length());
+    char* err_msg = NULL;
+    if(parse_sip_msg(&msg,err_msg)) {
+      fprintf(stderr,"could not parse '%s': %s\n",name.c_str(),err_msg);
+      continue;
+    }
+
+    corpus_msg m;
+    m.name = name;
+    m.data = data;
+    m.is_request = (msg.type == SIP_REQUEST);
+    m.is_ack = m.is_request && (msg.u.request->method == sip_request::ACK);
+    m.body = c2stlstr(msg.body);
+    if(msg.content_type)
+      m.content_type = c2stlstr(msg.content_type->value);
+
+    m.nameaddrs.push_back(c2stlstr(msg.from->value));
+    m.nameaddrs.push_back(c2stlstr(msg.to->value));
+    for(list<sip_header*>::iterator it = msg.contacts.begin();
+	it != msg.contacts.end(); ++it) {
+      m.nameaddrs.push_back(c2stlstr((*it)->value));
+    }
+
+    if(m.content_type == "application/sdp")
+      sdps.push_back(m.body);
+
+    msgs.push_back(m);
+  }
+
+  closedir(d);
+  return msgs.empty() ? -1 : 0;
+}
+
+//
+// Benchmarks: one pass over the corpus,
+// returning the number of items processed.
+//
+
+static unsigned int pass_parse_sip_msg()
+{
+  for(unsigned int i=0; i<msgs.size(); i++) {
+    sip_msg* msg = new sip_msg(msgs[i].data.c_str(),msgs[i].data.length());
+    char* err_msg = NULL;
+    parse_sip_msg(msg,err_msg);
+    delete msg;
+  }
+  return msgs.size();
+}
+
+/** arena usage per parsed message */
+static void arena_stats(AmArg& res)
+{
+  unsigned long objs = 0, chunks = 0, used = 0;
+  for(unsigned int i=0; i<msgs.size(); i++) {
+    sip_msg msg(msgs[i].data.c_str(),msgs[i].data.length());
+    char* err_msg = NULL;
+    parse_sip_msg(&msg,err_msg);
+    objs += msg.arena.get_allocs();
+    chunks += msg.arena.get_chunks();
+    used += msg.arena.get_used();
+  }
+
+  AmArg& r = res["parse_sip_msg"];
+  r["arena_objects"] = (double)objs / msgs.size();
+  r["arena_chunks"] = (double)chunks / msgs.size();
+  r["arena_bytes"] = (double)used / msgs.size();
+}
+
+static unsigned int pass_sdp_parse()
+{
+  for(unsigned int i=0; i<sdps.size(); i++) {
+    AmSdp sdp;
+    sdp.parse(sdps[i].c_str());
+  }
+  return sdps.size();
+}
+
+static unsigned int pass_uri_parse()
+{
+  unsigned int n = 0;
+  for(unsigned int i=0; i<msgs.size(); i++) {
+    const vector<string>& na = msgs[i].nameaddrs;
+    for(unsigned int j=0; j<na.size(); j++) {
+      AmUriParser p;
+      size_t end;
+      p.parse_contact(na[j],0,end);
+      n++;
+    }
+  }
+  return n;
+}
+
+static unsigned int pass_mime_parse()
+{
+  unsigned int n = 0;
+  for(unsigned int i=0; i<msgs.size(); i++) {
+    if(msgs[i].body.empty())
+      continue;
+
+    AmMimeBody body;
+    body.parse(msgs[i].content_type,
+	       (const unsigned char*)msgs[i].body.c_str(),
+	       msgs[i].body.length());
+    n++;
+  }
+  return n;
+}
+
+//
+// Transaction matching: the table is filled with UAS
+// transactions for 'TRANS_COPIES' variants of every request,
+// which are then matched as retransmissions.
+//
+
+#define TRANS_COPIES 2000
+
+static vector<sip_msg*>   retrans;
+static vector<sip_trans*> trans;
+
+/** appends '-<n>' to the Call-ID and to the top Via branch */
+static string make_variant(const string& data, unsigned int n)
+{
+  string res = data;
+  string suffix = "-" + int2str(n);
+
+  size_t pos = res.find("\r\nCall-ID:");
+  if(pos != string::npos) {
+    pos = res.find("\r\n",pos + 2);
+    res.insert(pos,suffix);
+  }
+
+  pos = res.find("branch=");
+  if(pos != string::npos) {
+    pos = res.find_first_of(";\r ,",pos);
+    res.insert(pos,suffix);
+  }
+
+  return res;
+}
+
+static sip_msg* parse_variant(const corpus_msg& m, unsigned int n)
+{
+  string data = make_variant(m.data,n);
+  sip_msg* msg = new sip_msg(data.c_str(),data.length());
+  char* err_msg = NULL;
+  if(parse_sip_msg(msg,err_msg)) {
+    delete msg;
+    return NULL;
+  }
+  return msg;
+}
+
+static void setup_trans_match()
+{
+  for(unsigned int n=0; n<TRANS_COPIES; n++) {
+    for(unsigned int i=0; i<msgs.size(); i++) {
+
+      if(!msgs[i].is_request || msgs[i].is_ack)
+	continue;
+
+      sip_msg* msg = parse_variant(msgs[i],n);
+      sip_msg* rt = parse_variant(msgs[i],n);
+      if(!msg || !rt) {
+	delete msg;
+	delete rt;
+	continue;
+      }
+
+      trans_bucket* bucket =
+	get_trans_bucket(msg->callid->value,get_cseq(msg)->num_str);
+      bucket->lock();
+      trans.push_back(bucket->add_trans(msg,TT_UAS));
+      bucket->unlock();
+
+      retrans.push_back(rt);
+    }
+  }
+}
+
+static void cleanup_trans_match()
+{
+  for(unsigned int i=0; i<trans.size(); i++) {
+    sip_msg* msg = trans[i]->msg;
+    trans_bucket* bucket =
+      get_trans_bucket(msg->callid->value,get_cseq(msg)->num_str);
+    bucket->lock();
+    bucket->remove(trans[i]);
+    bucket->unlock();
+  }
+  trans.clear();
+
+  for(unsigned int i=0; i<retrans.size(); i++)
+    delete retrans[i];
+  retrans.clear();
+}
+
+static unsigned int pass_trans_match()
+{
+  unsigned int matched = 0;
+  for(unsigned int i=0; i<retrans.size(); i++) {
+    sip_msg* msg = retrans[i];
+    unsigned int h = hash(msg->callid->value,get_cseq(msg)->num_str);
+    trans_bucket* bucket = get_trans_bucket(h);
+    bucket->lock();
+    if(bucket->match_request(msg,TT_UAS) == trans[i])
+      matched++;
+    bucket->unlock();
+  }
+
+  if(matched != retrans.size()) {
+    fprintf(stderr,"trans_match: %u out of %u retransmissions matched\n",
+	    matched,(unsigned int)retrans.size());
+  }
+  return retrans.size();
+}
+
+//
+// DSM: the events of one call through an IVR chart
+//
+
+static const char* dsm_chart =
+  "initial state START;\n"
+  "state MENU enter { set($menu=main); };\n"
+  "state PIN;\n"
+  "state DONE;\n"
+  "\n"
+  "transition \"start\" START - / {\n"
+  "  clear($pin);\n"
+  "  set($tries=0);\n"
+  "  set($caller=@user);\n"
+  "} -> MENU;\n"
+  "\n"
+  "transition \"enter pin\" MENU - keyTest(#key == 1) -> PIN;\n"
+  "transition \"repeat\" MENU - keyTest(#key == 9) / eval($tries = $tries + 1) -> MENU;\n"
+  "transition \"other key\" MENU - keyTest(#key > 1) -> MENU;\n"
+  "\n"
+  "transition \"add digit\" PIN - keyTest(#key < 10) / {\n"
+  "  append($pin, #key);\n"
+  "  if test(len($pin) > 3) {\n"
+  "    set($pin_complete=yes);\n"
+  "  } else {\n"
+  "    set($pin_complete=no);\n"
+  "  }\n"
+  "} -> PIN;\n"
+  "\n"
+  "transition \"check pin\" PIN - keyTest(#key == 11) / {\n"
+  "  if test($pin == 1234) {\n"
+  "    set($valid=1);\n"
+  "  } else {\n"
+  "    eval($tries = $tries + 1);\n"
+  "  }\n"
+  "  clear($pin);\n"
+  "} -> MENU;\n"
+  "\n"
+  "transition \"status\" (MENU, PIN) - eventTest(#cmd == status) / {\n"
+  "  set($last_cmd=#cmd);\n"
+  "  set(#result=$pin_complete);\n"
+  "  log(5, $tries);\n"
+  "} -> MENU;\n"
+  "\n"
+  "transition \"bye\" (START, MENU, PIN, DONE) - hangup / set($done=1) -> DONE;\n";
+
+/** no media, only the variables */
+class BenchDSMSession
+  : public DSMSession
+{
+public:
+  void playPrompt(const string& name, bool loop, bool front) {}
+  void playFile(const string& name, bool loop, bool front) {}
+  void playSilence(unsigned int length, bool front) {}
+  void playRingtone(int length, int on, int off, int f, int f2, bool front) {}
+  void recordFile(const string& name) {}
+  unsigned int getRecordLength() { return 0; }
+  unsigned int getRecordDataSize() { return 0; }
+  void stopRecord() {}
+  void setInOutPlaylist() {}
+  void setInputPlaylist() {}
+  void setOutputPlaylist() {}
+  void addToPlaylist(AmPlaylistItem* item, bool front) {}
+  void flushPlaylist() {}
+  void setPromptSet(const string& name) {}
+  void addSeparator(const string& name, bool front) {}
+  void connectMedia() {}
+  void disconnectMedia() {}
+  void mute() {}
+  void unmute() {}
+  void B2BconnectCallee(const string& remote_party, const string& remote_uri,
+			bool relayed_invite) {}
+  void B2BterminateOtherLeg() {}
+  void B2BaddReceivedRequest(const AmSipRequest& req) {}
+  void B2BsetRelayEarlyMediaSDP(bool enabled) {}
+  void B2BsetHeaders(const string& hdr, bool replaceCRLF) {}
+  void B2BclearHeaders() {}
+  void B2BaddHeader(const string& hdr) {}
+  void B2BremoveHeader(const string& hdr) {}
+  void transferOwnership(DSMDisposable* d) {}
+  void releaseOwnership(DSMDisposable* d) {}
+};
+
+static DSMElemContainer dsm_elems;
+static DSMStateDiagram* dsm_diag = NULL;
+static AmSession*       dsm_sess = NULL;
+
+static bool setup_dsm()
+{
+  dsm_diag = new DSMStateDiagram("ivr");
+  DSMChartReader reader;
+  vector<DSMModule*> mods;
+  if(!reader.decode(dsm_diag,dsm_chart,"",&dsm_elems,mods)) {
+    fprintf(stderr,"dsm: error reading the chart\n");
+    return false;
+  }
+
+  string report;
+  if(!dsm_diag->checkConsistency(report)) {
+    fprintf(stderr,"dsm: chart not consistent: %s\n",report.c_str());
+    return false;
+  }
+
+  dsm_sess = new AmSession();
+  dsm_sess->dlg->setUser("bench");
+  return true;
+}
+
+static void cleanup_dsm()
+{
+  delete dsm_sess;
+  delete dsm_diag;
+}
+
+static void dsm_key(DSMStateEngine& engine, BenchDSMSession& sc_sess, int key)
+{
+  map<string,string> params;
+  params["key"] = int2str(key);
+  params["duration"] = "100";
+  engine.runEvent(dsm_sess,&sc_sess,DSMCondition::Key,&params);
+}
+
+static unsigned int pass_dsm_events()
+{
+  BenchDSMSession sc_sess;
+  DSMStateEngine engine;
+  engine.addDiagram(dsm_diag);
+  engine.init(dsm_sess,&sc_sess,"ivr",DSMCondition::Start);
+  unsigned int events = 1;
+
+  // repeat, wrong PIN, status, correct PIN
+  const int keys[] = { 9, 5, 1, 4, 3, 2, 1, 11, 1, 1, 2, 3, 4, 11 };
+  for(unsigned int i=0; i<sizeof(keys)/sizeof(keys[0]); i++) {
+    dsm_key(engine,sc_sess,keys[i]);
+    events++;
+
+    if(i == 7) {
+      map<string,string> params;
+      params["cmd"] = "status";
+      engine.runEvent(dsm_sess,&sc_sess,DSMCondition::DSMEvent,&params);
+      events++;
+    }
+  }
+
+  engine.runEvent(dsm_sess,&sc_sess,DSMCondition::Hangup,NULL);
+  events++;
+
+  if((sc_sess.var["valid"] != "1") || (sc_sess.var["tries"] != "2") ||
+     (sc_sess.var["done"] != "1")) {
+    fprintf(stderr,"dsm: unexpected result (valid=%s, tries=%s, done=%s)\n",
+	    sc_sess.var["valid"].c_str(),sc_sess.var["tries"].c_str(),
+	    sc_sess.var["done"].c_str());
+  }
+  return events;
+}
+
+//
+// Driver
+//
+
+void measure(const char* name, bench_pass f, unsigned int min_ms, AmArg& res)
+{
+  // warm-up
+  f();
+
+  unsigned long items = 0;
+  unsigned long allocs = n_allocs;
+  double start = now_us();
+  double elapsed = 0;
+
+  do {
+    items += f();
+    elapsed = now_us() - start;
+  } while(elapsed < min_ms * 1000.0);
+
+  allocs = n_allocs - allocs;
+
+  AmArg& r = res[name];
+  r["items"] = (int)items;
+  if(!items) return;
+
+  r["per_sec"] = items * 1e6 / elapsed;
+  r["ns_per_item"] = elapsed * 1000.0 / items;
+  r["allocs_per_item"] = (double)allocs / items;
+}
+
+/** keeps an input which made a parser throw, for the corpus */
+static void save_crash(const string& data, unsigned int seed, unsigned int i)
+{
+  string name = "fuzz-" + int2str(seed) + "-" + int2str(i) + ".sip";
+  std::ofstream f(name.c_str(), std::ios::out | std::ios::binary);
+  f << data;
+  fprintf(stderr,"exception while parsing, input saved to '%s'\n",
+	  name.c_str());
+}
+
+static void fuzz(unsigned int iterations, unsigned int seed, AmArg& res)
+{
+  unsigned int parsed = 0;
+  unsigned int rejected = 0;
+  unsigned int sdp_parsed = 0;
+  unsigned int exceptions = 0;
+
+  srand(seed);
+  for(unsigned int i=0; i<iterations; i++) {
+
+    string data = msgs[rand() % msgs.size()].data;
+
+    // a few random bytes, sometimes truncated
+    unsigned int n = 1 + rand() % 8;
+    for(unsigned int j=0; j<n; j++)
+      data[rand() % data.length()] = (char)(rand() & 0xFF);
+    if(!(rand() % 8))
+      data.resize(rand() % data.length());
+
+    try {
+      sip_msg msg(data.c_str(),data.length());
+      char* err_msg = NULL;
+      if(parse_sip_msg(&msg,err_msg)) {
+	rejected++;
+	continue;
+      }
+      parsed++;
+
+      if(msg.content_type && msg.body.len &&
+	 (c2stlstr(msg.content_type->value) == "application/sdp")) {
+	AmSdp sdp;
+	if(!sdp.parse(c2stlstr(msg.body).c_str()))
+	  sdp_parsed++;
+      }
+    }
+    catch(std::exception& e) {
+      exceptions++;
+      save_crash(data,seed,i);
+    }
+  }
+
+  AmArg& r = res["fuzz"];
+  r["seed"] = (int)seed;
+  r["iterations"] = (int)iterations;
+  r["parsed"] = (int)parsed;
+  r["rejected"] = (int)rejected;
+  r["sdp_parsed"] = (int)sdp_parsed;
+  r["exceptions"] = (int)exceptions;
+}
+
+static void usage(const char* prog)
+{
+  fprintf(stderr,
+	  "usage: %s [-c <corpus dir>] [-t <min. ms per benchmark>]\n"
+	  "       %s [-c <corpus dir>] -f <iterations> [-s <seed>]\n",
+	  prog,prog);
+}
+
+int main(int argc, char** argv)
+{
+  string corpus_dir = "bench/corpus";
+  unsigned int min_ms = 500;
+  unsigned int fuzz_iterations = 0;
+  unsigned int seed = time(NULL);
+
+  int c;
+  while((c = getopt(argc,argv,"c:t:f:s:h")) != -1) {
+    switch(c) {
+    case 'c': corpus_dir = optarg; break;
+    case 't': min_ms = atoi(optarg); break;
+    case 'f': fuzz_iterations = atoi(optarg); break;
+    case 's': seed = atoi(optarg); break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  init_logging();
+  log_stderr = true;
+  log_level = fuzz_iterations ? -1 : L_ERR;
+
+  if(load_corpus(corpus_dir) < 0)
+    return 1;
+
+  AmArg res;
+  res["corpus"]["messages"] = (int)msgs.size();
+  res["corpus"]["sdp_bodies"] = (int)sdps.size();
+
+  if(fuzz_iterations) {
+    fuzz(fuzz_iterations,seed,res);
+  }
+  else {
+    measure("parse_sip_msg",pass_parse_sip_msg,min_ms,res);
+    arena_stats(res);
+    measure("sdp_parse",pass_sdp_parse,min_ms,res);
+    measure("uri_parse",pass_uri_parse,min_ms,res);
+    measure("mime_parse",pass_mime_parse,min_ms,res);
+
+    setup_trans_match();
+    res["trans_match"]["transactions"] = (int)trans.size();
+    measure("trans_match",pass_trans_match,min_ms,res);
+    cleanup_trans_match();
+
+    if(setup_dsm()) {
+      measure("dsm_events",pass_dsm_events,min_ms,res);
+      AmArg stats;
+      dsm_diag->getStats(stats);
+      res["dsm_events"]["conditions_per_event"] = stats["conditions_per_event"];
+    }
+    cleanup_dsm();
+
+    bench_rtp_ring(min_ms,res);
+    bench_wheeltimer(min_ms,res);
+    bench_event_dispatcher(min_ms,res);
+    bench_mixer(min_ms,res);
+    bench_log_ring(min_ms,res);
+    bench_param_replacer(min_ms,res);
+    bench_reg_cache_storage(min_ms,res);
+    bench_regex_mapper(min_ms,res);
+    bench_app_timer(min_ms,res);
+  }
+
+  printf("%s\n",arg2json(res).c_str());
+  return 0;
+}
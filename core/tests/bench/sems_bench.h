@@ -0,0 +1,28 @@
+#ifndef _sems_bench_h_
+#define _sems_bench_h_
+
+#include "AmArg.h"
+
+#include "../test_util.h"
+
+/** one benchmark pass, returning the number of items processed */
+typedef unsigned int (*bench_pass)();
+
+/**
+ * Runs f for at least min_ms (after a warm-up pass), and stores
+ * items, per_sec, ns_per_item and allocs_per_item in res[name].
+ */
+void measure(const char* name, bench_pass f, unsigned int min_ms, AmArg& res);
+
+// benchmarks of the other modules (bench_*.cpp)
+void bench_rtp_ring(unsigned int min_ms, AmArg& res);
+void bench_wheeltimer(unsigned int min_ms, AmArg& res);
+void bench_event_dispatcher(unsigned int min_ms, AmArg& res);
+void bench_mixer(unsigned int min_ms, AmArg& res);
+void bench_log_ring(unsigned int min_ms, AmArg& res);
+void bench_param_replacer(unsigned int min_ms, AmArg& res);
+void bench_reg_cache_storage(unsigned int min_ms, AmArg& res);
+void bench_regex_mapper(unsigned int min_ms, AmArg& res);
+void bench_app_timer(unsigned int min_ms, AmArg& res);
+
+#endif
@@ -15,6 +15,8 @@
 #include "AmSipMsg.h"
 #include "AmSipHeaders.h"
 
+#include <event2/thread.h>
+
 #include "fct.h"
 
 FCT_BGN() {
@@ -22,12 +24,34 @@ FCT_BGN() {
   log_stderr=true;
   log_level=3;
 
+  // as in sems.cpp: event loops are woken up from other threads
+  evthread_use_pthreads();
+
   FCTMF_SUITE_CALL(test_sdp);
   FCTMF_SUITE_CALL(test_auth);
   FCTMF_SUITE_CALL(test_headers);
   FCTMF_SUITE_CALL(test_uriparser);
   FCTMF_SUITE_CALL(test_jsonarg);
   FCTMF_SUITE_CALL(test_replaces);
+  FCTMF_SUITE_CALL(test_resolver);
+  FCTMF_SUITE_CALL(test_rtp_pool);
+  FCTMF_SUITE_CALL(test_rtp_ring);
+  FCTMF_SUITE_CALL(test_wheeltimer);
+  FCTMF_SUITE_CALL(test_trans_table);
+  FCTMF_SUITE_CALL(test_msg_arena);
+  FCTMF_SUITE_CALL(test_event_dispatcher);
+  FCTMF_SUITE_CALL(test_media_tick);
+  FCTMF_SUITE_CALL(test_mixer);
+  FCTMF_SUITE_CALL(test_log_ring);
+  FCTMF_SUITE_CALL(test_param_replacer);
+  FCTMF_SUITE_CALL(test_reg_cache_storage);
+  FCTMF_SUITE_CALL(test_regex_mapper);
+  FCTMF_SUITE_CALL(test_call_registry);
+  FCTMF_SUITE_CALL(test_rtcp);
+  FCTMF_SUITE_CALL(test_rtp_recv_stats);
+  FCTMF_SUITE_CALL(test_app_timer);
+  FCTMF_SUITE_CALL(test_db_reg_status);
+  FCTMF_SUITE_CALL(test_dsm);
 } FCT_END();
 
 
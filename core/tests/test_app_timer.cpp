@@ -0,0 +1,87 @@
+#include "fct.h"
+
+#include "log.h"
+
+#include "AmAppTimer.h"
+#include "AmEventDispatcher.h"
+#include "AmEvent.h"
+
+#include <unistd.h>
+
+#include "test_util.h"
+
+/**
+ * Counts the timeout events posted (from the timer thread).
+ */
+struct timeout_queue
+  : public AmEventQueueInterface
+{
+  atomic_int events;
+  atomic_int last_id;
+
+  void postEvent(AmEvent* ev) {
+    AmPluginEvent* p = dynamic_cast<AmPluginEvent*>(ev);
+    if(p && (p->name == TIMEOUTEVENT_NAME))
+      last_id.set(p->data.get(0).asInt());
+    events.inc();
+    delete ev;
+  }
+};
+
+FCTMF_SUITE_BGN(test_app_timer) {
+
+    static bool started = false;
+    if(!started) {
+      AmAppTimer::instance()->start();
+      started = true;
+    }
+
+    FCT_TEST_BGN(app_timer_fire) {
+      timeout_queue q;
+      fct_chk(AmEventDispatcher::instance()->addEventQueue("at-tag-1",&q));
+
+      AmAppTimerQueue timers;
+      AmAppTimer::instance()->setTimer(&timers,"at-tag-1",7,0.05);
+      fct_chk(wait_for(q.events,1,1000));
+      fct_chk(q.last_id.get() == 7);
+
+      // fired timers are gone
+      usleep(3 * TIMER_RESOLUTION);
+      fct_chk(q.events.get() == 1);
+      AmAppTimer::instance()->removeTimer(&timers,7);
+
+      AmEventDispatcher::instance()->delEventQueue("at-tag-1");
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(app_timer_reset_remove) {
+      timeout_queue q;
+      fct_chk(AmEventDispatcher::instance()->addEventQueue("at-tag-2",&q));
+      _AmAppTimer* at = AmAppTimer::instance();
+
+      // reset: only the new timeout fires
+      AmAppTimerQueue timers;
+      at->setTimer(&timers,"at-tag-2",1,0.05);
+      at->setTimer(&timers,"at-tag-2",1,0.3);
+      usleep(150000);
+      fct_chk(q.events.get() == 0);
+      fct_chk(wait_for(q.events,1,1000));
+
+      // removed, one by one and all at once
+      at->setTimer(&timers,"at-tag-2",2,0.05);
+      at->setTimer(&timers,"at-tag-2",3,0.05);
+      at->setTimer(&timers,"at-tag-2",4,0.05);
+      at->removeTimer(&timers,2);
+      at->removeTimers(&timers);
+
+      // destroyed with a pending timer
+      AmAppTimerQueue* tmp = new AmAppTimerQueue();
+      at->setTimer(tmp,"at-tag-2",5,0.05);
+      delete tmp;
+
+      usleep(200000);
+      fct_chk(q.events.get() == 1);
+
+      AmEventDispatcher::instance()->delEventQueue("at-tag-2");
+    } FCT_TEST_END();
+
+} FCTMF_SUITE_END();
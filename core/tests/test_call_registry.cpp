@@ -0,0 +1,126 @@
+#include "fct.h"
+
+#include "log.h"
+#include "AmThread.h"
+#include "AmUtils.h"
+
+#include "../../apps/sbc/SBCCallRegistry.h"
+
+#include "test_util.h"
+
+#define STRESS_THREADS 8
+#define STRESS_CALLS   20000
+
+/**
+ * Starts and stops calls (two legs each), as call legs do,
+ * and looks up the calls of the other threads meanwhile.
+ */
+class CallRegistryStress
+  : public AmThread
+{
+  unsigned int id;
+
+public:
+  unsigned int errors;
+  unsigned int found_others;
+
+  CallRegistryStress(unsigned int id)
+    : id(id), errors(0), found_others(0)
+  {}
+
+  void run() {
+    SBCCallRegistryEntry e;
+    for (unsigned int i=0; i<STRESS_CALLS; i++) {
+      string n = int2str(id) + "-" + int2str(i);
+      string a_tag = "a" + n, b_tag = "b" + n, callid = "c" + n;
+
+      SBCCallRegistry::addCall(a_tag, SBCCallRegistryEntry(callid, b_tag, ""));
+      SBCCallRegistry::addCall(b_tag, SBCCallRegistryEntry(callid, a_tag, ""));
+      SBCCallRegistry::updateCall(a_tag, "r" + n);
+
+      if (!SBCCallRegistry::lookupCall(a_tag, e) ||
+	  (e.ltag != b_tag) || (e.rtag != "r" + n) || (e.callid != callid))
+	errors++;
+
+      // some call of another thread
+      string other = "a" + int2str((id + 1) % STRESS_THREADS) + "-" + int2str(i);
+      if (SBCCallRegistry::lookupCall(other, e)) {
+	found_others++;
+	if (e.ltag != "b" + other.substr(1))
+	  errors++;
+      }
+
+      SBCCallRegistry::removeCall(a_tag);
+      SBCCallRegistry::removeCall(b_tag);
+
+      if (SBCCallRegistry::lookupCall(a_tag, e))
+	errors++;
+    }
+  }
+
+  void on_stop() {}
+};
+
+FCTMF_SUITE_BGN(test_call_registry) {
+
+    FCT_TEST_BGN(call_registry_basic) {
+      unsigned int size = SBCCallRegistry::getSize();
+      SBCCallRegistryEntry e;
+
+      SBCCallRegistry::addCall("ltag1", SBCCallRegistryEntry("cid", "ltag2", ""));
+      SBCCallRegistry::addCall("ltag1", SBCCallRegistryEntry("cid", "ltag3", ""));
+      fct_chk(SBCCallRegistry::getSize() == size + 1);
+
+      SBCCallRegistry::updateCall("ltag1", "rtag3");
+      SBCCallRegistry::updateCall("unknown", "rtag");
+      fct_chk(SBCCallRegistry::lookupCall("ltag1", e));
+      fct_chk(e.ltag == "ltag3" && e.rtag == "rtag3" && e.callid == "cid");
+      fct_chk(!SBCCallRegistry::lookupCall("unknown", e));
+
+      SBCCallRegistry::removeCall("ltag1");
+      SBCCallRegistry::removeCall("ltag1");
+      fct_chk(!SBCCallRegistry::lookupCall("ltag1", e));
+      fct_chk(SBCCallRegistry::getSize() == size);
+
+      AmArg stats;
+      SBCCallRegistry::getStats(stats);
+      fct_chk(stats["buckets"].asInt() == SBC_CALL_REGISTRY_BUCKETS);
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(call_registry_stress) {
+      unsigned int size = SBCCallRegistry::getSize();
+      unsigned int contended = SBCCallRegistry::getContended();
+
+      unsigned int errors = 0, found_others = 0;
+      double us;
+      {
+	// registry debug output would dominate
+	LogLevelScope lls;
+
+	CallRegistryStress* threads[STRESS_THREADS];
+	double start = now_us();
+	for (unsigned int i=0; i<STRESS_THREADS; i++) {
+	  threads[i] = new CallRegistryStress(i);
+	  threads[i]->start();
+	}
+
+	for (unsigned int i=0; i<STRESS_THREADS; i++) {
+	  threads[i]->join();
+	  errors += threads[i]->errors;
+	  found_others += threads[i]->found_others;
+	  delete threads[i];
+	}
+	us = now_us() - start;
+      }
+
+      fct_chk(errors == 0);
+      fct_chk(SBCCallRegistry::getSize() == size);
+
+      unsigned int ops = STRESS_THREADS * STRESS_CALLS * 8;
+      INFO("call registry stress: %u threads, %.0f ops/s, "
+	   "%u contended locks, %u calls of other threads found\n",
+	   STRESS_THREADS, ops * 1e6 / us,
+	   SBCCallRegistry::getContended() - contended, found_others);
+    } FCT_TEST_END();
+
+} FCTMF_SUITE_END();
@@ -0,0 +1,111 @@
+#include "fct.h"
+
+#include "log.h"
+#include "AmUtils.h"
+
+#include "../../apps/db_reg_agent/DBRegStatusUpdate.h"
+
+static DBRegStatusUpdate make_update(int code, bool status, bool ts, bool contacts)
+{
+  DBRegStatusUpdate u;
+  u.op = DBRegStatusUpdate::Update;
+  u.last_code = code;
+  u.last_reason = "reason " + int2str(code);
+  u.update_status = status;
+  u.status = code / 100;
+  u.update_ts = ts;
+  u.expiry = code;
+  u.ts = 1000 + code;
+  u.update_contacts = contacts;
+  u.contacts = "<sip:" + int2str(code) + "@example.com>";
+  return u;
+}
+
+static DBRegStatusUpdate make_op(DBRegStatusUpdate::Op op)
+{
+  DBRegStatusUpdate u;
+  u.op = op;
+  return u;
+}
+
+FCTMF_SUITE_BGN(test_db_reg_status) {
+
+    FCT_TEST_BGN(db_reg_status_merge_updates) {
+      // later columns win, columns not set later are kept
+      DBRegStatusUpdate u = make_update(200, true, true, false);
+      u.merge(make_update(408, false, false, true));
+      fct_chk(u.op == DBRegStatusUpdate::Update);
+      fct_chk(!u.recreate);
+      fct_chk(u.last_code == 408);
+      fct_chk(u.last_reason == "reason 408");
+      fct_chk(u.update_status && u.status == 2);
+      fct_chk(u.update_ts && u.expiry == 200 && u.ts == 1200);
+      fct_chk(u.update_contacts && u.contacts == "<sip:408@example.com>");
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(db_reg_status_merge_create) {
+      // create + update: upsert
+      DBRegStatusUpdate u = make_op(DBRegStatusUpdate::Create);
+      u.merge(make_update(200, true, false, false));
+      fct_chk(u.op == DBRegStatusUpdate::Update);
+      fct_chk(!u.recreate);
+      fct_chk(u.update_status && u.status == 2);
+
+      // update + create: the update creates the entry
+      u.merge(make_op(DBRegStatusUpdate::Create));
+      fct_chk(u.op == DBRegStatusUpdate::Update);
+      fct_chk(u.last_code == 200);
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(db_reg_status_merge_delete) {
+      DBRegStatusUpdate u = make_update(200, true, true, true);
+      u.merge(make_op(DBRegStatusUpdate::Delete));
+      fct_chk(u.op == DBRegStatusUpdate::Delete);
+      fct_chk(!u.recreate);
+      fct_chk(!u.update_status && !u.update_ts && !u.update_contacts);
+
+      // delete + update: the old entry is deleted, not updated
+      u.merge(make_update(401, false, false, true));
+      fct_chk(u.op == DBRegStatusUpdate::Update);
+      fct_chk(u.recreate);
+      fct_chk(u.last_code == 401);
+      fct_chk(!u.update_status && !u.update_ts);
+      fct_chk(u.update_contacts);
+
+      // ...also after more updates
+      u.merge(make_update(200, true, false, false));
+      fct_chk(u.recreate);
+      fct_chk(u.update_status && u.update_contacts && !u.update_ts);
+
+      // delete + create + update
+      DBRegStatusUpdate c = make_op(DBRegStatusUpdate::Delete);
+      c.merge(make_op(DBRegStatusUpdate::Create));
+      fct_chk(c.op == DBRegStatusUpdate::Create);
+      fct_chk(c.recreate);
+      c.merge(make_update(200, false, true, false));
+      fct_chk(c.op == DBRegStatusUpdate::Update);
+      fct_chk(c.recreate);
+      fct_chk(c.update_ts && !c.update_status);
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(db_reg_status_merge_requeued) {
+      // a failed update with a recreating change queued after it:
+      // nothing of the failed update is written
+      DBRegStatusUpdate failed = make_update(200, true, true, true);
+      DBRegStatusUpdate later = make_op(DBRegStatusUpdate::Delete);
+      later.merge(make_update(408, false, false, false));
+
+      failed.merge(later);
+      fct_chk(failed.op == DBRegStatusUpdate::Update);
+      fct_chk(failed.recreate);
+      fct_chk(failed.last_code == 408);
+      fct_chk(!failed.update_status && !failed.update_ts && !failed.update_contacts);
+
+      // a failed delete with an update queued after it
+      DBRegStatusUpdate d = make_op(DBRegStatusUpdate::Delete);
+      d.merge(make_update(200, true, false, false));
+      fct_chk(d.op == DBRegStatusUpdate::Update);
+      fct_chk(d.recreate);
+    } FCT_TEST_END();
+
+} FCTMF_SUITE_END();
@@ -0,0 +1,486 @@
+#include "fct.h"
+
+#include "log.h"
+#include "AmSession.h"
+#include "AmUtils.h"
+
+#include "../../apps/dsm/DSMSession.h"
+#include "../../apps/dsm/DSMModule.h"
+#include "../../apps/dsm/DSMCoreModule.h"
+#include "../../apps/dsm/DSMStateEngine.h"
+#include "../../apps/dsm/DSMChartReader.h"
+#include "../../apps/dsm/DSMStateDiagramCollection.h"
+
+#include <fstream>
+#include <unistd.h>
+
+/** no media, only the variables */
+class TestDSMSession
+  : public DSMSession
+{
+public:
+  void playPrompt(const string& name, bool loop, bool front) {}
+  void playFile(const string& name, bool loop, bool front) {}
+  void playSilence(unsigned int length, bool front) {}
+  void playRingtone(int length, int on, int off, int f, int f2, bool front) {}
+  void recordFile(const string& name) {}
+  unsigned int getRecordLength() { return 0; }
+  unsigned int getRecordDataSize() { return 0; }
+  void stopRecord() {}
+  void setInOutPlaylist() {}
+  void setInputPlaylist() {}
+  void setOutputPlaylist() {}
+  void addToPlaylist(AmPlaylistItem* item, bool front) {}
+  void flushPlaylist() {}
+  void setPromptSet(const string& name) {}
+  void addSeparator(const string& name, bool front) {}
+  void connectMedia() {}
+  void disconnectMedia() {}
+  void mute() {}
+  void unmute() {}
+  void B2BconnectCallee(const string& remote_party, const string& remote_uri,
+			bool relayed_invite) {}
+  void B2BterminateOtherLeg() {}
+  void B2BaddReceivedRequest(const AmSipRequest& req) {}
+  void B2BsetRelayEarlyMediaSDP(bool enabled) {}
+  void B2BsetHeaders(const string& hdr, bool replaceCRLF) {}
+  void B2BclearHeaders() {}
+  void B2BaddHeader(const string& hdr) {}
+  void B2BremoveHeader(const string& hdr) {}
+  void transferOwnership(DSMDisposable* d) {}
+  void releaseOwnership(DSMDisposable* d) {}
+};
+
+/** an argument as compiled by an action or condition */
+static string resolve(const string& s, AmSession* sess, DSMSession* sc_sess,
+		      map<string,string>* event_params, bool eval_ops = false)
+{
+  DSMArgRef ref;
+  ref.compile(s, eval_ops);
+  return ref.resolve(sess, sc_sess, event_params);
+}
+
+/** @return false if the action is not known */
+static bool run_action(const string& s, AmSession* sess, DSMSession* sc_sess,
+		       map<string,string>* event_params = NULL)
+{
+  DSMCoreModule core;
+  DSMAction* a = core.getAction(s);
+  if (!a)
+    return false;
+
+  a->execute(sess, sc_sess, DSMCondition::Any, event_params);
+  delete a;
+  return true;
+}
+
+static bool test_cond(const string& expr, AmSession* sess, DSMSession* sc_sess,
+		      map<string,string>* event_params = NULL)
+{
+  TestDSMCondition c(expr, DSMCondition::Any);
+  return c.match(sess, sc_sess, DSMCondition::Any, event_params);
+}
+
+static bool read_chart(DSMStateDiagram* diag, DSMElemContainer* elems,
+		       const string& chart)
+{
+  DSMChartReader reader;
+  vector<DSMModule*> mods;
+  return reader.decode(diag, chart, "", elems, mods);
+}
+
+/** names of the transitions of the state which may match the event */
+static string candidates(DSMStateDiagram* diag, const string& state,
+			 DSMCondition::EventType event)
+{
+  State* st = diag->getState(state);
+  if (!st)
+    return "<no state>";
+
+  string res;
+  const vector<unsigned int>& idx = st->getTransitions(event);
+  for (vector<unsigned int>::const_iterator it=
+	 idx.begin(); it != idx.end(); it++) {
+    if (!res.empty())
+      res += ",";
+    res += st->transitions[*it].name;
+  }
+  return res;
+}
+
+static void run_key(DSMStateEngine& engine, AmSession* sess,
+		    DSMSession* sc_sess, const string& key)
+{
+  map<string,string> params;
+  params["key"] = key;
+  engine.runEvent(sess, sc_sess, DSMCondition::Key, &params);
+}
+
+/** condition on timer events which fails with an exception */
+class ThrowDSMCondition
+  : public DSMCondition
+{
+public:
+  ThrowDSMCondition() { type = DSMCondition::Timer; }
+
+  bool match(AmSession* sess, DSMSession* sc_sess, DSMCondition::EventType event,
+	     map<string,string>* event_params) {
+    throw ::DSMException("condition");
+  }
+};
+
+FCTMF_SUITE_BGN(test_dsm) {
+
+    FCT_TEST_BGN(dsm_arg_escapes) {
+      TestDSMSession sc_sess;
+      sc_sess.var["x"] = "var";
+      map<string,string> params;
+      params["x"] = "param";
+
+      fct_chk(resolve("$$", NULL, &sc_sess, &params) == "$");
+      fct_chk(resolve("$$x", NULL, &sc_sess, &params) == "$");
+      fct_chk(resolve("##", NULL, &sc_sess, &params) == "#");
+      fct_chk(resolve("##x", NULL, &sc_sess, &params) == "#");
+      fct_chk(resolve("@@", NULL, &sc_sess, &params) == "@");
+      fct_chk(resolve("@@user", NULL, &sc_sess, &params) == "@");
+      fct_chk(resolve("@", NULL, &sc_sess, &params) == "@");
+
+      fct_chk(resolve("$x", NULL, &sc_sess, &params) == "var");
+      fct_chk(resolve("#x", NULL, &sc_sess, &params) == "param");
+      fct_chk(resolve("\"a b\"", NULL, &sc_sess, &params) == "a b");
+      fct_chk(resolve("x", NULL, &sc_sess, &params) == "x");
+      fct_chk(resolve("", NULL, &sc_sess, &params) == "");
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(dsm_arg_param_without_params) {
+      TestDSMSession sc_sess;
+      map<string,string> params;
+
+      fct_chk(resolve("#key", NULL, &sc_sess, NULL) == "");
+      fct_chk(resolve("#key", NULL, &sc_sess, &params) == "");
+      params["key"] = "5";
+      fct_chk(resolve("#key", NULL, &sc_sess, &params) == "5");
+      fct_chk(test_cond("#key == 5", NULL, &sc_sess, &params));
+      fct_chk(test_cond("#key == ", NULL, &sc_sess, NULL));
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(dsm_arg_selects) {
+      TestDSMSession sc_sess;
+      AmSession sess;
+      sess.dlg->setUser("alice");
+
+      fct_chk(resolve("@user", &sess, &sc_sess, NULL) == "alice");
+      fct_chk(resolve("@nosuchselect", &sess, &sc_sess, NULL) == "");
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(dsm_arg_eval) {
+      TestDSMSession sc_sess;
+      sc_sess.var["n"] = "3";
+      sc_sess.var["m"] = "4";
+      sc_sess.var["s"] = "x";
+
+      fct_chk(resolve("$n + 2", NULL, &sc_sess, NULL, true) == "5");
+      fct_chk(resolve("$n - 1", NULL, &sc_sess, NULL, true) == "2");
+      fct_chk(resolve("$n+$m", NULL, &sc_sess, NULL, true) == "7");
+      fct_chk(resolve("1 - $m", NULL, &sc_sess, NULL, true) == "-3");
+
+      // not numbers: the whole string (without spaces) as reference
+      fct_chk(resolve("a + 1", NULL, &sc_sess, NULL, true) == "a+1");
+      fct_chk(resolve("x-y", NULL, &sc_sess, NULL, true) == "x-y");
+      fct_chk(resolve("$s+1", NULL, &sc_sess, NULL, true) == "");
+      sc_sess.var["s+1"] = "whole";
+      fct_chk(resolve("$s + 1", NULL, &sc_sess, NULL, true) == "whole");
+
+      // operators only evaluated for eval
+      fct_chk(resolve("1+2", NULL, &sc_sess, NULL) == "1+2");
+
+      // runtime strings resolve the same, without a slot
+      fct_chk(resolveVars("$n + 2", NULL, &sc_sess, NULL, true) == "5");
+      fct_chk(resolveVars("$n", NULL, &sc_sess, NULL) == "3");
+      fct_chk(resolveVars("$unset", NULL, &sc_sess, NULL) == "");
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(dsm_set_targets) {
+      TestDSMSession sc_sess;
+      sc_sess.var["n"] = "3";
+
+      // one '$' is stripped from the target
+      fct_chk(run_action("set($sx=1)", NULL, &sc_sess));
+      fct_chk(run_action("set($$sx=2)", NULL, &sc_sess));
+      fct_chk(run_action("set(sy=3)", NULL, &sc_sess));
+      fct_chk(sc_sess.var["sx"] == "1");
+      fct_chk(sc_sess.var["$sx"] == "2");
+      fct_chk(sc_sess.var["sy"] == "3");
+
+      fct_chk(run_action("append($ax, a)", NULL, &sc_sess));
+      fct_chk(run_action("append($$ax, b)", NULL, &sc_sess));
+      fct_chk(run_action("append(ax, $n)", NULL, &sc_sess));
+      fct_chk(sc_sess.var["ax"] == "a3");
+      fct_chk(sc_sess.var["$ax"] == "b");
+
+      fct_chk(run_action("eval($ex=$n+1)", NULL, &sc_sess));
+      fct_chk(run_action("eval($$ex=$n-1)", NULL, &sc_sess));
+      fct_chk(run_action("eval(ey=$ex+$n)", NULL, &sc_sess));
+      fct_chk(sc_sess.var["ex"] == "4");
+      fct_chk(sc_sess.var["$ex"] == "2");
+      fct_chk(sc_sess.var["ey"] == "7");
+
+      // set of an event parameter
+      map<string,string> params;
+      fct_chk(run_action("set(#px=$n)", NULL, &sc_sess, &params));
+      fct_chk(params["px"] == "3");
+      fct_chk(sc_sess.var.find("px") == sc_sess.var.end());
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(dsm_test_len) {
+      TestDSMSession sc_sess;
+      sc_sess.var["lx"] = "abc";
+      sc_sess.var["ly"] = "abcd";
+      map<string,string> params;
+      params["p"] = "12";
+
+      fct_chk(test_cond("len($lx) == 3", NULL, &sc_sess));
+      fct_chk(test_cond("3 == len($lx)", NULL, &sc_sess));
+      fct_chk(test_cond("len($lx) < len($ly)", NULL, &sc_sess));
+      fct_chk(!test_cond("len($lx) > len($ly)", NULL, &sc_sess));
+      fct_chk(test_cond("len(#p) == 2", NULL, &sc_sess, &params));
+      fct_chk(test_cond("len($unset) == 0", NULL, &sc_sess));
+      fct_chk(test_cond("$lx == abc", NULL, &sc_sess));
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(dsm_var_slot_cache) {
+      const string name = "slot_cache_test";
+      unsigned int slot = DSMVarSlots::get(name);
+      fct_chk(DSMVarSlots::get(name) == slot);
+
+      DSMVarMap m;
+      fct_chk(m.findSlot(slot, name) == NULL);
+      m.slotValue(slot, name) = "1";
+      fct_chk(m.findSlot(slot, name) && *m.findSlot(slot, name) == "1");
+      fct_chk(m.find(name) != m.end() && m.find(name)->second == "1");
+
+      m.erase(name);
+      fct_chk(m.findSlot(slot, name) == NULL);
+
+      m.slotValue(slot, name) = "2";
+      m.erase(m.find(name));
+      fct_chk(m.findSlot(slot, name) == NULL);
+
+      m.slotValue(slot, name) = "3";
+      m.erase(m.begin(), m.end());
+      fct_chk(m.findSlot(slot, name) == NULL);
+
+      m.slotValue(slot, name) = "4";
+      m.clear();
+      fct_chk(m.findSlot(slot, name) == NULL);
+
+      m.slotValue(slot, name) = "5";
+      VarMapT vars;
+      vars[name] = "6";
+      m = vars;
+      fct_chk(m.findSlot(slot, name) && *m.findSlot(slot, name) == "6");
+
+      DSMVarMap m2;
+      m2[name] = "7";
+      m = m2;
+      fct_chk(m.findSlot(slot, name) && *m.findSlot(slot, name) == "7");
+      m2.clear();
+      fct_chk(m.findSlot(slot, name) && *m.findSlot(slot, name) == "7");
+
+      // the cached entry is the map entry
+      m[name] = "8";
+      fct_chk(*m.findSlot(slot, name) == "8");
+      fct_chk(m.findSlot(DSMVarSlots::NoSlot, name) &&
+	      *m.findSlot(DSMVarSlots::NoSlot, name) == "8");
+
+      // through a compiled $var of a session
+      TestDSMSession sc_sess;
+      DSMArgRef ref;
+      ref.compile("$" + name);
+      fct_chk(ref.getSlot() == slot);
+      sc_sess.var[name] = "9";
+      fct_chk(ref.resolve(NULL, &sc_sess, NULL) == "9");
+      sc_sess.var.erase(name);
+      fct_chk(ref.resolve(NULL, &sc_sess, NULL) == "");
+      sc_sess.var[name] = "10";
+      fct_chk(ref.resolve(NULL, &sc_sess, NULL) == "10");
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(dsm_transitions_chart_order) {
+      DSMElemContainer elems;
+      DSMStateDiagram diag("order");
+      fct_chk(read_chart(&diag, &elems,
+        "initial state S;\n"
+        "transition \"a0\" S - test($x == 0) -> S;\n"
+        "transition \"k1\" S - keyPress(1) -> S;\n"
+        "transition \"a2\" S - test($x == 2) -> S;\n"
+        // first timer transition, after some Any ones
+        "transition \"t3\" S - timerTest(#id == 3) -> S;\n"
+        "transition \"a4\" S - test($x == 4) -> S;\n"
+        "transition \"h5\" S - hangup -> S;\n"
+        "transition \"k6\" S - keyTest(#key == 6) -> S;\n"
+        "transition \"a7\" S - / set($x=7) -> S;\n"));
+
+      fct_chk(candidates(&diag, "S", DSMCondition::Key) ==
+	      "a0,k1,a2,a4,k6,a7");
+      fct_chk(candidates(&diag, "S", DSMCondition::Timer) ==
+	      "a0,a2,t3,a4,a7");
+      fct_chk(candidates(&diag, "S", DSMCondition::Hangup) ==
+	      "a0,a2,a4,h5,a7");
+      // no transition on these event types
+      fct_chk(candidates(&diag, "S", DSMCondition::Invite) == "a0,a2,a4,a7");
+      fct_chk(candidates(&diag, "S", DSMCondition::DSMEvent) ==
+	      "a0,a2,a4,a7");
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(dsm_transitions_inverted) {
+      DSMElemContainer elems;
+      DSMStateDiagram diag("inverted");
+      fct_chk(read_chart(&diag, &elems,
+        "initial state S;\n"
+        "state T enter { set($state=T); };\n"
+        "transition \"not key 1\" S - not keyPress(1); test($armed == 1) -> T;\n"
+        "transition \"bye\" (S, T) - hangup -> T;\n"));
+
+      fct_chk(candidates(&diag, "S", DSMCondition::Key) == "not key 1");
+      fct_chk(candidates(&diag, "S", DSMCondition::Timer) == "not key 1");
+      fct_chk(candidates(&diag, "S", DSMCondition::Hangup) ==
+	      "not key 1,bye");
+
+      AmSession sess;
+      TestDSMSession sc_sess;
+      DSMStateEngine engine;
+      engine.addDiagram(&diag);
+      fct_chk(engine.init(&sess, &sc_sess, "inverted", DSMCondition::Start));
+      sc_sess.var["armed"] = "1";
+
+      run_key(engine, &sess, &sc_sess, "1");
+      fct_chk(sc_sess.var["state"] == "");
+
+      map<string,string> params;
+      params["id"] = "1";
+      engine.runEvent(&sess, &sc_sess, DSMCondition::Timer, &params);
+      fct_chk(sc_sess.var["state"] == "T");
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(dsm_transitions_two_event_types) {
+      DSMElemContainer elems;
+      DSMStateDiagram diag("two_types");
+      fct_chk(read_chart(&diag, &elems,
+        "initial state S;\n"
+        "state T enter { set($state=T); };\n"
+        "transition \"both\" S - keyPress(1); timerTest(#id == 1) -> T;\n"
+        "transition \"key 2\" S - keyPress(2) -> T;\n"
+        "transition \"any\" S - test($x == 1) -> T;\n"));
+
+      fct_chk(diag.getState("S")->transitions.size() == 3);
+      fct_chk(candidates(&diag, "S", DSMCondition::Key) == "key 2,any");
+      fct_chk(candidates(&diag, "S", DSMCondition::Timer) == "any");
+      fct_chk(candidates(&diag, "S", DSMCondition::DSMEvent) == "any");
+
+      AmSession sess;
+      TestDSMSession sc_sess;
+      DSMStateEngine engine;
+      engine.addDiagram(&diag);
+      fct_chk(engine.init(&sess, &sc_sess, "two_types", DSMCondition::Start));
+      run_key(engine, &sess, &sc_sess, "1");
+      fct_chk(sc_sess.var["state"] == "");
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(dsm_transitions_exception) {
+      DSMElemContainer elems;
+      DSMStateDiagram diag("exception");
+      fct_chk(read_chart(&diag, &elems,
+        "initial state S;\n"
+        "state OK enter { set($state=OK); };\n"
+        "state ERR enter { set($state=ERR); };\n"
+        "transition \"action throws\" S - keyPress(1) / throw(action) -> OK;\n"
+        "transition \"key 2\" S - keyPress(2) -> OK;\n"
+        "transition \"caught\" S - exception / set($caught=#type) -> ERR;\n"));
+
+      ThrowDSMCondition* c = new ThrowDSMCondition();
+      elems.transferElem(c);
+      DSMTransition tr;
+      tr.name = "condition throws";
+      tr.from_state = "S";
+      tr.to_state = "OK";
+      tr.precond.push_back(c);
+      fct_chk(diag.addTransition(tr));
+
+      AmSession sess;
+      {
+	TestDSMSession sc_sess;
+	DSMStateEngine engine;
+	engine.addDiagram(&diag);
+	fct_chk(engine.init(&sess, &sc_sess, "exception", DSMCondition::Start));
+	run_key(engine, &sess, &sc_sess, "1");
+	fct_chk(sc_sess.var["state"] == "ERR");
+	fct_chk(sc_sess.var["caught"] == "action");
+      }
+      {
+	TestDSMSession sc_sess;
+	DSMStateEngine engine;
+	engine.addDiagram(&diag);
+	fct_chk(engine.init(&sess, &sc_sess, "exception", DSMCondition::Start));
+	map<string,string> params;
+	params["id"] = "1";
+	engine.runEvent(&sess, &sc_sess, DSMCondition::Timer, &params);
+	fct_chk(sc_sess.var["state"] == "ERR");
+	fct_chk(sc_sess.var["caught"] == "condition");
+      }
+      {
+	// no exception: the exception transition is not taken
+	TestDSMSession sc_sess;
+	DSMStateEngine engine;
+	engine.addDiagram(&diag);
+	fct_chk(engine.init(&sess, &sc_sess, "exception", DSMCondition::Start));
+	run_key(engine, &sess, &sc_sess, "2");
+	fct_chk(sc_sess.var["state"] == "OK");
+	fct_chk(sc_sess.var["caught"] == "");
+      }
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(dsm_stats) {
+      string path = "/tmp/sems_test_dsm_" + int2str((unsigned int)getpid()) +
+	".dsm";
+      {
+	std::ofstream f(path.c_str());
+	f << "initial state S;\n"
+	  "state T;\n"
+	  "transition \"key 1\" S - keyTest(#key == 1) -> T;\n"
+	  "transition \"key 2\" S - keyTest(#key == 2); test($x == 1) -> S;\n"
+	  "transition \"timer\" S - timerTest(#id == 1) -> S;\n"
+	  "transition \"bye\" (S, T) - hangup -> T;\n";
+      }
+
+      DSMStateDiagramCollection diags;
+      bool loaded = diags.loadFile(path, "stats", "", "", false, false);
+      unlink(path.c_str());
+      fct_chk(loaded);
+      if (loaded) {
+	AmSession sess;
+	TestDSMSession sc_sess;
+	DSMStateEngine engine;
+	diags.addToEngine(&engine);
+
+	// start: no transition to check
+	fct_chk(engine.init(&sess, &sc_sess, "stats", DSMCondition::Start));
+	// "key 1" (1 condition), "key 2" (2 conditions), no match
+	run_key(engine, &sess, &sc_sess, "2");
+	// "key 1" matches
+	run_key(engine, &sess, &sc_sess, "1");
+	// T: "bye" matches
+	engine.runEvent(&sess, &sc_sess, DSMCondition::Hangup, NULL);
+
+	// as returned by getDSMStats
+	AmArg ret;
+	diags.getStats(ret);
+	fct_chk(ret.hasMember("stats"));
+	fct_chk(ret["stats"]["events"].asInt() == 4);
+	fct_chk(ret["stats"]["transitions"].asInt() == 4);
+	fct_chk(ret["stats"]["conditions"].asInt() == 5);
+	fct_chk(ret["stats"]["conditions_per_event"].asDouble() == 1.25);
+      }
+    } FCT_TEST_END();
+
+} FCTMF_SUITE_END();
@@ -0,0 +1,136 @@
+#include "fct.h"
+
+#include "log.h"
+
+#include "AmEventDispatcher.h"
+#include "AmEvent.h"
+#include "AmConfig.h"
+#include "AmB2BSession.h"
+
+#include <stdio.h>
+
+/**
+ * Counts and drops the events posted.
+ */
+struct counting_queue
+  : public AmEventQueueInterface
+{
+  unsigned int events;
+
+  counting_queue() : events(0) {}
+
+  void postEvent(AmEvent* ev) {
+    events++;
+    delete ev;
+  }
+};
+
+/** B2B leg relaying to another leg's queue */
+struct relay_leg
+  : public AmB2BSession
+{
+  relay_leg(const string& other_tag)
+    : AmB2BSession(other_tag) {}
+  ~relay_leg() {}
+};
+
+FCTMF_SUITE_BGN(test_event_dispatcher) {
+
+    FCT_TEST_BGN(event_dispatcher_post) {
+      AmEventDispatcher* d = AmEventDispatcher::instance();
+      counting_queue q;
+      AmEventDispatcher::QueueHandle h = 0;
+
+      fct_chk(d->addEventQueue("ed-tag-1",&q,"ed-callid-1","ed-rtag-1",
+			       "ed-branch-1",&h));
+      fct_chk(h != 0);
+      fct_chk(d->getQueueHandle("ed-tag-1") == h);
+
+      // same local tag / same dialog ID
+      counting_queue q2;
+      fct_chk(!d->addEventQueue("ed-tag-1",&q2));
+      fct_chk(!d->addEventQueue("ed-tag-2",&q2,"ed-callid-1","ed-rtag-1",
+				"ed-branch-1"));
+      fct_chk(d->getQueueHandle("ed-tag-2") == 0);
+
+      fct_chk(d->post("ed-tag-1",new AmEvent(0)));
+      fct_chk(d->post("ed-callid-1","ed-rtag-1","ed-branch-1",new AmEvent(0)));
+      fct_chk(d->post(h,new AmEvent(0)));
+      fct_chk(q.events == 3);
+
+      AmEvent* ev = new AmEvent(0);
+      fct_chk(!d->post("ed-tag-x",ev));
+      fct_chk(!d->post("ed-callid-1","ed-rtag-x","ed-branch-1",ev));
+      fct_chk(!d->post((AmEventDispatcher::QueueHandle)0,ev));
+      delete ev;
+
+      fct_chk(d->delEventQueue("ed-tag-1") == &q);
+      fct_chk(d->delEventQueue("ed-tag-1") == NULL);
+      fct_chk(d->getQueueHandle("ed-tag-1") == 0);
+
+      // the dialog ID is free again
+      fct_chk(d->addEventQueue("ed-tag-2",&q2,"ed-callid-1","ed-rtag-1",
+			       "ed-branch-1"));
+      AmSipRequest req;
+      req.callid = "ed-callid-1";
+      req.from_tag = "ed-rtag-1";
+      req.via_branch = "ed-branch-1";
+      fct_chk(d->postSipRequest(req));
+      fct_chk(q2.events == 1);
+      fct_chk(d->delEventQueue("ed-tag-2") == &q2);
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(event_dispatcher_stale_handle) {
+      AmEventDispatcher* d = AmEventDispatcher::instance();
+      counting_queue q1, q2;
+      AmEventDispatcher::QueueHandle h1 = 0, h2 = 0;
+
+      fct_chk(d->addEventQueue("ed-stale-1",&q1,&h1));
+      fct_chk(d->delEventQueue("ed-stale-1") == &q1);
+
+      // a handle is never reused, even if the slot is
+      AmEvent* ev = new AmEvent(0);
+      fct_chk(!d->post(h1,ev));
+      delete ev;
+
+      for(int i=0; i<100; i++) {
+	char tag[32];
+	snprintf(tag,sizeof(tag),"ed-stale-%i",i);
+	fct_chk(d->addEventQueue(tag,&q2,&h2));
+	fct_chk(h2 != h1);
+	fct_chk(d->delEventQueue(tag) == &q2);
+      }
+
+      fct_chk(q1.events == 0);
+      fct_chk(q2.events == 0);
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(event_dispatcher_b2b_relay) {
+      AmEventDispatcher* d = AmEventDispatcher::instance();
+      counting_queue q1, q2;
+      relay_leg b2b("ed-other-leg");
+
+      // relayed through the handle of the other leg's queue
+      fct_chk(d->addEventQueue("ed-other-leg",&q1));
+      fct_chk(b2b.relayEvent(new AmEvent(0)) == 0);
+      fct_chk(b2b.relayEvent(new AmEvent(0)) == 0);
+      fct_chk(q1.events == 2);
+
+      // the other leg's queue is replaced: the stale handle is dropped
+      fct_chk(d->delEventQueue("ed-other-leg") == &q1);
+      fct_chk(d->addEventQueue("ed-other-leg",&q2));
+      fct_chk(b2b.relayEvent(new AmEvent(0)) == 0);
+      fct_chk(q2.events == 1);
+
+      fct_chk(d->delEventQueue("ed-other-leg") == &q2);
+      fct_chk(b2b.relayEvent(new AmEvent(0)) != 0);
+
+      // a new other leg
+      fct_chk(d->addEventQueue("ed-other-leg-2",&q1));
+      b2b.setOtherId("ed-other-leg-2");
+      fct_chk(b2b.relayEvent(new AmEvent(0)) == 0);
+      fct_chk(q1.events == 3);
+      fct_chk(d->delEventQueue("ed-other-leg-2") == &q1);
+    } FCT_TEST_END();
+
+} FCTMF_SUITE_END();
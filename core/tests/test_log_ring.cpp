@@ -0,0 +1,170 @@
+#include "fct.h"
+
+#include "log.h"
+
+#include "AmApi.h"
+#include "AmThread.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+using std::vector;
+
+#define TEST_PREFIX "log ring test"
+
+/**
+ * Collects the test messages; can block the
+ * calling thread (the log writer).
+ */
+class TestLogHook : public AmLoggingFacility
+{
+  AmMutex m;
+
+public:
+  vector<unsigned int> thread_idx;
+  vector<unsigned int> seq;
+
+  AmCondition<bool> release;
+  volatile bool block;
+
+  TestLogHook()
+    : AmLoggingFacility("test_log_ring"),
+      release(false), block(false)
+  {}
+
+  int onLoad() { return 0; }
+
+  void log(int level, pid_t pid, pthread_t tid, const char* func,
+	   const char* file, int line, char* msg)
+  {
+    unsigned int t, s;
+    // the category prefix is empty here
+    if(sscanf(msg, " " TEST_PREFIX " %u %u", &t, &s) != 2)
+      return;
+
+    if(block)
+      release.wait_for();
+
+    AmLock l(m);
+    thread_idx.push_back(t);
+    seq.push_back(s);
+  }
+
+  void reset() {
+    AmLock l(m);
+    thread_idx.clear();
+    seq.clear();
+  }
+};
+
+static TestLogHook* get_hook()
+{
+  static TestLogHook* hook = NULL;
+  if(!hook) {
+    hook = new TestLogHook();
+    register_log_hook(hook);
+  }
+  return hook;
+}
+
+class LogThread : public AmThread
+{
+  unsigned int idx;
+  unsigned int n;
+
+protected:
+  void run() {
+    for(unsigned int i=0; i<n; i++)
+      INFO(TEST_PREFIX " %u %u\n", idx, i);
+  }
+  void on_stop() {}
+
+public:
+  LogThread(unsigned int idx, unsigned int n)
+    : idx(idx), n(n) {}
+};
+
+FCTMF_SUITE_BGN(test_log_ring) {
+
+    FCT_TEST_BGN(log_ring_threads) {
+      TestLogHook* hook = get_hook();
+      hook->reset();
+
+      int old_log_stderr = log_stderr;
+      log_stderr = 0;
+
+      const unsigned int threads = 4;
+      const unsigned int n = 500;
+      unsigned int dropped = log_dropped();
+
+      start_async_logging(256*1024);
+
+      vector<LogThread*> t;
+      for(unsigned int i=0; i<threads; i++) {
+	t.push_back(new LogThread(i,n));
+	t.back()->start();
+      }
+      for(unsigned int i=0; i<threads; i++) {
+	t[i]->join();
+	delete t[i];
+      }
+
+      stop_async_logging();
+      log_stderr = old_log_stderr;
+
+      // nothing lost without being counted
+      dropped = log_dropped() - dropped;
+      fct_chk(hook->seq.size() + dropped == threads * n);
+
+      // order of the messages of each thread
+      bool ordered = true;
+      vector<int> last(threads,-1);
+      for(unsigned int i=0; i<hook->seq.size(); i++) {
+	unsigned int ti = hook->thread_idx[i];
+	if(ti >= threads || (int)hook->seq[i] <= last[ti]) {
+	  ordered = false;
+	  break;
+	}
+	last[ti] = hook->seq[i];
+      }
+      fct_chk(ordered);
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(log_ring_drops) {
+      TestLogHook* hook = get_hook();
+      hook->reset();
+
+      int old_log_stderr = log_stderr;
+      log_stderr = 0;
+
+      const unsigned int n = 2000;
+      unsigned int dropped = log_dropped();
+
+      // the writer is stuck in the first message:
+      // the (smallest) ring fills up
+      hook->block = true;
+      start_async_logging(0);
+      for(unsigned int i=0; i<n; i++)
+	INFO(TEST_PREFIX " 0 %u\n", i);
+
+      dropped = log_dropped() - dropped;
+      fct_chk(dropped > 0);
+
+      hook->release.set(true);
+      stop_async_logging();
+      hook->block = false;
+      log_stderr = old_log_stderr;
+
+      fct_chk(hook->seq.size() + dropped == n);
+
+      // the oldest messages are kept
+      fct_chk(hook->seq.size() && hook->seq[0] == 0);
+      fct_chk(hook->seq.size() && hook->seq.back() == hook->seq.size() - 1);
+
+      // synchronous again
+      hook->reset();
+      INFO(TEST_PREFIX " 0 0\n");
+      fct_chk(hook->seq.size() == 1);
+    } FCT_TEST_END();
+
+} FCTMF_SUITE_END();
@@ -0,0 +1,227 @@
+#include "fct.h"
+
+#include "log.h"
+
+#include "AmMediaProcessor.h"
+#include "AmConfig.h"
+#include "AmArg.h"
+#include "AmAudio.h"
+
+#include <unistd.h>
+#include <time.h>
+#include <vector>
+
+static int sum_classes(AmArg& hist)
+{
+  int sum = 0;
+  for(AmArg::ValueStruct::const_iterator it = hist.begin();
+      it != hist.end(); it++)
+    sum += it->second.asInt();
+  return sum;
+}
+
+/**
+ * Records the ticks it is processed in.
+ */
+struct tick_recorder
+  : public AmMediaSession
+{
+  std::vector<unsigned long long> read_ts;
+  std::vector<unsigned long long> write_ts;
+
+  /** simulated processing time */
+  unsigned int busy_us;
+
+  tick_recorder() : busy_us(0) {}
+
+  int readStreams(unsigned long long ts, unsigned char*) {
+    read_ts.push_back(ts);
+    if(busy_us) {
+      struct timespec start,now;
+      clock_gettime(CLOCK_MONOTONIC,&start);
+      do {
+	clock_gettime(CLOCK_MONOTONIC,&now);
+      } while((now.tv_sec - start.tv_sec) * 1000000 +
+	      (now.tv_nsec - start.tv_nsec) / 1000 < busy_us);
+    }
+    return 0;
+  }
+  int writeStreams(unsigned long long ts, unsigned char*) {
+    write_ts.push_back(ts);
+    return 0;
+  }
+  void processDtmfEvents() {}
+  void clearAudio() {}
+  void clearRTPTimeout() {}
+};
+
+/**
+ * Fails once, right after requesting the migration
+ * of its callgroup: the media thread's ClearSession
+ * is queued behind the migration.
+ */
+struct failing_session
+  : public AmMediaSession
+{
+  string callgroup;
+  bool failed;
+
+  failing_session(const string& cg) : callgroup(cg), failed(false) {}
+
+  int readStreams(unsigned long long, unsigned char*) {
+    if(failed) return 0;
+    failed = true;
+    AmMediaProcessor* mp = AmMediaProcessor::instance();
+    if(!mp->migrateCallgroup(callgroup,0))
+      mp->migrateCallgroup(callgroup,1);
+    return -1;
+  }
+  int writeStreams(unsigned long long, unsigned char*) { return 0; }
+  void processDtmfEvents() {}
+  void clearAudio() {}
+  void clearRTPTimeout() {}
+};
+
+/** ticks are contiguous: no tick missing or repeated */
+static bool contiguous(const std::vector<unsigned long long>& ts)
+{
+  for(unsigned int i=1; i<ts.size(); i++)
+    if(ts[i] != ((ts[i-1] + WC_INC) & WALLCLOCK_MASK))
+      return false;
+  return true;
+}
+
+FCTMF_SUITE_BGN(test_media_tick) {
+
+    FCT_TEST_BGN(media_tick_accounting) {
+      AmMediaProcessorThread* t = new AmMediaProcessorThread(0);
+      t->start();
+      usleep(300000);
+      t->stop();
+      while(!t->is_stopped())
+	usleep(10000);
+
+      AmArg st;
+      t->getStats(st);
+      DBG("media tick stats: %s\n",AmArg::print(st).c_str());
+
+      int ticks = st["ticks"].asInt();
+      // 10 ms ticks, with some slack for loaded test machines
+      fct_chk(ticks >= 20 && ticks <= 40);
+      fct_chk(st["sessions"].asInt() == 0);
+
+      // every tick lands in exactly one class of each histogram
+      fct_chk(st["late_us"].size() == MEDIA_TICK_CLASSES);
+      fct_chk(sum_classes(st["late_us"]) == ticks);
+      fct_chk(sum_classes(st["read_us"]) == ticks);
+      fct_chk(sum_classes(st["write_us"]) == ticks);
+      fct_chk(st["overruns"].asInt() <= ticks);
+
+      delete t;
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(media_callgroup_migration) {
+      int old_threads = AmConfig::MediaProcessorThreads;
+      AmConfig::MediaProcessorThreads = 2;
+      AmMediaProcessor* mp = AmMediaProcessor::instance();
+      mp->init();
+
+      tick_recorder s1, s2;
+      mp->addSession(&s1,"mig-cg");
+      mp->addSession(&s2,"mig-cg");
+      usleep(100000);
+
+      // back and forth
+      for(unsigned int i=0; i<6; i++) {
+	fct_chk(mp->migrateCallgroup("mig-cg",0) ||
+		mp->migrateCallgroup("mig-cg",1));
+	usleep(50000);
+      }
+      fct_chk(!mp->migrateCallgroup("unknown-cg",0));
+      fct_chk(!mp->migrateCallgroup("mig-cg",2));
+
+      AmArg st;
+      mp->getStats(st);
+      fct_chk(st.size() == 2);
+      fct_chk(st[0]["sessions"].asInt() + st[1]["sessions"].asInt() == 2);
+
+      mp->removeSession(&s1);
+      mp->removeSession(&s2);
+      for(int i=0; i<100 && (s1.isProcessingMedia() || s2.isProcessingMedia()); i++)
+	usleep(10000);
+      fct_chk(!s1.isProcessingMedia() && !s2.isProcessingMedia());
+
+      // no tick missing nor repeated
+      fct_chk(s1.read_ts.size() > 30);
+      fct_chk(contiguous(s1.read_ts));
+      fct_chk(contiguous(s1.write_ts));
+      fct_chk(contiguous(s2.read_ts));
+      fct_chk(contiguous(s2.write_ts));
+
+      AmMediaProcessor::dispose();
+      AmConfig::MediaProcessorThreads = old_threads;
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(media_clear_after_migration) {
+      int old_threads = AmConfig::MediaProcessorThreads;
+      AmConfig::MediaProcessorThreads = 2;
+      AmMediaProcessor* mp = AmMediaProcessor::instance();
+      mp->init();
+
+      // cleared by the thread the session has been migrated to
+      failing_session s("clear-cg");
+      mp->addSession(&s,"clear-cg");
+      for(int i=0; i<100 && (!s.failed || s.isProcessingMedia()); i++)
+	usleep(10000);
+      fct_chk(s.failed);
+      fct_chk(!s.isProcessingMedia());
+
+      mp->removeSession(&s);
+      usleep(20000);
+      AmMediaProcessor::dispose();
+      AmConfig::MediaProcessorThreads = old_threads;
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(media_rebalance) {
+      int old_threads = AmConfig::MediaProcessorThreads;
+      AmConfig::MediaProcessorThreads = 2;
+      AmMediaProcessor* mp = AmMediaProcessor::instance();
+      mp->init();
+
+      // two busy callgroups on the same thread
+      tick_recorder s1, s2;
+      s1.busy_us = s2.busy_us = 2000;
+      mp->addSession(&s1,"rb-cg1");
+      mp->addSession(&s2,"rb-cg2");
+      usleep(50000);
+      mp->migrateCallgroup("rb-cg1",0);
+      mp->migrateCallgroup("rb-cg2",0);
+
+      // wait for the session costs to be published
+      usleep(1500000);
+
+      AmArg st;
+      mp->getStats(st);
+      fct_chk(st[0]["sessions"].asInt() == 2);
+      fct_chk(st[0]["load_ns"].asInt() > 2000000);
+
+      mp->rebalance();
+      usleep(50000);
+
+      mp->getStats(st = AmArg());
+      DBG("media stats after rebalancing: %s\n",AmArg::print(st).c_str());
+      fct_chk(st[0]["sessions"].asInt() == 1);
+      fct_chk(st[1]["sessions"].asInt() == 1);
+
+      mp->removeSession(&s1);
+      mp->removeSession(&s2);
+      for(int i=0; i<100 && (s1.isProcessingMedia() || s2.isProcessingMedia()); i++)
+	usleep(10000);
+      fct_chk(contiguous(s1.read_ts));
+      fct_chk(contiguous(s2.read_ts));
+
+      AmMediaProcessor::dispose();
+      AmConfig::MediaProcessorThreads = old_threads;
+    } FCT_TEST_END();
+
+} FCTMF_SUITE_END();
@@ -0,0 +1,137 @@
+#include "fct.h"
+
+#include "log.h"
+
+#include "AmMixerKernels.h"
+#include "AmMultiPartyMixer.h"
+#include "AmAudio.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define KERNEL_BUF 512
+
+/**
+ * Runs the scale kernel over src with the generic and
+ * with the best kernels, and compares the results.
+ */
+static bool same_scale(const int* src, unsigned int size, int factor)
+{
+  short out1[KERNEL_BUF], out2[KERNEL_BUF];
+  int f1 = factor, f2 = factor;
+
+  mixer_use_generic_kernels(true);
+  mixer_scale(out1,src,size,f1);
+  mixer_use_generic_kernels(false);
+  mixer_scale(out2,src,size,f2);
+
+  return (f1 == f2) && !memcmp(out1,out2,size*sizeof(short));
+}
+
+FCTMF_SUITE_BGN(test_mixer) {
+
+    FCT_TEST_BGN(mixer_kernels_add_sub) {
+      int src1[KERNEL_BUF], out1[KERNEL_BUF], out2[KERNEL_BUF];
+      short src2[KERNEL_BUF];
+      srand(42);
+      for(unsigned int i=0; i<KERNEL_BUF; i++) {
+	src1[i] = rand() % 2000000 - 1000000;
+	src2[i] = (short)(rand() % 65536 - 32768);
+      }
+
+      // all sizes: vector bodies and scalar tails
+      bool same = true;
+      for(unsigned int size=0; size<=KERNEL_BUF; size+=7) {
+	mixer_use_generic_kernels(true);
+	mixer_add(out1,src1,src2,size);
+	mixer_use_generic_kernels(false);
+	mixer_add(out2,src1,src2,size);
+	same = same && !memcmp(out1,out2,size*sizeof(int));
+
+	mixer_use_generic_kernels(true);
+	mixer_sub(out1,src1,src2,size);
+	mixer_use_generic_kernels(false);
+	mixer_sub(out2,src1,src2,size);
+	same = same && !memcmp(out1,out2,size*sizeof(int));
+      }
+      fct_chk(same);
+
+      // in place, as used by the mixer
+      memcpy(out1,src1,sizeof(src1));
+      mixer_add(out1,out1,src2,KERNEL_BUF);
+      fct_chk(out1[3] == src1[3] + src2[3]);
+      fct_chk(out1[KERNEL_BUF-1] == src1[KERNEL_BUF-1] + src2[KERNEL_BUF-1]);
+
+      DBG("mixer kernels: %s\n",mixer_kernels());
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(mixer_kernels_scale) {
+      int src[KERNEL_BUF];
+      srand(43);
+
+      // no clipping
+      for(unsigned int i=0; i<KERNEL_BUF; i++)
+	src[i] = rand() % 60000 - 30000;
+      fct_chk(same_scale(src,KERNEL_BUF,16));
+      fct_chk(same_scale(src,KERNEL_BUF,64));
+      fct_chk(same_scale(src,333,40));
+
+      // clipping at various positions: the factor
+      // changes in the middle of the buffer
+      bool same = true;
+      for(unsigned int pos=0; pos<KERNEL_BUF; pos+=13) {
+	int save = src[pos];
+	src[pos] = (pos & 1) ? 500000 : -500000;
+	same = same && same_scale(src,KERNEL_BUF,64);
+	same = same && same_scale(src,KERNEL_BUF-5,30);
+	src[pos] = save;
+      }
+      fct_chk(same);
+
+      int f = 64;
+      short out[KERNEL_BUF];
+      src[10] = 1000000;
+      mixer_scale(out,src,KERNEL_BUF,f);
+      fct_chk(out[10] == 32737);
+      fct_chk(f < 64);
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(mixer_minus_self) {
+      AmMultiPartyMixer mixer;
+      unsigned int a = mixer.addChannel(8000);
+      unsigned int b = mixer.addChannel(8000);
+      unsigned int c = mixer.addChannel(8000);
+
+      short talk[160], silence[160];
+      for(unsigned int i=0; i<160; i++) {
+	talk[i] = 1000;
+	silence[i] = 0;
+      }
+
+      unsigned long long ts = 0;
+      short out_a[160], out_b[160], out_c[160];
+      for(unsigned int f=0; f<5; f++) {
+	mixer.lock();
+	mixer.PutChannelPacket(a,ts,(unsigned char*)talk,sizeof(talk));
+	mixer.PutChannelPacket(b,ts,(unsigned char*)silence,sizeof(silence));
+	mixer.PutChannelPacket(c,ts,(unsigned char*)silence,sizeof(silence));
+
+	unsigned int size = sizeof(out_a), rate = 0;
+	mixer.GetChannelPacket(a,ts,(unsigned char*)out_a,size,rate);
+	size = sizeof(out_b);
+	mixer.GetChannelPacket(b,ts,(unsigned char*)out_b,size,rate);
+	size = sizeof(out_c);
+	mixer.GetChannelPacket(c,ts,(unsigned char*)out_c,size,rate);
+	mixer.unlock();
+	ts += 2 * WC_INC;
+      }
+
+      // a does not hear itself, b and c hear a
+      // (the scaling factor ramps up with every read)
+      fct_chk(out_a[80] == 0);
+      fct_chk(out_b[80] > 0);
+      fct_chk(out_c[80] >= out_b[80]);
+      fct_chk(out_c[80] <= 1000);
+    } FCT_TEST_END();
+
+} FCTMF_SUITE_END();
@@ -0,0 +1,145 @@
+#include "fct.h"
+
+#include "log.h"
+
+#include "sip/sip_parser.h"
+#include "sip/parse_header.h"
+#include "sip/parse_from_to.h"
+#include "sip/parse_via.h"
+#include "sip/msg_arena.h"
+
+#include <string.h>
+
+/**
+ * Typical messages of a call and a registration.
+ */
+static const char* corpus[] = {
+
+  "INVITE sip:bob@biloxi.example.com SIP/2.0\r\n"
+  "Via: SIP/2.0/UDP pc33.atlanta.example.com:5060;branch=z9hG4bK74bf9;rport\r\n"
+  "Via: SIP/2.0/UDP 10.0.0.20:5060;branch=z9hG4bK2d4790.1;received=192.0.2.2\r\n"
+  "Max-Forwards: 70\r\n"
+  "Record-Route: <sip:p1.example.com;lr>\r\n"
+  "From: Alice <sip:alice@atlanta.example.com>;tag=9fxced76sl\r\n"
+  "To: Bob <sip:bob@biloxi.example.com>\r\n"
+  "Call-ID: 3848276298220188511@atlanta.example.com\r\n"
+  "CSeq: 1 INVITE\r\n"
+  "Contact: <sip:alice@client.atlanta.example.com;transport=udp>\r\n"
+  "Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, PRACK, UPDATE\r\n"
+  "Supported: 100rel, timer\r\n"
+  "User-Agent: SEMS test\r\n"
+  "Content-Type: application/sdp\r\n"
+  "Content-Length: 151\r\n"
+  "\r\n"
+  "v=0\r\n"
+  "o=alice 2890844526 2890844526 IN IP4 client.atlanta.example.com\r\n"
+  "s=-\r\n"
+  "c=IN IP4 192.0.2.101\r\n"
+  "t=0 0\r\n"
+  "m=audio 49172 RTP/AVP 0\r\n"
+  "a=rtpmap:0 PCMU/8000\r\n",
+
+  "SIP/2.0 200 OK\r\n"
+  "Via: SIP/2.0/UDP pc33.atlanta.example.com:5060;branch=z9hG4bK74bf9;received=192.0.2.101\r\n"
+  "Record-Route: <sip:p1.example.com;lr>\r\n"
+  "From: Alice <sip:alice@atlanta.example.com>;tag=9fxced76sl\r\n"
+  "To: Bob <sip:bob@biloxi.example.com>;tag=8321234356\r\n"
+  "Call-ID: 3848276298220188511@atlanta.example.com\r\n"
+  "CSeq: 1 INVITE\r\n"
+  "Contact: <sip:bob@client.biloxi.example.com;transport=udp>\r\n"
+  "Content-Length: 0\r\n"
+  "\r\n",
+
+  "ACK sip:bob@client.biloxi.example.com SIP/2.0\r\n"
+  "Via: SIP/2.0/UDP pc33.atlanta.example.com:5060;branch=z9hG4bK74bd5\r\n"
+  "Route: <sip:p1.example.com;lr>\r\n"
+  "Max-Forwards: 70\r\n"
+  "From: Alice <sip:alice@atlanta.example.com>;tag=9fxced76sl\r\n"
+  "To: Bob <sip:bob@biloxi.example.com>;tag=8321234356\r\n"
+  "Call-ID: 3848276298220188511@atlanta.example.com\r\n"
+  "CSeq: 1 ACK\r\n"
+  "Content-Length: 0\r\n"
+  "\r\n",
+
+  "BYE sip:alice@client.atlanta.example.com SIP/2.0\r\n"
+  "Via: SIP/2.0/UDP client.biloxi.example.com:5060;branch=z9hG4bKnashds7\r\n"
+  "Max-Forwards: 70\r\n"
+  "From: Bob <sip:bob@biloxi.example.com>;tag=8321234356\r\n"
+  "To: Alice <sip:alice@atlanta.example.com>;tag=9fxced76sl\r\n"
+  "Call-ID: 3848276298220188511@atlanta.example.com\r\n"
+  "CSeq: 1 BYE\r\n"
+  "Content-Length: 0\r\n"
+  "\r\n",
+
+  "REGISTER sip:registrar.biloxi.example.com SIP/2.0\r\n"
+  "Via: SIP/2.0/UDP bobspc.biloxi.example.com:5060;branch=z9hG4bKnashds7\r\n"
+  "Max-Forwards: 70\r\n"
+  "To: Bob <sip:bob@biloxi.example.com>\r\n"
+  "From: Bob <sip:bob@biloxi.example.com>;tag=456248\r\n"
+  "Call-ID: 843817637684230@998sdasdh09\r\n"
+  "CSeq: 1826 REGISTER\r\n"
+  "Contact: <sip:bob@192.0.2.4>;expires=7200\r\n"
+  "Content-Length: 0\r\n"
+  "\r\n",
+};
+
+#define CORPUS_SIZE (sizeof(corpus)/sizeof(corpus[0]))
+
+static sip_msg* parse(const char* s)
+{
+  sip_msg* msg = new sip_msg(s,strlen(s));
+  char* err_msg = NULL;
+  if(parse_sip_msg(msg,err_msg)) {
+    delete msg;
+    return NULL;
+  }
+  return msg;
+}
+
+FCTMF_SUITE_BGN(test_msg_arena) {
+
+    FCT_TEST_BGN(msg_arena_parse) {
+      for(unsigned int i=0; i<CORPUS_SIZE; i++) {
+	sip_msg* msg = parse(corpus[i]);
+	fct_chk(msg != NULL);
+	if(!msg) continue;
+
+	// everything parsed went to the arena
+	fct_chk(msg->arena.get_allocs() > 0);
+	fct_chk(msg->arena.get_chunks() == 1);
+	fct_chk(msg->via_p1 && msg->via_p1->branch.len);
+	fct_chk(get_from(msg)->tag.len);
+	delete msg;
+      }
+      fct_chk(msg_arena::current() == NULL);
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(msg_arena_heap_outside_parsing) {
+      sip_msg* msg = parse(corpus[0]);
+      fct_chk(msg != NULL);
+
+      // added later: heap
+      unsigned int allocs = msg->arena.get_allocs();
+      msg->hdrs.push_back(new sip_header(0,"X-Test","1"));
+      fct_chk(msg->arena.get_allocs() == allocs);
+
+      // copies do not share the arena
+      sip_msg copy(*msg);
+      fct_chk(copy.arena.get_allocs() == 0);
+      copy.release();
+
+      delete msg;
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(msg_arena_big_objects) {
+      msg_arena a;
+      void* p1 = a.alloc(16);
+      void* p2 = a.alloc(MSG_ARENA_CHUNK);
+      void* p3 = a.alloc(16);
+      fct_chk(p1 && p2 && p3);
+      fct_chk(a.get_chunks() == 2);
+      // the big object did not consume the current chunk
+      fct_chk((char*)p3 - (char*)p1 == 16);
+    } FCT_TEST_END();
+
+} FCTMF_SUITE_END();
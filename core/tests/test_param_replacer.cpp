@@ -0,0 +1,116 @@
+#include "fct.h"
+
+#include "log.h"
+
+#include "AmSipMsg.h"
+
+#include "../../apps/sbc/ParamReplacer.h"
+#include "../../apps/sbc/SBCCallProfile.h"
+
+static void make_invite(AmSipRequest& req)
+{
+  req.method = "INVITE";
+  req.r_uri = "sip:bob@biloxi.example.com:5062;user=phone";
+  req.from = "\"Alice\" <sip:alice@atlanta.example.com;x=1>";
+  req.from_tag = "9fxced76sl";
+  req.to = "<sip:bob@biloxi.example.com>";
+  req.callid = "3848276298220188511@atlanta.example.com";
+  req.remote_ip = "192.0.2.101";
+  req.remote_port = 5060;
+  req.hdrs =
+    "P-Asserted-Identity: <sip:+4930123@atlanta.example.com>\r\n"
+    "X-Account: 1234\r\n";
+}
+
+static string replace(const string& s, const AmSipRequest& req)
+{
+  ParamReplacerCtx ctx;
+  ctx.app_param = "k1=v1;k2=v2";
+  return ctx.replaceParameters(s,"test",req);
+}
+
+FCTMF_SUITE_BGN(test_param_replacer) {
+
+    FCT_TEST_BGN(param_replacer_patterns) {
+      AmSipRequest req;
+      make_invite(req);
+
+      fct_chk(replace("no patterns",req) == "no patterns");
+      fct_chk(replace("$fu",req) == "alice@atlanta.example.com");
+      fct_chk(replace("$fU/$fd",req) == "alice/atlanta.example.com");
+      fct_chk(replace("$fP(x)",req) == "1");
+      fct_chk(replace("$ft;$tU",req) == "9fxced76sl;bob");
+      fct_chk(replace("$rU@$rh:$rp",req) == "bob@biloxi.example.com:5062");
+      fct_chk(replace("$rP(user)",req) == "phone");
+      fct_chk(replace("$ci",req) == req.callid);
+      fct_chk(replace("$si:$sp",req) == "192.0.2.101:5060");
+      fct_chk(replace("$H(X-Account)",req) == "1234");
+      fct_chk(replace("$aU",req) == "+4930123");
+      fct_chk(replace("$P(k2)-$P(k1)",req) == "v2-v1");
+      fct_chk(replace("$#(a b)",req) == "a+b");
+      fct_chk(replace("$_s($fU)",req) == "5");
+      fct_chk(replace("a\\tb\\",req) == "a\tb\\");
+
+      // literal text between and after the patterns
+      fct_chk(replace("<sip:$rU@gw.example.com>;tag=$ft",req) ==
+	      "<sip:bob@gw.example.com>;tag=9fxced76sl");
+      fct_chk(replace("$f.x",req) == req.from + "x");
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(param_replacer_templates) {
+      SBCCallProfile profile;
+      ParamTemplates* templates = new ParamTemplates();
+      templates->add("sip:$rU@$H(X-Account)");
+      templates->add("$_u($fU)-$#($H(X-Account) $tU)");
+      templates->add("sip:bob@example.com");
+      profile.param_templates.reset(templates);
+
+      fct_chk(templates->size() == 2);
+      fct_chk(!ParamTemplate::needsReplace("sip:bob@example.com"));
+      const ParamTemplate* t1 = templates->find("sip:$rU@$H(X-Account)");
+      fct_chk(t1 && t1->isReplaced());
+
+      AmSipRequest req;
+      make_invite(req);
+
+      // parsed on first use only
+      ParamReplacerCtx ctx(&profile);
+      fct_chk(ctx.from_parser.uri.empty());
+      fct_chk(ctx.replaceParameters("$fU","test",req) == "alice");
+      string from_uri = ctx.from_parser.uri;
+      fct_chk(!from_uri.empty());
+      fct_chk(ctx.replaceParameters(*t1,"test",req) == "sip:bob@1234");
+
+      // compiled arguments in brackets
+      fct_chk(ctx.replaceParameters("$_u($fU)-$#($H(X-Account) $tU)",
+				    "test",req) == "ALICE-1234+bob");
+      fct_chk(replace("$_u($fU)-$#($H(X-Account) $tU)",req) ==
+	      "ALICE-1234+bob");
+      fct_chk(replace("$Hu(P-Asserted-Identity)",req) ==
+	      "+4930123@atlanta.example.com");
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(param_replacer_profile_evaluate) {
+      AmSipRequest req;
+      make_invite(req);
+
+      SBCCallProfile profile;
+      profile.ruri = "sip:$rU@gw.example.com;user=phone";
+      profile.callid = "$_5($ci)";
+      profile.fix_replaces_inv = "no";
+      profile.fix_replaces_ref = "no";
+
+      ParamTemplates* templates = new ParamTemplates();
+      templates->add(profile.ruri);
+      templates->add(profile.callid);
+      profile.param_templates.reset(templates);
+
+      // the copy for the call shares the templates
+      SBCCallProfile call_profile(profile);
+      ParamReplacerCtx ctx(&call_profile);
+      fct_chk(call_profile.evaluate(ctx,req));
+      fct_chk(call_profile.ruri == "sip:bob@gw.example.com;user=phone");
+      fct_chk(call_profile.callid.length() == 32);
+    } FCT_TEST_END();
+
+} FCTMF_SUITE_END();
@@ -0,0 +1,138 @@
+#include "fct.h"
+
+#include "log.h"
+#include "AmUtils.h"
+
+#include "../../apps/sbc/RegisterCache.h"
+#include "../../apps/sbc/RegCacheStorage.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+static string storage_path()
+{
+  return "/tmp/sems_test_reg_cache_" + int2str((unsigned int)getpid());
+}
+
+static void remove_storage(const string& path)
+{
+  unlink((path + ".snapshot").c_str());
+  unlink((path + ".journal").c_str());
+}
+
+static long file_size(const string& path)
+{
+  struct stat st;
+  if(stat(path.c_str(),&st))
+    return -1;
+  return st.st_size;
+}
+
+static AliasEntry make_ae(unsigned int i)
+{
+  AliasEntry ae;
+  ae.aor = "sip:user" + int2str(i) + "@example.com";
+  ae.alias = "alias" + int2str(i);
+  ae.contact_uri = "sip:user" + int2str(i) + "@10.0.0.1:5062;transport=udp";
+  ae.source_ip = "192.0.2." + int2str(i % 250);
+  ae.source_port = 1024 + i;
+  ae.trsp = "udp";
+  ae.local_if = 1;
+  ae.remote_ua = "SEMS test UA";
+  return ae;
+}
+
+FCTMF_SUITE_BGN(test_reg_cache_storage) {
+
+    FCT_TEST_BGN(reg_cache_journal_replay) {
+      string path = storage_path();
+      remove_storage(path);
+      long now = time(NULL);
+
+      AliasEntry a = make_ae(1), b = make_ae(2), c = make_ae(3);
+      {
+	RegCacheFileStorage s(path);
+	s.onUpdate(a.aor,a.alias,now + 3600,a);
+	s.onUpdate(b.aor,b.alias,now + 3600,b);
+	s.onUpdate(c.aor,c.alias,now - 10,c);    // expired meanwhile
+	s.onDelete(b.aor,b.contact_uri,b.alias); // unregistered
+	s.onUpdate(a.alias,now + 60);
+      }
+
+      RegisterCache::dispose();
+      _RegisterCache* rc = RegisterCache::instance();
+      fct_chk(rc->enablePersistence(path,0) == 0);
+      fct_chk(rc->getActiveRegs() == 1);
+
+      AliasEntry ae;
+      fct_chk(rc->findAliasEntry(a.alias,ae));
+      fct_chk(ae.aor == a.aor);
+      fct_chk(ae.contact_uri == a.contact_uri);
+      fct_chk(ae.source_ip == a.source_ip);
+      fct_chk(ae.source_port == a.source_port);
+      fct_chk(ae.trsp == a.trsp);
+      fct_chk(ae.local_if == a.local_if);
+      fct_chk(ae.remote_ua == a.remote_ua);
+      fct_chk(ae.ua_expire == now + 60);
+
+      RegBinding binding;
+      fct_chk(rc->getAlias(a.aor,a.contact_uri,a.source_ip,binding));
+      fct_chk(binding.reg_expire == now + 3600);
+      fct_chk(binding.alias == a.alias);
+
+      fct_chk(!rc->findAliasEntry(b.alias,ae));
+      fct_chk(!rc->findAliasEntry(c.alias,ae));
+      fct_chk(rc->findAEByContact(a.contact_uri,a.source_ip,a.source_port,ae));
+
+      // the replayed journal went into the snapshot
+      fct_chk(file_size(path + ".journal") == 0);
+      fct_chk(file_size(path + ".snapshot") > 0);
+
+      RegisterCache::dispose();
+      remove_storage(path);
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(reg_cache_snapshot_restore) {
+      string path = storage_path();
+      remove_storage(path);
+      long now = time(NULL);
+
+      _RegisterCache* rc = RegisterCache::instance();
+      fct_chk(rc->enablePersistence(path,0) == 0);
+      fct_chk(rc->getActiveRegs() == 0);
+
+      for(unsigned int i=0; i<10; i++) {
+	AliasEntry ae = make_ae(i);
+	rc->update(ae.alias,now + 100 + i,ae);
+      }
+      rc->remove(make_ae(5).aor,make_ae(5).contact_uri,make_ae(5).alias);
+      rc->updateAliasExpires(make_ae(7).alias,now + 30);
+      fct_chk(rc->getActiveRegs() == 9);
+
+      // snapshot on shutdown
+      RegisterCache::dispose();
+      fct_chk(file_size(path + ".journal") == 0);
+
+      rc = RegisterCache::instance();
+      fct_chk(rc->enablePersistence(path,0) == 0);
+      fct_chk(rc->getActiveRegs() == 9);
+
+      for(unsigned int i=0; i<10; i++) {
+	AliasEntry ae, ref = make_ae(i);
+	RegBinding binding;
+	if(i == 5) {
+	  fct_chk(!rc->findAliasEntry(ref.alias,ae));
+	  continue;
+	}
+	fct_chk(rc->findAliasEntry(ref.alias,ae));
+	fct_chk(ae.contact_uri == ref.contact_uri);
+	fct_chk(ae.ua_expire == ((i == 7) ? now + 30 : 0));
+	fct_chk(rc->getAlias(ref.aor,ref.contact_uri,ref.source_ip,binding));
+	fct_chk(binding.reg_expire == (long)(now + 100 + i));
+      }
+
+      RegisterCache::dispose();
+      remove_storage(path);
+    } FCT_TEST_END();
+
+} FCTMF_SUITE_END();
@@ -0,0 +1,123 @@
+#include "fct.h"
+
+#include "log.h"
+#include "AmUtils.h"
+
+#include "../../apps/sbc/RegexMapper.h"
+
+#include <vector>
+using std::vector;
+using std::make_pair;
+
+static const char* rules[][2] = {
+  { "^alice$",      "p_alice" },
+  { "^bob",         "p_bob_prefix" },
+  { "^bob$",        "p_bob_exact" },   // shadowed by the prefix
+  { "^\\+49(.*)",   "de_\\1" },
+  { "^\\+4930$",    "berlin" },        // shadowed by the regex
+  { "^00(.*)",      "intl_\\1" },
+  { "^abc+d",       "quant" },
+  { "^x|y",         "alt" },
+  { "carol",        "contains" },
+  { "^dave.*",      "dave" },
+  { "^e\\.f$",      "e.f" },
+  { "^back$",       "a\\\\b" },
+  { "^(ann|anna)$", "ann" },
+  { "^",            "default" },
+};
+
+#define RULES (sizeof(rules)/sizeof(rules[0]))
+
+static const char* inputs[] = {
+  "alice", "alice2", "bob", "bobby", "+49301234", "+4930", "0049",
+  "abccd", "abd", "ad", "y", "xz", "zy", "carolina", "mcarol",
+  "dave", "davey", "e.f", "eXf", "back", "ann", "anna", "annabel",
+  "user17", "", "zzz"
+};
+
+#define INPUTS (sizeof(inputs)/sizeof(inputs[0]))
+
+static void add_rule(RegexMappingVector& v, vector<string>& patterns,
+		     const string& re, const string& repl)
+{
+  regex_t r;
+  if (regcomp(&r, re.c_str(), REG_EXTENDED)) {
+    ERROR("could not compile '%s'\n", re.c_str());
+    return;
+  }
+  v.push_back(make_pair(r, repl));
+  patterns.push_back(re);
+}
+
+static void test_rules(RegexMappingVector& v, vector<string>& patterns,
+		       unsigned int n)
+{
+  for (unsigned int i=0; i<n; i++)
+    add_rule(v, patterns, rules[i][0], rules[i][1]);
+}
+
+static void free_rules(RegexMappingVector& v)
+{
+  for (unsigned int i=0; i<v.size(); i++)
+    regfree(&v[i].first);
+  v.clear();
+}
+
+FCTMF_SUITE_BGN(test_regex_mapper) {
+
+    FCT_TEST_BGN(regex_map_same_as_regex_mapping) {
+      // without and with the default rule at the end
+      for (unsigned int n = RULES - 1; n <= RULES; n++) {
+	RegexMappingVector ref, v, v_plain;
+	vector<string> patterns;
+	test_rules(ref, patterns, n);
+	patterns.clear();
+	test_rules(v_plain, patterns, n);
+	patterns.clear();
+	test_rules(v, patterns, n);
+
+	RegexMap m(v, patterns);
+	RegexMap plain(v_plain, vector<string>()); // not indexed
+	fct_chk(m.size() == n);
+	fct_chk(m.literalRules() == ((n == RULES) ? 8 : 7));
+	fct_chk(plain.literalRules() == 0);
+
+	for (unsigned int i=0; i<INPUTS; i++) {
+	  string exp_res, res, plain_res;
+	  bool exp = run_regex_mapping(ref, inputs[i], exp_res);
+
+	  bool found = m.match(inputs[i], res);
+	  fct_chk(exp == found);
+	  fct_chk(exp_res == res);
+	  if ((exp != found) || (exp_res != res)) {
+	    ERROR("'%s': expected %i/'%s', got %i/'%s'\n", inputs[i],
+		  exp, exp_res.c_str(), found, res.c_str());
+	  }
+
+	  fct_chk(plain.match(inputs[i], plain_res) == exp);
+	  fct_chk(plain_res == exp_res);
+	}
+
+	free_rules(ref);
+      }
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(regex_mapper_reload) {
+      RegexMapper mapper;
+      RegexMappingVector v;
+      vector<string> patterns;
+      string res;
+
+      add_rule(v, patterns, "^alice$", "one");
+      mapper.setRegexMap("users", v, patterns);
+      fct_chk(mapper.mapRegex("users", "alice", res) && res == "one");
+      fct_chk(!mapper.mapRegex("other", "alice", res));
+
+      v.clear(); patterns.clear();
+      add_rule(v, patterns, "^alice$", "two");
+      mapper.setRegexMap("users", v, patterns);
+      fct_chk(mapper.mapRegex("users", "alice", res) && res == "two");
+      fct_chk(mapper.getNames().size() == 1);
+    } FCT_TEST_END();
+
+} FCTMF_SUITE_END();
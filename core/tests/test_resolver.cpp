@@ -0,0 +1,368 @@
+#include "fct.h"
+
+#include "log.h"
+
+#include "sip/resolver.h"
+#include "sip/dns_client.h"
+#include "sip/ip_util.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+
+/**
+ * Minimal stub DNS server on 127.0.0.1 (UDP and TCP):
+ *  - 'a.test'        -> A 10.0.0.1
+ *  - 'slow.test'     -> A 10.0.0.2, answered after 100 ms
+ *  - 'tc.test'       -> truncated A 10.0.0.99 over UDP,
+ *                       A 10.0.0.3 over TCP
+ *  - 'short.example' -> A 10.0.0.4
+ *  - 'b.test'        -> A 10.0.0.5
+ *  - 'nx.test', '*.example' -> NXDOMAIN
+ *  - anything else   -> no answer at all
+ */
+class stub_dns_server
+  : public AmThread
+{
+  int sd;
+  int tcp_sd;
+  sockaddr_storage addr;
+
+  int answer(u_char* buf, int len, bool tcp);
+  void serve_tcp();
+
+protected:
+  void run();
+  void on_stop() {}
+
+public:
+  atomic_int queries;
+  atomic_int tcp_queries;
+
+  stub_dns_server();
+  ~stub_dns_server() { close(sd); close(tcp_sd); }
+
+  const sockaddr_storage& get_addr() const { return addr; }
+};
+
+stub_dns_server::stub_dns_server()
+{
+  sd = socket(AF_INET,SOCK_DGRAM,0);
+
+  memset(&addr,0,sizeof(addr));
+  sockaddr_in* sin = (sockaddr_in*)&addr;
+  sin->sin_family = AF_INET;
+  sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  bind(sd,(sockaddr*)sin,sizeof(sockaddr_in));
+
+  socklen_t len = sizeof(sockaddr_in);
+  getsockname(sd,(sockaddr*)sin,&len);
+
+  // TCP on the same port
+  tcp_sd = socket(AF_INET,SOCK_STREAM,0);
+  int one = 1;
+  setsockopt(tcp_sd,SOL_SOCKET,SO_REUSEADDR,&one,sizeof(one));
+  bind(tcp_sd,(sockaddr*)sin,sizeof(sockaddr_in));
+  listen(tcp_sd,4);
+}
+
+static void stub_qname(const u_char* p, const u_char* end, string& name)
+{
+  while((p < end) && *p) {
+    if(!name.empty()) name += ".";
+    name.append((const char*)p+1,*p);
+    p += *p + 1;
+  }
+}
+
+/**
+ * Turns the query in 'buf' into the reply.
+ * @return the reply length, or -1 for no reply.
+ */
+int stub_dns_server::answer(u_char* buf, int len, bool tcp)
+{
+  string name;
+  stub_qname(buf+12,buf+len,name);
+
+  u_char ip_last = 0;
+  if(name == "a.test") {
+    ip_last = 1;
+  }
+  else if(name == "slow.test") {
+    usleep(100000);
+    ip_last = 2;
+  }
+  else if(name == "tc.test") {
+    ip_last = tcp ? 3 : 99;
+  }
+  else if(name == "short.example") {
+    ip_last = 4;
+  }
+  else if(name == "b.test") {
+    ip_last = 5;
+  }
+  else if((name == "nx.test") ||
+	  ((name.length() > 8) &&
+	   !name.compare(name.length()-8,8,".example"))) {
+    buf[2] |= 0x80; // QR
+    buf[3] = 0x83;  // RA + NXDOMAIN
+    return len;
+  }
+  else {
+    // no reply
+    return -1;
+  }
+
+  buf[2] |= 0x80; // QR
+  if(ip_last == 99)
+    buf[2] |= 0x02; // TC
+  buf[3] = 0x80;  // RA
+  buf[7] = 1;     // ANCOUNT
+
+  u_char* p = buf + len;
+  const u_char rr[] = {
+    0xc0, 0x0c,       // name: pointer to question
+    0x00, 0x01,       // A
+    0x00, 0x01,       // IN
+    0x00, 0x00, 0x00, 0x3c, // TTL=60
+    0x00, 0x04,
+    10, 0, 0, ip_last
+  };
+  memcpy(p,rr,sizeof(rr));
+  p += sizeof(rr);
+
+  return p - buf;
+}
+
+void stub_dns_server::serve_tcp()
+{
+  int c = accept(tcp_sd,NULL,NULL);
+  if(c < 0) return;
+
+  u_char buf[NS_PACKETSZ+2];
+  int len = 0;
+  while(len < 2 || len < 2 + ((buf[0] << 8) | buf[1])) {
+    int n = read(c,buf+len,sizeof(buf)-len);
+    if(n <= 0) { close(c); return; }
+    len += n;
+  }
+
+  tcp_queries.inc();
+
+  int reply_len = answer(buf+2,len-2,true);
+  if(reply_len > 0) {
+    buf[0] = reply_len >> 8;
+    buf[1] = reply_len & 0xff;
+    write(c,buf,reply_len+2);
+  }
+  close(c);
+}
+
+void stub_dns_server::run()
+{
+  u_char buf[NS_PACKETSZ];
+
+  while(true) {
+    pollfd fds[2];
+    fds[0].fd = sd;     fds[0].events = POLLIN;
+    fds[1].fd = tcp_sd; fds[1].events = POLLIN;
+    if(poll(fds,2,-1) <= 0) continue;
+
+    if(fds[1].revents & POLLIN)
+      serve_tcp();
+
+    if(!(fds[0].revents & POLLIN))
+      continue;
+
+    sockaddr_storage from;
+    socklen_t from_len = sizeof(from);
+    int len = recvfrom(sd,buf,NS_PACKETSZ,0,(sockaddr*)&from,&from_len);
+    if(len < 12) continue;
+
+    queries.inc();
+
+    int reply_len = answer(buf,len,false);
+    if(reply_len > 0)
+      sendto(sd,buf,reply_len,0,(sockaddr*)&from,from_len);
+  }
+}
+
+/**
+ * Counts and remembers the async results.
+ */
+struct test_dns_cb
+  : public dns_query_cb
+{
+  AmCondition<bool> done;
+  int err;
+  string ip;
+
+  test_dns_cb() : done(false), err(1) {}
+
+  void on_dns_result(const string& name, int res, dns_entry_map& entries)
+  {
+    err = res;
+    dns_entry* e = entries.fetch(name);
+    if(e && !e->ip_vec.empty()) {
+      ip = e->ip_vec[0]->to_str();
+    }
+    done.set(true);
+  }
+};
+
+FCTMF_SUITE_BGN(test_resolver) {
+
+    // the suite body is run once per test
+    static stub_dns_server* stub = NULL;
+    if(!stub) {
+      stub = new stub_dns_server();
+      stub->start();
+
+      vector<sockaddr_storage> ns;
+      ns.push_back(stub->get_addr());
+      _dns_client::timeout = 200;
+      _dns_client::retries = 1;
+      dns_client::instance()->set_nameservers(ns);
+      // independent of the local resolv.conf
+      dns_client::instance()->set_search(vector<string>(),1);
+    }
+
+    FCT_TEST_BGN(dns_async_a_record) {
+      test_dns_cb cb;
+      fct_chk(dns_client::instance()->query("a.test",dns_r_a,&cb) == 0);
+      fct_chk(cb.done.wait_for_to(2000));
+      fct_chk(cb.err == 0);
+      fct_chk(cb.ip == "10.0.0.1");
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(dns_sync_query) {
+      dns_entry_map entries;
+      fct_chk(resolver::instance()->query_dns("a.test",entries,dns_r_a) == 0);
+      fct_chk(entries.fetch("a.test") != NULL);
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(dns_coalesce_identical_queries) {
+      unsigned int sent_before = stub->queries.get();
+
+      test_dns_cb cb1, cb2;
+      fct_chk(dns_client::instance()->query("slow.test",dns_r_a,&cb1) == 0);
+      fct_chk(dns_client::instance()->query("slow.test",dns_r_a,&cb2) == 0);
+      fct_chk(cb1.done.wait_for_to(2000));
+      fct_chk(cb2.done.wait_for_to(2000));
+      fct_chk(cb1.ip == "10.0.0.2");
+      fct_chk(cb2.ip == "10.0.0.2");
+
+      // only one packet hit the server
+      fct_chk(stub->queries.get() - sent_before == 1);
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(dns_nxdomain) {
+      test_dns_cb cb;
+      fct_chk(dns_client::instance()->query("nx.test",dns_r_a,&cb) == 0);
+      fct_chk(cb.done.wait_for_to(2000));
+      fct_chk(cb.err == -1);
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(dns_timeout_and_retry) {
+      unsigned int sent_before = stub->queries.get();
+
+      test_dns_cb cb;
+      fct_chk(dns_client::instance()->query("dead.test",dns_r_a,&cb) == 0);
+      // 2 attempts x 200 ms
+      fct_chk(cb.done.wait_for_to(2000));
+      fct_chk(cb.err == -1);
+      fct_chk(stub->queries.get() - sent_before == 2);
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(dns_truncated_reply_over_tcp) {
+      unsigned int tcp_before = stub->tcp_queries.get();
+
+      test_dns_cb cb;
+      fct_chk(dns_client::instance()->query("tc.test",dns_r_a,&cb) == 0);
+      fct_chk(cb.done.wait_for_to(2000));
+      fct_chk(cb.err == 0);
+      // the truncated UDP reply is not used
+      fct_chk(cb.ip == "10.0.0.3");
+      fct_chk(stub->tcp_queries.get() - tcp_before == 1);
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(dns_search_domains) {
+      vector<string> search;
+      search.push_back("example");
+      dns_client::instance()->set_search(search,1);
+
+      test_dns_cb cb;
+      fct_chk(dns_client::instance()->query("short",dns_r_a,&cb) == 0);
+      fct_chk(cb.done.wait_for_to(2000));
+      fct_chk(cb.err == 0);
+      fct_chk(cb.ip == "10.0.0.4");
+
+      // 'nx.test' has enough dots: tried as-is first, then searched
+      unsigned int sent_before = stub->queries.get();
+      test_dns_cb cb_nx;
+      fct_chk(dns_client::instance()->query("nx.test",dns_r_a,&cb_nx) == 0);
+      fct_chk(cb_nx.done.wait_for_to(2000));
+      fct_chk(cb_nx.err == -1);
+      fct_chk(stub->queries.get() - sent_before == 2);
+
+      dns_client::instance()->set_search(vector<string>(),1);
+
+      // cached under the short name as well
+      dns_handle h;
+      sockaddr_storage sa;
+      memset(&sa,0,sizeof(sa));
+      fct_chk(resolver::instance()->resolve_name("short",&h,&sa,IPv4) == 0);
+      fct_chk(am_inet_ntop(&sa) == "10.0.0.4");
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(dns_resolve_targets_async) {
+      list<sip_destination> dests;
+      sip_destination d;
+      d.host = cstring("b.test");
+      d.port = 5060;
+      dests.push_back(d);
+
+      // cache miss: nothing queried yet
+      dns_async_ctx ctx;
+      sip_target_set targets;
+      resolver::instance()->resolve_targets(dests,&targets,&ctx);
+      fct_chk(ctx.pending());
+      fct_chk(ctx.missing.size() == 1);
+      fct_chk(ctx.missing.front().first == "b.test");
+
+      test_dns_cb cb;
+      fct_chk(dns_client::instance()->query("b.test",dns_r_a,&cb) == 0);
+      fct_chk(cb.done.wait_for_to(2000));
+      ctx.queried.insert("b.test");
+      ctx.missing.clear();
+
+      sip_target_set targets2;
+      fct_chk(resolver::instance()->resolve_targets(dests,&targets2,&ctx) == 0);
+      fct_chk(!ctx.pending());
+      fct_chk(targets2.dest_list.size() == 1);
+      if(!targets2.dest_list.empty())
+	fct_chk(am_inet_ntop(&targets2.dest_list.front().ss) == "10.0.0.5");
+
+      // failed queries are not requested again
+      d.host = cstring("nx.test");
+      dests.clear();
+      dests.push_back(d);
+      dns_async_ctx nx_ctx;
+      nx_ctx.queried.insert("nx.test");
+      sip_target_set targets3;
+      fct_chk(resolver::instance()->resolve_targets(dests,&targets3,&nx_ctx) == -478);
+      fct_chk(!nx_ctx.pending());
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(dns_resolve_name_cached) {
+      dns_handle h;
+      sockaddr_storage sa;
+      memset(&sa,0,sizeof(sa));
+      fct_chk(resolver::instance()->resolve_name("a.test",&h,&sa,IPv4) == 0);
+      fct_chk(am_inet_ntop(&sa) == "10.0.0.1");
+    } FCT_TEST_END();
+
+} FCTMF_SUITE_END();
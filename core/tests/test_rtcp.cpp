@@ -0,0 +1,208 @@
+#include "fct.h"
+
+#include "log.h"
+#include "AmArg.h"
+
+#include "AmRtcp.h"
+
+#include <sys/time.h>
+
+static struct timeval tv_add_ms(const struct timeval& t, unsigned int ms)
+{
+  struct timeval d = { (time_t)(ms / 1000), (suseconds_t)((ms % 1000) * 1000) };
+  struct timeval r;
+  timeradd(&t, &d, &r);
+  return r;
+}
+
+static unsigned int get32(const unsigned char* p)
+{
+  return ((unsigned int)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+/** RTCP packet length in bytes from its header */
+static unsigned int rtcp_len(const unsigned char* p)
+{
+  return (((p[2] << 8) | p[3]) + 1) * 4;
+}
+
+FCTMF_SUITE_BGN(test_rtcp) {
+
+    FCT_TEST_BGN(rtcp_receiver_report) {
+      AmRtcpReporter r;
+      r.init(0x1111, "sems@192.0.2.1");
+
+      struct timeval t0 = { 1000000, 0 };
+      unsigned short first_seq = 65500; // wraps around
+
+      for (unsigned int i=0; i<200; i++) {
+	if ((i >= 50 && i <= 52) || (i == 120))
+	  continue; // a burst of 3 and a single loss
+	// 20 ms packets, every other one 5 ms late
+	r.onRtpReceived(0xabcd, first_seq + i, 160 * i, 8000,
+			tv_add_ms(t0, 20 * i + (i % 2) * 5));
+      }
+
+      AmArg stats;
+      r.getStats(stats);
+      // the first packet is in probation (RFC 3550, A.1)
+      fct_chk(stats["rx"]["expected"].asInt() == 199);
+      fct_chk(stats["rx"]["packets"].asInt() == 195);
+      fct_chk(stats["rx"]["lost"].asInt() == 4);
+      double jitter = stats["rx"]["jitter_ms"].asDouble();
+      fct_chk(jitter > 3.5 && jitter < 5.5);
+
+      unsigned char buf[RTCP_MAX_REPORT_SIZE];
+      unsigned int len = r.buildReport(tv_add_ms(t0, 4000), 5, buf, sizeof(buf));
+      fct_chk(len > 0 && (len % 4) == 0);
+
+      // RR (nothing sent) with one report block
+      fct_chk(buf[0] == 0x81 && buf[1] == RTCP_RR);
+      fct_chk(rtcp_len(buf) == 32);
+      fct_chk(get32(buf + 4) == 0x1111);
+      const unsigned char* rb = buf + 8;
+      fct_chk(get32(rb) == 0xabcd);
+      fct_chk(rb[4] == 4 * 256 / 199);
+      fct_chk((get32(rb + 4) & 0xffffff) == 4);
+      fct_chk(get32(rb + 8) == (unsigned int)first_seq + 199);
+      fct_chk(get32(rb + 12) >= 28 && get32(rb + 12) <= 44);
+      fct_chk(get32(rb + 16) == 0); // no SR received
+
+      // SDES CNAME
+      const unsigned char* sdes = buf + 32;
+      fct_chk(sdes[1] == RTCP_SDES);
+      fct_chk(sdes[8] == RTCP_SDES_CNAME && sdes[9] == 14);
+      fct_chk(!memcmp(sdes + 10, "sems@192.0.2.1", 14));
+
+      // XR VoIP metrics
+      const unsigned char* xr = sdes + rtcp_len(sdes);
+      fct_chk((unsigned int)(xr - buf) + 44 == len);
+      fct_chk(xr[1] == RTCP_XR && rtcp_len(xr) == 44);
+      const unsigned char* m = xr + 8;
+      fct_chk(m[0] == RTCP_XR_VOIP_METRICS);
+      fct_chk(get32(m + 4) == 0xabcd);
+      fct_chk(m[8] == 4 * 256 / 199);   // loss rate
+      fct_chk(m[10] == 255);            // burst density: 3 of 3
+      fct_chk(m[11] == 256 / 196);      // gap density: 1 of 196
+      fct_chk(((m[12] << 8) | m[13]) == 60); // burst duration (ms)
+      fct_chk(m[23] == RTCP_XR_GMIN);
+
+      // the interval loss is reset with each report
+      r.buildReport(tv_add_ms(t0, 9000), 5, buf, sizeof(buf));
+      fct_chk(buf[8 + 4] == 0);
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(rtcp_round_trip) {
+      AmRtcpReporter a, b;
+      a.init(1, "a");
+      b.init(2, "b");
+
+      struct timeval t0;
+      gettimeofday(&t0, NULL);
+
+      // a -> b, 5 packets lost
+      for (unsigned int i=0; i<50; i++) {
+	a.onRtpSent(160 * i, 160, 8000);
+	if (i < 20 || i >= 25)
+	  b.onRtpReceived(1, 100 + i, 160 * i, 8000, tv_add_ms(t0, 20 * i));
+      }
+
+      unsigned char buf[RTCP_MAX_REPORT_SIZE];
+      unsigned int len = a.buildReport(t0, 5, buf, sizeof(buf));
+      fct_chk(buf[1] == RTCP_SR && rtcp_len(buf) == 28);
+      fct_chk(get32(buf + 20) == 50);
+      fct_chk(get32(buf + 24) == 50 * 160);
+      fct_chk(b.onRtcpReceived(buf, len, tv_add_ms(t0, 10)));
+
+      // b answers 100 ms later
+      len = b.buildReport(tv_add_ms(t0, 110), 5, buf, sizeof(buf));
+      fct_chk(buf[1] == RTCP_RR);
+      fct_chk(get32(buf + 8 + 20) == 100 * 65536 / 1000); // DLSR
+      fct_chk(a.onRtcpReceived(buf, len, tv_add_ms(t0, 130)));
+
+      int rtt = a.getRtt();
+      fct_chk(rtt >= 29 && rtt <= 31);
+
+      AmArg stats;
+      a.getStats(stats);
+      fct_chk(stats["tx"]["packets"].asInt() == 50);
+      fct_chk(stats["remote"]["rr_received"].asInt() == 1);
+      fct_chk(stats["remote"]["xr_received"].asInt() == 1);
+      fct_chk(stats["remote"]["lost"].asInt() == 5);
+      fct_chk(stats["remote"]["rtt_ms"].asInt() == rtt);
+      double loss = stats["remote"]["xr_loss_rate"].asDouble();
+      fct_chk(loss > 0.09 && loss < 0.11);
+
+      AmArg b_stats;
+      b.getStats(b_stats);
+      fct_chk(b_stats["remote"]["sr_received"].asInt() == 1);
+      fct_chk(b_stats["remote"]["packets_sent"].asInt() == 50);
+      fct_chk(b_stats["rx"]["lost"].asInt() == 5);
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(rtcp_invalid_and_restart) {
+      AmRtcpReporter r;
+      r.init(1, "r");
+      struct timeval now;
+      gettimeofday(&now, NULL);
+
+      unsigned char junk[16] = { 0x12, 0x34 };
+      fct_chk(!r.onRtcpReceived(junk, sizeof(junk), now));
+
+      // length beyond the packet
+      unsigned char trunc[8] = { 0x80, RTCP_RR, 0x00, 0x05 };
+      fct_chk(!r.onRtcpReceived(trunc, sizeof(trunc), now));
+
+      for (unsigned int i=0; i<10; i++)
+	r.onRtpReceived(7, 10 + i, 160 * i, 8000, tv_add_ms(now, 20 * i));
+
+      // new SSRC: new source
+      for (unsigned int i=0; i<4; i++)
+	r.onRtpReceived(8, 5000 + i, 160 * i, 8000, tv_add_ms(now, 200 + 20 * i));
+
+      AmArg stats;
+      r.getStats(stats);
+      fct_chk(stats["rx"]["ssrc"].asInt() == 8);
+      fct_chk(stats["rx"]["packets"].asInt() == 3);
+      fct_chk(stats["rx"]["lost"].asInt() == 0);
+
+      // sequence restart: accepted after two sequential packets
+      r.onRtpReceived(8, 30000, 1000, 8000, tv_add_ms(now, 300));
+      r.onRtpReceived(8, 30001, 1160, 8000, tv_add_ms(now, 320));
+      r.onRtpReceived(8, 30002, 1320, 8000, tv_add_ms(now, 340));
+      AmArg stats2;
+      r.getStats(stats2);
+      fct_chk(stats2["rx"]["packets"].asInt() == 2);
+      fct_chk(stats2["rx"]["expected"].asInt() == 2);
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(rtcp_report_schedule) {
+      AmRtcpReporter r;
+      r.init(1, "r");
+      struct timeval t0;
+      gettimeofday(&t0, NULL);
+
+      // nothing sent or received yet
+      fct_chk(!r.reportDue(t0, 5));
+      fct_chk(!r.reportDue(tv_add_ms(t0, 60000), 5));
+
+      r.onRtpSent(0, 160, 8000);
+      fct_chk(!r.reportDue(t0, 5));   // schedules the first one
+      fct_chk(!r.reportDue(tv_add_ms(t0, 2400), 5));
+      fct_chk(r.reportDue(tv_add_ms(t0, 2500), 5));
+
+      unsigned char buf[RTCP_MAX_REPORT_SIZE];
+      struct timeval t1 = tv_add_ms(t0, 2500);
+      fct_chk(r.buildReport(t1, 5, buf, sizeof(buf)) > 0);
+      fct_chk(!r.reportDue(tv_add_ms(t1, 2400), 5));
+      fct_chk(r.reportDue(tv_add_ms(t1, 7501), 5));
+
+      // buffer too small
+      fct_chk(r.buildReport(t1, 5, buf, 32) == 0);
+
+      AmArg stats;
+      r.getStats(stats);
+      fct_chk(stats["reports_sent"].asInt() == 1);
+    } FCT_TEST_END();
+
+} FCTMF_SUITE_END();
@@ -0,0 +1,179 @@
+#include "fct.h"
+
+#include "log.h"
+
+#include "AmRtpPacketPool.h"
+#include "AmConfig.h"
+#include "AmArg.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * Pair of connected UDP sockets on 127.0.0.1.
+ */
+struct udp_pair
+{
+  int rx;
+  int tx;
+
+  udp_pair() {
+    sockaddr_in sa;
+    socklen_t sa_len = sizeof(sa);
+    memset(&sa,0,sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    rx = socket(AF_INET,SOCK_DGRAM,0);
+    bind(rx,(sockaddr*)&sa,sizeof(sa));
+    getsockname(rx,(sockaddr*)&sa,&sa_len);
+
+    tx = socket(AF_INET,SOCK_DGRAM,0);
+    connect(tx,(sockaddr*)&sa,sizeof(sa));
+  }
+
+  ~udp_pair() {
+    close(rx);
+    close(tx);
+  }
+
+  void send(unsigned int len) {
+    unsigned char buf[RTP_POOL_OVERFLOW_SIZE];
+    for(unsigned int i=0; i<len; i++)
+      buf[i] = (unsigned char)i;
+    ::send(tx,buf,len,0);
+  }
+};
+
+static bool check_pattern(AmRtpPacket* p, unsigned int len)
+{
+  if(p->getBufferSize() != len)
+    return false;
+
+  for(unsigned int i=0; i<len; i++) {
+    if(p->getBuffer()[i] != (unsigned char)i)
+      return false;
+  }
+  return true;
+}
+
+/**
+ * Pool which reports its deletion.
+ */
+struct test_pool: public AmRtpPacketPool
+{
+  bool* deleted;
+  test_pool(bool* deleted) : deleted(deleted) {}
+  ~test_pool() { *deleted = true; }
+};
+
+FCTMF_SUITE_BGN(test_rtp_pool) {
+
+    FCT_TEST_BGN(rtp_pool_reuse_freed_packets) {
+      AmRtpPacketPool* pool = new AmRtpPacketPool();
+      inc_ref(pool);
+      AmRtpPacket* p1 = pool->newPacket();
+      fct_chk(p1 != NULL);
+      fct_chk(p1->getBufferCapacity() == RTP_PACKET_BUF_SIZE);
+
+      AmArg st;
+      pool->getStats(st);
+      fct_chk(st["mtu_capacity"].asInt() == RTP_POOL_SLAB_PACKETS);
+      fct_chk(st["mtu_in_use"].asInt() == 1);
+
+      AmRtpPacketPool::freePacket(p1);
+      pool->getStats(st);
+      fct_chk(st["mtu_in_use"].asInt() == 0);
+
+      // drain the current slab, the released packet comes back last
+      AmRtpPacket* pkts[RTP_POOL_SLAB_PACKETS];
+      for(int i=0; i<RTP_POOL_SLAB_PACKETS; i++)
+	pkts[i] = pool->newPacket();
+      fct_chk(pkts[RTP_POOL_SLAB_PACKETS-1] == p1);
+
+      pool->getStats(st);
+      fct_chk(st["mtu_capacity"].asInt() == RTP_POOL_SLAB_PACKETS);
+
+      for(int i=0; i<RTP_POOL_SLAB_PACKETS; i++)
+	AmRtpPacketPool::freePacket(pkts[i]);
+      dec_ref(pool);
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(rtp_pool_recv_mtu) {
+      AmRtpPacketPool* pool = new AmRtpPacketPool();
+      inc_ref(pool);
+      udp_pair s;
+      s.send(172);
+
+      AmRtpPacket* p = pool->newPacket();
+      AmRtpPacket* orig = p;
+      fct_chk(pool->recv(p,s.rx) == 172);
+      fct_chk(p == orig);
+      fct_chk(check_pattern(p,172));
+      AmRtpPacketPool::freePacket(p);
+      dec_ref(pool);
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(rtp_pool_recv_oversized_heap) {
+      AmConfig::RtpJumboBuffers = false;
+      AmRtpPacketPool* pool = new AmRtpPacketPool();
+      inc_ref(pool);
+      udp_pair s;
+      s.send(3000);
+
+      AmRtpPacket* p = pool->newPacket();
+      fct_chk(pool->recv(p,s.rx) == 3000);
+      fct_chk(check_pattern(p,3000));
+
+      AmArg st;
+      pool->getStats(st);
+      fct_chk(st["heap_in_use"].asInt() == 1);
+      fct_chk(st["mtu_in_use"].asInt() == 0);
+      fct_chk(st["oversized"].asInt() == 1);
+
+      AmRtpPacketPool::freePacket(p);
+      pool->getStats(st);
+      fct_chk(st["heap_in_use"].asInt() == 0);
+      dec_ref(pool);
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(rtp_pool_recv_oversized_jumbo) {
+      AmConfig::RtpJumboBuffers = true;
+      AmRtpPacketPool* pool = new AmRtpPacketPool();
+      inc_ref(pool);
+      udp_pair s;
+      s.send(3000);
+
+      AmRtpPacket* p = pool->newPacket();
+      fct_chk(pool->recv(p,s.rx) == 3000);
+      fct_chk(check_pattern(p,3000));
+      fct_chk(p->getBufferCapacity() == RTP_PACKET_JUMBO_BUF_SIZE);
+
+      AmArg st;
+      pool->getStats(st);
+      fct_chk(st["jumbo_in_use"].asInt() == 1);
+      fct_chk(st["heap_in_use"].asInt() == 0);
+
+      AmRtpPacketPool::freePacket(p);
+      AmConfig::RtpJumboBuffers = false;
+      dec_ref(pool);
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(rtp_pool_outlives_owner) {
+      bool deleted = false;
+      AmRtpPacketPool* pool = new test_pool(&deleted);
+      inc_ref(pool);
+      AmRtpPacket* p = pool->newPacket();
+
+      // the owner goes first, a stream still holds a packet
+      dec_ref(pool);
+      fct_chk(!deleted);
+
+      AmRtpPacketPool::freePacket(p);
+      fct_chk(deleted);
+    } FCT_TEST_END();
+
+} FCTMF_SUITE_END();
@@ -0,0 +1,111 @@
+#include "fct.h"
+
+#include "log.h"
+#include "AmArg.h"
+
+#include "AmRtpStream.h"
+#include "AmRtpReceiver.h"
+#include "rtp/rtp.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+static void send_to(int sd, unsigned short port, const void* buf, size_t len)
+{
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  sendto(sd, buf, len, 0, (struct sockaddr*)&addr, sizeof(addr));
+}
+
+/** sums up the counters of all receiver threads */
+static long thread_total(const char* key)
+{
+  AmArg stats;
+  AmRtpReceiver::instance()->getStats(stats);
+  long total = 0;
+  for (size_t i=0; i<stats.size(); i++)
+    total += stats.get(i)[key].asLong();
+  return total;
+}
+
+FCTMF_SUITE_BGN(test_rtp_recv_stats) {
+
+    FCT_TEST_BGN(rtp_recv_stats_counters) {
+      AmRtpReceiver::instance()->start();
+
+      long packets_before = thread_total("packets");
+      long dropped_before = thread_total("dropped");
+
+      AmRtpStream* stream = new AmRtpStream(NULL, 0);
+      stream->setLocalIP("127.0.0.1");
+      unsigned short port = 30000 + (getpid() % 10000) * 2;
+      stream->setLocalPort(port);
+      // an explicit port is not added to the receiver
+      stream->resumeReceiving();
+
+      int sd = socket(AF_INET, SOCK_DGRAM, 0);
+      fct_chk(sd >= 0);
+
+      // not RTP (version 1)
+      unsigned char junk[20] = { 0x40 };
+      send_to(sd, port, junk, sizeof(junk));
+
+      for (unsigned int i=0; i<100; i++) {
+	unsigned char pkt[sizeof(rtp_hdr_t) + 160];
+	memset(pkt, 0, sizeof(pkt));
+	rtp_hdr_t* hdr = (rtp_hdr_t*)pkt;
+	hdr->version = RTP_VERSION;
+	hdr->seq = htons(1000 + i);
+	hdr->ts = htonl(160 * i);
+	hdr->ssrc = htonl(0x1234);
+	send_to(sd, port, pkt, sizeof(pkt));
+      }
+
+      unsigned char rtcp[8] = { 0x80, 201, 0x00, 0x01 };
+      send_to(sd, port + 1, rtcp, sizeof(rtcp));
+
+      // nobody reads the stream: the newest MAX_PACKETS are held,
+      // the older ones dropped to reuse their buffers
+      const AmRtpRecvStats& s = stream->getRecvStats();
+      for (unsigned int i=0; i<200; i++) {
+	if ((s.packets == 101) && s.rtcp_packets)
+	  break;
+	usleep(10000);
+      }
+
+      fct_chk(s.packets == 101);
+      fct_chk(s.parse_errors == 1);
+      fct_chk(s.dropped == 100 - MAX_PACKETS);
+      fct_chk(s.late == 0);
+      fct_chk(s.rtcp_packets == 1);
+      fct_chk(s.bytes == sizeof(junk) + 100 * (sizeof(rtp_hdr_t) + 160));
+
+      fct_chk(thread_total("packets") - packets_before == 101);
+      fct_chk(thread_total("rtcp_packets") >= 1);
+      fct_chk(thread_total("callbacks") >= 2 + MAX_PACKETS);
+
+      // rates are updated every second
+      usleep(1200000);
+      AmArg top;
+      AmRtpReceiver::instance()->getTopTalkers(top, 1);
+      fct_chk(top.size() == 1);
+      if (top.size() == 1) {
+	fct_chk(top.get(0)["local_port"].asInt() == port);
+	fct_chk(top.get(0)["dropped"].asLong() == 100 - MAX_PACKETS);
+	fct_chk(top.get(0).hasMember("thread"));
+      }
+
+      // the counters of removed streams remain in the thread totals
+      delete stream;
+      fct_chk(thread_total("packets") - packets_before == 101);
+      fct_chk(thread_total("dropped") - dropped_before == 100 - MAX_PACKETS);
+
+      close(sd);
+    } FCT_TEST_END();
+
+} FCTMF_SUITE_END();
@@ -0,0 +1,240 @@
+#include "fct.h"
+
+#include "log.h"
+
+#include "AmRtpReceiveRing.h"
+#include "AmRtpPacket.h"
+
+#include <vector>
+using std::vector;
+
+#define TEST_PACKETS 256
+
+/**
+ * Packets with consecutive sequence numbers and timestamps.
+ */
+struct test_packets
+{
+  unsigned char buf[8];
+  vector<AmRtpPacket*> pkts;
+
+  test_packets(unsigned short first_seq, unsigned int n = TEST_PACKETS) {
+    for(unsigned int i=0; i<n; i++) {
+      AmRtpPacket* p = new AmRtpPacket(buf,sizeof(buf));
+      p->sequence = first_seq + i;
+      p->timestamp = 160 * i;
+      pkts.push_back(p);
+    }
+  }
+
+  ~test_packets() {
+    for(unsigned int i=0; i<pkts.size(); i++)
+      delete pkts[i];
+  }
+};
+
+/**
+ * Order of arrival: every 'reorder'-th pair is swapped,
+ * every 'loss'-th packet is lost (0 = never).
+ */
+static void arrival_order(unsigned int n, unsigned int reorder,
+			  unsigned int loss, vector<unsigned int>& order)
+{
+  for(unsigned int i=0; i<n; i++) {
+    if(loss && (i % loss == loss-1))
+      continue;
+    order.push_back(i);
+  }
+
+  if(!reorder) return;
+  for(unsigned int i=1; i<order.size(); i+=reorder) {
+    unsigned int t = order[i];
+    order[i] = order[i-1];
+    order[i-1] = t;
+  }
+}
+
+FCTMF_SUITE_BGN(test_rtp_ring) {
+
+    FCT_TEST_BGN(rtp_ring_in_order) {
+      test_packets tp(65530, 16); // wraps around
+      AmRtpReceiveRing ring;
+      for(unsigned int i=0; i<tp.pkts.size(); i++)
+	fct_chk(ring.put(tp.pkts[i]));
+
+      for(unsigned int i=0; i<tp.pkts.size(); i++)
+	fct_chk(ring.get(0) == tp.pkts[i]);
+      fct_chk(ring.get(0) == NULL);
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(rtp_ring_reordered) {
+      test_packets tp(100, 4);
+      AmRtpReceiveRing ring;
+      fct_chk(ring.put(tp.pkts[0]));
+      fct_chk(ring.put(tp.pkts[2]));
+      fct_chk(ring.put(tp.pkts[1]));
+      fct_chk(ring.put(tp.pkts[3]));
+
+      for(unsigned int i=0; i<tp.pkts.size(); i++)
+	fct_chk(ring.get(0) == tp.pkts[i]);
+      fct_chk(ring.get(0) == NULL);
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(rtp_ring_reordered_before_first_get) {
+      // 101, 100, 102, ... with no get() in between
+      test_packets tp(100, 2 * RTP_RING_SIZE);
+      vector<unsigned int> order;
+      arrival_order(tp.pkts.size(), tp.pkts.size(), 0, order);
+      AmRtpReceiveRing ring;
+      for(unsigned int i=0; i<3; i++)
+	fct_chk(ring.put(tp.pkts[order[i]]));
+
+      for(unsigned int i=0; i<3; i++)
+	fct_chk(ring.get(0) == tp.pkts[i]);
+      fct_chk(ring.get(0) == NULL);
+
+      // nothing is left behind to block the following rounds
+      for(unsigned int i=3; i<order.size(); i++) {
+	fct_chk(ring.put(tp.pkts[order[i]]));
+	fct_chk(ring.get(0) == tp.pkts[i]);
+      }
+      fct_chk(ring.busy == 0);
+      fct_chk(ring.late == 0);
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(rtp_ring_loss_and_late) {
+      test_packets tp(100, 4);
+      AmRtpReceiveRing ring;
+      fct_chk(ring.put(tp.pkts[0]));
+      fct_chk(ring.put(tp.pkts[2]));
+
+      // #1 is missing: waited for, then skipped
+      fct_chk(ring.get(0) == tp.pkts[0]);
+      fct_chk(ring.get(0) == NULL);
+      fct_chk(ring.get(RTP_RING_REORDER_MS - 1) == NULL);
+      fct_chk(ring.get(RTP_RING_REORDER_MS) == tp.pkts[2]);
+      fct_chk(ring.get(RTP_RING_REORDER_MS) == NULL);
+
+      // too late now
+      fct_chk(!ring.put(tp.pkts[1]));
+      fct_chk(ring.late == 1);
+
+      fct_chk(ring.put(tp.pkts[3]));
+      fct_chk(ring.get(0) == tp.pkts[3]);
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(rtp_ring_reordered_after_get) {
+      test_packets tp(100, 4);
+      AmRtpReceiveRing ring;
+      fct_chk(ring.put(tp.pkts[0]));
+      fct_chk(ring.put(tp.pkts[2]));
+      fct_chk(ring.get(0) == tp.pkts[0]);
+      fct_chk(ring.get(10) == NULL);
+
+      // #1 arrives after the consumer has read
+      fct_chk(ring.put(tp.pkts[1]));
+      fct_chk(ring.put(tp.pkts[3]));
+      fct_chk(ring.late == 0);
+      for(unsigned int i=1; i<tp.pkts.size(); i++)
+	fct_chk(ring.get(20) == tp.pkts[i]);
+      fct_chk(ring.get(20) == NULL);
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(rtp_ring_reorder_window) {
+      // missing packets are not waited for beyond the window
+      test_packets tp(100, RTP_RING_REORDER + 2);
+      AmRtpReceiveRing ring;
+      fct_chk(ring.put(tp.pkts[0]));
+      for(unsigned int i=3; i<=RTP_RING_REORDER; i++)
+	fct_chk(ring.put(tp.pkts[i]));
+      fct_chk(ring.get(0) == tp.pkts[0]);
+      fct_chk(ring.get(0) == NULL);
+
+      fct_chk(ring.put(tp.pkts[RTP_RING_REORDER + 1]));
+      for(unsigned int i=3; i<tp.pkts.size(); i++)
+	fct_chk(ring.get(0) == tp.pkts[i]);
+      fct_chk(!ring.put(tp.pkts[1]));
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(rtp_ring_no_reorder) {
+      // telephone events: the gaps are audio packets, not waited for
+      test_packets tp(100, 8);
+      AmRtpReceiveRing ring(false);
+      fct_chk(ring.put(tp.pkts[0]));
+      fct_chk(ring.put(tp.pkts[3]));
+      fct_chk(ring.get(0) == tp.pkts[0]);
+      fct_chk(ring.get(0) == tp.pkts[3]);
+      fct_chk(ring.get(0) == NULL);
+
+      fct_chk(ring.put(tp.pkts[7]));
+      fct_chk(ring.get(0) == tp.pkts[7]);
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(rtp_ring_duplicate) {
+      test_packets tp(100, 2);
+      AmRtpReceiveRing ring;
+      fct_chk(ring.put(tp.pkts[0]));
+      fct_chk(!ring.put(tp.pkts[0]));
+      fct_chk(ring.busy == 1);
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(rtp_ring_overrun) {
+      // consumer does not read: the oldest packets are skipped
+      test_packets tp(0, RTP_RING_SIZE + 8);
+      AmRtpReceiveRing ring;
+      for(unsigned int i=0; i<RTP_RING_SIZE; i++)
+	fct_chk(ring.put(tp.pkts[i]));
+      // slots still occupied
+      fct_chk(!ring.put(tp.pkts[RTP_RING_SIZE]));
+
+      fct_chk(ring.get(0) == tp.pkts[0]);
+      fct_chk(ring.put(tp.pkts[RTP_RING_SIZE]));
+      fct_chk(ring.get(0) == tp.pkts[1]);
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(rtp_ring_seq_restart) {
+      test_packets tp1(30000, 4);
+      test_packets tp2(10, 4);
+      AmRtpReceiveRing ring;
+      fct_chk(ring.put(tp1.pkts[0]));
+      fct_chk(ring.put(tp1.pkts[1]));
+      fct_chk(ring.get(0) == tp1.pkts[0]);
+      fct_chk(ring.get(0) == tp1.pkts[1]);
+
+      for(unsigned int i=0; i<tp2.pkts.size(); i++)
+	fct_chk(ring.put(tp2.pkts[i]));
+      for(unsigned int i=0; i<tp2.pkts.size(); i++)
+	fct_chk(ring.get(0) == tp2.pkts[i]);
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(rtp_ring_recycle) {
+      test_packets tp(100, 4);
+      AmRtpReceiveRing ring;
+      fct_chk(ring.recycle() == NULL);
+      for(unsigned int i=0; i<tp.pkts.size(); i++)
+	fct_chk(ring.put(tp.pkts[i]));
+      fct_chk(ring.get(0) == tp.pkts[0]);
+
+      // the oldest packet not read yet is taken back...
+      fct_chk(ring.recycle() == tp.pkts[1]);
+      fct_chk(ring.recycled == 1);
+
+      // ...and the consumer does not wait for it
+      fct_chk(ring.get(0) == tp.pkts[2]);
+      fct_chk(ring.get(0) == tp.pkts[3]);
+      fct_chk(ring.recycle() == NULL);
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(rtp_ring_drain) {
+      test_packets tp(100, 3);
+      AmRtpReceiveRing ring;
+      for(unsigned int i=0; i<tp.pkts.size(); i++)
+	fct_chk(ring.put(tp.pkts[i]));
+
+      unsigned int n = 0;
+      while(ring.drain()) n++;
+      fct_chk(n == 3);
+      fct_chk(ring.get(0) == NULL);
+    } FCT_TEST_END();
+
+} FCTMF_SUITE_END();
@@ -0,0 +1,140 @@
+#include "fct.h"
+
+#include "log.h"
+
+#include "sip/trans_table.h"
+#include "sip/sip_parser.h"
+#include "sip/sip_trans.h"
+#include "sip/trans_layer.h"
+
+#include <string.h>
+#include <stdio.h>
+
+/**
+ * Parsed INVITE with the given branch and Call-ID.
+ */
+static sip_msg* make_invite(const char* branch, const char* callid)
+{
+  char buf[1024];
+  int len = snprintf(buf,sizeof(buf),
+		     "INVITE sip:bob@example.com SIP/2.0\r\n"
+		     "Via: SIP/2.0/UDP 10.0.0.1:5060;branch=z9hG4bK%s\r\n"
+		     "From: <sip:alice@example.com>;tag=a1\r\n"
+		     "To: <sip:bob@example.com>\r\n"
+		     "Call-ID: %s\r\n"
+		     "CSeq: 1 INVITE\r\n"
+		     "Content-Length: 0\r\n"
+		     "\r\n",branch,callid);
+
+  sip_msg* msg = new sip_msg(buf,len);
+  char* err_msg = NULL;
+  if(parse_sip_msg(msg,err_msg)) {
+    delete msg;
+    return NULL;
+  }
+  return msg;
+}
+
+FCTMF_SUITE_BGN(test_trans_table) {
+
+    FCT_TEST_BGN(trans_table_add_match_remove) {
+      sip_msg* m1 = make_invite("b1","call-1");
+      sip_msg* m2 = make_invite("b2","call-1");
+      sip_msg* m3 = make_invite("b3","call-1");
+      fct_chk(m1 && m2 && m3);
+
+      trans_bucket* bucket = get_trans_bucket(7);
+      bucket->lock();
+      unsigned int n = bucket->size();
+
+      sip_trans* t1 = bucket->add_trans(m1,TT_UAS);
+      sip_trans* t2 = bucket->add_trans(m2,TT_UAS);
+      sip_trans* t3 = bucket->add_trans(m3,TT_UAS);
+      fct_chk(bucket->size() == n + 3);
+
+      sip_msg* r2 = make_invite("b2","call-1");
+      fct_chk(bucket->match_request(r2,TT_UAS) == t2);
+
+      // unlinking from the middle of the chain
+      bucket->remove(t2);
+      fct_chk(bucket->size() == n + 2);
+      fct_chk(!bucket->exist(t2));
+      fct_chk(bucket->exist(t1));
+      fct_chk(bucket->exist(t3));
+      fct_chk(bucket->match_request(r2,TT_UAS) == NULL);
+
+      sip_msg* r3 = make_invite("b3","call-1");
+      fct_chk(bucket->match_request(r3,TT_UAS) == t3);
+
+      // UAC transaction sent once a pending request has been resolved
+      sip_msg* m4 = make_invite("b4","call-1");
+      sip_trans* t4 = bucket->add_trans(m4,TT_UAC);
+      t4->pending_id = 42;
+      fct_chk(bucket->find_pending_trans(42) == t4);
+      fct_chk(bucket->find_pending_trans(43) == NULL);
+      bucket->remove(t4);
+      fct_chk(bucket->find_pending_trans(42) == NULL);
+
+      // a ticket's stale pointer (e.g. reused memory of a
+      // deleted transaction) is neither unlinked nor deleted
+      sip_trans* stale = new sip_trans();
+      stale->type = TT_UAS;
+      stale->bucket = bucket;
+      stale->bucket_prev = t1;
+      stale->bucket_next = t3;
+      trans_ticket tt(stale,bucket);
+      tt.remove_trans();
+      fct_chk(bucket->size() == n + 2);
+      fct_chk(bucket->exist(t1));
+      fct_chk(bucket->exist(t3));
+      fct_chk(bucket->match_request(r3,TT_UAS) == t3);
+      delete stale;
+
+      bucket->remove(t3);
+      bucket->remove(t1);
+      fct_chk(bucket->size() == n);
+      bucket->unlock();
+
+      delete r2;
+      delete r3;
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(trans_table_stats) {
+      trans_table_stats st;
+      get_trans_table_stats(st);
+      fct_chk(st.buckets == trans_table_size);
+
+      unsigned int empty = st.chains[0];
+      unsigned int lookups = 0;
+      for(unsigned int c=0; c<TRANS_CHAIN_CLASSES; c++)
+	lookups += st.lookups[c];
+
+      trans_bucket* bucket = get_trans_bucket(11);
+      bucket->lock();
+      sip_trans* t = bucket->add_trans(make_invite("s1","call-2"),TT_UAS);
+      sip_msg* r = make_invite("s1","call-2");
+      fct_chk(bucket->match_request(r,TT_UAS) == t);
+      bucket->unlock();
+
+      get_trans_table_stats(st);
+      fct_chk(st.transactions >= 1);
+      fct_chk(st.chains[0] == empty - 1);
+      fct_chk(st.lookups[1] >= 1);
+
+      unsigned int lookups_after = 0;
+      for(unsigned int c=0; c<TRANS_CHAIN_CLASSES; c++)
+	lookups_after += st.lookups[c];
+      fct_chk(lookups_after == lookups + 1);
+
+      bucket->lock();
+      bucket->remove(t);
+      bucket->unlock();
+      delete r;
+
+      fct_chk(trans_chain_class_min(0) == 0);
+      fct_chk(trans_chain_class_min(3) == 3);
+      fct_chk(trans_chain_class_min(4) == 5);
+      fct_chk(trans_chain_class_min(TRANS_CHAIN_CLASSES-1) == 33);
+    } FCT_TEST_END();
+
+} FCTMF_SUITE_END();
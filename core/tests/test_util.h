@@ -0,0 +1,49 @@
+#ifndef _test_util_h_
+#define _test_util_h_
+
+#include "log.h"
+#include "atomic_types.h"
+
+#include <sys/time.h>
+#include <unistd.h>
+
+/** wall clock time in us, for timing loops */
+static inline double now_us()
+{
+  struct timeval tv;
+  gettimeofday(&tv,NULL);
+  return tv.tv_sec * 1e6 + tv.tv_usec;
+}
+
+/** waits (up to ms) until cnt has reached val */
+static inline bool wait_for(atomic_int& cnt, unsigned int val, unsigned int ms)
+{
+  for(unsigned int i=0; i<ms; i++) {
+    if(cnt.get() >= val) return true;
+    usleep(1000);
+  }
+  return cnt.get() >= val;
+}
+
+/**
+ * Lowers the log level while in scope
+ * (e.g. debug output which would dominate a stress test).
+ */
+class LogLevelScope
+{
+  int old_log_level;
+
+public:
+  LogLevelScope(int level = L_WARN)
+    : old_log_level(log_level)
+  {
+    log_level = level;
+  }
+
+  ~LogLevelScope()
+  {
+    log_level = old_log_level;
+  }
+};
+
+#endif
@@ -0,0 +1,63 @@
+#include "fct.h"
+
+#include "log.h"
+
+#include "sip/wheeltimer.h"
+#include "AmThread.h"
+
+#include <unistd.h>
+
+#include "test_util.h"
+
+static atomic_int timers_fired;
+static atomic_int timers_deleted;
+
+struct test_timer
+  : public timer
+{
+  test_timer(unsigned int expires)
+    : timer(expires) {}
+
+  ~test_timer() { timers_deleted.inc(); }
+
+  void fire() {
+    timers_fired.inc();
+  }
+};
+
+FCTMF_SUITE_BGN(test_wheeltimer) {
+
+    static bool started = false;
+    if(!started) {
+      wheeltimer::instance()->start();
+      started = true;
+    }
+
+    FCT_TEST_BGN(wheeltimer_fire) {
+      unsigned int fired = timers_fired.get();
+      _wheeltimer* wt = wheeltimer::instance();
+      test_timer* t = new test_timer(wt->wall_clock + 2);
+      wt->insert_timer(t);
+      fct_chk(wait_for(timers_fired,fired+1,1000));
+
+      unsigned int deleted = timers_deleted.get();
+      wt->remove_timer(t);
+      fct_chk(wait_for(timers_deleted,deleted+1,1000));
+    } FCT_TEST_END();
+
+    FCT_TEST_BGN(wheeltimer_insert_remove) {
+      unsigned int fired = timers_fired.get();
+      unsigned int deleted = timers_deleted.get();
+      _wheeltimer* wt = wheeltimer::instance();
+
+      // removed before the timer thread even sees the insertion
+      test_timer* t = new test_timer(wt->wall_clock + 2);
+      wt->insert_timer(t);
+      wt->remove_timer(t);
+
+      fct_chk(wait_for(timers_deleted,deleted+1,1000));
+      usleep(3 * TIMER_RESOLUTION);
+      fct_chk(timers_fired.get() == fired);
+    } FCT_TEST_END();
+
+} FCTMF_SUITE_END();